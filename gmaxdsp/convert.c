@@ -0,0 +1,116 @@
+/*++
+
+Module Name:
+
+convert.c
+
+Abstract:
+
+PCM container conversion for CsAudio format overrides. Samples are
+brought to 32-bit left justified, requantized when the output has
+fewer valid bits, and packed to the output container, a block at a
+time through a stack buffer.
+
+--*/
+
+#include "dsp_internal.h"
+
+#define GMAX_PCM_BLOCK 1024
+
+static unsigned
+gmax_pcm_bytes(
+	GMAX_PCM_CONTAINER Container
+)
+{
+	return Container == GmaxPcm16 ? 2 : 4;
+}
+
+static unsigned
+gmax_pcm_bits(
+	GMAX_PCM_CONTAINER Container
+)
+{
+	switch (Container) {
+	case GmaxPcm16:
+		return 16;
+	case GmaxPcm24In32:
+		return 24;
+	default:
+		return 32;
+	}
+}
+
+GMAX_PCM_CONTAINER
+gmax_pcm_container(
+	unsigned BitsPerSample,
+	unsigned ValidBitsPerSample,
+	int Force32BitContainer
+)
+{
+	unsigned container = Force32BitContainer ? 32 : BitsPerSample;
+	unsigned valid = ValidBitsPerSample ? ValidBitsPerSample : BitsPerSample;
+
+	if (container == 16 && valid == 16) {
+		return GmaxPcm16;
+	}
+	if (container == 32 && valid <= 24) {
+		// 16 valid bits in a 32-bit container is exact as 24-in-32
+		return GmaxPcm24In32;
+	}
+	if (container == 32 && valid == 32) {
+		return GmaxPcm32;
+	}
+	return GmaxPcmMax;
+}
+
+int
+gmax_pcm_converter_init(
+	GMAX_PCM_CONVERTER* Converter,
+	GMAX_PCM_CONTAINER In,
+	GMAX_PCM_CONTAINER Out,
+	int Dither,
+	uint32_t Seed
+)
+{
+	if (In >= GmaxPcmMax || Out >= GmaxPcmMax) {
+		return -1;
+	}
+
+	Converter->In = In;
+	Converter->Out = Out;
+	Converter->Dither = Dither;
+	Converter->Seed = Seed;
+	Converter->Position = 0;
+	return 0;
+}
+
+void
+gmax_pcm_convert(
+	GMAX_PCM_CONVERTER* Converter,
+	const void* In,
+	void* Out,
+	size_t Samples
+)
+{
+	const GMAX_DSP_KERNELS* kernels = gmax_dsp_kernels();
+	unsigned inBytes = gmax_pcm_bytes(Converter->In);
+	unsigned outBytes = gmax_pcm_bytes(Converter->Out);
+	unsigned outBits = gmax_pcm_bits(Converter->Out);
+	int narrow = outBits < gmax_pcm_bits(Converter->In);
+	const uint8_t* in = (const uint8_t*)In;
+	uint8_t* out = (uint8_t*)Out;
+	int32_t block[GMAX_PCM_BLOCK];
+
+	for (size_t n = 0; n < Samples; n += GMAX_PCM_BLOCK) {
+		size_t count = Samples - n < GMAX_PCM_BLOCK ? Samples - n : GMAX_PCM_BLOCK;
+
+		kernels->Unpack(in + n * inBytes, count, inBytes, block);
+		if (narrow) {
+			kernels->Requantize(block, count, outBits,
+				Converter->Dither, Converter->Seed, Converter->Position + n);
+		}
+		kernels->Pack(block, count, outBytes, out + n * outBytes);
+	}
+
+	Converter->Position += Samples;
+}
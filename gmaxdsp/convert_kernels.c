@@ -0,0 +1,262 @@
+/*++
+
+Module Name:
+
+convert_kernels.c
+
+Abstract:
+
+Requantization kernels for narrowing PCM conversions. The dither for a
+sample comes from a hash of its stream position, so every lane of a
+vector computes exactly what the scalar loop would and the output is
+bit identical on all paths. Rounding adds half an output LSB and clears
+the dropped bits; overflow on the add saturates to full scale.
+
+--*/
+
+#include "dsp_internal.h"
+
+#ifdef GMAX_DSP_X86
+#include <immintrin.h>
+#endif
+
+#ifdef GMAX_DSP_NEON
+#include <arm_neon.h>
+#endif
+
+#define GMAX_HASH_M1 0x7FEB352Du
+#define GMAX_HASH_M2 0x846CA68Bu
+
+static inline uint32_t
+gmax_dither_hash(
+	uint32_t x
+)
+{
+	x ^= x >> 16;
+	x *= GMAX_HASH_M1;
+	x ^= x >> 15;
+	x *= GMAX_HASH_M2;
+	x ^= x >> 16;
+	return x;
+}
+
+void
+gmax_requantize_scalar(
+	int32_t* Data,
+	size_t Count,
+	unsigned Bits,
+	int Dither,
+	uint32_t Seed,
+	uint64_t Position
+)
+{
+	unsigned shift = 32 - Bits;
+	uint32_t round = 1u << (shift - 1);
+	uint32_t mask = ~((1u << shift) - 1);
+
+	for (size_t n = 0; n < Count; n++) {
+		uint32_t x = (uint32_t)Data[n];
+		uint32_t d = round;
+		uint32_t sum;
+
+		if (Dither) {
+			uint32_t h = gmax_dither_hash(((uint32_t)Position + (uint32_t)n) ^ Seed);
+			int32_t tpdf = (int32_t)(h & 0xFFFF) - (int32_t)(h >> 16);
+
+			d += (uint32_t)(shift >= 16 ? tpdf * (1 << (shift - 16)) : tpdf >> (16 - shift));
+		}
+
+		sum = x + d;
+		if ((int32_t)((x ^ sum) & (d ^ sum)) < 0) {
+			sum = (uint32_t)((int32_t)x >> 31) ^ 0x7FFFFFFFu;
+		}
+		Data[n] = (int32_t)(sum & mask);
+	}
+}
+
+#ifdef GMAX_DSP_X86
+
+static inline __m128i
+gmax_mullo_sse2(
+	__m128i a,
+	__m128i b
+)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+		_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+void
+gmax_requantize_sse2(
+	int32_t* Data,
+	size_t Count,
+	unsigned Bits,
+	int Dither,
+	uint32_t Seed,
+	uint64_t Position
+)
+{
+	unsigned shift = 32 - Bits;
+	const __m128i round = _mm_set1_epi32((int)(1u << (shift - 1)));
+	const __m128i mask = _mm_set1_epi32((int)~((1u << shift) - 1));
+	const __m128i maxCode = _mm_set1_epi32(0x7FFFFFFF);
+	const __m128i low16 = _mm_set1_epi32(0xFFFF);
+	const __m128i seed = _mm_set1_epi32((int)Seed);
+	const __m128i m1 = _mm_set1_epi32((int)GMAX_HASH_M1);
+	const __m128i m2 = _mm_set1_epi32((int)GMAX_HASH_M2);
+	const __m128i up = _mm_cvtsi32_si128(shift >= 16 ? (int)(shift - 16) : 0);
+	const __m128i down = _mm_cvtsi32_si128(shift >= 16 ? 0 : (int)(16 - shift));
+	__m128i pos = _mm_add_epi32(_mm_set1_epi32((int)(uint32_t)Position), _mm_setr_epi32(0, 1, 2, 3));
+	size_t n = 0;
+
+	for (; n + 4 <= Count; n += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(Data + n));
+		__m128i d = round;
+		__m128i sum;
+		__m128i overflow;
+
+		if (Dither) {
+			__m128i h = _mm_xor_si128(pos, seed);
+
+			h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+			h = gmax_mullo_sse2(h, m1);
+			h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+			h = gmax_mullo_sse2(h, m2);
+			h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+
+			h = _mm_sub_epi32(_mm_and_si128(h, low16), _mm_srli_epi32(h, 16));
+			d = _mm_add_epi32(d, _mm_sra_epi32(_mm_sll_epi32(h, up), down));
+		}
+
+		sum = _mm_add_epi32(x, d);
+		overflow = _mm_srai_epi32(_mm_and_si128(_mm_xor_si128(x, sum), _mm_xor_si128(d, sum)), 31);
+		sum = _mm_or_si128(_mm_andnot_si128(overflow, sum),
+			_mm_and_si128(overflow, _mm_xor_si128(_mm_srai_epi32(x, 31), maxCode)));
+
+		_mm_storeu_si128((__m128i*)(Data + n), _mm_and_si128(sum, mask));
+		pos = _mm_add_epi32(pos, _mm_set1_epi32(4));
+	}
+
+	gmax_requantize_scalar(Data + n, Count - n, Bits, Dither, Seed, Position + n);
+}
+
+GMAX_DSP_TARGET_AVX2
+void
+gmax_requantize_avx2(
+	int32_t* Data,
+	size_t Count,
+	unsigned Bits,
+	int Dither,
+	uint32_t Seed,
+	uint64_t Position
+)
+{
+	unsigned shift = 32 - Bits;
+	const __m256i round = _mm256_set1_epi32((int)(1u << (shift - 1)));
+	const __m256i mask = _mm256_set1_epi32((int)~((1u << shift) - 1));
+	const __m256i maxCode = _mm256_set1_epi32(0x7FFFFFFF);
+	const __m256i low16 = _mm256_set1_epi32(0xFFFF);
+	const __m256i seed = _mm256_set1_epi32((int)Seed);
+	const __m256i m1 = _mm256_set1_epi32((int)GMAX_HASH_M1);
+	const __m256i m2 = _mm256_set1_epi32((int)GMAX_HASH_M2);
+	const __m128i up = _mm_cvtsi32_si128(shift >= 16 ? (int)(shift - 16) : 0);
+	const __m128i down = _mm_cvtsi32_si128(shift >= 16 ? 0 : (int)(16 - shift));
+	__m256i pos = _mm256_add_epi32(_mm256_set1_epi32((int)(uint32_t)Position),
+		_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	size_t n = 0;
+
+	for (; n + 8 <= Count; n += 8) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(Data + n));
+		__m256i d = round;
+		__m256i sum;
+		__m256i overflow;
+
+		if (Dither) {
+			__m256i h = _mm256_xor_si256(pos, seed);
+
+			h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+			h = _mm256_mullo_epi32(h, m1);
+			h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+			h = _mm256_mullo_epi32(h, m2);
+			h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+
+			h = _mm256_sub_epi32(_mm256_and_si256(h, low16), _mm256_srli_epi32(h, 16));
+			d = _mm256_add_epi32(d, _mm256_sra_epi32(_mm256_sll_epi32(h, up), down));
+		}
+
+		sum = _mm256_add_epi32(x, d);
+		overflow = _mm256_srai_epi32(_mm256_and_si256(_mm256_xor_si256(x, sum), _mm256_xor_si256(d, sum)), 31);
+		sum = _mm256_blendv_epi8(sum, _mm256_xor_si256(_mm256_srai_epi32(x, 31), maxCode), overflow);
+
+		_mm256_storeu_si256((__m256i*)(Data + n), _mm256_and_si256(sum, mask));
+		pos = _mm256_add_epi32(pos, _mm256_set1_epi32(8));
+	}
+
+	gmax_requantize_scalar(Data + n, Count - n, Bits, Dither, Seed, Position + n);
+}
+
+#endif
+
+#ifdef GMAX_DSP_NEON
+
+void
+gmax_requantize_neon(
+	int32_t* Data,
+	size_t Count,
+	unsigned Bits,
+	int Dither,
+	uint32_t Seed,
+	uint64_t Position
+)
+{
+	unsigned shift = 32 - Bits;
+	const uint32x4_t round = vdupq_n_u32(1u << (shift - 1));
+	const uint32x4_t mask = vdupq_n_u32(~((1u << shift) - 1));
+	const uint32x4_t maxCode = vdupq_n_u32(0x7FFFFFFF);
+	const uint32x4_t low16 = vdupq_n_u32(0xFFFF);
+	const uint32x4_t seed = vdupq_n_u32(Seed);
+	// vshlq shifts right for negative counts
+	const int32x4_t scale = vdupq_n_s32((int32_t)shift - 16);
+	static const uint32_t lanes[4] = { 0, 1, 2, 3 };
+	uint32x4_t pos = vaddq_u32(vdupq_n_u32((uint32_t)Position), vld1q_u32(lanes));
+	size_t n = 0;
+
+	for (; n + 4 <= Count; n += 4) {
+		uint32x4_t x = vreinterpretq_u32_s32(vld1q_s32(Data + n));
+		uint32x4_t d = round;
+		uint32x4_t sum;
+		uint32x4_t overflow;
+
+		if (Dither) {
+			uint32x4_t h = veorq_u32(pos, seed);
+			int32x4_t tpdf;
+
+			h = veorq_u32(h, vshrq_n_u32(h, 16));
+			h = vmulq_n_u32(h, GMAX_HASH_M1);
+			h = veorq_u32(h, vshrq_n_u32(h, 15));
+			h = vmulq_n_u32(h, GMAX_HASH_M2);
+			h = veorq_u32(h, vshrq_n_u32(h, 16));
+
+			tpdf = vsubq_s32(vreinterpretq_s32_u32(vandq_u32(h, low16)),
+				vreinterpretq_s32_u32(vshrq_n_u32(h, 16)));
+			d = vaddq_u32(d, vreinterpretq_u32_s32(vshlq_s32(tpdf, scale)));
+		}
+
+		sum = vaddq_u32(x, d);
+		overflow = vreinterpretq_u32_s32(vshrq_n_s32(
+			vreinterpretq_s32_u32(vandq_u32(veorq_u32(x, sum), veorq_u32(d, sum))), 31));
+		sum = vbslq_u32(overflow,
+			veorq_u32(vreinterpretq_u32_s32(vshrq_n_s32(vreinterpretq_s32_u32(x), 31)), maxCode),
+			sum);
+
+		vst1q_s32(Data + n, vreinterpretq_s32_u32(vandq_u32(sum, mask)));
+		pos = vaddq_u32(pos, vdupq_n_u32(4));
+	}
+
+	gmax_requantize_scalar(Data + n, Count - n, Bits, Dither, Seed, Position + n);
+}
+
+#endif
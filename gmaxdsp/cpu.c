@@ -0,0 +1,156 @@
+/*++
+
+Module Name:
+
+cpu.c
+
+Abstract:
+
+Picks the kernel set for the CPU. Every kernel has a scalar reference;
+ISA specific variants are only used when the CPU reports support.
+
+--*/
+
+#include "dsp_internal.h"
+
+#if defined(GMAX_DSP_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static const GMAX_DSP_KERNELS GmaxDspScalarKernels = {
+	GmaxDspIsaScalar,
+	gmax_iv_sum_scalar,
+	gmax_pack_scalar,
+	gmax_unpack_scalar,
+	gmax_requantize_scalar,
+	gmax_frame_peak_scalar,
+	gmax_max_scalar,
+};
+
+#ifdef GMAX_DSP_X86
+static const GMAX_DSP_KERNELS GmaxDspSse2Kernels = {
+	GmaxDspIsaSse2,
+	gmax_iv_sum_sse2,
+	gmax_pack_sse2,
+	gmax_unpack_sse2,
+	gmax_requantize_sse2,
+	gmax_frame_peak_sse2,
+	gmax_max_sse2,
+};
+
+static const GMAX_DSP_KERNELS GmaxDspAvx2Kernels = {
+	GmaxDspIsaAvx2,
+	gmax_iv_sum_avx2,
+	gmax_pack_avx2,
+	gmax_unpack_avx2,
+	gmax_requantize_avx2,
+	gmax_frame_peak_avx2,
+	gmax_max_avx2,
+};
+#endif
+
+#ifdef GMAX_DSP_NEON
+static const GMAX_DSP_KERNELS GmaxDspNeonKernels = {
+	GmaxDspIsaNeon,
+	gmax_iv_sum_neon,
+	gmax_pack_neon,
+	gmax_unpack_neon,
+	gmax_requantize_neon,
+	gmax_frame_peak_neon,
+	gmax_max_neon,
+};
+#endif
+
+static const GMAX_DSP_KERNELS* GmaxDspActive;
+
+static int
+gmax_dsp_has_avx2(
+	void
+)
+{
+#if defined(GMAX_DSP_X86) && defined(_MSC_VER)
+	int info[4];
+
+	__cpuid(info, 1);
+	// FMA, OSXSAVE, AVX
+	if ((info[2] & ((1 << 12) | (1 << 27) | (1 << 28))) != ((1 << 12) | (1 << 27) | (1 << 28))) {
+		return 0;
+	}
+	// OS saves XMM and YMM state
+	if ((_xgetbv(0) & 6) != 6) {
+		return 0;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(GMAX_DSP_X86) && defined(__GNUC__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+	return 0;
+#endif
+}
+
+static const GMAX_DSP_KERNELS*
+gmax_dsp_lookup(
+	GMAX_DSP_ISA Isa
+)
+{
+	switch (Isa) {
+#ifdef GMAX_DSP_X86
+	case GmaxDspIsaAuto:
+	case GmaxDspIsaAvx2:
+		if (gmax_dsp_has_avx2()) {
+			return &GmaxDspAvx2Kernels;
+		}
+		return Isa == GmaxDspIsaAuto ? &GmaxDspSse2Kernels : &GmaxDspScalarKernels;
+	case GmaxDspIsaSse2:
+		// baseline on x64
+		return &GmaxDspSse2Kernels;
+#endif
+#ifdef GMAX_DSP_NEON
+	case GmaxDspIsaAuto:
+	case GmaxDspIsaNeon:
+		// baseline on ARM64
+		return &GmaxDspNeonKernels;
+#endif
+	default:
+		return &GmaxDspScalarKernels;
+	}
+}
+
+GMAX_DSP_ISA
+gmax_dsp_select_isa(
+	GMAX_DSP_ISA Isa
+)
+{
+	GmaxDspActive = gmax_dsp_lookup(Isa);
+	return GmaxDspActive->Isa;
+}
+
+const GMAX_DSP_KERNELS*
+gmax_dsp_kernels(
+	void
+)
+{
+	if (!GmaxDspActive) {
+		GmaxDspActive = gmax_dsp_lookup(GmaxDspIsaAuto);
+	}
+	return GmaxDspActive;
+}
+
+unsigned
+gmax_dsp_format_bytes(
+	GMAX_DSP_FORMAT Format
+)
+{
+	switch (Format) {
+	case GmaxDspFormatS16:
+		return 2;
+	case GmaxDspFormatS24:
+		return 3;
+	case GmaxDspFormatS32:
+		return 4;
+	default:
+		return 0;
+	}
+}
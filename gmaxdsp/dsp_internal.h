@@ -0,0 +1,157 @@
+#pragma once
+
+//
+// Kernel dispatch shared by the gmaxdsp modules
+//
+
+#include <string.h>
+
+#include "gmaxdsp.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define GMAX_DSP_X86 1
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define GMAX_DSP_NEON 1
+#endif
+
+//
+// gcc and clang only emit AVX2 code in functions marked for it; MSVC
+// takes intrinsics anywhere.
+//
+#if defined(__GNUC__)
+#define GMAX_DSP_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define GMAX_DSP_TARGET_AVX2
+#endif
+
+//
+// Sums over Frames of v*v, i*i and v*i, with samples scaled to [-1, 1).
+// Added to Sums. The scalar path sums in double; the vector paths sum
+// in float lanes and flush them to Sums every GMAX_IV_FLUSH_FRAMES
+// frames, so they agree with it to within float rounding over that
+// many terms.
+//
+#define GMAX_IV_FLUSH_FRAMES 4096
+
+typedef void GMAX_DSP_IV_SUM(
+	const uint8_t* Data,
+	size_t Frames,
+	size_t FrameBytes,
+	const GMAX_DSP_CHANNEL* V,
+	const GMAX_DSP_CHANNEL* I,
+	double Sums[3]
+);
+
+//
+// Between 32-bit left justified samples and 2, 3 or 4 byte containers
+//
+typedef void GMAX_DSP_PACK(
+	const int32_t* In,
+	size_t Count,
+	unsigned Bytes,
+	void* Out
+);
+
+typedef void GMAX_DSP_UNPACK(
+	const void* In,
+	size_t Count,
+	unsigned Bytes,
+	int32_t* Out
+);
+
+//
+// Rounds left justified samples in place to Bits valid bits, adding TPDF
+// dither keyed on Seed and the sample Position when Dither is set, and
+// saturating at full scale.
+//
+typedef void GMAX_DSP_REQUANTIZE(
+	int32_t* Data,
+	size_t Count,
+	unsigned Bits,
+	int Dither,
+	uint32_t Seed,
+	uint64_t Position
+);
+
+//
+// Per frame peak magnitude of interleaved float samples
+//
+typedef void GMAX_DSP_FRAME_PEAK(
+	const float* In,
+	size_t Frames,
+	unsigned Channels,
+	float* Peak
+);
+
+//
+// Out[n] = max(A[n], B[n])
+//
+typedef void GMAX_DSP_MAX(
+	const float* A,
+	const float* B,
+	size_t Count,
+	float* Out
+);
+
+typedef struct _GMAX_DSP_KERNELS
+{
+	GMAX_DSP_ISA Isa;
+	GMAX_DSP_IV_SUM* IvSum;
+	GMAX_DSP_PACK* Pack;
+	GMAX_DSP_UNPACK* Unpack;
+	GMAX_DSP_REQUANTIZE* Requantize;
+	GMAX_DSP_FRAME_PEAK* FramePeak;
+	GMAX_DSP_MAX* Max;
+} GMAX_DSP_KERNELS;
+
+const GMAX_DSP_KERNELS*
+gmax_dsp_kernels(
+	void
+);
+
+static inline uint32_t
+gmax_dsp_load(
+	const uint8_t* p,
+	const GMAX_DSP_CHANNEL* Channel
+)
+{
+	uint32_t x = 0;
+
+	for (uint32_t b = 0; b < Channel->Bytes; b++) {
+		x |= (uint32_t)p[Channel->Offset + b] << (8 * b);
+	}
+	return (x << Channel->Shift) & Channel->Mask;
+}
+
+#define GMAX_DSP_SCALE (1.0f / 2147483648.0f)
+
+GMAX_DSP_IV_SUM gmax_iv_sum_scalar;
+GMAX_DSP_PACK gmax_pack_scalar;
+GMAX_DSP_UNPACK gmax_unpack_scalar;
+GMAX_DSP_REQUANTIZE gmax_requantize_scalar;
+GMAX_DSP_FRAME_PEAK gmax_frame_peak_scalar;
+GMAX_DSP_MAX gmax_max_scalar;
+#ifdef GMAX_DSP_X86
+GMAX_DSP_IV_SUM gmax_iv_sum_sse2;
+GMAX_DSP_IV_SUM gmax_iv_sum_avx2;
+GMAX_DSP_PACK gmax_pack_sse2;
+GMAX_DSP_PACK gmax_pack_avx2;
+GMAX_DSP_UNPACK gmax_unpack_sse2;
+GMAX_DSP_UNPACK gmax_unpack_avx2;
+GMAX_DSP_REQUANTIZE gmax_requantize_sse2;
+GMAX_DSP_FRAME_PEAK gmax_frame_peak_sse2;
+GMAX_DSP_MAX gmax_max_sse2;
+GMAX_DSP_REQUANTIZE gmax_requantize_avx2;
+GMAX_DSP_FRAME_PEAK gmax_frame_peak_avx2;
+GMAX_DSP_MAX gmax_max_avx2;
+#endif
+#ifdef GMAX_DSP_NEON
+GMAX_DSP_IV_SUM gmax_iv_sum_neon;
+GMAX_DSP_PACK gmax_pack_neon;
+GMAX_DSP_UNPACK gmax_unpack_neon;
+GMAX_DSP_REQUANTIZE gmax_requantize_neon;
+GMAX_DSP_FRAME_PEAK gmax_frame_peak_neon;
+GMAX_DSP_MAX gmax_max_neon;
+#endif
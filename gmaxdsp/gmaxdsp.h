@@ -0,0 +1,451 @@
+#pragma once
+
+//
+// gmaxdsp - user-mode processing for MAX98512 amplifier feedback and
+// playback streams. Portable C with SIMD kernels selected at runtime,
+// builds on Windows (MSVC, clang-cl) and Linux (gcc, clang).
+//
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// TDM slot containers as they arrive from the capture path
+//
+typedef enum {
+	GmaxDspFormatS16,	// 16-bit, 2 bytes per slot
+	GmaxDspFormatS24,	// 24-bit packed, 3 bytes per slot
+	GmaxDspFormatS32,	// 32-bit, or 24-in-32 left justified
+	GmaxDspFormatMax
+} GMAX_DSP_FORMAT;
+
+#define GMAX_DSP_MAX_SLOTS 16
+#define GMAX_DSP_MAX_AMPS 8
+
+//
+// One channel of a TDM frame: the 32-bit word loaded at Offset is
+// shifted left by Shift, which left justifies the sample (and for an
+// interleaved half, drops the other half), then masked.
+//
+typedef struct _GMAX_DSP_CHANNEL
+{
+	uint32_t Offset;
+	uint32_t Bytes;		// container bytes, the scalar path reads only these
+	uint32_t Shift;
+	uint32_t Mask;
+} GMAX_DSP_CHANNEL;
+
+//
+// Kernel selection. GmaxDspIsaAuto picks the best the CPU supports;
+// the others force a path, e.g. to compare against the scalar reference.
+//
+typedef enum {
+	GmaxDspIsaAuto,
+	GmaxDspIsaScalar,
+	GmaxDspIsaSse2,
+	GmaxDspIsaAvx2,
+	GmaxDspIsaNeon,
+	GmaxDspIsaMax
+} GMAX_DSP_ISA;
+
+//
+// Returns the ISA actually selected, which is GmaxDspIsaScalar when the
+// requested one is not available on this CPU or in this build.
+//
+GMAX_DSP_ISA
+gmax_dsp_select_isa(
+	GMAX_DSP_ISA Isa
+);
+
+unsigned
+gmax_dsp_format_bytes(
+	GMAX_DSP_FORMAT Format
+);
+
+//
+// IV-sense (VMON/IMON) feedback
+//
+// StartCodec routes each amp's voltage and current monitor onto its own
+// pair of TDM TX slots, or onto a single slot when PCM_TX_CH_SRC_B
+// interleave is set. In interleave mode V and I alternate frame by frame
+// in the VMON slot, V first, each at half the frame rate.
+//
+
+typedef struct _GMAX_IV_AMP_CONFIG
+{
+	uint8_t VmonSlot;
+	uint8_t ImonSlot;
+	uint8_t Interleaved;	// V and I alternate in VmonSlot
+	float VoltsFullScale;	// volts at digital full scale
+	float AmpsFullScale;	// amps at digital full scale
+} GMAX_IV_AMP_CONFIG;
+
+typedef struct _GMAX_IV_CONFIG
+{
+	uint32_t SampleRate;
+	uint8_t SlotCount;	// slots per TDM frame
+	GMAX_DSP_FORMAT Format;
+	uint8_t AmpCount;
+	GMAX_IV_AMP_CONFIG Amp[GMAX_DSP_MAX_AMPS];
+	float TimeConstantMs;	// smoothing of the running estimates
+	float MinCurrentRms;	// amps, below this Re is not updated
+} GMAX_IV_CONFIG;
+
+typedef struct _GMAX_IV_ESTIMATE
+{
+	float VoltsRms;
+	float AmpsRms;
+	float Power;		// watts, mean of v * i
+	float Re;		// ohms, 0 until enough current has been seen
+	uint64_t Frames;	// V/I sample pairs behind the estimate
+} GMAX_IV_ESTIMATE;
+
+typedef struct _GMAX_IV_STATE
+{
+	GMAX_IV_CONFIG Config;
+	uint32_t FrameBytes;
+	uint64_t FrameIndex;	// frames consumed, for the interleave phase
+	struct {
+		GMAX_DSP_CHANNEL V;
+		GMAX_DSP_CHANNEL I;
+	} Layout[GMAX_DSP_MAX_AMPS];
+	struct {
+		double MeanVV;
+		double MeanII;
+		double MeanVI;
+		double Re;
+		uint64_t Frames;
+	} Amp[GMAX_DSP_MAX_AMPS];
+} GMAX_IV_STATE;
+
+int
+gmax_iv_init(
+	GMAX_IV_STATE* State,
+	const GMAX_IV_CONFIG* Config
+);
+
+//
+// Consumes Frames complete TDM frames and folds them into the running
+// estimates of every amp.
+//
+void
+gmax_iv_process(
+	GMAX_IV_STATE* State,
+	const void* Data,
+	size_t Frames
+);
+
+void
+gmax_iv_get_estimate(
+	const GMAX_IV_STATE* State,
+	unsigned Amp,
+	GMAX_IV_ESTIMATE* Estimate
+);
+
+//
+// TDM bus simulator
+//
+// Builds the frames a set of amps would drive onto the shared TDM TX
+// bus from each amp's PCM register image (PCM_RX_EN_A through
+// PCM_TO_SPK_MONOMIX_B), and decodes captured frames back into per-amp
+// V and I. gmax_tdm_sim_init rejects images that would not work on
+// real hardware: contention, enabled slots left Hi-Z, sources routed to
+// disabled slots and IV ADC rates that don't match the interleave mode.
+//
+
+#define GMAX_TDM_REG_FIRST 0x0018
+#define GMAX_TDM_REG_LAST 0x0026
+#define GMAX_TDM_REG_COUNT (GMAX_TDM_REG_LAST - GMAX_TDM_REG_FIRST + 1)
+
+typedef struct _GMAX_TDM_REGS
+{
+	uint8_t Reg[GMAX_TDM_REG_COUNT];	// indexed by address - GMAX_TDM_REG_FIRST
+} GMAX_TDM_REGS;
+
+typedef struct _GMAX_TDM_SLOT
+{
+	int8_t Amp;		// -1 when no amp drives the slot
+	uint8_t Current;	// 0 = VMON, 1 = IMON
+	uint8_t Interleaved;	// VMON on even frames, IMON on odd
+} GMAX_TDM_SLOT;
+
+typedef struct _GMAX_TDM_SIM
+{
+	GMAX_DSP_FORMAT Format;
+	uint8_t SlotCount;
+	uint8_t AmpCount;
+	GMAX_TDM_SLOT Slot[GMAX_DSP_MAX_SLOTS];
+} GMAX_TDM_SIM;
+
+//
+// Fills Regs with what StartCodec programs for these slots, with the
+// init table's 16-bit TDM mode at 48 kHz.
+//
+void
+gmax_tdm_driver_image(
+	unsigned VmonSlot,
+	unsigned ImonSlot,
+	int Interleave,
+	GMAX_TDM_REGS* Regs
+);
+
+//
+// Returns 0, or -1 with a description in Error.
+//
+int
+gmax_tdm_sim_init(
+	GMAX_TDM_SIM* Sim,
+	const GMAX_TDM_REGS* Amps,
+	unsigned AmpCount,
+	unsigned SlotCount,
+	char* Error,
+	size_t ErrorSize
+);
+
+//
+// Samples are 32-bit left justified. V[a] and I[a] hold one sample per
+// frame, or one per frame pair for an interleaved amp. FirstFrame is the
+// bus frame number of the first frame, which sets the interleave phase.
+//
+void
+gmax_tdm_sim_drive(
+	const GMAX_TDM_SIM* Sim,
+	const int32_t* const* V,
+	const int32_t* const* I,
+	uint64_t FirstFrame,
+	size_t Frames,
+	void* Out
+);
+
+void
+gmax_tdm_sim_decode(
+	const GMAX_TDM_SIM* Sim,
+	const void* In,
+	uint64_t FirstFrame,
+	size_t Frames,
+	int32_t* const* V,
+	int32_t* const* I
+);
+
+//
+// Container conversion between left justified 32-bit samples and the
+// packed wire format, used by the simulator.
+//
+void
+gmax_tdm_pack(
+	const int32_t* In,
+	size_t Count,
+	GMAX_DSP_FORMAT Format,
+	void* Out
+);
+
+void
+gmax_tdm_unpack(
+	const void* In,
+	size_t Count,
+	GMAX_DSP_FORMAT Format,
+	int32_t* Out
+);
+
+//
+// PCM container conversion
+//
+// Converts between the containers a CsAudio format override can ask
+// for when the DSP and the amp disagree (IOCTL_GMAX_GET_FORMAT). Widening
+// is exact. Narrowing rounds to nearest with optional TPDF dither at
+// the output LSB and saturates. The dither sequence depends only on the
+// seed and the sample position, so the result is the same whichever
+// kernel runs it and however the stream is split into blocks.
+//
+
+typedef enum {
+	GmaxPcm16,		// 16 valid bits in a 16-bit container
+	GmaxPcm24In32,		// 24 valid bits, left justified in 32
+	GmaxPcm32,
+	GmaxPcmMax
+} GMAX_PCM_CONTAINER;
+
+typedef struct _GMAX_PCM_CONVERTER
+{
+	GMAX_PCM_CONTAINER In;
+	GMAX_PCM_CONTAINER Out;
+	int Dither;
+	uint32_t Seed;
+	uint64_t Position;	// samples converted so far
+} GMAX_PCM_CONVERTER;
+
+//
+// Maps CsAudioFormatOverride fields to a container, GmaxPcmMax if the
+// combination has no container here.
+//
+GMAX_PCM_CONTAINER
+gmax_pcm_container(
+	unsigned BitsPerSample,
+	unsigned ValidBitsPerSample,
+	int Force32BitContainer
+);
+
+int
+gmax_pcm_converter_init(
+	GMAX_PCM_CONVERTER* Converter,
+	GMAX_PCM_CONTAINER In,
+	GMAX_PCM_CONTAINER Out,
+	int Dither,
+	uint32_t Seed
+);
+
+//
+// Converts Samples samples (all channels counted). In and Out may be
+// the same buffer when the output container is not larger than the
+// input.
+//
+void
+gmax_pcm_convert(
+	GMAX_PCM_CONVERTER* Converter,
+	const void* In,
+	void* Out,
+	size_t Samples
+);
+
+//
+// Look-ahead brownout guard
+//
+// Runs on the playback stream before it reaches the amp. The peak over
+// the next LookAheadMs is tracked with a sliding window maximum, and an
+// attenuation that keeps that peak under CeilingDb is decided before
+// the transient plays rather than after the supply droops. Actions name
+// the stream frame the attenuation must be in effect by; the caller
+// turns that into IOCTL_GMAX_SET_GAIN_LIMIT with GmaxLimitBrownout and
+// a DelayUs that lands the write just before it. Decisions are made up
+// to two windows after the samples go in and returned when that call
+// returns, so with calls of n frames the playback path needs two
+// windows plus n - 1 frames of buffering, plus the bus latency.
+//
+
+#define GMAX_GUARD_MAX_WINDOW 4096
+
+typedef struct _GMAX_GUARD_CONFIG
+{
+	uint32_t SampleRate;
+	uint32_t Channels;
+	float LookAheadMs;
+	float CeilingDb;		// dBFS the peak may reach after attenuation
+	float HoldMs;
+	float ReleaseDbPerSec;
+	float MaxAttenuationDb;
+	float MinIntervalMs;		// between release actions
+} GMAX_GUARD_CONFIG;
+
+typedef struct _GMAX_GUARD_ACTION
+{
+	uint64_t Frame;
+	int32_t Attenuation;		// 1/100 dB
+} GMAX_GUARD_ACTION;
+
+typedef struct _GMAX_GUARD_STATE
+{
+	GMAX_GUARD_CONFIG Config;
+	uint32_t Window;
+	uint32_t Fill;
+	int HaveSuffix;
+	float Block[GMAX_GUARD_MAX_WINDOW];	// frame peaks of the block filling
+	float Suffix[GMAX_GUARD_MAX_WINDOW];	// suffix maxima of the previous block
+	float Prefix[GMAX_GUARD_MAX_WINDOW];
+	float WindowMax[GMAX_GUARD_MAX_WINDOW];
+	uint64_t Position;			// first frame of the previous block
+	float Ceiling;
+	float AttenuationDb;
+	int32_t Reported;
+	uint64_t HoldUntil;
+	uint64_t LastAction;
+} GMAX_GUARD_STATE;
+
+int
+gmax_guard_init(
+	GMAX_GUARD_STATE* State,
+	const GMAX_GUARD_CONFIG* Config
+);
+
+//
+// Consumes Frames interleaved float frames. Returns the number of
+// actions written; when more than MaxActions are due the last one is
+// updated in place, so the final state is always reported.
+//
+size_t
+gmax_guard_process(
+	GMAX_GUARD_STATE* State,
+	const float* Samples,
+	size_t Frames,
+	GMAX_GUARD_ACTION* Actions,
+	size_t MaxActions
+);
+
+//
+// Speaker thermal protection
+//
+// Voice coil temperature is read off the Re estimate (copper resistance
+// rises about 0.39% per kelvin). A first order coil model predicts where
+// the temperature is heading at the current power, and the attenuation
+// needed to keep it under MaxC over the horizon is returned in 1/100 dB,
+// ready for IOCTL_GMAX_SET_GAIN_LIMIT.
+//
+
+typedef struct _GMAX_THERMAL_CONFIG
+{
+	float ReAmbient;		// ohms at AmbientC
+	float AmbientC;
+	float MaxC;			// voice coil limit
+	float TempCoefficient;		// per kelvin, 0.00393 for copper
+	float ThermalResistance;	// K/W, coil to ambient
+	float TimeConstantMs;		// coil heating time constant
+	float HorizonMs;		// how far ahead to protect
+	float MeasureLagMs;		// IV-sense smoothing, see gmax_iv_init
+	float ReleaseDbPerSec;
+	float MaxAttenuationDb;
+} GMAX_THERMAL_CONFIG;
+
+typedef struct _GMAX_THERMAL_STATE
+{
+	GMAX_THERMAL_CONFIG Config;
+	struct {
+		float TempC;
+		float AttenuationDb;
+		float PendingDb;	// added but not yet visible in the power
+		int32_t Reported;	// last value returned, 1/100 dB
+	} Amp[GMAX_DSP_MAX_AMPS];
+} GMAX_THERMAL_STATE;
+
+int
+gmax_thermal_init(
+	GMAX_THERMAL_STATE* State,
+	const GMAX_THERMAL_CONFIG* Config
+);
+
+//
+// Advances the model for one amp by a block of BlockMs. Returns the
+// attenuation in 1/100 dB, quantized to the 0.25 dB AMP_VOL_CTRL step;
+// *Changed is set when it differs from the previous call so callers
+// only issue a register write when something moved.
+//
+int32_t
+gmax_thermal_update(
+	GMAX_THERMAL_STATE* State,
+	unsigned Amp,
+	const GMAX_IV_ESTIMATE* Estimate,
+	float BlockMs,
+	int* Changed
+);
+
+float
+gmax_thermal_temperature(
+	const GMAX_THERMAL_STATE* State,
+	unsigned Amp
+);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,234 @@
+/*++
+
+Module Name:
+
+guard.c
+
+Abstract:
+
+Look-ahead brownout guard.
+
+The peak over the next Window frames is the van Herk / Gil-Werman
+sliding maximum: the stream is cut into blocks of Window frames, and
+the window starting at frame j of one block is the suffix maximum of
+that block from j combined with the prefix maximum of the next block
+up to j - 1. Both scans are one pass per block, so the cost is a few
+compares per frame whatever the look-ahead, and the window maximum for
+a block is known as soon as the block after it has filled.
+
+Attenuation attacks at the first frame whose window exceeds the
+ceiling, giving up to Window frames of lead before the peak itself.
+It holds for HoldMs after the last frame that needed it and then
+releases once per block at ReleaseDbPerSec, never below what the next
+block needs. Releases are at least MinIntervalMs apart to keep bus
+traffic down; attacks are never delayed.
+
+--*/
+
+#include <math.h>
+
+#include "dsp_internal.h"
+
+#define GMAX_GUARD_STEP 25	// AMP_VOL_CTRL step, 1/100 dB
+
+int
+gmax_guard_init(
+	GMAX_GUARD_STATE* State,
+	const GMAX_GUARD_CONFIG* Config
+)
+{
+	float window = Config->LookAheadMs * Config->SampleRate * 1e-3f;
+
+	if (Config->SampleRate == 0 ||
+		Config->Channels == 0 ||
+		window < 1.0f ||
+		window > GMAX_GUARD_MAX_WINDOW ||
+		Config->MaxAttenuationDb <= 0.0f) {
+		return -1;
+	}
+
+	memset(State, 0, sizeof(*State));
+	State->Config = *Config;
+	State->Window = (uint32_t)(window + 0.5f);
+	State->Ceiling = powf(10.0f, Config->CeilingDb / 20.0f);
+	return 0;
+}
+
+static float
+gmax_guard_need(
+	const GMAX_GUARD_STATE* State,
+	float Peak
+)
+{
+	float need;
+
+	if (Peak <= State->Ceiling) {
+		return 0.0f;
+	}
+
+	need = 20.0f * log10f(Peak / State->Ceiling);
+	return need < State->Config.MaxAttenuationDb ? need : State->Config.MaxAttenuationDb;
+}
+
+static int32_t
+gmax_guard_quantize(
+	float AttenuationDb
+)
+{
+	// Round up so the limit is never weaker than decided
+	return (int32_t)ceilf(AttenuationDb * 100.0f / GMAX_GUARD_STEP) * GMAX_GUARD_STEP;
+}
+
+static size_t
+gmax_guard_emit(
+	GMAX_GUARD_STATE* State,
+	uint64_t Frame,
+	int32_t Attenuation,
+	GMAX_GUARD_ACTION* Actions,
+	size_t MaxActions,
+	size_t Count
+)
+{
+	State->Reported = Attenuation;
+	State->LastAction = Frame;
+
+	if (MaxActions == 0) {
+		return 0;
+	}
+	if (Count == MaxActions) {
+		Count--;
+	}
+	Actions[Count].Frame = Frame;
+	Actions[Count].Attenuation = Attenuation;
+	return Count + 1;
+}
+
+static size_t
+gmax_guard_block(
+	GMAX_GUARD_STATE* State,
+	GMAX_GUARD_ACTION* Actions,
+	size_t MaxActions,
+	size_t Count
+)
+{
+	const GMAX_DSP_KERNELS* kernels = gmax_dsp_kernels();
+	const GMAX_GUARD_CONFIG* config = &State->Config;
+	uint32_t window = State->Window;
+	uint64_t hold = (uint64_t)(config->HoldMs * config->SampleRate * 1e-3f);
+	uint64_t interval = (uint64_t)(config->MinIntervalMs * config->SampleRate * 1e-3f);
+	uint64_t next = State->Position + window;
+	float attack;
+	float keep;
+
+	if (!State->HaveSuffix) {
+		goto suffix;
+	}
+
+	//
+	// Prefix maxima of the block just filled, then the window maximum
+	// for every frame of the previous block
+	//
+	State->Prefix[0] = State->Block[0];
+	for (uint32_t j = 1; j < window; j++) {
+		float x = State->Block[j];
+
+		State->Prefix[j] = x > State->Prefix[j - 1] ? x : State->Prefix[j - 1];
+	}
+	State->WindowMax[0] = State->Suffix[0];
+	kernels->Max(State->Suffix + 1, State->Prefix, window - 1, State->WindowMax + 1);
+
+	//
+	// Linear thresholds so the per-frame test is one compare: above
+	// attack the current attenuation is not enough, above keep it is
+	// still in use and the hold restarts.
+	//
+	attack = State->Ceiling * powf(10.0f, State->AttenuationDb / 20.0f);
+	keep = State->Ceiling * powf(10.0f, (State->AttenuationDb - GMAX_GUARD_STEP / 100.0f) / 20.0f);
+
+	for (uint32_t j = 0; j < window; j++) {
+		float peak = State->WindowMax[j];
+		uint64_t frame = State->Position + j;
+
+		if (peak > attack) {
+			int32_t reported;
+
+			State->AttenuationDb = gmax_guard_need(State, peak);
+			reported = gmax_guard_quantize(State->AttenuationDb);
+			if (reported > State->Reported) {
+				Count = gmax_guard_emit(State, frame, reported, Actions, MaxActions, Count);
+			}
+			attack = State->Ceiling * powf(10.0f, State->AttenuationDb / 20.0f);
+			keep = State->Ceiling * powf(10.0f, (State->AttenuationDb - GMAX_GUARD_STEP / 100.0f) / 20.0f);
+			State->HoldUntil = frame + hold;
+		}
+		else if (peak > keep) {
+			State->HoldUntil = frame + hold;
+		}
+	}
+
+	//
+	// Release takes effect from the start of the next block, whose own
+	// peak is the prefix maximum of the block just filled
+	//
+	if (State->AttenuationDb > 0.0f && next >= State->HoldUntil) {
+		float floor = gmax_guard_need(State, State->Prefix[window - 1]);
+		float release = config->ReleaseDbPerSec * window / config->SampleRate;
+		int32_t reported;
+
+		State->AttenuationDb -= release;
+		if (State->AttenuationDb < floor) {
+			State->AttenuationDb = floor;
+		}
+
+		reported = gmax_guard_quantize(State->AttenuationDb);
+		if (reported < State->Reported && next - State->LastAction >= interval) {
+			Count = gmax_guard_emit(State, next, reported, Actions, MaxActions, Count);
+		}
+	}
+
+	State->Position = next;
+
+suffix:
+	State->Suffix[window - 1] = State->Block[window - 1];
+	for (uint32_t j = window - 1; j > 0; j--) {
+		float x = State->Block[j - 1];
+
+		State->Suffix[j - 1] = x > State->Suffix[j] ? x : State->Suffix[j];
+	}
+	State->HaveSuffix = 1;
+	State->Fill = 0;
+	return Count;
+}
+
+size_t
+gmax_guard_process(
+	GMAX_GUARD_STATE* State,
+	const float* Samples,
+	size_t Frames,
+	GMAX_GUARD_ACTION* Actions,
+	size_t MaxActions
+)
+{
+	const GMAX_DSP_KERNELS* kernels = gmax_dsp_kernels();
+	unsigned channels = State->Config.Channels;
+	size_t count = 0;
+
+	while (Frames > 0) {
+		size_t n = State->Window - State->Fill;
+
+		if (n > Frames) {
+			n = Frames;
+		}
+
+		kernels->FramePeak(Samples, n, channels, State->Block + State->Fill);
+		State->Fill += (uint32_t)n;
+		Samples += n * channels;
+		Frames -= n;
+
+		if (State->Fill == State->Window) {
+			count = gmax_guard_block(State, Actions, MaxActions, count);
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,210 @@
+/*++
+
+Module Name:
+
+guard_kernels.c
+
+Abstract:
+
+Kernels for the look-ahead brownout guard: per frame peak magnitude
+and the elementwise maximum that combines the two halves of the van
+Herk / Gil-Werman sliding window. Mono and stereo peaks are vectorized;
+other channel counts use the scalar loop.
+
+--*/
+
+#include <math.h>
+
+#include "dsp_internal.h"
+
+#ifdef GMAX_DSP_X86
+#include <immintrin.h>
+#endif
+
+#ifdef GMAX_DSP_NEON
+#include <arm_neon.h>
+#endif
+
+void
+gmax_frame_peak_scalar(
+	const float* In,
+	size_t Frames,
+	unsigned Channels,
+	float* Peak
+)
+{
+	for (size_t f = 0; f < Frames; f++) {
+		float peak = 0.0f;
+
+		for (unsigned c = 0; c < Channels; c++) {
+			float x = fabsf(*In++);
+
+			peak = x > peak ? x : peak;
+		}
+		Peak[f] = peak;
+	}
+}
+
+void
+gmax_max_scalar(
+	const float* A,
+	const float* B,
+	size_t Count,
+	float* Out
+)
+{
+	for (size_t n = 0; n < Count; n++) {
+		Out[n] = A[n] > B[n] ? A[n] : B[n];
+	}
+}
+
+#ifdef GMAX_DSP_X86
+
+void
+gmax_frame_peak_sse2(
+	const float* In,
+	size_t Frames,
+	unsigned Channels,
+	float* Peak
+)
+{
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	size_t f = 0;
+
+	if (Channels == 1) {
+		for (; f + 4 <= Frames; f += 4) {
+			_mm_storeu_ps(Peak + f, _mm_and_ps(_mm_loadu_ps(In + f), absMask));
+		}
+	}
+	else if (Channels == 2) {
+		for (; f + 4 <= Frames; f += 4) {
+			__m128 a = _mm_and_ps(_mm_loadu_ps(In + 2 * f), absMask);
+			__m128 b = _mm_and_ps(_mm_loadu_ps(In + 2 * f + 4), absMask);
+
+			// L0 L1 L2 L3 against R0 R1 R2 R3
+			_mm_storeu_ps(Peak + f, _mm_max_ps(
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+		}
+	}
+
+	gmax_frame_peak_scalar(In + f * Channels, Frames - f, Channels, Peak + f);
+}
+
+void
+gmax_max_sse2(
+	const float* A,
+	const float* B,
+	size_t Count,
+	float* Out
+)
+{
+	size_t n = 0;
+
+	for (; n + 4 <= Count; n += 4) {
+		_mm_storeu_ps(Out + n, _mm_max_ps(_mm_loadu_ps(A + n), _mm_loadu_ps(B + n)));
+	}
+
+	gmax_max_scalar(A + n, B + n, Count - n, Out + n);
+}
+
+GMAX_DSP_TARGET_AVX2
+void
+gmax_frame_peak_avx2(
+	const float* In,
+	size_t Frames,
+	unsigned Channels,
+	float* Peak
+)
+{
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	size_t f = 0;
+
+	if (Channels == 1) {
+		for (; f + 8 <= Frames; f += 8) {
+			_mm256_storeu_ps(Peak + f, _mm256_and_ps(_mm256_loadu_ps(In + f), absMask));
+		}
+	}
+	else if (Channels == 2) {
+		for (; f + 8 <= Frames; f += 8) {
+			__m256 a = _mm256_and_ps(_mm256_loadu_ps(In + 2 * f), absMask);
+			__m256 b = _mm256_and_ps(_mm256_loadu_ps(In + 2 * f + 8), absMask);
+			__m256 m = _mm256_max_ps(
+				_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+				_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+			// the in-lane shuffle leaves frames as 0 1 4 5 2 3 6 7
+			_mm256_storeu_ps(Peak + f, _mm256_castpd_ps(
+				_mm256_permute4x64_pd(_mm256_castps_pd(m), _MM_SHUFFLE(3, 1, 2, 0))));
+		}
+	}
+
+	gmax_frame_peak_scalar(In + f * Channels, Frames - f, Channels, Peak + f);
+}
+
+GMAX_DSP_TARGET_AVX2
+void
+gmax_max_avx2(
+	const float* A,
+	const float* B,
+	size_t Count,
+	float* Out
+)
+{
+	size_t n = 0;
+
+	for (; n + 8 <= Count; n += 8) {
+		_mm256_storeu_ps(Out + n, _mm256_max_ps(_mm256_loadu_ps(A + n), _mm256_loadu_ps(B + n)));
+	}
+
+	gmax_max_scalar(A + n, B + n, Count - n, Out + n);
+}
+
+#endif
+
+#ifdef GMAX_DSP_NEON
+
+void
+gmax_frame_peak_neon(
+	const float* In,
+	size_t Frames,
+	unsigned Channels,
+	float* Peak
+)
+{
+	size_t f = 0;
+
+	if (Channels == 1) {
+		for (; f + 4 <= Frames; f += 4) {
+			vst1q_f32(Peak + f, vabsq_f32(vld1q_f32(In + f)));
+		}
+	}
+	else if (Channels == 2) {
+		for (; f + 4 <= Frames; f += 4) {
+			float32x4x2_t lr = vld2q_f32(In + 2 * f);
+
+			vst1q_f32(Peak + f, vmaxq_f32(vabsq_f32(lr.val[0]), vabsq_f32(lr.val[1])));
+		}
+	}
+
+	gmax_frame_peak_scalar(In + f * Channels, Frames - f, Channels, Peak + f);
+}
+
+void
+gmax_max_neon(
+	const float* A,
+	const float* B,
+	size_t Count,
+	float* Out
+)
+{
+	size_t n = 0;
+
+	for (; n + 4 <= Count; n += 4) {
+		vst1q_f32(Out + n, vmaxq_f32(vld1q_f32(A + n), vld1q_f32(B + n)));
+	}
+
+	gmax_max_scalar(A + n, B + n, Count - n, Out + n);
+}
+
+#endif
@@ -0,0 +1,156 @@
+/*++
+
+Module Name:
+
+ivsense.c
+
+Abstract:
+
+Running estimates from the amps' IV-sense feedback: RMS voltage and
+current, real power and the DC resistance (Re) of the voice coil.
+
+Re is the least squares fit of v = Re * i over a block, sum(v*i) /
+sum(i*i). It is only updated from blocks carrying enough current for
+the fit to mean anything, so it holds its value through silence.
+
+--*/
+
+#include <math.h>
+
+#include "dsp_internal.h"
+
+int
+gmax_iv_init(
+	GMAX_IV_STATE* State,
+	const GMAX_IV_CONFIG* Config
+)
+{
+	unsigned bytes = gmax_dsp_format_bytes(Config->Format);
+	unsigned width = 8 * bytes;
+
+	if (bytes == 0 ||
+		Config->SlotCount == 0 || Config->SlotCount > GMAX_DSP_MAX_SLOTS ||
+		Config->AmpCount > GMAX_DSP_MAX_AMPS ||
+		Config->SampleRate == 0) {
+		return -1;
+	}
+
+	memset(State, 0, sizeof(*State));
+	State->Config = *Config;
+	State->FrameBytes = Config->SlotCount * bytes;
+
+	for (unsigned a = 0; a < Config->AmpCount; a++) {
+		const GMAX_IV_AMP_CONFIG* amp = &Config->Amp[a];
+		GMAX_DSP_CHANNEL* v = &State->Layout[a].V;
+		GMAX_DSP_CHANNEL* i = &State->Layout[a].I;
+
+		if (amp->VmonSlot >= Config->SlotCount ||
+			(!amp->Interleaved && amp->ImonSlot >= Config->SlotCount)) {
+			return -1;
+		}
+
+		v->Offset = amp->VmonSlot * bytes;
+		v->Bytes = bytes;
+		v->Shift = 32 - width;
+		v->Mask = 0xFFFFFFFF;
+
+		*i = *v;
+		if (amp->Interleaved) {
+			//
+			// Processed a frame pair at a time, I in the second frame
+			//
+			i->Offset += State->FrameBytes;
+		}
+		else {
+			i->Offset = amp->ImonSlot * bytes;
+		}
+	}
+
+	return 0;
+}
+
+void
+gmax_iv_process(
+	GMAX_IV_STATE* State,
+	const void* Data,
+	size_t Frames
+)
+{
+	const GMAX_IV_CONFIG* config = &State->Config;
+	GMAX_DSP_IV_SUM* sum = gmax_dsp_kernels()->IvSum;
+	double tau = config->TimeConstantMs * 1e-3 * config->SampleRate;
+
+	for (unsigned a = 0; a < config->AmpCount; a++) {
+		const GMAX_IV_AMP_CONFIG* amp = &config->Amp[a];
+		const uint8_t* data = (const uint8_t*)Data;
+		size_t count = Frames;
+		size_t stride = State->FrameBytes;
+		double sums[3] = { 0.0, 0.0, 0.0 };
+		double vv, ii, vi;
+		double alpha;
+
+		//
+		// Interleaved amps are summed over V/I frame pairs. A pair split
+		// across calls is dropped rather than carried.
+		//
+		if (amp->Interleaved) {
+			if (State->FrameIndex & 1) {
+				data += stride;
+				count = count ? count - 1 : 0;
+			}
+			count /= 2;
+			stride *= 2;
+		}
+
+		if (count == 0) {
+			continue;
+		}
+
+		sum(data, count, stride, &State->Layout[a].V, &State->Layout[a].I, sums);
+
+		vv = sums[0] / count;
+		ii = sums[1] / count;
+		vi = sums[2] / count;
+
+		//
+		// The first block seeds the averages.
+		//
+		alpha = tau > 0.0 ? 1.0 - exp(-(double)count * (amp->Interleaved ? 2 : 1) / tau) : 1.0;
+		if (State->Amp[a].Frames == 0) {
+			alpha = 1.0;
+		}
+		State->Amp[a].MeanVV += alpha * (vv - State->Amp[a].MeanVV);
+		State->Amp[a].MeanII += alpha * (ii - State->Amp[a].MeanII);
+		State->Amp[a].MeanVI += alpha * (vi - State->Amp[a].MeanVI);
+		State->Amp[a].Frames += count;
+
+		if (ii > 0.0 && sqrt(ii) * amp->AmpsFullScale >= config->MinCurrentRms) {
+			double re = vi / ii * amp->VoltsFullScale / amp->AmpsFullScale;
+
+			if (State->Amp[a].Re == 0.0) {
+				State->Amp[a].Re = re;
+			}
+			else {
+				State->Amp[a].Re += alpha * (re - State->Amp[a].Re);
+			}
+		}
+	}
+
+	State->FrameIndex += Frames;
+}
+
+void
+gmax_iv_get_estimate(
+	const GMAX_IV_STATE* State,
+	unsigned Amp,
+	GMAX_IV_ESTIMATE* Estimate
+)
+{
+	const GMAX_IV_AMP_CONFIG* amp = &State->Config.Amp[Amp];
+
+	Estimate->VoltsRms = (float)(sqrt(State->Amp[Amp].MeanVV) * amp->VoltsFullScale);
+	Estimate->AmpsRms = (float)(sqrt(State->Amp[Amp].MeanII) * amp->AmpsFullScale);
+	Estimate->Power = (float)(State->Amp[Amp].MeanVI * amp->VoltsFullScale * amp->AmpsFullScale);
+	Estimate->Re = (float)State->Amp[Amp].Re;
+	Estimate->Frames = State->Amp[Amp].Frames;
+}
@@ -0,0 +1,247 @@
+/*++
+
+Module Name:
+
+ivsense_kernels.c
+
+Abstract:
+
+IV-sense accumulation kernels. Each walks the TDM capture a frame at a
+time, pulls the V and I words out of their slots and accumulates v*v,
+i*i and v*i. The vector paths take several frames per iteration and
+gather the strided slots, accumulating in float lanes that are flushed
+to the double sums every GMAX_IV_FLUSH_FRAMES frames so long captures
+don't lose precision. The last frame always goes through the scalar
+path since a 32-bit load there could run past the end of the buffer.
+
+--*/
+
+#include "dsp_internal.h"
+
+#ifdef GMAX_DSP_X86
+#include <immintrin.h>
+#endif
+
+#ifdef GMAX_DSP_NEON
+#include <arm_neon.h>
+#endif
+
+static inline uint32_t
+gmax_load32(
+	const uint8_t* p
+)
+{
+	uint32_t x;
+
+	memcpy(&x, p, sizeof(x));
+	return x;
+}
+
+void
+gmax_iv_sum_scalar(
+	const uint8_t* Data,
+	size_t Frames,
+	size_t FrameBytes,
+	const GMAX_DSP_CHANNEL* V,
+	const GMAX_DSP_CHANNEL* I,
+	double Sums[3]
+)
+{
+	double vv = 0.0;
+	double ii = 0.0;
+	double vi = 0.0;
+
+	for (size_t f = 0; f < Frames; f++, Data += FrameBytes) {
+		double v = (double)(int32_t)gmax_dsp_load(Data, V) * GMAX_DSP_SCALE;
+		double i = (double)(int32_t)gmax_dsp_load(Data, I) * GMAX_DSP_SCALE;
+
+		vv += v * v;
+		ii += i * i;
+		vi += v * i;
+	}
+
+	Sums[0] += vv;
+	Sums[1] += ii;
+	Sums[2] += vi;
+}
+
+#ifdef GMAX_DSP_X86
+
+void
+gmax_iv_sum_sse2(
+	const uint8_t* Data,
+	size_t Frames,
+	size_t FrameBytes,
+	const GMAX_DSP_CHANNEL* V,
+	const GMAX_DSP_CHANNEL* I,
+	double Sums[3]
+)
+{
+	const __m128i vShift = _mm_cvtsi32_si128((int)V->Shift);
+	const __m128i iShift = _mm_cvtsi32_si128((int)I->Shift);
+	const __m128i vMask = _mm_set1_epi32((int)V->Mask);
+	const __m128i iMask = _mm_set1_epi32((int)I->Mask);
+	const __m128 scale = _mm_set1_ps(GMAX_DSP_SCALE);
+	size_t vector = Frames > 0 ? (Frames - 1) & ~(size_t)3 : 0;
+	size_t f = 0;
+
+	while (f < vector) {
+		size_t end = f + GMAX_IV_FLUSH_FRAMES < vector ? f + GMAX_IV_FLUSH_FRAMES : vector;
+		__m128 vv = _mm_setzero_ps();
+		__m128 ii = _mm_setzero_ps();
+		__m128 vi = _mm_setzero_ps();
+		float lanes[3][4];
+
+		for (; f < end; f += 4) {
+			const uint8_t* p = Data + f * FrameBytes;
+			__m128i vw = _mm_set_epi32(
+				(int)gmax_load32(p + 3 * FrameBytes + V->Offset),
+				(int)gmax_load32(p + 2 * FrameBytes + V->Offset),
+				(int)gmax_load32(p + FrameBytes + V->Offset),
+				(int)gmax_load32(p + V->Offset));
+			__m128i iw = _mm_set_epi32(
+				(int)gmax_load32(p + 3 * FrameBytes + I->Offset),
+				(int)gmax_load32(p + 2 * FrameBytes + I->Offset),
+				(int)gmax_load32(p + FrameBytes + I->Offset),
+				(int)gmax_load32(p + I->Offset));
+			__m128 v = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_sll_epi32(vw, vShift), vMask)), scale);
+			__m128 i = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_sll_epi32(iw, iShift), iMask)), scale);
+
+			vv = _mm_add_ps(vv, _mm_mul_ps(v, v));
+			ii = _mm_add_ps(ii, _mm_mul_ps(i, i));
+			vi = _mm_add_ps(vi, _mm_mul_ps(v, i));
+		}
+
+		_mm_storeu_ps(lanes[0], vv);
+		_mm_storeu_ps(lanes[1], ii);
+		_mm_storeu_ps(lanes[2], vi);
+		for (int k = 0; k < 3; k++) {
+			Sums[k] += (double)lanes[k][0] + lanes[k][1] + lanes[k][2] + lanes[k][3];
+		}
+	}
+
+	gmax_iv_sum_scalar(Data + f * FrameBytes, Frames - f, FrameBytes, V, I, Sums);
+}
+
+GMAX_DSP_TARGET_AVX2
+static inline double
+gmax_hsum256(
+	__m256 x
+)
+{
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+
+GMAX_DSP_TARGET_AVX2
+void
+gmax_iv_sum_avx2(
+	const uint8_t* Data,
+	size_t Frames,
+	size_t FrameBytes,
+	const GMAX_DSP_CHANNEL* V,
+	const GMAX_DSP_CHANNEL* I,
+	double Sums[3]
+)
+{
+	const __m128i vShift = _mm_cvtsi32_si128((int)V->Shift);
+	const __m128i iShift = _mm_cvtsi32_si128((int)I->Shift);
+	const __m256i vMask = _mm256_set1_epi32((int)V->Mask);
+	const __m256i iMask = _mm256_set1_epi32((int)I->Mask);
+	const __m256 scale = _mm256_set1_ps(GMAX_DSP_SCALE);
+	const int fb = (int)FrameBytes;
+	const __m256i index = _mm256_setr_epi32(0, fb, 2 * fb, 3 * fb, 4 * fb, 5 * fb, 6 * fb, 7 * fb);
+	size_t vector = Frames > 0 ? (Frames - 1) & ~(size_t)7 : 0;
+	size_t f = 0;
+
+	while (f < vector) {
+		size_t end = f + GMAX_IV_FLUSH_FRAMES < vector ? f + GMAX_IV_FLUSH_FRAMES : vector;
+		__m256 vv = _mm256_setzero_ps();
+		__m256 ii = _mm256_setzero_ps();
+		__m256 vi = _mm256_setzero_ps();
+
+		for (; f < end; f += 8) {
+			const uint8_t* p = Data + f * FrameBytes;
+			__m256i vw = _mm256_i32gather_epi32((const int*)(p + V->Offset), index, 1);
+			__m256i iw = _mm256_i32gather_epi32((const int*)(p + I->Offset), index, 1);
+			__m256 v = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_sll_epi32(vw, vShift), vMask)), scale);
+			__m256 i = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_sll_epi32(iw, iShift), iMask)), scale);
+
+			vv = _mm256_fmadd_ps(v, v, vv);
+			ii = _mm256_fmadd_ps(i, i, ii);
+			vi = _mm256_fmadd_ps(v, i, vi);
+		}
+
+		Sums[0] += gmax_hsum256(vv);
+		Sums[1] += gmax_hsum256(ii);
+		Sums[2] += gmax_hsum256(vi);
+	}
+
+	gmax_iv_sum_scalar(Data + f * FrameBytes, Frames - f, FrameBytes, V, I, Sums);
+}
+
+#endif
+
+#ifdef GMAX_DSP_NEON
+
+static inline uint32x4_t
+gmax_load4_neon(
+	const uint8_t* p,
+	size_t FrameBytes
+)
+{
+	uint32x4_t x = vdupq_n_u32(gmax_load32(p));
+
+	x = vsetq_lane_u32(gmax_load32(p + FrameBytes), x, 1);
+	x = vsetq_lane_u32(gmax_load32(p + 2 * FrameBytes), x, 2);
+	x = vsetq_lane_u32(gmax_load32(p + 3 * FrameBytes), x, 3);
+	return x;
+}
+
+void
+gmax_iv_sum_neon(
+	const uint8_t* Data,
+	size_t Frames,
+	size_t FrameBytes,
+	const GMAX_DSP_CHANNEL* V,
+	const GMAX_DSP_CHANNEL* I,
+	double Sums[3]
+)
+{
+	const int32x4_t vShift = vdupq_n_s32((int32_t)V->Shift);
+	const int32x4_t iShift = vdupq_n_s32((int32_t)I->Shift);
+	const uint32x4_t vMask = vdupq_n_u32(V->Mask);
+	const uint32x4_t iMask = vdupq_n_u32(I->Mask);
+	size_t vector = Frames > 0 ? (Frames - 1) & ~(size_t)3 : 0;
+	size_t f = 0;
+
+	while (f < vector) {
+		size_t end = f + GMAX_IV_FLUSH_FRAMES < vector ? f + GMAX_IV_FLUSH_FRAMES : vector;
+		float32x4_t vv = vdupq_n_f32(0.0f);
+		float32x4_t ii = vdupq_n_f32(0.0f);
+		float32x4_t vi = vdupq_n_f32(0.0f);
+
+		for (; f < end; f += 4) {
+			const uint8_t* p = Data + f * FrameBytes;
+			uint32x4_t vw = vandq_u32(vshlq_u32(gmax_load4_neon(p + V->Offset, FrameBytes), vShift), vMask);
+			uint32x4_t iw = vandq_u32(vshlq_u32(gmax_load4_neon(p + I->Offset, FrameBytes), iShift), iMask);
+			float32x4_t v = vmulq_n_f32(vcvtq_f32_s32(vreinterpretq_s32_u32(vw)), GMAX_DSP_SCALE);
+			float32x4_t i = vmulq_n_f32(vcvtq_f32_s32(vreinterpretq_s32_u32(iw)), GMAX_DSP_SCALE);
+
+			vv = vfmaq_f32(vv, v, v);
+			ii = vfmaq_f32(ii, i, i);
+			vi = vfmaq_f32(vi, v, i);
+		}
+
+		Sums[0] += vaddvq_f32(vv);
+		Sums[1] += vaddvq_f32(ii);
+		Sums[2] += vaddvq_f32(vi);
+	}
+
+	gmax_iv_sum_scalar(Data + f * FrameBytes, Frames - f, FrameBytes, V, I, Sums);
+}
+
+#endif
@@ -0,0 +1,312 @@
+/*++
+
+Module Name:
+
+tdm.c
+
+Abstract:
+
+Host simulation of the amps' TDM TX bus. Each amp's register image is
+decoded into a slot table the way the hardware reads it: PCM_TX_EN
+selects the driven slots, PCM_TX_HIZ_CTRL releases the rest, and
+PCM_TX_CH_SRC_A/B place VMON and IMON. Frames are then built a chunk
+at a time as 32-bit words and packed to the configured channel size,
+and captures are unpacked and routed back the same way.
+
+--*/
+
+#include <stdio.h>
+
+#include "dsp_internal.h"
+#include "../opengmaxcodec/tdmslots.h"
+
+#define GMAX_TDM_REG(r) ((r) - GMAX_TDM_REG_FIRST)
+
+//
+// Frames per chunk when building or decoding
+//
+#define GMAX_TDM_CHUNK 256
+
+//
+// PCM_SR_SETUP1 / PCM_SR_SETUP2 rate codes
+//
+static const uint32_t GmaxTdmRates[] = {
+	8000, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000, 88200, 96000
+};
+
+static uint32_t
+gmax_tdm_rate(
+	unsigned Code
+)
+{
+	return Code < sizeof(GmaxTdmRates) / sizeof(GmaxTdmRates[0]) ? GmaxTdmRates[Code] : 0;
+}
+
+void
+gmax_tdm_driver_image(
+	unsigned VmonSlot,
+	unsigned ImonSlot,
+	int Interleave,
+	GMAX_TDM_REGS* Regs
+)
+{
+	memset(Regs, 0, sizeof(*Regs));
+
+	//
+	// max98512_initregs and StartCodec
+	//
+	Regs->Reg[GMAX_TDM_REG(MAX98512_R0018_PCM_RX_EN_A)] = 0x3;
+	Regs->Reg[GMAX_TDM_REG(MAX98512_R0020_PCM_MODE_CFG)] = 0x58;
+	Regs->Reg[GMAX_TDM_REG(MAX98512_R0022_PCM_CLK_SETUP)] = 0x26;
+	Regs->Reg[GMAX_TDM_REG(MAX98512_R0023_PCM_SR_SETUP1)] = 0x8;
+	Regs->Reg[GMAX_TDM_REG(MAX98512_R0024_PCM_SR_SETUP2)] = Interleave ? 0x85 : 0x88;
+
+	GmaxBuildTxSlotMap(VmonSlot, ImonSlot, Interleave,
+		&Regs->Reg[GMAX_TDM_REG(GMAX_TX_SLOT_MAP_FIRST)]);
+}
+
+int
+gmax_tdm_sim_init(
+	GMAX_TDM_SIM* Sim,
+	const GMAX_TDM_REGS* Amps,
+	unsigned AmpCount,
+	unsigned SlotCount,
+	char* Error,
+	size_t ErrorSize
+)
+{
+	uint16_t slotMask;
+	uint16_t claimed = 0;
+
+#define GMAX_TDM_FAIL(...) do { snprintf(Error, ErrorSize, __VA_ARGS__); return -1; } while (0)
+
+	if (AmpCount == 0 || AmpCount > GMAX_DSP_MAX_AMPS ||
+		SlotCount == 0 || SlotCount > GMAX_DSP_MAX_SLOTS) {
+		GMAX_TDM_FAIL("bad amp or slot count");
+	}
+
+	memset(Sim, 0, sizeof(*Sim));
+	Sim->SlotCount = (uint8_t)SlotCount;
+	Sim->AmpCount = (uint8_t)AmpCount;
+	Sim->Format = GmaxDspFormatMax;
+	for (unsigned s = 0; s < GMAX_DSP_MAX_SLOTS; s++) {
+		Sim->Slot[s].Amp = -1;
+	}
+	slotMask = (uint16_t)((1u << SlotCount) - 1);
+
+	for (unsigned a = 0; a < AmpCount; a++) {
+		const uint8_t* reg = Amps[a].Reg;
+		uint16_t enabled = reg[GMAX_TDM_REG(MAX98512_R001A_PCM_TX_EN_A)] |
+			reg[GMAX_TDM_REG(MAX98512_R001B_PCM_TX_EN_B)] << 8;
+		uint16_t hiz = reg[GMAX_TDM_REG(MAX98512_R001C_PCM_TX_HIZ_CTRL_A)] |
+			reg[GMAX_TDM_REG(MAX98512_R001D_PCM_TX_HIZ_CTRL_B)] << 8;
+		uint16_t driven = (uint16_t)(enabled | ~hiz);
+		unsigned vslot = (reg[GMAX_TDM_REG(MAX98512_R001E_PCM_TX_CH_SRC_A)] >> MAX98512_PCM_TX_CH_SRC_A_V_SHIFT) & 0xF;
+		unsigned islot = (reg[GMAX_TDM_REG(MAX98512_R001E_PCM_TX_CH_SRC_A)] >> MAX98512_PCM_TX_CH_SRC_A_I_SHIFT) & 0xF;
+		int interleave = (reg[GMAX_TDM_REG(MAX98512_R001F_PCM_TX_CH_SRC_B)] & MAX98512_PCM_TX_CH_INTERLEAVE_MASK) != 0;
+		uint8_t mode = reg[GMAX_TDM_REG(MAX98512_R0020_PCM_MODE_CFG)];
+		uint32_t rate = gmax_tdm_rate(reg[GMAX_TDM_REG(MAX98512_R0023_PCM_SR_SETUP1)] & MAX98512_PCM_SR_SET1_SR_MASK);
+		uint8_t setup2 = reg[GMAX_TDM_REG(MAX98512_R0024_PCM_SR_SETUP2)];
+		uint32_t ivRate = gmax_tdm_rate(setup2 & MAX98512_PCM_SR_SET2_IVADC_SR_MASK);
+		GMAX_DSP_FORMAT format;
+
+		switch (mode & MAX98512_PCM_MODE_CFG_CHANSZ_MASK) {
+		case MAX98512_PCM_MODE_CFG_CHANSZ_16:
+			format = GmaxDspFormatS16;
+			break;
+		case MAX98512_PCM_MODE_CFG_CHANSZ_24:
+			format = GmaxDspFormatS24;
+			break;
+		case MAX98512_PCM_MODE_CFG_CHANSZ_32:
+			format = GmaxDspFormatS32;
+			break;
+		default:
+			GMAX_TDM_FAIL("amp %u: reserved channel size in PCM_MODE_CFG 0x%02x", a, mode);
+		}
+		if (Sim->Format != GmaxDspFormatMax && Sim->Format != format) {
+			GMAX_TDM_FAIL("amp %u: channel size differs from amp 0", a);
+		}
+		Sim->Format = format;
+
+		if (enabled & hiz) {
+			GMAX_TDM_FAIL("amp %u: slots 0x%04x enabled but Hi-Z", a, enabled & hiz);
+		}
+		if (driven & ~slotMask) {
+			GMAX_TDM_FAIL("amp %u: drives slots 0x%04x beyond the %u slot frame", a, driven & ~slotMask, SlotCount);
+		}
+		if (driven & claimed) {
+			GMAX_TDM_FAIL("amp %u: contention on slots 0x%04x", a, driven & claimed);
+		}
+		claimed |= driven;
+
+		if (!(enabled & (1u << vslot))) {
+			GMAX_TDM_FAIL("amp %u: VMON routed to disabled slot %u", a, vslot);
+		}
+		if (!interleave && !(enabled & (1u << islot))) {
+			GMAX_TDM_FAIL("amp %u: IMON routed to disabled slot %u", a, islot);
+		}
+		if (!interleave && vslot == islot) {
+			GMAX_TDM_FAIL("amp %u: VMON and IMON share slot %u without interleave", a, vslot);
+		}
+
+		if (rate == 0 || ivRate == 0) {
+			GMAX_TDM_FAIL("amp %u: reserved sample rate code", a);
+		}
+		if (interleave ? ivRate * 2 != rate : ivRate != rate) {
+			GMAX_TDM_FAIL("amp %u: IV ADC at %u Hz with PCM at %u Hz, interleave %d",
+				a, (unsigned)ivRate, (unsigned)rate, interleave);
+		}
+
+		for (unsigned s = 0; s < SlotCount; s++) {
+			if (!(driven & (1u << s))) {
+				continue;
+			}
+			if (s == vslot) {
+				Sim->Slot[s].Amp = (int8_t)a;
+				Sim->Slot[s].Current = 0;
+				Sim->Slot[s].Interleaved = (uint8_t)interleave;
+			}
+			else if (s == islot && !interleave) {
+				Sim->Slot[s].Amp = (int8_t)a;
+				Sim->Slot[s].Current = 1;
+			}
+			else {
+				GMAX_TDM_FAIL("amp %u: slot %u driven with no source", a, s);
+			}
+		}
+	}
+
+#undef GMAX_TDM_FAIL
+
+	return 0;
+}
+
+//
+// Index of the sample for bus frame Frame in a call starting at First,
+// or -1 for the second half of an interleaved pair begun in an earlier
+// call.
+//
+static ptrdiff_t
+gmax_tdm_sample(
+	const GMAX_TDM_SLOT* Slot,
+	uint64_t First,
+	uint64_t Frame,
+	int* Current
+)
+{
+	uint64_t pairBase = First + (First & 1);
+
+	if (!Slot->Interleaved) {
+		*Current = Slot->Current;
+		return (ptrdiff_t)(Frame - First);
+	}
+
+	*Current = (int)(Frame & 1);
+	if (Frame < pairBase) {
+		return -1;
+	}
+	return (ptrdiff_t)((Frame - pairBase) / 2);
+}
+
+void
+gmax_tdm_sim_drive(
+	const GMAX_TDM_SIM* Sim,
+	const int32_t* const* V,
+	const int32_t* const* I,
+	uint64_t FirstFrame,
+	size_t Frames,
+	void* Out
+)
+{
+	GMAX_DSP_PACK* pack = gmax_dsp_kernels()->Pack;
+	unsigned bytes = gmax_dsp_format_bytes(Sim->Format);
+	int32_t words[GMAX_TDM_CHUNK * GMAX_DSP_MAX_SLOTS];
+	uint8_t* out = (uint8_t*)Out;
+
+	for (size_t f = 0; f < Frames; f += GMAX_TDM_CHUNK) {
+		size_t chunk = Frames - f < GMAX_TDM_CHUNK ? Frames - f : GMAX_TDM_CHUNK;
+		int32_t* w = words;
+
+		for (size_t k = 0; k < chunk; k++) {
+			for (unsigned s = 0; s < Sim->SlotCount; s++) {
+				const GMAX_TDM_SLOT* slot = &Sim->Slot[s];
+				int current;
+				ptrdiff_t n;
+
+				*w = 0;
+				if (slot->Amp >= 0) {
+					n = gmax_tdm_sample(slot, FirstFrame, FirstFrame + f + k, &current);
+					if (n >= 0) {
+						*w = current ? I[slot->Amp][n] : V[slot->Amp][n];
+					}
+				}
+				w++;
+			}
+		}
+
+		pack(words, chunk * Sim->SlotCount, bytes, out);
+		out += chunk * Sim->SlotCount * bytes;
+	}
+}
+
+void
+gmax_tdm_sim_decode(
+	const GMAX_TDM_SIM* Sim,
+	const void* In,
+	uint64_t FirstFrame,
+	size_t Frames,
+	int32_t* const* V,
+	int32_t* const* I
+)
+{
+	GMAX_DSP_UNPACK* unpack = gmax_dsp_kernels()->Unpack;
+	unsigned bytes = gmax_dsp_format_bytes(Sim->Format);
+	int32_t words[GMAX_TDM_CHUNK * GMAX_DSP_MAX_SLOTS];
+	const uint8_t* in = (const uint8_t*)In;
+
+	for (size_t f = 0; f < Frames; f += GMAX_TDM_CHUNK) {
+		size_t chunk = Frames - f < GMAX_TDM_CHUNK ? Frames - f : GMAX_TDM_CHUNK;
+		const int32_t* w = words;
+
+		unpack(in, chunk * Sim->SlotCount, bytes, words);
+		in += chunk * Sim->SlotCount * bytes;
+
+		for (size_t k = 0; k < chunk; k++) {
+			for (unsigned s = 0; s < Sim->SlotCount; s++, w++) {
+				const GMAX_TDM_SLOT* slot = &Sim->Slot[s];
+				int current;
+				ptrdiff_t n;
+
+				if (slot->Amp < 0) {
+					continue;
+				}
+				n = gmax_tdm_sample(slot, FirstFrame, FirstFrame + f + k, &current);
+				if (n >= 0) {
+					(current ? I : V)[slot->Amp][n] = *w;
+				}
+			}
+		}
+	}
+}
+
+void
+gmax_tdm_pack(
+	const int32_t* In,
+	size_t Count,
+	GMAX_DSP_FORMAT Format,
+	void* Out
+)
+{
+	gmax_dsp_kernels()->Pack(In, Count, gmax_dsp_format_bytes(Format), Out);
+}
+
+void
+gmax_tdm_unpack(
+	const void* In,
+	size_t Count,
+	GMAX_DSP_FORMAT Format,
+	int32_t* Out
+)
+{
+	gmax_dsp_kernels()->Unpack(In, Count, gmax_dsp_format_bytes(Format), Out);
+}
@@ -0,0 +1,300 @@
+/*++
+
+Module Name:
+
+tdm_kernels.c
+
+Abstract:
+
+Container packing between 32-bit left justified samples and the 16,
+24 (packed) and 32-bit TDM wire formats. 24-bit containers are the
+awkward case: the vector paths shuffle four samples into twelve bytes
+per 128-bit lane and use overlapping 16 byte loads and stores, so they
+stop while at least a vector of input remains and leave the rest to
+the scalar loop.
+
+--*/
+
+#include "dsp_internal.h"
+
+#ifdef GMAX_DSP_X86
+#include <immintrin.h>
+#endif
+
+#ifdef GMAX_DSP_NEON
+#include <arm_neon.h>
+#endif
+
+void
+gmax_pack_scalar(
+	const int32_t* In,
+	size_t Count,
+	unsigned Bytes,
+	void* Out
+)
+{
+	uint8_t* out = (uint8_t*)Out;
+
+	for (size_t n = 0; n < Count; n++) {
+		uint32_t x = (uint32_t)In[n] >> (32 - 8 * Bytes);
+
+		for (unsigned b = 0; b < Bytes; b++) {
+			*out++ = (uint8_t)(x >> (8 * b));
+		}
+	}
+}
+
+void
+gmax_unpack_scalar(
+	const void* In,
+	size_t Count,
+	unsigned Bytes,
+	int32_t* Out
+)
+{
+	const uint8_t* in = (const uint8_t*)In;
+
+	for (size_t n = 0; n < Count; n++) {
+		uint32_t x = 0;
+
+		for (unsigned b = 0; b < Bytes; b++) {
+			x |= (uint32_t)*in++ << (8 * b);
+		}
+		Out[n] = (int32_t)(x << (32 - 8 * Bytes));
+	}
+}
+
+#ifdef GMAX_DSP_X86
+
+void
+gmax_pack_sse2(
+	const int32_t* In,
+	size_t Count,
+	unsigned Bytes,
+	void* Out
+)
+{
+	size_t n = 0;
+
+	if (Bytes == 4) {
+		memcpy(Out, In, Count * sizeof(int32_t));
+		return;
+	}
+
+	if (Bytes == 2) {
+		int16_t* out = (int16_t*)Out;
+
+		for (; n + 8 <= Count; n += 8) {
+			__m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(In + n)), 16);
+			__m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(In + n + 4)), 16);
+
+			_mm_storeu_si128((__m128i*)(out + n), _mm_packs_epi32(a, b));
+		}
+	}
+
+	// no byte shuffle before SSSE3, 24-bit stays scalar
+	gmax_pack_scalar(In + n, Count - n, Bytes, (uint8_t*)Out + n * Bytes);
+}
+
+void
+gmax_unpack_sse2(
+	const void* In,
+	size_t Count,
+	unsigned Bytes,
+	int32_t* Out
+)
+{
+	size_t n = 0;
+
+	if (Bytes == 4) {
+		memcpy(Out, In, Count * sizeof(int32_t));
+		return;
+	}
+
+	if (Bytes == 2) {
+		const int16_t* in = (const int16_t*)In;
+		const __m128i zero = _mm_setzero_si128();
+
+		for (; n + 8 <= Count; n += 8) {
+			__m128i x = _mm_loadu_si128((const __m128i*)(in + n));
+
+			_mm_storeu_si128((__m128i*)(Out + n), _mm_unpacklo_epi16(zero, x));
+			_mm_storeu_si128((__m128i*)(Out + n + 4), _mm_unpackhi_epi16(zero, x));
+		}
+	}
+
+	gmax_unpack_scalar((const uint8_t*)In + n * Bytes, Count - n, Bytes, Out + n);
+}
+
+GMAX_DSP_TARGET_AVX2
+void
+gmax_pack_avx2(
+	const int32_t* In,
+	size_t Count,
+	unsigned Bytes,
+	void* Out
+)
+{
+	uint8_t* out = (uint8_t*)Out;
+	size_t n = 0;
+
+	if (Bytes == 4) {
+		memcpy(Out, In, Count * sizeof(int32_t));
+		return;
+	}
+
+	if (Bytes == 2) {
+		for (; n + 16 <= Count; n += 16) {
+			__m256i a = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(In + n)), 16);
+			__m256i b = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(In + n + 8)), 16);
+
+			// packs works per 128-bit lane, put the quarters back in order
+			_mm256_storeu_si256((__m256i*)(out + 2 * n),
+				_mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8));
+		}
+	}
+	else if (Bytes == 3) {
+		const __m256i shuffle = _mm256_setr_epi8(
+			1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1,
+			1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1);
+
+		for (; n + 16 <= Count; n += 8) {
+			__m256i x = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(In + n)), shuffle);
+
+			// 12 bytes per lane, the second store overwrites the first's padding
+			_mm_storeu_si128((__m128i*)(out + 3 * n), _mm256_castsi256_si128(x));
+			_mm_storeu_si128((__m128i*)(out + 3 * n + 12), _mm256_extracti128_si256(x, 1));
+		}
+	}
+
+	gmax_pack_scalar(In + n, Count - n, Bytes, out + n * Bytes);
+}
+
+GMAX_DSP_TARGET_AVX2
+void
+gmax_unpack_avx2(
+	const void* In,
+	size_t Count,
+	unsigned Bytes,
+	int32_t* Out
+)
+{
+	const uint8_t* in = (const uint8_t*)In;
+	size_t n = 0;
+
+	if (Bytes == 4) {
+		memcpy(Out, In, Count * sizeof(int32_t));
+		return;
+	}
+
+	if (Bytes == 2) {
+		for (; n + 8 <= Count; n += 8) {
+			__m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(in + 2 * n)));
+
+			_mm256_storeu_si256((__m256i*)(Out + n), _mm256_slli_epi32(x, 16));
+		}
+	}
+	else if (Bytes == 3) {
+		const __m256i shuffle = _mm256_setr_epi8(
+			-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+			-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+
+		for (; n + 16 <= Count; n += 8) {
+			__m256i x = _mm256_inserti128_si256(
+				_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(in + 3 * n))),
+				_mm_loadu_si128((const __m128i*)(in + 3 * n + 12)),
+				1);
+
+			_mm256_storeu_si256((__m256i*)(Out + n), _mm256_shuffle_epi8(x, shuffle));
+		}
+	}
+
+	gmax_unpack_scalar(in + n * Bytes, Count - n, Bytes, Out + n);
+}
+
+#endif
+
+#ifdef GMAX_DSP_NEON
+
+void
+gmax_pack_neon(
+	const int32_t* In,
+	size_t Count,
+	unsigned Bytes,
+	void* Out
+)
+{
+	uint8_t* out = (uint8_t*)Out;
+	size_t n = 0;
+
+	if (Bytes == 4) {
+		memcpy(Out, In, Count * sizeof(int32_t));
+		return;
+	}
+
+	if (Bytes == 2) {
+		for (; n + 8 <= Count; n += 8) {
+			int16x8_t x = vcombine_s16(vshrn_n_s32(vld1q_s32(In + n), 16),
+				vshrn_n_s32(vld1q_s32(In + n + 4), 16));
+
+			vst1q_s16((int16_t*)(out + 2 * n), x);
+		}
+	}
+	else if (Bytes == 3) {
+		static const uint8_t shuffle[16] = {
+			1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, 0xFF, 0xFF, 0xFF, 0xFF
+		};
+		const uint8x16_t index = vld1q_u8(shuffle);
+
+		for (; n + 8 <= Count; n += 4) {
+			uint8x16_t x = vqtbl1q_u8(vreinterpretq_u8_s32(vld1q_s32(In + n)), index);
+
+			// 12 bytes, the next store overwrites the padding
+			vst1q_u8(out + 3 * n, x);
+		}
+	}
+
+	gmax_pack_scalar(In + n, Count - n, Bytes, out + n * Bytes);
+}
+
+void
+gmax_unpack_neon(
+	const void* In,
+	size_t Count,
+	unsigned Bytes,
+	int32_t* Out
+)
+{
+	const uint8_t* in = (const uint8_t*)In;
+	size_t n = 0;
+
+	if (Bytes == 4) {
+		memcpy(Out, In, Count * sizeof(int32_t));
+		return;
+	}
+
+	if (Bytes == 2) {
+		for (; n + 8 <= Count; n += 8) {
+			int16x8_t x = vld1q_s16((const int16_t*)(in + 2 * n));
+
+			vst1q_s32(Out + n, vshll_n_s16(vget_low_s16(x), 16));
+			vst1q_s32(Out + n + 4, vshll_n_s16(vget_high_s16(x), 16));
+		}
+	}
+	else if (Bytes == 3) {
+		static const uint8_t shuffle[16] = {
+			0xFF, 0, 1, 2, 0xFF, 3, 4, 5, 0xFF, 6, 7, 8, 0xFF, 9, 10, 11
+		};
+		const uint8x16_t index = vld1q_u8(shuffle);
+
+		for (; n + 8 <= Count; n += 4) {
+			uint8x16_t x = vqtbl1q_u8(vld1q_u8(in + 3 * n), index);
+
+			vst1q_s32(Out + n, vreinterpretq_s32_u8(x));
+		}
+	}
+
+	gmax_unpack_scalar(in + n * Bytes, Count - n, Bytes, Out + n);
+}
+
+#endif
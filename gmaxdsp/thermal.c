@@ -0,0 +1,138 @@
+/*++
+
+Module Name:
+
+thermal.c
+
+Abstract:
+
+Speaker thermal protection driven by the IV-sense Re estimate.
+
+The coil is modelled as one thermal mass: at constant power P it moves
+toward AmbientC + P * ThermalResistance with the coil time constant.
+Each block measures the temperature from Re (falling back to the model
+while Re is not yet known), predicts it HorizonMs ahead and works out
+the power that would land exactly on MaxC. Attenuation attacks at once
+to the level that brings power under that, and releases at
+ReleaseDbPerSec once there is headroom again. State is a few floats per
+amp and each update is O(1).
+
+The power estimate lags a gain change by the IV-sense smoothing, so
+attenuation added within the last MeasureLagMs is counted against what
+the next blocks ask for instead of being added again.
+
+--*/
+
+#include <math.h>
+
+#include "dsp_internal.h"
+
+#define GMAX_THERMAL_STEP 25	// AMP_VOL_CTRL step, 1/100 dB
+
+int
+gmax_thermal_init(
+	GMAX_THERMAL_STATE* State,
+	const GMAX_THERMAL_CONFIG* Config
+)
+{
+	if (Config->ReAmbient <= 0.0f ||
+		Config->TempCoefficient <= 0.0f ||
+		Config->ThermalResistance <= 0.0f ||
+		Config->TimeConstantMs <= 0.0f ||
+		Config->MaxC <= Config->AmbientC) {
+		return -1;
+	}
+
+	memset(State, 0, sizeof(*State));
+	State->Config = *Config;
+	for (unsigned a = 0; a < GMAX_DSP_MAX_AMPS; a++) {
+		State->Amp[a].TempC = Config->AmbientC;
+	}
+	return 0;
+}
+
+int32_t
+gmax_thermal_update(
+	GMAX_THERMAL_STATE* State,
+	unsigned Amp,
+	const GMAX_IV_ESTIMATE* Estimate,
+	float BlockMs,
+	int* Changed
+)
+{
+	const GMAX_THERMAL_CONFIG* config = &State->Config;
+	float* temp = &State->Amp[Amp].TempC;
+	float* atten = &State->Amp[Amp].AttenuationDb;
+	float* pending = &State->Amp[Amp].PendingDb;
+	float power = Estimate->Power > 0.0f ? Estimate->Power : 0.0f;
+	float rise = config->ThermalResistance;
+	float settle = 1.0f - expf(-config->HorizonMs / config->TimeConstantMs);
+	float predicted;
+	float allowed;
+	int32_t reported;
+
+	if (Estimate->Re > 0.0f) {
+		*temp = config->AmbientC +
+			(Estimate->Re / config->ReAmbient - 1.0f) / config->TempCoefficient;
+	}
+	else {
+		*temp += (config->AmbientC + power * rise - *temp) *
+			(1.0f - expf(-BlockMs / config->TimeConstantMs));
+	}
+
+	//
+	// Power that reaches MaxC exactly at the end of the horizon
+	//
+	predicted = *temp + (config->AmbientC + power * rise - *temp) * settle;
+	allowed = ((config->MaxC - *temp) / settle + (*temp - config->AmbientC)) / rise;
+
+	if (predicted > config->MaxC) {
+		float needed = allowed > 0.0f ?
+			10.0f * log10f(power / allowed) :
+			config->MaxAttenuationDb;
+
+		if (needed > *pending) {
+			*atten += needed - *pending;
+			*pending = needed;
+		}
+	}
+	else if (*atten > 0.0f) {
+		float headroom = power > 0.0f && allowed > 0.0f ?
+			10.0f * log10f(allowed / power) :
+			config->MaxAttenuationDb;
+		float release = config->ReleaseDbPerSec * BlockMs * 1e-3f;
+
+		*atten -= release < headroom ? release : headroom;
+	}
+
+	if (config->MeasureLagMs > BlockMs) {
+		*pending -= *pending * BlockMs / config->MeasureLagMs;
+	}
+	else {
+		*pending = 0.0f;
+	}
+
+	if (*atten < 0.0f) {
+		*atten = 0.0f;
+	}
+	if (*atten > config->MaxAttenuationDb) {
+		*atten = config->MaxAttenuationDb;
+	}
+
+	//
+	// Round up so the limit is never weaker than asked for
+	//
+	reported = (int32_t)ceilf(*atten * 100.0f / GMAX_THERMAL_STEP) * GMAX_THERMAL_STEP;
+	*Changed = reported != State->Amp[Amp].Reported;
+	State->Amp[Amp].Reported = reported;
+	return reported;
+}
+
+float
+gmax_thermal_temperature(
+	const GMAX_THERMAL_STATE* State,
+	unsigned Amp
+)
+{
+	return State->Amp[Amp].TempC;
+}
@@ -0,0 +1,336 @@
+/*++
+
+Module Name:
+
+bde.c
+
+Abstract:
+
+Brownout detection engine (BDE) profiles.
+
+Each profile is a complete image of the three BDE register runs,
+built at compile time, so applying one is at most three bursts. The
+image last written is kept, and a profile switch only writes the span
+of bytes that differ in each run. Switching between the AC and battery
+profiles is a couple of short bursts, cheap enough to do on every power
+source change.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+#include "max98512.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+POWER_SETTING_CALLBACK GmaxBdePowerSourceCallback;
+
+//
+// Engine control, BROWNOUT_EN..BROWNOUT_LVL_HOLD: enables, the level 4
+// infinite hold and its clear, and how long a level is held after VBAT
+// recovers
+//
+#define GMAX_BDE_CONTROL(Enable, InfiniteHold, InfiniteHoldClear, LevelHold) \
+	(Enable), (InfiniteHold), (InfiniteHoldClear), (LevelHold)
+
+#define GMAX_BDE_ENABLE (MAX98512_BROWNOUT_BDE_EN | MAX98512_BROWNOUT_AMP_EN)
+
+//
+// LVL1_THRESH..AMP1_CLIP_MODE: the VBAT code at which each level
+// engages (level 1 highest), the hysteresis before a level releases,
+// limiter and gain attack/release rates (attack in the high nibble) and
+// the clip mode
+//
+#define GMAX_BDE_THRESH(Lvl1, Lvl2, Lvl3, Lvl4, Hysteresis, LimiterAtkRel, GainAtkRel, ClipMode) \
+	(Lvl1), (Lvl2), (Lvl3), (Lvl4), (Hysteresis), (LimiterAtkRel), (GainAtkRel), (ClipMode)
+
+//
+// One brownout level, LVLn_CUR_LIMIT..LVLn_AMP1_CTRL3: boost current
+// limit code, amp attenuation code, limiter threshold code and the
+// limiter enable applied while the level is active
+//
+#define GMAX_BDE_LEVEL(CurLimit, Atten, LimThresh, Limiter) \
+	(CurLimit), (Atten), (LimThresh), (Limiter)
+
+#define GMAX_BDE_LIMITER_OFF 0x00
+#define GMAX_BDE_LIMITER_ON 0x01
+
+static const struct {
+	UINT16 Reg;
+	UINT16 Offset;
+	UINT16 Length;
+} GmaxBdeRuns[] = {
+	{ MAX98512_R0050_BROWNOUT_EN, FIELD_OFFSET(GMAX_BDE_IMAGE, Control), RTL_FIELD_SIZE(GMAX_BDE_IMAGE, Control) },
+	{ MAX98512_R0058_BROWNOUT_LVL1_THRESH, FIELD_OFFSET(GMAX_BDE_IMAGE, Thresh), RTL_FIELD_SIZE(GMAX_BDE_IMAGE, Thresh) },
+	{ MAX98512_R0070_BROWNOUT_LVL1_CUR_LIMIT, FIELD_OFFSET(GMAX_BDE_IMAGE, Level), RTL_FIELD_SIZE(GMAX_BDE_IMAGE, Level) },
+};
+
+static const GMAX_BDE_IMAGE GmaxBdeProfiles[GmaxBdeProfileMax] = {
+	//
+	// Off: engine disabled and every BDE register cleared to zero. These
+	// are not the chip's reset values; with BROWNOUT_EN clear the chip
+	// ignores them, and zero keeps the diff to the other profiles simple.
+	//
+	[GmaxBdeProfileOff] = {
+		.Control = { GMAX_BDE_CONTROL(0x00, 0x00, 0x00, 0x00) },
+		.Thresh = { GMAX_BDE_THRESH(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00) },
+		.Level = {
+			GMAX_BDE_LEVEL(0x00, 0x00, 0x00, GMAX_BDE_LIMITER_OFF),
+			GMAX_BDE_LEVEL(0x00, 0x00, 0x00, GMAX_BDE_LIMITER_OFF),
+			GMAX_BDE_LEVEL(0x00, 0x00, 0x00, GMAX_BDE_LIMITER_OFF),
+			GMAX_BDE_LEVEL(0x00, 0x00, 0x00, GMAX_BDE_LIMITER_OFF),
+		},
+	},
+	//
+	// AC: the supply is stiff, only catch deep sags. Attenuation only
+	// from level 2 and the limiter from level 3.
+	//
+	[GmaxBdeProfileAc] = {
+		.Control = { GMAX_BDE_CONTROL(GMAX_BDE_ENABLE, 0x00, 0x00, 0x10) },
+		.Thresh = { GMAX_BDE_THRESH(0x3C, 0x32, 0x28, 0x1E, 0x04, 0x24, 0x24, 0x00) },
+		.Level = {
+			GMAX_BDE_LEVEL(0x14, 0x00, 0x00, GMAX_BDE_LIMITER_OFF),
+			GMAX_BDE_LEVEL(0x12, 0x04, 0x00, GMAX_BDE_LIMITER_OFF),
+			GMAX_BDE_LEVEL(0x10, 0x08, 0x0C, GMAX_BDE_LIMITER_ON),
+			GMAX_BDE_LEVEL(0x0C, 0x0C, 0x10, GMAX_BDE_LIMITER_ON),
+		},
+	},
+	//
+	// Battery: start attenuating early and hold longer so loud
+	// transients don't pull VBAT under the system's UVLO. Every
+	// threshold is higher than on AC, with twice the hysteresis and a
+	// four times longer level hold.
+	//
+	[GmaxBdeProfileBattery] = {
+		.Control = { GMAX_BDE_CONTROL(GMAX_BDE_ENABLE, 0x00, 0x00, 0x40) },
+		.Thresh = { GMAX_BDE_THRESH(0x5A, 0x50, 0x46, 0x3C, 0x08, 0x12, 0x14, 0x00) },
+		.Level = {
+			GMAX_BDE_LEVEL(0x10, 0x04, 0x00, GMAX_BDE_LIMITER_OFF),
+			GMAX_BDE_LEVEL(0x0C, 0x08, 0x0C, GMAX_BDE_LIMITER_ON),
+			GMAX_BDE_LEVEL(0x08, 0x0C, 0x14, GMAX_BDE_LIMITER_ON),
+			GMAX_BDE_LEVEL(0x04, 0x18, 0x1C, GMAX_BDE_LIMITER_ON),
+		},
+	},
+};
+
+C_ASSERT(sizeof(GMAX_BDE_IMAGE) == GMAX_BDE_CONTROL_LEN + GMAX_BDE_THRESH_LEN + GMAX_BDE_LEVEL_LEN);
+
+static GMAX_BDE_PROFILE
+GmaxBdeActiveProfile(
+	_In_ GMAX_BDE* bde
+)
+{
+	if (bde->Requested == GmaxBdeProfileAuto) {
+		return bde->OnAc ? GmaxBdeProfileAc : GmaxBdeProfileBattery;
+	}
+	return bde->Requested;
+}
+
+static NTSTATUS
+GmaxBdeWrite(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ const GMAX_BDE_IMAGE* Image
+)
+/*++
+
+Routine Description:
+
+Writes the parts of Image that differ from what the chip holds, one
+burst per run covering the first to the last changed byte. The caller
+owns a register command.
+
+--*/
+{
+	GMAX_BDE* bde = &pDevice->Bde;
+	const UINT8* image = (const UINT8*)Image;
+	UINT8* applied = (UINT8*)&bde->Applied;
+	ULONG written = 0;
+	NTSTATUS status = STATUS_SUCCESS;
+
+	for (int i = 0; i < sizeof(GmaxBdeRuns) / sizeof(GmaxBdeRuns[0]); i++) {
+		const UINT8* want = image + GmaxBdeRuns[i].Offset;
+		UINT8* have = applied + GmaxBdeRuns[i].Offset;
+		int first = 0;
+		int last = GmaxBdeRuns[i].Length - 1;
+
+		if (bde->AppliedValid) {
+			while (first <= last && want[first] == have[first]) {
+				first++;
+			}
+			while (last >= first && want[last] == have[last]) {
+				last--;
+			}
+			if (first > last) {
+				continue;
+			}
+		}
+
+		status = gmax_reg_bulk_write(pDevice,
+			GmaxBdeRuns[i].Reg + first,
+			(PVOID)(want + first),
+			last - first + 1);
+		if (!NT_SUCCESS(status)) {
+			bde->AppliedValid = FALSE;
+			return status;
+		}
+
+		RtlCopyMemory(have + first, want + first, last - first + 1);
+		written += last - first + 1;
+	}
+
+	bde->AppliedValid = TRUE;
+
+	GmaxPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+		"BDE profile written, %d bytes\n", written);
+	return status;
+}
+
+VOID
+GmaxBdeInitialize(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	GMAX_BDE* bde = &pDevice->Bde;
+
+	//
+	// Assume battery until the power source is known, it is the safe
+	// choice on a phone.
+	//
+	bde->Requested = GmaxBdeProfileAuto;
+	bde->OnAc = FALSE;
+	bde->AppliedValid = FALSE;
+}
+
+NTSTATUS
+GmaxBdeApply(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Programs the active profile. Called by StartCodec, which already owns
+the power command.
+
+--*/
+{
+	GMAX_BDE* bde = &pDevice->Bde;
+
+	return GmaxBdeWrite(pDevice, &GmaxBdeProfiles[GmaxBdeActiveProfile(bde)]);
+}
+
+VOID
+GmaxBdeInvalidate(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	pDevice->Bde.AppliedValid = FALSE;
+}
+
+static NTSTATUS
+GmaxBdeRefresh(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+
+	if (!GmaxChipHas(pDevice, GMAX_CHIP_BDE)) {
+		return STATUS_NOT_SUPPORTED;
+	}
+
+	//
+	// Powered down, StartCodec picks up the new selection.
+	//
+	GmaxCmdBegin(pDevice, GmaxPriorityTuning);
+	if (pDevice->Codec.PoweredOn) {
+		status = GmaxBdeApply(pDevice);
+	}
+	GmaxCmdEnd(pDevice);
+
+	return status;
+}
+
+NTSTATUS
+GmaxBdeSetProfile(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ GMAX_BDE_PROFILE Profile
+)
+{
+	if ((UINT32)Profile > GmaxBdeProfileAuto) {
+		return STATUS_INVALID_PARAMETER;
+	}
+
+	pDevice->Bde.Requested = Profile;
+	return GmaxBdeRefresh(pDevice);
+}
+
+NTSTATUS
+GmaxBdePowerSourceCallback(
+	_In_ LPCGUID SettingGuid,
+	_In_reads_bytes_(ValueLength) PVOID Value,
+	_In_ ULONG ValueLength,
+	_Inout_opt_ PVOID Context
+)
+/*++
+
+Routine Description:
+
+GUID_ACDC_POWER_SOURCE notification. Also called once on registration
+with the current source.
+
+--*/
+{
+	PGMAX_CONTEXT pDevice = (PGMAX_CONTEXT)Context;
+	BOOLEAN onAc;
+
+	UNREFERENCED_PARAMETER(SettingGuid);
+
+	if (ValueLength != sizeof(ULONG) || !pDevice) {
+		return STATUS_SUCCESS;
+	}
+
+	onAc = *(ULONG*)Value == PoAc;
+	if (onAc == pDevice->Bde.OnAc) {
+		return STATUS_SUCCESS;
+	}
+
+	pDevice->Bde.OnAc = onAc;
+	GmaxPrint(DEBUG_LEVEL_INFO, DBG_PNP,
+		"Power source changed, on AC %d\n", onAc);
+
+	if (pDevice->Bde.Requested == GmaxBdeProfileAuto) {
+		GmaxBdeRefresh(pDevice);
+	}
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS
+GmaxBdeRegisterPowerSource(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	if (pDevice->Bde.PowerSourceHandle) {
+		return STATUS_SUCCESS;
+	}
+
+	return PoRegisterPowerSettingCallback(WdfDeviceWdmGetDeviceObject(pDevice->FxDevice),
+		&GUID_ACDC_POWER_SOURCE,
+		GmaxBdePowerSourceCallback,
+		pDevice,
+		&pDevice->Bde.PowerSourceHandle);
+}
+
+VOID
+GmaxBdeUnregisterPowerSource(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	if (pDevice->Bde.PowerSourceHandle) {
+		PoUnregisterPowerSettingCallback(pDevice->Bde.PowerSourceHandle);
+		pDevice->Bde.PowerSourceHandle = NULL;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+//
+// Brownout detection engine profiles
+//
+
+#include "max98512.h"
+
+//
+// The BDE registers are programmed as three auto-increment bursts. An
+// image is laid out in register order so each run is one contiguous
+// slice of it.
+//
+#define GMAX_BDE_CONTROL_LEN (MAX98512_R0053_BROWNOUT_LVL_HOLD - MAX98512_R0050_BROWNOUT_EN + 1)
+#define GMAX_BDE_THRESH_LEN (MAX98512_R005F_BROWNOUT_AMP1_CLIP_MODE - MAX98512_R0058_BROWNOUT_LVL1_THRESH + 1)
+#define GMAX_BDE_LEVEL_LEN (MAX98512_R007F_BROWNOUT_LVL4_AMP1_CTRL3 - MAX98512_R0070_BROWNOUT_LVL1_CUR_LIMIT + 1)
+
+typedef struct _GMAX_BDE_IMAGE
+{
+	UINT8 Control[GMAX_BDE_CONTROL_LEN];	// BROWNOUT_EN..BROWNOUT_LVL_HOLD
+	UINT8 Thresh[GMAX_BDE_THRESH_LEN];	// LVL1_THRESH..AMP1_CLIP_MODE
+	UINT8 Level[GMAX_BDE_LEVEL_LEN];	// LVL1_CUR_LIMIT..LVL4_AMP1_CTRL3
+} GMAX_BDE_IMAGE;
+
+typedef struct _GMAX_BDE
+{
+	PVOID PowerSourceHandle;
+
+	GMAX_BDE_PROFILE Requested;	// may be GmaxBdeProfileAuto
+	BOOLEAN OnAc;
+
+	//
+	// What the chip holds, only touched inside a register command.
+	// Invalid after a soft reset.
+	//
+	GMAX_BDE_IMAGE Applied;
+	BOOLEAN AppliedValid;
+} GMAX_BDE;
+
+struct _GMAX_CONTEXT;
+
+VOID
+GmaxBdeInitialize(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+NTSTATUS
+GmaxBdeRegisterPowerSource(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+VOID
+GmaxBdeUnregisterPowerSource(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+NTSTATUS
+GmaxBdeApply(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+VOID
+GmaxBdeInvalidate(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+NTSTATUS
+GmaxBdeSetProfile(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ GMAX_BDE_PROFILE Profile
+);
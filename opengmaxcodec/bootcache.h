@@ -0,0 +1,327 @@
+#pragma once
+
+//
+// Boot cache: the configuration resolved from ACPI (_UID, _HID and the
+// _DSD properties) and the init register image StartCodec writes from
+// it, persisted under the device's hardware key. Pure, with an explicit
+// little-endian encoding, so the host tool (tools/gmaxbootcache) can
+// round-trip and corrupt it exactly as the driver reads it.
+//
+
+#include "tdmslots.h"
+
+#define GMAX_BOOT_CACHE_MAGIC 0x43424D47	// "GMBC"
+
+//
+// Bump whenever the encoding or the meaning of a field changes
+//
+#define GMAX_BOOT_CACHE_VERSION 2
+
+#define GMAX_BOOT_CACHE_MAX_REGS 32
+#define GMAX_BOOT_CACHE_HID_LEN 8
+#define GMAX_BOOT_CACHE_HEADER 12	// magic, version, length, crc
+#define GMAX_BOOT_CACHE_BODY (4 * 6 + GMAX_BOOT_CACHE_HID_LEN + 5 + 2)
+#define GMAX_BOOT_CACHE_MAX_SIZE (GMAX_BOOT_CACHE_HEADER + GMAX_BOOT_CACHE_BODY + 3 * GMAX_BOOT_CACHE_MAX_REGS)
+
+typedef enum {
+	GmaxBootCacheOk,
+	GmaxBootCacheTruncated,
+	GmaxBootCacheBadMagic,
+	GmaxBootCacheBadVersion,
+	GmaxBootCacheBadLength,
+	GmaxBootCacheBadChecksum,
+	GmaxBootCacheBadImage
+} GMAX_BOOT_CACHE_RESULT;
+
+typedef struct _GMAX_BOOT_REG
+{
+	uint16_t Reg;
+	uint8_t Value;
+	uint8_t Reserved;
+} GMAX_BOOT_REG;
+
+typedef struct _GMAX_BOOT_CONFIG
+{
+	//
+	// Validation key, all known before any firmware evaluation: the
+	// I2C connection ID from the resource list, a hash of the driver's
+	// own init table, and a hash of the firmware identity read in
+	// DriverEntry (BIOS version and date, FADT OEM revision), so a
+	// firmware update that changes _DSD rediscovers
+	//
+	uint32_t ConnectionLow;
+	uint32_t ConnectionHigh;
+	uint32_t TableHash;
+	uint32_t FirmwareHash;
+
+	int32_t Uid;
+	uint32_t ChipModel;
+	uint8_t Hid[GMAX_BOOT_CACHE_HID_LEN];	// not terminated when full
+	uint8_t RevId;				// 0 until read from the chip
+	uint8_t Interleave;
+	uint8_t VmonSlot;
+	uint8_t ImonSlot;
+	uint8_t DsdDefaults;			// _DSD was missing, slots are the UID defaults
+
+	uint16_t RegCount;
+	GMAX_BOOT_REG Image[GMAX_BOOT_CACHE_MAX_REGS];	// ascending register order
+} GMAX_BOOT_CONFIG;
+
+static __inline uint32_t
+GmaxBootCrc32(
+	const uint8_t* Data,
+	uint32_t Length
+)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	for (uint32_t i = 0; i < Length; i++) {
+		crc ^= Data[i];
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+		}
+	}
+	return ~crc;
+}
+
+static __inline uint32_t
+GmaxBootHashTable(
+	const GMAX_BOOT_REG* Table,
+	uint32_t Count
+)
+{
+	uint32_t hash = 0;
+
+	for (uint32_t i = 0; i < Count; i++) {
+		uint8_t entry[3] = { (uint8_t)(Table[i].Reg >> 8), (uint8_t)Table[i].Reg, Table[i].Value };
+
+		hash = GmaxBootCrc32(entry, sizeof(entry)) ^ (hash * 31);
+	}
+	return hash;
+}
+
+//
+// Inserts or replaces one register, keeping the image sorted
+//
+static __inline int
+GmaxBootImageSet(
+	GMAX_BOOT_CONFIG* Config,
+	uint16_t Reg,
+	uint8_t Value
+)
+{
+	uint32_t i = 0;
+
+	while (i < Config->RegCount && Config->Image[i].Reg < Reg) {
+		i++;
+	}
+
+	if (i < Config->RegCount && Config->Image[i].Reg == Reg) {
+		Config->Image[i].Value = Value;
+		return 1;
+	}
+
+	if (Config->RegCount >= GMAX_BOOT_CACHE_MAX_REGS) {
+		return 0;
+	}
+
+	for (uint32_t j = Config->RegCount; j > i; j--) {
+		Config->Image[j] = Config->Image[j - 1];
+	}
+	Config->Image[i].Reg = Reg;
+	Config->Image[i].Value = Value;
+	Config->Image[i].Reserved = 0;
+	Config->RegCount++;
+	return 1;
+}
+
+//
+// The init image StartCodec writes for a resolved configuration: the
+// chip's static init table, then, on chips with the MAX98512 PCM
+// block, the IV-sense slot routing and mono mix that depend on _UID
+// and _DSD
+//
+static __inline int
+GmaxBootBuildImage(
+	GMAX_BOOT_CONFIG* Config,
+	const GMAX_BOOT_REG* Table,
+	uint32_t Count,
+	int IvRouting,
+	int32_t RightSpeaker
+)
+{
+	uint8_t slotMap[GMAX_TX_SLOT_MAP_LEN];
+	int ok = 1;
+
+	Config->RegCount = 0;
+	for (uint32_t i = 0; i < Count; i++) {
+		ok &= GmaxBootImageSet(Config, Table[i].Reg, Table[i].Value);
+	}
+
+	if (!IvRouting) {
+		return ok;
+	}
+
+	GmaxBuildTxSlotMap(Config->VmonSlot, Config->ImonSlot, Config->Interleave, slotMap);
+	for (uint32_t i = 0; i < GMAX_TX_SLOT_MAP_LEN; i++) {
+		ok &= GmaxBootImageSet(Config, (uint16_t)(GMAX_TX_SLOT_MAP_FIRST + i), slotMap[i]);
+	}
+
+	ok &= GmaxBootImageSet(Config, MAX98512_R0024_PCM_SR_SETUP2, Config->Interleave ? 0x85 : 0x88);
+	ok &= GmaxBootImageSet(Config, MAX98512_R0025_PCM_TO_SPK_MONOMIX_A, Config->Uid == RightSpeaker ? 0x40 : 0);
+	ok &= GmaxBootImageSet(Config, MAX98512_R0026_PCM_TO_SPK_MONOMIX_B, 1);
+	return ok;
+}
+
+static __inline void
+GmaxBootPut16(
+	uint8_t** Cursor,
+	uint32_t Value
+)
+{
+	(*Cursor)[0] = (uint8_t)Value;
+	(*Cursor)[1] = (uint8_t)(Value >> 8);
+	*Cursor += 2;
+}
+
+static __inline void
+GmaxBootPut32(
+	uint8_t** Cursor,
+	uint32_t Value
+)
+{
+	GmaxBootPut16(Cursor, Value & 0xFFFF);
+	GmaxBootPut16(Cursor, Value >> 16);
+}
+
+static __inline uint32_t
+GmaxBootGet16(
+	const uint8_t** Cursor
+)
+{
+	uint32_t value = (uint32_t)(*Cursor)[0] | ((uint32_t)(*Cursor)[1] << 8);
+
+	*Cursor += 2;
+	return value;
+}
+
+static __inline uint32_t
+GmaxBootGet32(
+	const uint8_t** Cursor
+)
+{
+	uint32_t low = GmaxBootGet16(Cursor);
+
+	return low | (GmaxBootGet16(Cursor) << 16);
+}
+
+//
+// Returns the encoded size, 0 if Capacity is too small
+//
+static __inline uint32_t
+GmaxBootCacheEncode(
+	const GMAX_BOOT_CONFIG* Config,
+	uint8_t* Buffer,
+	uint32_t Capacity
+)
+{
+	uint32_t size = GMAX_BOOT_CACHE_HEADER + GMAX_BOOT_CACHE_BODY + 3u * Config->RegCount;
+	uint8_t* cursor = Buffer;
+
+	if (Config->RegCount > GMAX_BOOT_CACHE_MAX_REGS || Capacity < size) {
+		return 0;
+	}
+
+	GmaxBootPut32(&cursor, GMAX_BOOT_CACHE_MAGIC);
+	GmaxBootPut16(&cursor, GMAX_BOOT_CACHE_VERSION);
+	GmaxBootPut16(&cursor, size);
+	GmaxBootPut32(&cursor, 0);		// crc, filled in last
+
+	GmaxBootPut32(&cursor, Config->ConnectionLow);
+	GmaxBootPut32(&cursor, Config->ConnectionHigh);
+	GmaxBootPut32(&cursor, Config->TableHash);
+	GmaxBootPut32(&cursor, Config->FirmwareHash);
+	GmaxBootPut32(&cursor, (uint32_t)Config->Uid);
+	GmaxBootPut32(&cursor, Config->ChipModel);
+	for (int i = 0; i < GMAX_BOOT_CACHE_HID_LEN; i++) {
+		*cursor++ = Config->Hid[i];
+	}
+	*cursor++ = Config->RevId;
+	*cursor++ = Config->Interleave;
+	*cursor++ = Config->VmonSlot;
+	*cursor++ = Config->ImonSlot;
+	*cursor++ = Config->DsdDefaults;
+	GmaxBootPut16(&cursor, Config->RegCount);
+
+	for (uint32_t i = 0; i < Config->RegCount; i++) {
+		GmaxBootPut16(&cursor, Config->Image[i].Reg);
+		*cursor++ = Config->Image[i].Value;
+	}
+
+	cursor = Buffer + 8;
+	GmaxBootPut32(&cursor, GmaxBootCrc32(Buffer + GMAX_BOOT_CACHE_HEADER, size - GMAX_BOOT_CACHE_HEADER));
+	return size;
+}
+
+static __inline GMAX_BOOT_CACHE_RESULT
+GmaxBootCacheDecode(
+	const uint8_t* Buffer,
+	uint32_t Length,
+	GMAX_BOOT_CONFIG* Config
+)
+{
+	const uint8_t* cursor = Buffer;
+	uint32_t size;
+	uint32_t crc;
+
+	if (Length < GMAX_BOOT_CACHE_HEADER + GMAX_BOOT_CACHE_BODY) {
+		return GmaxBootCacheTruncated;
+	}
+	if (GmaxBootGet32(&cursor) != GMAX_BOOT_CACHE_MAGIC) {
+		return GmaxBootCacheBadMagic;
+	}
+	if (GmaxBootGet16(&cursor) != GMAX_BOOT_CACHE_VERSION) {
+		return GmaxBootCacheBadVersion;
+	}
+	size = GmaxBootGet16(&cursor);
+	if (size != Length) {
+		return GmaxBootCacheBadLength;
+	}
+	crc = GmaxBootGet32(&cursor);
+	if (crc != GmaxBootCrc32(Buffer + GMAX_BOOT_CACHE_HEADER, size - GMAX_BOOT_CACHE_HEADER)) {
+		return GmaxBootCacheBadChecksum;
+	}
+
+	Config->ConnectionLow = GmaxBootGet32(&cursor);
+	Config->ConnectionHigh = GmaxBootGet32(&cursor);
+	Config->TableHash = GmaxBootGet32(&cursor);
+	Config->FirmwareHash = GmaxBootGet32(&cursor);
+	Config->Uid = (int32_t)GmaxBootGet32(&cursor);
+	Config->ChipModel = GmaxBootGet32(&cursor);
+	for (int i = 0; i < GMAX_BOOT_CACHE_HID_LEN; i++) {
+		Config->Hid[i] = *cursor++;
+	}
+	Config->RevId = *cursor++;
+	Config->Interleave = *cursor++;
+	Config->VmonSlot = *cursor++;
+	Config->ImonSlot = *cursor++;
+	Config->DsdDefaults = *cursor++;
+	Config->RegCount = (uint16_t)GmaxBootGet16(&cursor);
+
+	if (Config->RegCount > GMAX_BOOT_CACHE_MAX_REGS ||
+		size != GMAX_BOOT_CACHE_HEADER + GMAX_BOOT_CACHE_BODY + 3u * Config->RegCount) {
+		return GmaxBootCacheBadLength;
+	}
+
+	for (uint32_t i = 0; i < Config->RegCount; i++) {
+		Config->Image[i].Reg = (uint16_t)GmaxBootGet16(&cursor);
+		Config->Image[i].Value = *cursor++;
+		Config->Image[i].Reserved = 0;
+
+		if (i > 0 && Config->Image[i].Reg <= Config->Image[i - 1].Reg) {
+			return GmaxBootCacheBadImage;
+		}
+	}
+
+	return GmaxBootCacheOk;
+}
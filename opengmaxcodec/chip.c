@@ -0,0 +1,97 @@
+/*++
+
+Module Name:
+
+chip.c
+
+Abstract:
+
+Chip selection. Each supported amp has its own operations table in
+max98512.c, max98927.c and max98373.c: the init register table, the
+register descriptors the generic modules use, and its power and
+monitor implementations. The table is picked once, from _HID on first
+start or from the model in the boot cache, and stored in the device
+context.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+
+static const GMAX_CHIP_OPS* const GmaxChips[] = {
+	&GmaxMax98512Ops,
+	&GmaxMax98927Ops,
+	&GmaxMax98373Ops
+};
+
+const GMAX_CHIP_OPS*
+GmaxChipFromHid(
+	_In_reads_(Length) const char* Hid,
+	_In_ ULONG Length
+)
+{
+	for (ULONG i = 0; i < ARRAYSIZE(GmaxChips); i++) {
+		size_t hidLength = strlen(GmaxChips[i]->Hid);
+
+		//
+		// ACPI strings include the terminator in DataLength
+		//
+		if (Length >= hidLength && strncmp(Hid, GmaxChips[i]->Hid, hidLength) == 0 &&
+			(Length == hidLength || Hid[hidLength] == '\0')) {
+			return GmaxChips[i];
+		}
+	}
+	return NULL;
+}
+
+const GMAX_CHIP_OPS*
+GmaxChipFromModel(
+	_In_ UINT32 Model
+)
+{
+	for (ULONG i = 0; i < ARRAYSIZE(GmaxChips); i++) {
+		if (GmaxChips[i]->Model == Model) {
+			return GmaxChips[i];
+		}
+	}
+	return NULL;
+}
+
+UINT32
+GmaxChipTableHash(
+	VOID
+)
+/*++
+
+Routine Description:
+
+Hash of every chip's init table for the boot cache key, so changing
+any table makes cached images rediscover.
+
+--*/
+{
+	UINT32 hash = 0;
+
+	for (ULONG i = 0; i < ARRAYSIZE(GmaxChips); i++) {
+		hash = GmaxBootHashTable(GmaxChips[i]->InitRegs, GmaxChips[i]->InitCount) ^
+			(hash * 31) ^ GmaxChips[i]->Model;
+	}
+	return hash;
+}
+
+UINT8
+GmaxChipInitValue(
+	_In_ const GMAX_CHIP_OPS* Chip,
+	_In_ UINT16 Reg
+)
+{
+	for (UINT32 i = 0; i < Chip->InitCount; i++) {
+		if (Chip->InitRegs[i].Reg == Reg) {
+			return Chip->InitRegs[i].Value;
+		}
+	}
+	return 0;
+}
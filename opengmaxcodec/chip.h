@@ -0,0 +1,104 @@
+#pragma once
+
+//
+// Per-chip operations for the supported Maxim amps, selected once from
+// _HID (or the boot cache) so the start, power and telemetry paths call
+// straight into the right implementation
+//
+
+//
+// Optional blocks the driver drives on a chip
+//
+#define GMAX_CHIP_IV_ROUTING	0x01	// MAX98512 PCM TX slot map, SR_SETUP2 and mono mix
+#define GMAX_CHIP_INTERRUPTS	0x02	// MAX98512 INT_FLAG / INT_EN / IRQ_CTRL layout
+#define GMAX_CHIP_VOLUME	0x04	// AMP_VOL_CTRL in the MAX98512 0.25 dB scale
+#define GMAX_CHIP_BDE		0x08	// MAX98512 brownout register block
+#define GMAX_CHIP_CLOCK_MONITOR	0x10	// CLK_MON enabled, CLK_ERR / CLK_RECOVER interrupts
+
+//
+// Every supported amp resets on bit 0 of its reset register, and has
+// GLOBAL_EN and AMP_EN in bit 0
+//
+#define GMAX_CHIP_SOFT_RESET 0x01
+#define GMAX_CHIP_ENABLE 0x01
+
+//
+// Register descriptor table, addresses the generic modules need
+//
+typedef struct _GMAX_CHIP_REGS
+{
+	UINT16 RevId;
+	UINT16 SoftReset;
+	UINT16 GlobalEnable;
+	UINT16 AmpEnable;
+	UINT16 PcmModeCfg;	// CHANSZ in bits 7:6 on every chip
+	UINT16 ThermWarnThresh;	// in the Therm code the monitor reads
+	UINT16 AmpVolume;	// GMAX_CHIP_VOLUME
+	UINT16 SpeakerGain;	// GMAX_CHIP_VOLUME
+} GMAX_CHIP_REGS;
+
+//
+// Register map, the address ranges a chip decodes. Register statistics
+// and the shadow give every register in it a slot of its own; at most
+// GMAX_REG_IMAGE_RANGES ranges and GMAX_REG_IMAGE_COUNT registers.
+//
+typedef struct _GMAX_CHIP_REG_MAP
+{
+	const GMAX_REG_RANGE* Ranges;
+	UINT32 Count;
+} GMAX_CHIP_REG_MAP;
+
+struct _GMAX_CONTEXT;
+
+typedef NTSTATUS
+GMAX_CHIP_READ_MONITOR(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_Out_ GMAX_MONITOR_SAMPLE* Sample
+);
+
+typedef struct _GMAX_CHIP_OPS
+{
+	UINT32 Model;
+	const char* Hid;
+	ULONG Features;
+	GMAX_CHIP_REGS Regs;
+	GMAX_CHIP_REG_MAP RegMap;
+
+	const GMAX_BOOT_REG* InitRegs;	// before IV routing, see GmaxBootBuildImage
+	UINT32 InitCount;
+
+	const GMAX_POWER_STEP* PowerUp;		// GLOBAL_EN through AMP_EN
+	UINT32 PowerUpCount;
+	const GMAX_POWER_STEP* PowerDown;	// no settle times, see GmaxPowerDown
+	UINT32 PowerDownCount;
+
+	GMAX_CHIP_READ_MONITOR* ReadMonitor;
+} GMAX_CHIP_OPS;
+
+extern const GMAX_CHIP_OPS GmaxMax98512Ops;
+extern const GMAX_CHIP_OPS GmaxMax98927Ops;
+extern const GMAX_CHIP_OPS GmaxMax98373Ops;
+
+#define GmaxChipHas(pDevice, feature) (((pDevice)->Chip->Features & (feature)) != 0)
+
+const GMAX_CHIP_OPS*
+GmaxChipFromHid(
+	_In_reads_(Length) const char* Hid,
+	_In_ ULONG Length
+);
+
+const GMAX_CHIP_OPS*
+GmaxChipFromModel(
+	_In_ UINT32 Model
+);
+
+UINT32
+GmaxChipTableHash(
+	VOID
+);
+
+UINT8
+GmaxChipInitValue(
+	_In_ const GMAX_CHIP_OPS* Chip,
+	_In_ UINT16 Reg
+);
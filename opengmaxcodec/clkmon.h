@@ -0,0 +1,58 @@
+#pragma once
+
+//
+// Clock-loss recovery decisions. Pure so the host clock simulator
+// (tools/gmaxclocksim) runs exactly what clock.c runs.
+//
+// With CLK_MON enabled the amp flags CLK_ERR when BCLK/LRCLK stop and
+// CLK_RECOVER when they come back. The driver mutes with AMP_EN on the
+// first and, on the second, re-enables with as few writes as the chip
+// state allows. Every configured register survives a clock stop.
+//
+
+typedef enum {
+	GmaxClockRunning,
+	GmaxClockLost
+} GMAX_CLOCK_STATE;
+
+//
+// Registers read back when the clock returns
+//
+#define GMAX_CLOCK_RECOVERY_READS 2	// sentinel, GLOBAL_SHDN
+
+//
+// An amp that resets while the clock is gone loses IRQ_CTRL with the
+// rest of the image and never raises CLK_RECOVER. While the clock is
+// lost the driver reads the sentinel this often and restarts the codec
+// when it changed, instead of waiting for an interrupt that is not
+// coming.
+//
+#define GMAX_CLOCK_POLL_MS 50
+
+typedef enum {
+	GmaxClockAmpEnable,	// AMP_EN only
+	GmaxClockPowerUp,	// GLOBAL_EN dropped, run the power-up sequence
+	GmaxClockRestart	// the amp reset while the clock was gone
+} GMAX_CLOCK_PLAN;
+
+//
+// Sentinel is a register from the written image (PCM_MODE_CFG) that
+// the chip only loses on a reset. When it still holds the image value
+// the rest of the image does too.
+//
+static __inline GMAX_CLOCK_PLAN
+GmaxClockRecoveryPlan(
+	uint8_t Sentinel,
+	uint8_t ExpectedSentinel,
+	uint8_t GlobalShdn,
+	uint8_t GlobalEnableMask
+)
+{
+	if (Sentinel != ExpectedSentinel) {
+		return GmaxClockRestart;
+	}
+	if (!(GlobalShdn & GlobalEnableMask)) {
+		return GmaxClockPowerUp;
+	}
+	return GmaxClockAmpEnable;
+}
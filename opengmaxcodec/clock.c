@@ -0,0 +1,242 @@
+/*++
+
+Module Name:
+
+clock.c
+
+Abstract:
+
+Clock-loss handling for chips with a clock monitor. The DSP stops
+BCLK/LRCLK between streams; CLK_ERR mutes the amp with one AMP_EN
+write and CLK_RECOVER brings it back without a reset, reading back a
+sentinel and GLOBAL_SHDN to decide how little to write (clkmon.h).
+Only an amp that reset while the clock was gone goes through the full
+recovery path. Such an amp has lost IRQ_CTRL too, so while the clock
+is lost a timer polls the sentinel and starts that path itself.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+EVT_WDF_TIMER GmaxEvtClockTimer;
+
+static UINT8
+GmaxClockSentinel(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+PCM_MODE_CFG as StartCodec wrote it.
+
+--*/
+{
+	const GMAX_TUNING_IMAGE* image = &pDevice->Tuning.Image;
+	ULONG index;
+
+	if (GmaxTuningFind(image, pDevice->Chip->Regs.PcmModeCfg, &index)) {
+		return image->Value[index];
+	}
+	return 0;
+}
+
+VOID
+GmaxEvtClockTimer(
+	_In_ WDFTIMER Timer
+)
+/*++
+
+Routine Description:
+
+Reads the sentinel while the clock is lost. Unchanged, the amp still
+has its image and IRQ_CTRL and CLK_RECOVER will come, so it polls
+again. Changed, or unreadable, the amp is handed to a recovery pass,
+which rewrites everything and re-enables the interrupts.
+
+--*/
+{
+	PGMAX_CONTEXT pDevice = GetDeviceContext(WdfTimerGetParentObject(Timer));
+	GMAX_CLOCK* clock = &pDevice->Clock;
+	UINT8 sentinel = 0;
+	GMAX_CODEC_NEXT next;
+	NTSTATUS status;
+
+	GmaxCmdBegin(pDevice, GmaxPriorityPower);
+	if (!GmaxCodecClockLost(&pDevice->Codec)) {
+		GmaxCmdEnd(pDevice);
+		return;
+	}
+
+	status = gmax_reg_read(pDevice, pDevice->Chip->Regs.PcmModeCfg, &sentinel);
+	next = GmaxCodecClockPolled(&pDevice->Codec, NT_SUCCESS(status), sentinel, GmaxClockSentinel(pDevice));
+	if (next == GmaxCodecPoll) {
+		GmaxCmdEnd(pDevice);
+		WdfTimerStart(clock->Timer, WDF_REL_TIMEOUT_IN_MS(GMAX_CLOCK_POLL_MS));
+		return;
+	}
+
+	clock->Restarts++;
+	clock->PollRestarts++;
+	GmaxCmdEnd(pDevice);
+
+	GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+		"Amp reset while the clock was lost (0x%x), restarting the codec\n", status);
+
+	GmaxRecoveryNext(pDevice, next);
+}
+
+NTSTATUS
+GmaxClockInitialize(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	WDF_TIMER_CONFIG timerConfig;
+	WDF_OBJECT_ATTRIBUTES attributes;
+
+	WDF_TIMER_CONFIG_INIT(&timerConfig, GmaxEvtClockTimer);
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+	attributes.ExecutionLevel = WdfExecutionLevelPassive;
+
+	return WdfTimerCreate(&timerConfig, &attributes, &pDevice->Clock.Timer);
+}
+
+VOID
+GmaxClockStop(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Stops the sentinel poll. Called before taking the power command, the
+poll may be waiting for it.
+
+--*/
+{
+	if (!pDevice->Clock.Timer) {
+		return;
+	}
+
+	WdfTimerStop(pDevice->Clock.Timer, TRUE);
+}
+
+VOID
+GmaxClockHandleLoss(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Mutes on CLK_ERR. The clock monitor has already stopped the amp, the
+AMP_EN write keeps it from coming back on its own before the driver
+has checked its state. Starts the sentinel poll, the fallback for a
+CLK_RECOVER that never comes.
+
+--*/
+{
+	GMAX_CLOCK* clock = &pDevice->Clock;
+	NTSTATUS status;
+
+	GmaxCmdBegin(pDevice, GmaxPriorityPower);
+	if (!GmaxCodecClockLoss(&pDevice->Codec)) {
+		GmaxCmdEnd(pDevice);
+		return;
+	}
+
+	status = gmax_reg_write(pDevice, pDevice->Chip->Regs.AmpEnable, 0);
+	clock->LostAt = KeQueryInterruptTimePrecise(NULL);
+	clock->Losses++;
+	WdfTimerStart(clock->Timer, WDF_REL_TIMEOUT_IN_MS(GMAX_CLOCK_POLL_MS));
+	GmaxCmdEnd(pDevice);
+
+	if (!NT_SUCCESS(status)) {
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Unable to mute on clock loss 0x%x\n", status);
+	}
+}
+
+VOID
+GmaxClockHandleRecovery(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Re-enables the amp on CLK_RECOVER: AMP_EN alone when the amp is still
+globally enabled, the chip's power-up sequence when it dropped
+GLOBAL_EN, and a recovery pass (soft reset and StartCodec) when the
+sentinel shows the image is gone.
+
+--*/
+{
+	GMAX_CLOCK* clock = &pDevice->Clock;
+	const GMAX_CHIP_REGS* regs = &pDevice->Chip->Regs;
+	ULONGLONG start = KeQueryInterruptTimePrecise(NULL);
+	GMAX_CLOCK_PLAN plan = GmaxClockRestart;
+	UINT8 sentinel = 0;
+	UINT8 global = 0;
+	GMAX_CODEC_NEXT next;
+	ULONG elapsedUs;
+	NTSTATUS status;
+
+	GmaxCmdBegin(pDevice, GmaxPriorityPower);
+	if (!GmaxCodecClockLost(&pDevice->Codec)) {
+		GmaxCmdEnd(pDevice);
+		return;
+	}
+
+	status = gmax_reg_read(pDevice, regs->PcmModeCfg, &sentinel);
+	if (NT_SUCCESS(status)) {
+		status = gmax_reg_read(pDevice, regs->GlobalEnable, &global);
+	}
+	if (NT_SUCCESS(status)) {
+		plan = GmaxClockRecoveryPlan(sentinel, GmaxClockSentinel(pDevice), global, GMAX_CHIP_ENABLE);
+	}
+
+	switch (plan) {
+	case GmaxClockAmpEnable:
+		status = gmax_reg_write(pDevice, regs->AmpEnable, GMAX_CHIP_ENABLE);
+		break;
+	case GmaxClockPowerUp:
+		status = GmaxPowerUp(pDevice, NULL);
+		break;
+	default:
+		status = STATUS_DEVICE_DATA_ERROR;
+		break;
+	}
+
+	next = GmaxCodecClockRecovered(&pDevice->Codec, NT_SUCCESS(status));
+	GmaxCmdEnd(pDevice);
+
+	if (next != GmaxCodecNone) {
+		//
+		// Same path as a bus fault, from a soft reset
+		//
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Clock recovery plan %d failed 0x%x, restarting the codec\n", plan, status);
+		clock->Restarts++;
+		GmaxRecoveryNext(pDevice, next);
+		return;
+	}
+
+	elapsedUs = (ULONG)min((KeQueryInterruptTimePrecise(NULL) - start) / 10, MAXULONG);
+	clock->Recoveries++;
+	clock->LastRecoveryUs = elapsedUs;
+	clock->MaxRecoveryUs = max(clock->MaxRecoveryUs, elapsedUs);
+
+	GmaxPrint(DEBUG_LEVEL_INFO, DBG_PNP,
+		"Clock recovered (plan %d) in %u us, lost for %llu ms\n",
+		plan, elapsedUs, (start - clock->LostAt) / 10000);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+//
+// Clock-loss mute and fast recovery, see clkmon.h. Whether the clock is
+// lost is codec state, GMAX_CODEC_STATE.Clock.
+//
+
+typedef struct _GMAX_CLOCK
+{
+	ULONGLONG LostAt;		// interrupt time, 100ns
+	WDFTIMER Timer;			// sentinel poll while lost, PASSIVE_LEVEL
+
+	ULONG Losses;
+	ULONG Recoveries;		// AMP_EN or power-up only
+	ULONG Restarts;			// handed to a full StartCodec
+	ULONG PollRestarts;		// of those, found by the poll
+	ULONG LastRecoveryUs;		// CLK_RECOVER service to AMP_EN written
+	ULONG MaxRecoveryUs;
+} GMAX_CLOCK;
+
+struct _GMAX_CONTEXT;
+
+NTSTATUS
+GmaxClockInitialize(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+VOID
+GmaxClockStop(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+VOID
+GmaxClockHandleLoss(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+VOID
+GmaxClockHandleRecovery(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
@@ -0,0 +1,256 @@
+#pragma once
+
+//
+// Codec power state and the decisions StartCodec, StopCodec, OnD0Entry,
+// OnD0Exit, the recovery pass (recovery.c) and the clock-loss handlers
+// (clock.c) make on it. Pure so the host soak (tools/gmaxsoak) runs
+// exactly what the driver runs: the callers do the bus I/O and the
+// timers, everything they decide from is here.
+//
+
+#include "clkmon.h"
+
+//
+// Longest OnD0Entry or StopCodec may spend on the bus (the codec
+// start is then handed to recovery), and the bound on one recovery pass
+//
+#define GMAX_RESUME_DEADLINE_MS 100
+#define GMAX_RECOVERY_DEADLINE_MS 200
+
+//
+// Passes spent on a failed power-down after OnD0Exit. Past that the
+// reset is left to the next StartCodec.
+//
+#define GMAX_RECOVERY_DX_ATTEMPTS 3
+
+typedef struct _GMAX_CODEC_STATE
+{
+	uint8_t D0Active;	// the codec should be running
+	uint8_t NeedsReset;	// a power-down failed, the amp may still be on
+	uint8_t PoweredOn;	// StartCodec got as far as the power-up
+	GMAX_CLOCK_STATE Clock;
+	uint32_t DxAttempts;	// recovery passes since OnD0Exit
+} GMAX_CODEC_STATE;
+
+//
+// StartCodec, in order. Chips without a block skip its step.
+//
+typedef enum {
+	GmaxCodecStepReset,		// power down an amp a failed power-down left on
+	GmaxCodecStepRevId,
+	GmaxCodecStepTuning,
+	GmaxCodecStepVolume,
+	GmaxCodecStepBde,
+	GmaxCodecStepInterrupts,
+	GmaxCodecStepPowerUp,
+	GmaxCodecStepDone
+} GMAX_CODEC_STEP;
+
+//
+// What the caller does once a handler is done with the bus
+//
+typedef enum {
+	GmaxCodecNone,
+	GmaxCodecRetry,		// GmaxRecoveryRetry, a pass after the breaker cooldown
+	GmaxCodecRestart,	// a recovery pass straight away
+	GmaxCodecPoll		// read the sentinel again in GMAX_CLOCK_POLL_MS
+} GMAX_CODEC_NEXT;
+
+static __inline GMAX_CODEC_STEP
+GmaxCodecStartFirst(
+	const GMAX_CODEC_STATE* State
+)
+{
+	return State->NeedsReset ? GmaxCodecStepReset : GmaxCodecStepRevId;
+}
+
+//
+// Records the outcome of Step and returns the next one, or
+// GmaxCodecStepDone when StartCodec returns. A failed step ends the
+// start with the codec still off. The clock is assumed running from
+// the power-up on, and the codec counts as on once the power-up has
+// been started, whether or not it then fails: a failure is the power
+// work item's to hand to recovery.
+//
+static __inline GMAX_CODEC_STEP
+GmaxCodecStartStep(
+	GMAX_CODEC_STATE* State,
+	GMAX_CODEC_STEP Step,
+	int Ok
+)
+{
+	if (Step == GmaxCodecStepPowerUp) {
+		State->PoweredOn = 1;
+		return GmaxCodecStepDone;
+	}
+	if (!Ok) {
+		return GmaxCodecStepDone;
+	}
+	if (Step == GmaxCodecStepReset) {
+		State->NeedsReset = 0;
+	}
+
+	Step = (GMAX_CODEC_STEP)(Step + 1);
+	if (Step == GmaxCodecStepPowerUp) {
+		State->Clock = GmaxClockRunning;
+	}
+	return Step;
+}
+
+//
+// StopCodec's power-down finished. The codec is stopped either way; an
+// amp that may still be playing is marked for a reset and handed to
+// recovery.
+//
+static __inline GMAX_CODEC_NEXT
+GmaxCodecStopped(
+	GMAX_CODEC_STATE* State,
+	int Ok
+)
+{
+	State->PoweredOn = 0;
+	State->NeedsReset = !Ok;
+	return Ok ? GmaxCodecNone : GmaxCodecRetry;
+}
+
+static __inline void
+GmaxCodecD0Entry(
+	GMAX_CODEC_STATE* State
+)
+{
+	State->D0Active = 1;
+}
+
+//
+// A bus that is not answering must not hold up resume, the codec is
+// started in the background once it recovers
+//
+static __inline GMAX_CODEC_NEXT
+GmaxCodecD0EntryDone(
+	int BusFailure
+)
+{
+	return BusFailure ? GmaxCodecRetry : GmaxCodecNone;
+}
+
+static __inline void
+GmaxCodecD0Exit(
+	GMAX_CODEC_STATE* State
+)
+{
+	State->D0Active = 0;
+	State->DxAttempts = 0;
+}
+
+//
+// Whether a recovery pass has anything to do: restart the codec in D0,
+// or reset an amp a failed power-down left on in Dx
+//
+static __inline int
+GmaxCodecRecoveryBegin(
+	GMAX_CODEC_STATE* State
+)
+{
+	if (!State->D0Active) {
+		if (!State->NeedsReset) {
+			return 0;
+		}
+		State->DxAttempts++;
+	}
+	return 1;
+}
+
+//
+// The pass's power-down finished. Returns nonzero when StartCodec
+// runs next.
+//
+static __inline int
+GmaxCodecRecoveryReset(
+	GMAX_CODEC_STATE* State,
+	int Ok
+)
+{
+	if (!Ok) {
+		return 0;
+	}
+	State->NeedsReset = 0;
+	State->PoweredOn = 0;
+	return State->D0Active;
+}
+
+static __inline GMAX_CODEC_NEXT
+GmaxCodecRecoveryDone(
+	const GMAX_CODEC_STATE* State,
+	int Ok
+)
+{
+	if (Ok) {
+		return GmaxCodecNone;
+	}
+	if (!State->D0Active && State->DxAttempts >= GMAX_RECOVERY_DX_ATTEMPTS) {
+		return GmaxCodecNone;
+	}
+	return GmaxCodecRetry;
+}
+
+//
+// CLK_ERR. Returns nonzero when the amp is to be muted (AMP_EN off)
+// and the sentinel poll started.
+//
+static __inline int
+GmaxCodecClockLoss(
+	GMAX_CODEC_STATE* State
+)
+{
+	if (!State->PoweredOn || State->Clock == GmaxClockLost) {
+		return 0;
+	}
+	State->Clock = GmaxClockLost;
+	return 1;
+}
+
+//
+// The sentinel poll and CLK_RECOVER only act while the codec is on
+// with the clock lost
+//
+static __inline int
+GmaxCodecClockLost(
+	const GMAX_CODEC_STATE* State
+)
+{
+	return State->PoweredOn && State->Clock == GmaxClockLost;
+}
+
+//
+// The poll read the sentinel. Unchanged, the amp still has its image
+// and IRQ_CTRL and CLK_RECOVER will come. Changed, the amp reset and
+// is restarted; unreadable, the bus is handed to recovery.
+//
+static __inline GMAX_CODEC_NEXT
+GmaxCodecClockPolled(
+	GMAX_CODEC_STATE* State,
+	int Ok,
+	uint8_t Sentinel,
+	uint8_t ExpectedSentinel
+)
+{
+	if (Ok && Sentinel == ExpectedSentinel) {
+		return GmaxCodecPoll;
+	}
+	State->Clock = GmaxClockRunning;
+	return Ok ? GmaxCodecRestart : GmaxCodecRetry;
+}
+
+//
+// CLK_RECOVER ran its GmaxClockRecoveryPlan. A plan that failed, or a
+// GmaxClockRestart, goes through a full recovery pass.
+//
+static __inline GMAX_CODEC_NEXT
+GmaxCodecClockRecovered(
+	GMAX_CODEC_STATE* State,
+	int Ok
+)
+{
+	State->Clock = GmaxClockRunning;
+	return Ok ? GmaxCodecNone : GmaxCodecRestart;
+}
@@ -0,0 +1,179 @@
+/*++
+
+Module Name:
+
+config.c
+
+Abstract:
+
+Boot cache for the configuration resolved from ACPI. The first start
+evaluates _UID, _HID and the _DSD slot properties, builds the init
+register image and stores both under the device's hardware key. Later
+starts load and validate the cache instead of evaluating firmware.
+
+A cache is used only if it decodes cleanly (magic, version, length,
+CRC32) and its key matches this start: the I2C connection ID from the
+resource list, a hash of the driver's init table and a hash of the
+firmware identity, so a driver with a different table, an amp moved to
+another bus or a BIOS update rediscovers. Any mismatch falls back to
+full discovery, which rewrites the cache.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+EVT_WDF_WORKITEM GmaxEvtConfigWorkItem;
+
+NTSTATUS
+GmaxConfigLoad(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Replaces pDevice->Config with the boot cache if it is valid for the
+key already filled into pDevice->Config.
+
+Return Value:
+
+STATUS_OBJECT_NAME_NOT_FOUND on first boot, STATUS_DATA_ERROR for a
+cache that does not decode, STATUS_REVISION_MISMATCH for one written
+for another key.
+
+--*/
+{
+	DECLARE_CONST_UNICODE_STRING(valueName, GMAX_BOOT_CACHE_VALUE);
+	UCHAR buffer[GMAX_BOOT_CACHE_MAX_SIZE];
+	GMAX_BOOT_CONFIG config;
+	GMAX_BOOT_CACHE_RESULT result;
+	ULONG length = 0;
+	ULONG type = 0;
+	WDFKEY key;
+	NTSTATUS status;
+
+	status = WdfDeviceOpenRegistryKey(pDevice->FxDevice,
+		PLUGPLAY_REGKEY_DEVICE,
+		KEY_READ,
+		WDF_NO_OBJECT_ATTRIBUTES,
+		&key);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	status = WdfRegistryQueryValue(key, &valueName, sizeof(buffer), buffer, &length, &type);
+	WdfRegistryClose(key);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	if (type != REG_BINARY) {
+		return STATUS_DATA_ERROR;
+	}
+
+	result = GmaxBootCacheDecode(buffer, length, &config);
+	if (result != GmaxBootCacheOk) {
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Boot cache rejected (%d)\n", result);
+		return STATUS_DATA_ERROR;
+	}
+
+	if (config.ConnectionLow != pDevice->Config.ConnectionLow ||
+		config.ConnectionHigh != pDevice->Config.ConnectionHigh ||
+		config.TableHash != pDevice->Config.TableHash ||
+		config.FirmwareHash != pDevice->Config.FirmwareHash) {
+		GmaxPrint(DEBUG_LEVEL_INFO, DBG_PNP,
+			"Boot cache is for another connection, init table or firmware\n");
+		return STATUS_REVISION_MISMATCH;
+	}
+
+	pDevice->Config = config;
+	pDevice->ConfigSource = GmaxConfigCached;
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS
+GmaxConfigStore(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	DECLARE_CONST_UNICODE_STRING(valueName, GMAX_BOOT_CACHE_VALUE);
+	UCHAR buffer[GMAX_BOOT_CACHE_MAX_SIZE];
+	ULONG length;
+	WDFKEY key;
+	NTSTATUS status;
+
+	length = GmaxBootCacheEncode(&pDevice->Config, buffer, sizeof(buffer));
+	if (length == 0) {
+		return STATUS_BUFFER_TOO_SMALL;
+	}
+
+	status = WdfDeviceOpenRegistryKey(pDevice->FxDevice,
+		PLUGPLAY_REGKEY_DEVICE,
+		KEY_READ | KEY_SET_VALUE,
+		WDF_NO_OBJECT_ATTRIBUTES,
+		&key);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	status = WdfRegistryAssignValue(key, &valueName, REG_BINARY, length, buffer);
+	WdfRegistryClose(key);
+	return status;
+}
+
+VOID
+GmaxEvtConfigWorkItem(
+	_In_ WDFWORKITEM WorkItem
+)
+/*++
+
+Routine Description:
+
+Rewrites the boot cache. Config only changes in PrepareHardware and,
+for RevId, in StartCodec before the work item is queued.
+
+--*/
+{
+	PGMAX_CONTEXT pDevice = GetDeviceContext(WdfWorkItemGetParentObject(WorkItem));
+	NTSTATUS status;
+
+	status = GmaxConfigStore(pDevice);
+	if (!NT_SUCCESS(status)) {
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Unable to update boot cache 0x%x\n", status);
+	}
+}
+
+NTSTATUS
+GmaxConfigInitialize(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	WDF_WORKITEM_CONFIG workItemConfig;
+	WDF_OBJECT_ATTRIBUTES attributes;
+
+	WDF_WORKITEM_CONFIG_INIT(&workItemConfig, GmaxEvtConfigWorkItem);
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+
+	return WdfWorkItemCreate(&workItemConfig, &attributes, &pDevice->ConfigWorkItem);
+}
+
+VOID
+GmaxConfigStoreLater(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	if (pDevice->ConfigWorkItem) {
+		WdfWorkItemEnqueue(pDevice->ConfigWorkItem);
+	}
+}
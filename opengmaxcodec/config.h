@@ -0,0 +1,45 @@
+#pragma once
+
+//
+// ACPI-derived configuration, cached in the registry across boots
+//
+
+#include "bootcache.h"
+
+//
+// REG_BINARY value under the device's hardware key. Deleting it forces
+// full discovery on the next start; a firmware update is detected from
+// the key.
+//
+#define GMAX_BOOT_CACHE_VALUE L"GmaxBootCache"
+
+typedef enum {
+	GmaxConfigNone,
+	GmaxConfigDiscovered,	// evaluated _UID, _HID and _DSD this boot
+	GmaxConfigCached	// loaded from the boot cache
+} GMAX_CONFIG_SOURCE;
+
+struct _GMAX_CONTEXT;
+
+NTSTATUS
+GmaxConfigLoad(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+NTSTATUS
+GmaxConfigInitialize(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+NTSTATUS
+GmaxConfigStore(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+//
+// GmaxConfigStore from a work item, for callers on the power path
+//
+VOID
+GmaxConfigStoreLater(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
@@ -0,0 +1,142 @@
+/*++
+
+Module Name:
+
+events.c
+
+Abstract:
+
+Delivers amp events (thermal, brownout, clock monitor, power state) to
+clients that pend IOCTL_GMAX_GET_EVENTS on the ReportQueue. Events that
+arrive while no request is pended are buffered and handed out together
+with the next request.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+NTSTATUS
+GmaxEventQueueInitialize(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	WDF_OBJECT_ATTRIBUTES attributes;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+
+	return WdfSpinLockCreate(&attributes, &pDevice->EventQueue.Lock);
+}
+
+VOID
+GmaxReportEvent(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ GMAX_EVENT Event,
+	_In_ UINT16 Data
+)
+{
+	GMAX_EVENT_QUEUE* queue = &pDevice->EventQueue;
+	GMAX_EVENT_RECORD* record;
+
+	WdfSpinLockAcquire(queue->Lock);
+
+	if (queue->Count == GMAX_EVENT_QUEUE_DEPTH) {
+		//
+		// Nobody is listening fast enough, drop the oldest record.
+		// The client is told through a GmaxEventOverflow record.
+		//
+		queue->Head = (queue->Head + 1) % GMAX_EVENT_QUEUE_DEPTH;
+		queue->Count--;
+		queue->Dropped++;
+	}
+
+	record = &queue->Records[(queue->Head + queue->Count) % GMAX_EVENT_QUEUE_DEPTH];
+	record->Event = (UINT8)Event;
+	record->Uid = (UINT8)pDevice->UID;
+	record->Data = Data;
+	record->TimestampMs = (UINT32)(KeQueryInterruptTime() / 10000);
+	queue->Count++;
+
+	WdfSpinLockRelease(queue->Lock);
+
+	GmaxCompleteEventRequests(pDevice);
+}
+
+VOID
+GmaxCompleteEventRequests(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Completes pended requests while buffered events remain. Every request
+takes as many records as its output buffer holds, so a burst of events
+costs the client a single completion.
+
+--*/
+{
+	GMAX_EVENT_QUEUE* queue = &pDevice->EventQueue;
+
+	for (;;) {
+		WDFREQUEST request;
+		GMAX_EVENT_RECORD* records;
+		size_t bufferLength;
+		ULONG capacity;
+		ULONG filled = 0;
+		NTSTATUS status;
+
+		WdfSpinLockAcquire(queue->Lock);
+
+		if (queue->Count == 0 && queue->Dropped == 0) {
+			WdfSpinLockRelease(queue->Lock);
+			return;
+		}
+
+		status = WdfIoQueueRetrieveNextRequest(pDevice->ReportQueue, &request);
+		if (!NT_SUCCESS(status)) {
+			WdfSpinLockRelease(queue->Lock);
+			return;
+		}
+
+		status = WdfRequestRetrieveOutputBuffer(request,
+			sizeof(GMAX_EVENT_RECORD),
+			(PVOID*)&records,
+			&bufferLength);
+		if (!NT_SUCCESS(status)) {
+			WdfSpinLockRelease(queue->Lock);
+			WdfRequestComplete(request, status);
+			continue;
+		}
+
+		capacity = (ULONG)(bufferLength / sizeof(GMAX_EVENT_RECORD));
+
+		if (queue->Dropped) {
+			records[filled].Event = GmaxEventOverflow;
+			records[filled].Uid = (UINT8)pDevice->UID;
+			records[filled].Data = (UINT16)min(queue->Dropped, 0xFFFF);
+			records[filled].TimestampMs = (UINT32)(KeQueryInterruptTime() / 10000);
+			filled++;
+			queue->Dropped = 0;
+		}
+
+		while (filled < capacity && queue->Count > 0) {
+			records[filled++] = queue->Records[queue->Head];
+			queue->Head = (queue->Head + 1) % GMAX_EVENT_QUEUE_DEPTH;
+			queue->Count--;
+		}
+
+		WdfSpinLockRelease(queue->Lock);
+
+		WdfRequestCompleteWithInformation(request,
+			STATUS_SUCCESS,
+			filled * sizeof(GMAX_EVENT_RECORD));
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+//
+// Event delivery through the ReportQueue
+//
+
+#define GMAX_EVENT_QUEUE_DEPTH 32
+
+typedef struct _GMAX_EVENT_QUEUE
+{
+	WDFSPINLOCK Lock;
+
+	GMAX_EVENT_RECORD Records[GMAX_EVENT_QUEUE_DEPTH];
+	ULONG Head;
+	ULONG Count;
+	ULONG Dropped;
+} GMAX_EVENT_QUEUE;
+
+struct _GMAX_CONTEXT;
+
+NTSTATUS
+GmaxEventQueueInitialize(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+VOID
+GmaxReportEvent(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ GMAX_EVENT Event,
+	_In_ UINT16 Data
+);
+
+VOID
+GmaxCompleteEventRequests(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
@@ -0,0 +1,151 @@
+/*++
+
+Module Name:
+
+format.c
+
+Abstract:
+
+Tracks the format the DSP plays with against the amp's TDM slot size.
+
+A CsAudio format override from the DSP used to be ignored. It is now
+recorded and compared with PCM_MODE_CFG, and the result is published
+through IOCTL_GMAX_GET_FORMAT and a GmaxEventFormatChanged event. When
+the containers differ the DSP side converts samples (gmaxdsp
+gmax_pcm_convert) instead of renegotiating and restarting the stream.
+The amp's slot size is never changed here.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+#include "max98512.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+static UINT16
+GmaxFormatSlotBits(
+	_In_ UINT8 PcmModeCfg
+)
+{
+	switch (PcmModeCfg & MAX98512_PCM_MODE_CFG_CHANSZ_MASK) {
+	case MAX98512_PCM_MODE_CFG_CHANSZ_24:
+		return 24;
+	case MAX98512_PCM_MODE_CFG_CHANSZ_32:
+		return 32;
+	default:
+		return 16;
+	}
+}
+
+static VOID
+GmaxFormatCompare(
+	_Inout_ GMAX_FORMAT_INFO* Info
+)
+{
+	Info->ConversionRequired = Info->DspContainerBits != Info->AmpContainerBits ||
+		Info->DspValidBits > Info->AmpContainerBits;
+}
+
+NTSTATUS
+GmaxFormatInitialize(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ UINT8 PcmModeCfg
+)
+{
+	GMAX_FORMAT* format = &pDevice->Format;
+	WDF_OBJECT_ATTRIBUTES attributes;
+
+	format->Info.AmpContainerBits = GmaxFormatSlotBits(PcmModeCfg);
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+
+	return WdfSpinLockCreate(&attributes, &format->Lock);
+}
+
+VOID
+GmaxFormatOverride(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ const CsAudioFormatOverride* Override
+)
+{
+	GMAX_FORMAT* format = &pDevice->Format;
+	GMAX_FORMAT_INFO info;
+	BOOLEAN changed;
+
+	WdfSpinLockAcquire(format->Lock);
+
+	info = format->Info;
+	info.DspContainerBits = Override->force32BitOutputContainer ? 32 : Override->bitsPerSample;
+	info.DspValidBits = Override->validBitsPerSample ? Override->validBitsPerSample : Override->bitsPerSample;
+	info.Channels = Override->channels;
+	info.Frequency = Override->frequency;
+	GmaxFormatCompare(&info);
+
+	changed = RtlCompareMemory(&info, &format->Info, sizeof(info)) != sizeof(info);
+	format->Info = info;
+
+	WdfSpinLockRelease(format->Lock);
+
+	if (changed) {
+		GmaxPrint(DEBUG_LEVEL_INFO, DBG_IOCTL,
+			"DSP format %d/%d bits, amp slot %d bits, conversion %d\n",
+			info.DspValidBits, info.DspContainerBits, info.AmpContainerBits, info.ConversionRequired);
+
+		GmaxReportEvent(pDevice, GmaxEventFormatChanged, info.ConversionRequired);
+	}
+}
+
+VOID
+GmaxFormatSetSlot(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ UINT8 PcmModeCfg
+)
+/*++
+
+Routine Description:
+
+Records the PCM_MODE_CFG StartCodec will write, for a tuning profile
+that changes the slot size from the init table.
+
+--*/
+{
+	GMAX_FORMAT* format = &pDevice->Format;
+	GMAX_FORMAT_INFO info;
+	BOOLEAN changed;
+
+	WdfSpinLockAcquire(format->Lock);
+
+	info = format->Info;
+	info.AmpContainerBits = GmaxFormatSlotBits(PcmModeCfg);
+	if (info.DspContainerBits) {
+		GmaxFormatCompare(&info);
+	}
+
+	changed = info.AmpContainerBits != format->Info.AmpContainerBits;
+	format->Info = info;
+
+	WdfSpinLockRelease(format->Lock);
+
+	if (changed && info.DspContainerBits) {
+		GmaxReportEvent(pDevice, GmaxEventFormatChanged, info.ConversionRequired);
+	}
+}
+
+VOID
+GmaxFormatGetInfo(
+	_In_ PGMAX_CONTEXT pDevice,
+	_Out_ GMAX_FORMAT_INFO* Info
+)
+{
+	GMAX_FORMAT* format = &pDevice->Format;
+
+	WdfSpinLockAcquire(format->Lock);
+	*Info = format->Info;
+	WdfSpinLockRelease(format->Lock);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+//
+// Stream format agreement between the DSP and the amp's TDM slots
+//
+
+typedef struct _GMAX_FORMAT
+{
+	WDFSPINLOCK Lock;
+	GMAX_FORMAT_INFO Info;
+} GMAX_FORMAT;
+
+struct _GMAX_CONTEXT;
+struct CSAUDIOFORMATOVERRIDE;
+
+NTSTATUS
+GmaxFormatInitialize(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ UINT8 PcmModeCfg
+);
+
+VOID
+GmaxFormatOverride(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ const struct CSAUDIOFORMATOVERRIDE* Override
+);
+
+VOID
+GmaxFormatSetSlot(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ UINT8 PcmModeCfg
+);
+
+VOID
+GmaxFormatGetInfo(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_Out_ GMAX_FORMAT_INFO* Info
+);
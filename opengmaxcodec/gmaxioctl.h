@@ -0,0 +1,377 @@
+#pragma once
+
+//
+// Definitions shared with clients of the driver (kernel or user mode).
+//
+
+// {0C5D6B48-3E0A-4C7D-9A0E-5B8F4A2D9E31}
+DEFINE_GUID(GUID_DEVINTERFACE_GMAX,
+	0x0c5d6b48, 0x3e0a, 0x4c7d, 0x9a, 0x0e, 0x5b, 0x8f, 0x4a, 0x2d, 0x9e, 0x31);
+
+#define FILE_DEVICE_GMAX 0x8A98
+
+#define GMAX_IOCTL(fn, method, access) CTL_CODE(FILE_DEVICE_GMAX, 0x800 + (fn), method, access)
+
+//
+// Pends until at least one event is available, then completes with as
+// many GMAX_EVENT_RECORDs as fit in the output buffer.
+//
+#define IOCTL_GMAX_GET_EVENTS GMAX_IOCTL(0, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+//
+// Returns the most recent GMAX_MONITOR_SAMPLEs, oldest first.
+//
+#define IOCTL_GMAX_GET_MONITOR_SAMPLES GMAX_IOCTL(1, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+//
+// Returns a GMAX_SCHEDULER_STATS with queueing delay per priority class.
+//
+#define IOCTL_GMAX_GET_SCHEDULER_STATS GMAX_IOCTL(2, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+//
+// Moves AMP_VOL_CTRL to a new level over RampMs (0 = immediately) and
+// optionally sets SPK_GAIN. Input is a GMAX_VOLUME_REQUEST.
+//
+#define IOCTL_GMAX_SET_VOLUME GMAX_IOCTL(3, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Returns a GMAX_VOLUME_STATS describing ramp timing and bus usage.
+//
+#define IOCTL_GMAX_GET_VOLUME_STATS GMAX_IOCTL(4, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+//
+// Selects the brownout detection profile. Input is a UINT32 GMAX_BDE_PROFILE.
+//
+#define IOCTL_GMAX_SET_BDE_PROFILE GMAX_IOCTL(5, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Sets an attenuation applied on top of the requested volume, used by
+// speaker protection and the brownout guard. Each source has its own
+// limit and the largest applies. Input is a GMAX_GAIN_LIMIT.
+//
+#define IOCTL_GMAX_SET_GAIN_LIMIT GMAX_IOCTL(6, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Returns a GMAX_FORMAT_INFO comparing the DSP's stream format with the
+// amp's TDM slot size. GmaxEventFormatChanged is reported when it changes.
+//
+#define IOCTL_GMAX_GET_FORMAT GMAX_IOCTL(7, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+//
+// Returns a GMAX_REG_STATS for every register accessed since load or
+// the last reset, in address order.
+//
+#define IOCTL_GMAX_GET_REG_STATS GMAX_IOCTL(8, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+//
+// Clears the per-register counters.
+//
+#define IOCTL_GMAX_RESET_REG_STATS GMAX_IOCTL(9, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Starts logging every SPB transfer into the capture ring (input UINT32
+// 1, which also empties it) or stops logging (0).
+//
+#define IOCTL_GMAX_SET_SPB_CAPTURE GMAX_IOCTL(10, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Drains the capture ring: a GMAX_SPB_CAPTURE_HEADER followed by as
+// many whole records as fit in the output buffer, oldest first.
+//
+#define IOCTL_GMAX_GET_SPB_CAPTURE GMAX_IOCTL(11, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+//
+// Returns a GMAX_LOCK_PROFILE (lockprof.h) with wait and hold times for
+// SpbLock and the SPB controller lock since load or the last reset.
+//
+#define IOCTL_GMAX_GET_LOCK_PROFILE GMAX_IOCTL(12, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+//
+// Clears the lock profile.
+//
+#define IOCTL_GMAX_RESET_LOCK_PROFILE GMAX_IOCTL(13, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Returns a GMAX_REG_IMAGE with the last value seen on the bus for each
+// register. Served from the driver's register shadow without touching
+// the bus, so it never waits behind codec start or other transfers.
+//
+#define IOCTL_GMAX_GET_REG_IMAGE GMAX_IOCTL(14, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+//
+// Returns a GMAX_SPB_STATS with the SPB transfer counters since load or
+// the last reset.
+//
+#define IOCTL_GMAX_GET_SPB_STATS GMAX_IOCTL(15, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+//
+// Clears the SPB transfer counters.
+//
+#define IOCTL_GMAX_RESET_SPB_STATS GMAX_IOCTL(16, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Returns a GMAX_TIMELINE_HEADER followed by GMAX_TIMELINE_RECORDs: the
+// start of the device from DriverEntry to the end of SelfManagedIoInit
+// (after the first D0Entry), then the most recent power transitions.
+// The timeline is not drained.
+//
+#define IOCTL_GMAX_GET_TIMELINE GMAX_IOCTL(17, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+typedef enum {
+	GmaxEventThermalWarn,
+	GmaxEventThermalWarnEnd,
+	GmaxEventThermalShutdown,
+	GmaxEventThermalShutdownEnd,
+	GmaxEventBrownoutActive,
+	GmaxEventBrownoutEnd,
+	GmaxEventBrownoutLevel,
+	GmaxEventClockLoss,
+	GmaxEventClockRecovered,
+	GmaxEventWatchdog,
+	GmaxEventSpeakerFault,
+	GmaxEventBoostFault,
+	GmaxEventPowerUp,
+	GmaxEventPowerDown,
+	GmaxEventOverflow,
+	GmaxEventFormatChanged,
+	GmaxEventBusFault,	// breaker opened, Data is the cooldown in ms
+	GmaxEventBusRecovered,	// Data is the number of recovery passes
+	GmaxEventMax
+} GMAX_EVENT;
+
+//
+// Register command priority classes, highest first
+//
+typedef enum {
+	GmaxPriorityPower,	// power and stream control, fault handling
+	GmaxPriorityVolume,
+	GmaxPriorityTuning,
+	GmaxPriorityTelemetry,
+	GmaxPriorityMax
+} GMAX_PRIORITY;
+
+//
+// Brownout detection engine profiles. GmaxBdeProfileAuto follows the
+// system power source (AC or battery).
+//
+typedef enum {
+	GmaxBdeProfileOff,
+	GmaxBdeProfileAc,
+	GmaxBdeProfileBattery,
+	GmaxBdeProfileMax,
+	GmaxBdeProfileAuto = GmaxBdeProfileMax
+} GMAX_BDE_PROFILE;
+
+typedef enum {
+	GmaxSpbWrite,
+	GmaxSpbXfer		// address write followed by a read
+} GMAX_SPB_DIRECTION;
+
+//
+// Timeline stages. Callbacks are at depth 0, the steps inside them and
+// the bus transfers they make one level deeper per enclosing stage.
+//
+typedef enum {
+	GmaxStageDriverEntry,
+	GmaxStageDeviceAdd,
+	GmaxStagePrepareHardware,
+	GmaxStageSpbOpen,		// SpbTargetInitialize
+	GmaxStageBootCache,		// GmaxConfigLoad
+	GmaxStageAcpiUid,
+	GmaxStageAcpiHid,
+	GmaxStageAcpiDsd,		// IV-sense slot properties
+	GmaxStageTuningLoad,
+	GmaxStageSelfManagedIoInit,
+	GmaxStageCallbackRegister,	// CsAudioCallbackAPI
+	GmaxStageD0Entry,
+	GmaxStageStartCodec,
+	GmaxStageD0Exit,
+	GmaxStageBusWrite,		// Data is the register
+	GmaxStageBusXfer,
+	GmaxStageMax
+} GMAX_STAGE;
+
+#include <pshpack1.h>
+typedef struct _GMAX_EVENT_RECORD {
+	UINT8 Event;		// GMAX_EVENT
+	UINT8 Uid;		// _UID of the reporting amp
+	UINT16 Data;		// event specific, raw INT_FLAG bits for chip events
+	UINT32 TimestampMs;	// interrupt time in ms
+} GMAX_EVENT_RECORD, *PGMAX_EVENT_RECORD;
+
+typedef struct _GMAX_MONITOR_SAMPLE {
+	UINT32 TimestampMs;
+	UINT8 Pvdd;		// MEAS_ADC_CH0_READ
+	UINT8 Therm;		// MEAS_ADC_CH1_READ
+	UINT8 Vbat;		// MEAS_ADC_CH2_READ
+	UINT8 BrownoutStatus;	// BROWNOUT_STATUS
+	UINT8 BoostVout;	// ENV_TRACK_BOOST_VOUT_READ
+	UINT8 Reserved[3];
+} GMAX_MONITOR_SAMPLE, *PGMAX_MONITOR_SAMPLE;
+
+#define GMAX_SPK_GAIN_UNCHANGED 0x7FFFFFFF
+
+//
+// Longest ramp IOCTL_GMAX_SET_VOLUME and IOCTL_GMAX_SET_GAIN_LIMIT take,
+// longer ones fail with STATUS_INVALID_PARAMETER
+//
+#define GMAX_VOLUME_RAMP_MAX_MS 10000
+
+typedef struct _GMAX_VOLUME_REQUEST {
+	INT32 Volume;		// 1/100 dB, rounded to the nearest AMP_VOL_CTRL step
+	UINT32 RampMs;		// up to GMAX_VOLUME_RAMP_MAX_MS
+	INT32 SpeakerGain;	// 1/100 dB or GMAX_SPK_GAIN_UNCHANGED, applied at once
+} GMAX_VOLUME_REQUEST, *PGMAX_VOLUME_REQUEST;
+
+typedef enum {
+	GmaxLimitThermal,
+	GmaxLimitBrownout,
+	GmaxLimitSourceMax
+} GMAX_LIMIT_SOURCE;
+
+typedef struct _GMAX_GAIN_LIMIT {
+	INT32 Attenuation;	// 1/100 dB, 0 removes the limit
+	UINT32 RampMs;		// up to GMAX_VOLUME_RAMP_MAX_MS
+	UINT32 Source;		// GMAX_LIMIT_SOURCE
+	UINT32 DelayUs;		// start the ramp this far in the future
+} GMAX_GAIN_LIMIT, *PGMAX_GAIN_LIMIT;
+
+typedef struct _GMAX_VOLUME_STATS {
+	UINT32 RampsStarted;
+	UINT32 RampsSuperseded;
+	UINT32 StepsWritten;
+	UINT32 StepsCoalesced;	// step deadlines folded into a later write
+	UINT64 TotalLateness;	// 100ns units, write time minus step deadline
+	UINT64 MaxLateness;
+	UINT64 BusTime;		// 100ns units spent in AMP_VOL_CTRL writes
+} GMAX_VOLUME_STATS, *PGMAX_VOLUME_STATS;
+
+typedef struct _GMAX_PRIORITY_STATS {
+	UINT32 Commands;
+	UINT32 Preempted;	// had to wait for a higher class
+	UINT64 TotalWait;	// 100ns units
+	UINT64 MaxWait;		// 100ns units
+} GMAX_PRIORITY_STATS;
+
+typedef struct _GMAX_SCHEDULER_STATS {
+	GMAX_PRIORITY_STATS Class[GmaxPriorityMax];
+} GMAX_SCHEDULER_STATS, *PGMAX_SCHEDULER_STATS;
+
+typedef struct _GMAX_FORMAT_INFO {
+	UINT16 AmpContainerBits;	// TDM slot size in PCM_MODE_CFG
+	UINT16 DspContainerBits;	// 0 until the DSP overrides the format
+	UINT16 DspValidBits;
+	UINT16 Channels;
+	UINT32 Frequency;
+	UINT8 ConversionRequired;
+	UINT8 Reserved[3];
+} GMAX_FORMAT_INFO, *PGMAX_FORMAT_INFO;
+
+//
+// Reg for accesses outside the tracked register ranges
+//
+#define GMAX_REG_STATS_OTHER 0xFFFF
+
+typedef struct _GMAX_REG_STATS {
+	UINT16 Reg;
+	UINT16 Reserved;
+	UINT32 Reads;		// bulk transfers count each register they cover
+	UINT32 Writes;
+	UINT32 RedundantWrites;	// wrote the value last seen on the bus
+	UINT32 NoopUpdates;	// read-modify-writes that skipped the write
+	UINT32 CacheHits;	// read back the value last seen on the bus
+	UINT32 CacheMisses;
+	UINT64 BusTime;		// 100ns units, charged to a transfer's first register
+} GMAX_REG_STATS, *PGMAX_REG_STATS;
+
+//
+// Register address range of a chip's register map
+//
+typedef struct _GMAX_REG_RANGE {
+	UINT16 Base;
+	UINT16 Count;
+} GMAX_REG_RANGE;
+
+//
+// GMAX_REG_IMAGE slots follow the chip's register map: the registers of
+// Ranges[0] first, then those of Ranges[1] and so on
+//
+#define GMAX_REG_IMAGE_COUNT 0x111
+#define GMAX_REG_IMAGE_VALID_BYTES ((GMAX_REG_IMAGE_COUNT + 7) / 8)
+#define GMAX_REG_IMAGE_RANGES 4
+
+typedef struct _GMAX_REG_IMAGE {
+	UINT32 Sequence;	// changes with every update
+	UINT32 AgeMs;		// since the last update
+	UINT32 RangeCount;
+	GMAX_REG_RANGE Ranges[GMAX_REG_IMAGE_RANGES];
+	UINT8 Valid[GMAX_REG_IMAGE_VALID_BYTES];	// bit per slot, clear until seen and after a soft reset
+	UINT8 Value[GMAX_REG_IMAGE_COUNT];
+} GMAX_REG_IMAGE, *PGMAX_REG_IMAGE;
+
+#define GMAX_SPB_CAPTURE_VERSION 1
+
+//
+// Payload kept per direction, longer transfers are cut short
+//
+#define GMAX_SPB_CAPTURE_MAX_PAYLOAD 256
+
+typedef struct _GMAX_SPB_CAPTURE_HEADER {
+	UINT32 Version;
+	UINT32 Records;		// in this buffer
+	UINT32 Dropped;		// overwritten before being drained, since start
+	UINT32 Bytes;		// of records following the header
+	UINT64 StartTime;	// interrupt time at start, 100ns
+} GMAX_SPB_CAPTURE_HEADER, *PGMAX_SPB_CAPTURE_HEADER;
+
+//
+// Followed by min(WriteLength, MAX_PAYLOAD) bytes sent, register address
+// first, then min(ReadLength, MAX_PAYLOAD) bytes read, padded to 4 bytes
+//
+typedef struct _GMAX_SPB_RECORD {
+	UINT32 Timestamp;	// us since StartTime
+	UINT32 Latency;		// us, including the controller lock
+	INT32 Status;
+	UINT8 Direction;	// GMAX_SPB_DIRECTION
+	UINT8 Reserved;
+	UINT16 WriteLength;
+	UINT16 ReadLength;	// 0 for writes and failed reads
+	UINT16 Reserved2;
+} GMAX_SPB_RECORD, *PGMAX_SPB_RECORD;
+
+typedef struct _GMAX_SPB_STATS {
+	UINT64 Transfers;	// sends to the I/O target, retries and read phases included
+	UINT64 BytesSent;
+	UINT64 BytesRead;
+	UINT64 BytesCopied;	// staged through a buffer other than the one sent or read
+	UINT32 Allocations;	// messages that did not fit a preallocated buffer
+	UINT32 Retries;
+	UINT32 FastFails;	// refused while the breaker was open
+	UINT32 Reserved;
+} GMAX_SPB_STATS, *PGMAX_SPB_STATS;
+
+#define GMAX_TIMELINE_VERSION 1
+
+typedef struct _GMAX_TIMELINE_HEADER {
+	UINT32 Version;
+	UINT32 Records;		// following the header
+	UINT32 BootRecords;	// the first Records, kept for the life of the device
+	UINT32 Dropped;		// boot records that did not fit, later ones overwritten
+	UINT64 StartTime;	// interrupt time at DriverEntry, 100ns
+} GMAX_TIMELINE_HEADER, *PGMAX_TIMELINE_HEADER;
+
+//
+// Written when the stage ends, so a stage follows the stages and
+// transfers nested in it
+//
+typedef struct _GMAX_TIMELINE_RECORD {
+	UINT64 Start;		// interrupt time, 100ns
+	UINT32 Duration;	// us
+	INT32 Status;
+	UINT8 Stage;		// GMAX_STAGE
+	UINT8 Depth;
+	UINT16 Data;
+	UINT32 Reserved;
+} GMAX_TIMELINE_RECORD, *PGMAX_TIMELINE_RECORD;
+
+#include <poppack.h>
@@ -0,0 +1,347 @@
+/*++
+
+Module Name:
+
+interrupt.c
+
+Abstract:
+
+Handles the amplifier IRQ pin. The pin is routed through a GPIO
+controller, so the interrupt is serviced at PASSIVE_LEVEL where
+synchronous SPB transfers are allowed. The ISR only reads, acknowledges
+and decodes the flags (intflags.h); the events are dispatched from the
+interrupt's work item.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+//
+// Flag bit -> event mapping, one entry per INT_FLAGx bit
+//
+
+static const GMAX_INT_MAP GmaxIntMap[] = {
+	{0, MAX98512_INT1_THERMWARN_BGN, GmaxEventThermalWarn},
+	{0, MAX98512_INT1_THERMWARN_END, GmaxEventThermalWarnEnd},
+	{0, MAX98512_INT1_THERMSHDN_BGN, GmaxEventThermalShutdown},
+	{0, MAX98512_INT1_THERMSHDN_END, GmaxEventThermalShutdownEnd},
+	{0, MAX98512_INT1_BDE_ACTIVE_BGN, GmaxEventBrownoutActive},
+	{0, MAX98512_INT1_BDE_ACTIVE_END, GmaxEventBrownoutEnd},
+	{0, MAX98512_INT1_BDE_LEVEL_CHANGE, GmaxEventBrownoutLevel},
+	{0, MAX98512_INT1_BDE_L4, GmaxEventBrownoutLevel},
+	{1, MAX98512_INT2_CLK_ERR, GmaxEventClockLoss},
+	{1, MAX98512_INT2_CLK_RECOVER, GmaxEventClockRecovered},
+	{1, MAX98512_INT2_WDOG_ERR, GmaxEventWatchdog},
+	{1, MAX98512_INT2_SPK_OVC, GmaxEventSpeakerFault},
+	{2, MAX98512_INT3_BST_CURLIM, GmaxEventBoostFault},
+	{2, MAX98512_INT3_BST_UVLO, GmaxEventBoostFault},
+	{2, MAX98512_INT3_PVDD_UVLO, GmaxEventBoostFault}
+};
+
+ULONG
+GmaxDecodeInterruptFlags(
+	_In_reads_bytes_(GMAX_INT_REG_COUNT) const UINT8* Flags
+)
+{
+	return GmaxIntDecode(GmaxIntMap, sizeof(GmaxIntMap) / sizeof(GMAX_INT_MAP), Flags);
+}
+
+NTSTATUS
+GmaxEnableInterrupts(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Clears any stale flags and unmasks the interrupt sources. Called after
+the init registers are written, the chip loses these on SOFT_RESET.
+
+--*/
+{
+	GMAX_INTERRUPT_CONTEXT* intContext = &pDevice->InterruptContext;
+	UINT8 clear[GMAX_INT_REG_COUNT] = { 0xFF, 0xFF, 0xFF };
+	NTSTATUS status;
+
+	if (!intContext->Interrupt) {
+		return STATUS_SUCCESS;
+	}
+
+	status = gmax_reg_bulk_write(pDevice, MAX98512_R000D_INT_FLAG_CLR1, clear, sizeof(clear));
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	status = gmax_reg_bulk_write(pDevice, MAX98512_R000A_INT_EN1, (PVOID)GmaxIntEnableMask, sizeof(GmaxIntEnableMask));
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+	RtlCopyMemory(intContext->Enabled, GmaxIntEnableMask, sizeof(GmaxIntEnableMask));
+
+	return gmax_reg_write(pDevice, MAX98512_R0010_IRQ_CTRL, MAX98512_IRQ_CTRL_EN);
+}
+
+VOID
+GmaxInterruptRestore(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	GMAX_INTERRUPT_CONTEXT* intContext = &pDevice->InterruptContext;
+
+	if (intContext->Interrupt && intContext->Disabled) {
+		intContext->Disabled = FALSE;
+		WdfInterruptEnable(intContext->Interrupt);
+	}
+}
+
+GMAX_INT_RESULT
+GmaxServiceInterrupt(
+	_In_ PGMAX_CONTEXT pDevice,
+	_Out_writes_bytes_(GMAX_INT_REG_COUNT) UINT8* Flags
+)
+/*++
+
+Routine Description:
+
+Collects and acknowledges pending chip interrupts, running the service
+in intflags.h on the bus. A fault costs exactly one burst read of
+INT_FLAG1..3 and one burst write of INT_FLAG_CLR1..3. When the bus
+fails, INT_EN1..3 are cleared instead so the level-triggered line
+drops until recovery enables them again.
+
+Arguments:
+
+pDevice - the device context
+Flags - receives the enabled flags that were set and acknowledged
+
+Return Value:
+
+How the service ended
+
+--*/
+{
+	GMAX_INTERRUPT_CONTEXT* intContext = &pDevice->InterruptContext;
+	UINT8 mask[GMAX_INT_REG_COUNT] = { 0 };
+	GMAX_INT_SERVICE service;
+	GMAX_INT_ACTION action;
+	NTSTATUS status;
+
+	action = GmaxIntServiceStart(&service, intContext->Enabled);
+	while (action != GmaxIntDone) {
+		switch (action) {
+		case GmaxIntReadFlags:
+			status = gmax_reg_bulk_read(pDevice, MAX98512_R0007_INT_FLAG1, service.Flags, sizeof(service.Flags));
+			break;
+		case GmaxIntClearFlags:
+			status = gmax_reg_bulk_write(pDevice, MAX98512_R000D_INT_FLAG_CLR1, service.Flags, sizeof(service.Flags));
+			break;
+		default:
+			status = gmax_reg_bulk_write(pDevice, MAX98512_R000A_INT_EN1, mask, sizeof(mask));
+			break;
+		}
+		action = GmaxIntServiceNext(&service, NT_SUCCESS(status));
+	}
+
+	RtlCopyMemory(Flags, service.Flags, sizeof(service.Flags));
+
+	switch (service.Result) {
+	case GmaxIntClaimed:
+		RtlCopyMemory(intContext->LastFlags, service.Flags, sizeof(service.Flags));
+		intContext->ServiceCount++;
+		break;
+	case GmaxIntSpurious:
+		intContext->SpuriousCount++;
+		break;
+	default:
+		intContext->MaskedCount++;
+		break;
+	}
+	return service.Result;
+}
+
+VOID
+GmaxDispatchEvents(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ ULONG Events,
+	_In_reads_bytes_(GMAX_INT_REG_COUNT) const UINT8* Flags
+)
+{
+	GMAX_INTERRUPT_CONTEXT* intContext = &pDevice->InterruptContext;
+
+	if (Events & GMAX_EVENT_MASK(GmaxEventThermalShutdown)) {
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Amp entered thermal shutdown\n");
+	}
+
+	//
+	// A stop and restart can both be pending, loss first
+	//
+	if (GmaxChipHas(pDevice, GMAX_CHIP_CLOCK_MONITOR)) {
+		if (Events & GMAX_EVENT_MASK(GmaxEventClockLoss)) {
+			GmaxClockHandleLoss(pDevice);
+		}
+		if (Events & GMAX_EVENT_MASK(GmaxEventClockRecovered)) {
+			GmaxClockHandleRecovery(pDevice);
+		}
+	}
+
+	for (int i = 0; i < sizeof(GmaxIntMap) / sizeof(GMAX_INT_MAP); i++) {
+		GMAX_EVENT event = (GMAX_EVENT)GmaxIntMap[i].Event;
+		if (!(Events & GMAX_EVENT_MASK(event))) {
+			continue;
+		}
+
+		//
+		// Several flag bits can map to the same event, report it once
+		// with the raw flag register it came from.
+		//
+		Events &= ~GMAX_EVENT_MASK(event);
+		intContext->EventCounts[event]++;
+		GmaxReportEvent(pDevice, event, Flags[GmaxIntMap[i].Reg]);
+	}
+}
+
+BOOLEAN
+GmaxEvtInterruptIsr(
+	_In_ WDFINTERRUPT Interrupt,
+	_In_ ULONG MessageID
+)
+/*++
+
+Routine Description:
+
+Passive-level ISR for the amp IRQ line. The flags are serviced whatever
+the codec state: the line is level triggered and stays asserted until
+they are cleared or masked, which StartCodec's interrupt step can leave
+to happen before the power-up. Everything the events lead to runs in
+the work item, not under the interrupt lock.
+
+--*/
+{
+	PGMAX_CONTEXT pDevice = GetDeviceContext(WdfInterruptGetDevice(Interrupt));
+	GMAX_INTERRUPT_CONTEXT* intContext = &pDevice->InterruptContext;
+	UINT8 flags[GMAX_INT_REG_COUNT];
+	GMAX_INT_RESULT result;
+
+	UNREFERENCED_PARAMETER(MessageID);
+
+	GmaxCmdBegin(pDevice, GmaxPriorityPower);
+	result = GmaxServiceInterrupt(pDevice, flags);
+	GmaxCmdEnd(pDevice);
+
+	switch (result) {
+	case GmaxIntSpurious:
+		return FALSE;
+
+	case GmaxIntClaimed:
+		intContext->PendingEvents |= GmaxDecodeInterruptFlags(flags);
+		for (int i = 0; i < GMAX_INT_REG_COUNT; i++) {
+			intContext->PendingFlags[i] |= flags[i];
+		}
+		break;
+
+	case GmaxIntFailed:
+		intContext->PendingDisable = TRUE;
+		//
+		// Fall through
+		//
+	default:
+		intContext->PendingRecovery = TRUE;
+		break;
+	}
+
+	WdfInterruptQueueWorkItemForIsr(Interrupt);
+	return TRUE;
+}
+
+VOID
+GmaxEvtInterruptWorkItem(
+	_In_ WDFINTERRUPT Interrupt,
+	_In_ WDFOBJECT AssociatedObject
+)
+/*++
+
+Routine Description:
+
+Dispatches what the ISR collected: clock recovery, the power-up it may
+start and completion of pended event requests. A bus that failed in
+the ISR goes to recovery, which unmasks the sources again; when even
+the mask failed, the interrupt is disabled until then.
+
+--*/
+{
+	PGMAX_CONTEXT pDevice = GetDeviceContext(WdfInterruptGetDevice(Interrupt));
+	GMAX_INTERRUPT_CONTEXT* intContext = &pDevice->InterruptContext;
+	UINT8 flags[GMAX_INT_REG_COUNT];
+	BOOLEAN recovery;
+	BOOLEAN disable;
+	ULONG events;
+
+	UNREFERENCED_PARAMETER(AssociatedObject);
+
+	WdfInterruptAcquireLock(Interrupt);
+	events = intContext->PendingEvents;
+	RtlCopyMemory(flags, intContext->PendingFlags, sizeof(flags));
+	recovery = intContext->PendingRecovery;
+	disable = intContext->PendingDisable;
+	intContext->PendingEvents = 0;
+	RtlZeroMemory(intContext->PendingFlags, sizeof(intContext->PendingFlags));
+	intContext->PendingRecovery = FALSE;
+	intContext->PendingDisable = FALSE;
+	WdfInterruptReleaseLock(Interrupt);
+
+	if (recovery) {
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Interrupt service failed on the bus, sources %s\n", disable ? "not masked" : "masked");
+		if (disable && !intContext->Disabled) {
+			intContext->Disabled = TRUE;
+			WdfInterruptDisable(Interrupt);
+		}
+		GmaxRecoveryRetry(pDevice);
+	}
+
+	GmaxDispatchEvents(pDevice, events, flags);
+}
+
+NTSTATUS
+GmaxInterruptCreate(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ PCM_PARTIAL_RESOURCE_DESCRIPTOR RawDescriptor,
+	_In_ PCM_PARTIAL_RESOURCE_DESCRIPTOR TranslatedDescriptor
+)
+{
+	WDF_INTERRUPT_CONFIG interruptConfig;
+	NTSTATUS status;
+
+	if (pDevice->InterruptContext.Interrupt) {
+		return STATUS_SUCCESS;
+	}
+
+	WDF_INTERRUPT_CONFIG_INIT(&interruptConfig, GmaxEvtInterruptIsr, NULL);
+
+	interruptConfig.PassiveHandling = TRUE;
+	interruptConfig.EvtInterruptWorkItem = GmaxEvtInterruptWorkItem;
+	interruptConfig.InterruptRaw = RawDescriptor;
+	interruptConfig.InterruptTranslated = TranslatedDescriptor;
+
+	status = WdfInterruptCreate(pDevice->FxDevice,
+		&interruptConfig,
+		WDF_NO_OBJECT_ATTRIBUTES,
+		&pDevice->InterruptContext.Interrupt);
+
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"WdfInterruptCreate failed 0x%x\n", status);
+		pDevice->InterruptContext.Interrupt = NULL;
+	}
+
+	return status;
+}
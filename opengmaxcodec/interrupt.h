@@ -0,0 +1,76 @@
+#pragma once
+
+//
+// Chip interrupt (IRQ pin) handling, see intflags.h
+//
+
+#define GMAX_EVENT_MASK(e) (1UL << (e))
+
+typedef struct _GMAX_INTERRUPT_CONTEXT
+{
+	WDFINTERRUPT Interrupt;
+
+	UINT8 Enabled[GMAX_INT_REG_COUNT];
+	UINT8 LastFlags[GMAX_INT_REG_COUNT];
+
+	//
+	// Handed from the ISR to the interrupt work item, under the
+	// interrupt lock
+	//
+	ULONG PendingEvents;
+	UINT8 PendingFlags[GMAX_INT_REG_COUNT];
+	BOOLEAN PendingRecovery;	// the bus failed, the sources are masked
+	BOOLEAN PendingDisable;		// and the mask did not take either
+
+	BOOLEAN Disabled;		// WdfInterruptDisable until recovery
+
+	ULONG ServiceCount;
+	ULONG SpuriousCount;
+	ULONG MaskedCount;
+	ULONG EventCounts[GmaxEventMax];
+} GMAX_INTERRUPT_CONTEXT;
+
+struct _GMAX_CONTEXT;
+
+EVT_WDF_INTERRUPT_ISR GmaxEvtInterruptIsr;
+EVT_WDF_INTERRUPT_WORKITEM GmaxEvtInterruptWorkItem;
+
+ULONG
+GmaxDecodeInterruptFlags(
+	_In_reads_bytes_(GMAX_INT_REG_COUNT) const UINT8* Flags
+);
+
+NTSTATUS
+GmaxInterruptCreate(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ PCM_PARTIAL_RESOURCE_DESCRIPTOR RawDescriptor,
+	_In_ PCM_PARTIAL_RESOURCE_DESCRIPTOR TranslatedDescriptor
+);
+
+NTSTATUS
+GmaxEnableInterrupts(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+//
+// Re-enables an interrupt the work item disabled after a bus failure.
+// Called once recovery has the codec running, outside any register
+// command: the ISR takes one while holding the interrupt lock.
+//
+VOID
+GmaxInterruptRestore(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+GMAX_INT_RESULT
+GmaxServiceInterrupt(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_Out_writes_bytes_(GMAX_INT_REG_COUNT) UINT8* Flags
+);
+
+VOID
+GmaxDispatchEvents(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ ULONG Events,
+	_In_reads_bytes_(GMAX_INT_REG_COUNT) const UINT8* Flags
+);
@@ -0,0 +1,159 @@
+#pragma once
+
+//
+// Amp interrupt service: what the ISR reads, acknowledges and decodes.
+// Nothing here touches the bus: the caller runs the burst Next hands
+// out and reports whether it went through. Pure so the host IRQ line
+// simulation (tools/gmaxirqsim) runs exactly what interrupt.c runs.
+//
+// The IRQ pin is level triggered, it stays asserted while any enabled
+// INT_FLAG bit is set. A service therefore either clears what it saw
+// or, when the bus fails, masks every source, so the line never fires
+// again straight away for the same flags.
+//
+
+#include "max98512.h"
+
+#define GMAX_INT_REG_COUNT 3
+
+//
+// Sources we unmask. Power up/down done is deliberately left masked,
+// the driver sequences power itself.
+//
+static const uint8_t GmaxIntEnableMask[GMAX_INT_REG_COUNT] = {
+	MAX98512_INT1_THERMSHDN_BGN | MAX98512_INT1_THERMSHDN_END |
+	MAX98512_INT1_THERMWARN_BGN | MAX98512_INT1_THERMWARN_END |
+	MAX98512_INT1_BDE_ACTIVE_BGN | MAX98512_INT1_BDE_ACTIVE_END |
+	MAX98512_INT1_BDE_LEVEL_CHANGE,
+
+	MAX98512_INT2_WDOG_ERR | MAX98512_INT2_CLK_ERR |
+	MAX98512_INT2_CLK_RECOVER | MAX98512_INT2_SPK_OVC,
+
+	MAX98512_INT3_BST_CURLIM | MAX98512_INT3_BST_UVLO |
+	MAX98512_INT3_PVDD_UVLO
+};
+
+//
+// Flag bit -> event, one entry per bit. Event is the caller's (the
+// driver's GMAX_EVENT), several bits may share one.
+//
+typedef struct _GMAX_INT_MAP {
+	uint8_t Reg;		// 0..2, INT_FLAG1..3
+	uint8_t Bit;
+	uint8_t Event;
+} GMAX_INT_MAP;
+
+typedef enum {
+	GmaxIntReadFlags,	// burst read INT_FLAG1..3 into Flags
+	GmaxIntClearFlags,	// burst write Flags to INT_FLAG_CLR1..3
+	GmaxIntMaskAll,		// burst write zeros to INT_EN1..3
+	GmaxIntDone
+} GMAX_INT_ACTION;
+
+typedef enum {
+	GmaxIntClaimed,		// Flags were set and are acknowledged
+	GmaxIntSpurious,	// no enabled flag was set, nothing written
+	GmaxIntMasked,		// the bus failed, every source is masked
+	GmaxIntFailed		// the bus failed, and so did the mask
+} GMAX_INT_RESULT;
+
+typedef struct _GMAX_INT_SERVICE
+{
+	uint8_t* Enabled;	// what INT_EN1..3 hold, the caller's
+	uint8_t Flags[GMAX_INT_REG_COUNT];
+	GMAX_INT_ACTION Action;
+	GMAX_INT_RESULT Result;
+} GMAX_INT_SERVICE;
+
+static __inline GMAX_INT_ACTION
+GmaxIntServiceStart(
+	GMAX_INT_SERVICE* Service,
+	uint8_t* Enabled
+)
+{
+	for (int i = 0; i < GMAX_INT_REG_COUNT; i++) {
+		Service->Flags[i] = 0;
+	}
+	Service->Enabled = Enabled;
+	Service->Action = GmaxIntReadFlags;
+	Service->Result = GmaxIntFailed;
+	return Service->Action;
+}
+
+//
+// Records whether the burst Action asked for went through and returns
+// the next one. One fault costs one read and one write; a flag that
+// is masked is never acknowledged, so it cannot hide a later fault of
+// a source that gets unmasked.
+//
+static __inline GMAX_INT_ACTION
+GmaxIntServiceNext(
+	GMAX_INT_SERVICE* Service,
+	int Ok
+)
+{
+	int pending = 0;
+
+	switch (Service->Action) {
+	case GmaxIntReadFlags:
+		if (!Ok) {
+			Service->Action = GmaxIntMaskAll;
+			break;
+		}
+		for (int i = 0; i < GMAX_INT_REG_COUNT; i++) {
+			Service->Flags[i] &= Service->Enabled[i];
+			if (Service->Flags[i]) {
+				pending = 1;
+			}
+		}
+		if (!pending) {
+			Service->Result = GmaxIntSpurious;
+			Service->Action = GmaxIntDone;
+			break;
+		}
+		Service->Action = GmaxIntClearFlags;
+		break;
+
+	case GmaxIntClearFlags:
+		if (!Ok) {
+			Service->Action = GmaxIntMaskAll;
+			break;
+		}
+		Service->Result = GmaxIntClaimed;
+		Service->Action = GmaxIntDone;
+		break;
+
+	case GmaxIntMaskAll:
+		if (Ok) {
+			for (int i = 0; i < GMAX_INT_REG_COUNT; i++) {
+				Service->Enabled[i] = 0;
+			}
+			Service->Result = GmaxIntMasked;
+		}
+		Service->Action = GmaxIntDone;
+		break;
+
+	default:
+		Service->Action = GmaxIntDone;
+		break;
+	}
+
+	return Service->Action;
+}
+
+static __inline uint32_t
+GmaxIntDecode(
+	const GMAX_INT_MAP* Map,
+	uint32_t Count,
+	const uint8_t* Flags
+)
+{
+	uint32_t events = 0;
+
+	for (uint32_t i = 0; i < Count; i++) {
+		if (Flags[Map[i].Reg] & Map[i].Bit) {
+			events |= 1UL << Map[i].Event;
+		}
+	}
+	return events;
+}
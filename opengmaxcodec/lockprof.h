@@ -0,0 +1,113 @@
+#pragma once
+
+//
+// SPB lock contention profile: wait and hold time histograms for the
+// driver's SpbLock and the SPB controller lock, each with its worst
+// samples and the operation behind them. Fixed-width types only, so
+// clients of IOCTL_GMAX_GET_LOCK_PROFILE and the host contention
+// simulator (tools/gmaxlocksim) share it with the driver.
+//
+
+#define GMAX_LOCK_BUCKETS 20	// bucket n counts [2^(n-1), 2^n) us, the last one is open
+#define GMAX_LOCK_WORST 8
+#define GMAX_LOCK_REG_UNKNOWN 0xFFFF	// held outside this driver
+
+typedef enum {
+	GmaxLockSpb,		// per-amp SpbLock
+	GmaxLockController,	// IOCTL_SPB_LOCK_CONTROLLER, shared with every client of the bus
+	GmaxLockMax
+} GMAX_LOCK;
+
+typedef struct _GMAX_LOCK_OP
+{
+	uint16_t Reg;		// first register of the transfer
+	uint8_t Direction;	// GMAX_SPB_DIRECTION
+	uint8_t Length;		// data bytes, saturated
+} GMAX_LOCK_OP;
+
+typedef struct _GMAX_LOCK_SAMPLE
+{
+	uint32_t Us;
+	uint32_t TimestampMs;	// interrupt time
+	GMAX_LOCK_OP Op;	// the waiting or holding operation
+	GMAX_LOCK_OP Holder;	// for waits, the operation that held the lock last
+} GMAX_LOCK_SAMPLE;
+
+typedef struct _GMAX_LOCK_HISTOGRAM
+{
+	uint32_t Count;
+	uint32_t Reserved;
+	uint64_t TotalUs;
+	uint32_t Bucket[GMAX_LOCK_BUCKETS];
+	GMAX_LOCK_SAMPLE Worst[GMAX_LOCK_WORST];	// unordered, Us 0 when unused
+} GMAX_LOCK_HISTOGRAM;
+
+typedef struct _GMAX_LOCK_PROFILE
+{
+	GMAX_LOCK_HISTOGRAM Wait[GmaxLockMax];
+	GMAX_LOCK_HISTOGRAM Hold[GmaxLockMax];
+} GMAX_LOCK_PROFILE;
+
+static __inline unsigned
+GmaxLockBucket(
+	uint32_t Us
+)
+{
+	unsigned bucket = 0;
+
+	while (Us != 0 && bucket < GMAX_LOCK_BUCKETS - 1) {
+		Us >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+static __inline void
+GmaxLockRecord(
+	GMAX_LOCK_HISTOGRAM* Histogram,
+	uint32_t Us,
+	uint32_t TimestampMs,
+	GMAX_LOCK_OP Op,
+	GMAX_LOCK_OP Holder
+)
+{
+	unsigned least = 0;
+
+	Histogram->Count++;
+	Histogram->TotalUs += Us;
+	Histogram->Bucket[GmaxLockBucket(Us)]++;
+
+	for (unsigned i = 1; i < GMAX_LOCK_WORST; i++) {
+		if (Histogram->Worst[i].Us < Histogram->Worst[least].Us) {
+			least = i;
+		}
+	}
+
+	if (Us > Histogram->Worst[least].Us) {
+		Histogram->Worst[least].Us = Us;
+		Histogram->Worst[least].TimestampMs = TimestampMs;
+		Histogram->Worst[least].Op = Op;
+		Histogram->Worst[least].Holder = Holder;
+	}
+}
+
+//
+// Upper bound of the bucket holding the given percentile
+//
+static __inline uint32_t
+GmaxLockPercentileUs(
+	const GMAX_LOCK_HISTOGRAM* Histogram,
+	unsigned Percent
+)
+{
+	uint64_t target = ((uint64_t)Histogram->Count * Percent + 99) / 100;
+	uint64_t seen = 0;
+
+	for (unsigned b = 0; b < GMAX_LOCK_BUCKETS; b++) {
+		seen += Histogram->Bucket[b];
+		if (seen >= target && seen != 0) {
+			return b == 0 ? 1 : (uint32_t)1 << b;
+		}
+	}
+	return 0;
+}
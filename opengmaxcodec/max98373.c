@@ -0,0 +1,99 @@
+/*++
+
+Module Name:
+
+max98373.c
+
+Abstract:
+
+MAX98373 operations. Its registers live at 0x2000 and up with a
+different PCM, volume and interrupt layout, so only the init table,
+power sequencing and the PVDD / thermal readback are driven here. The
+IV slots, volume and brownout stay at their power-on defaults unless a
+tuning profile sets them.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+#include "max98373.h"
+
+#define MAX98373_MONITOR_BURST_LEN (MAX98373_R2055_MEAS_ADC_THERM_CH_READBACK - MAX98373_R2054_MEAS_ADC_PVDD_CH_READBACK + 1)
+
+static const GMAX_BOOT_REG Max98373InitRegs[] = {
+	{MAX98373_R2020_PCM_TX_HIZ_EN_1, 0xFF},
+	{MAX98373_R2021_PCM_TX_HIZ_EN_2, 0xFF},
+	{MAX98373_R203F_AMP_DSP_CFG, 0x03},		// DC blocker
+	{MAX98373_R2046_IV_SENSE_ADC_DSP_CFG, 0x07}	// IV DC blocker
+};
+
+static const GMAX_POWER_STEP Max98373PowerUpSteps[] = {
+	{{{MAX98373_R20FF_GLOBAL_SHDN, MAX98373_GLOBAL_EN_MASK}}, 1, GMAX_POWER_SETTLE_QUIRK},
+	{{{MAX98373_R2043_AMP_EN, MAX98373_SPK_EN_MASK}}, 1, 0}
+};
+
+static const GMAX_POWER_STEP Max98373PowerDownSteps[] = {
+	{{{MAX98373_R2000_SW_RESET, GMAX_CHIP_SOFT_RESET}}, 1, 0}
+};
+
+static NTSTATUS
+Max98373ReadMonitor(
+	_In_ PGMAX_CONTEXT pDevice,
+	_Out_ GMAX_MONITOR_SAMPLE* Sample
+)
+/*++
+
+Routine Description:
+
+PVDD and thermal in one burst. There is no VBAT channel, brownout
+status or boost readback, those stay 0.
+
+--*/
+{
+	UINT8 adc[MAX98373_MONITOR_BURST_LEN];
+	NTSTATUS status;
+
+	GmaxCmdBegin(pDevice, GmaxPriorityTelemetry);
+	status = gmax_reg_bulk_read(pDevice, MAX98373_R2054_MEAS_ADC_PVDD_CH_READBACK, adc, sizeof(adc));
+	GmaxCmdEnd(pDevice);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	Sample->Pvdd = adc[0];
+	Sample->Therm = adc[1];
+	return status;
+}
+
+//
+// SW_RESET through GLOBAL_SHDN, then REV_ID on its own
+//
+static const GMAX_REG_RANGE Max98373RegMap[] = {
+	{ MAX98373_R2000_SW_RESET, MAX98373_R20FF_GLOBAL_SHDN - MAX98373_R2000_SW_RESET + 1 },
+	{ MAX98373_R21FF_REV_ID, 1 }
+};
+
+const GMAX_CHIP_OPS GmaxMax98373Ops = {
+	.Model = 98373,
+	.Hid = "MX98373",
+	.Features = 0,
+	.Regs = {
+		.RevId = MAX98373_R21FF_REV_ID,
+		.SoftReset = MAX98373_R2000_SW_RESET,
+		.GlobalEnable = MAX98373_R20FF_GLOBAL_SHDN,
+		.AmpEnable = MAX98373_R2043_AMP_EN,
+		.PcmModeCfg = MAX98373_R2024_PCM_DATA_FMT_CFG,
+		.ThermWarnThresh = MAX98373_R2014_THERM_WARN_THRESH
+	},
+	.RegMap = { Max98373RegMap, ARRAYSIZE(Max98373RegMap) },
+	.InitRegs = Max98373InitRegs,
+	.InitCount = ARRAYSIZE(Max98373InitRegs),
+	.PowerUp = Max98373PowerUpSteps,
+	.PowerUpCount = ARRAYSIZE(Max98373PowerUpSteps),
+	.PowerDown = Max98373PowerDownSteps,
+	.PowerDownCount = ARRAYSIZE(Max98373PowerDownSteps),
+	.ReadMonitor = Max98373ReadMonitor
+};
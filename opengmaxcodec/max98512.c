@@ -0,0 +1,118 @@
+/*++
+
+Module Name:
+
+max98512.c
+
+Abstract:
+
+MAX98512 operations: init table, power sequencing and the monitor
+read. The only chip with interrupts, the clock monitor, the volume
+ramp and brownout profiles wired up.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+#include "max98512.h"
+
+//
+// MEAS_ADC_CH0_READ through BROWNOUT_STATUS in one burst
+//
+#define MAX98512_MONITOR_BURST_LEN (MAX98512_R004F_BROWNOUT_STATUS - MAX98512_R004A_MEAS_ADC_CH0_READ + 1)
+
+static const GMAX_BOOT_REG Max98512InitRegs[] = {
+	{MAX98512_R0011_CLK_MON, MAX98512_CLK_MON_CMON_ENA | MAX98512_CLK_MON_CMON_AUTORESTART_ENA},
+	{MAX98512_R0014_MEAS_ADC_THERM_WARN_THRESH, GMAX_THERM_WARN_THRESH},
+	{MAX98512_R0015_MEAS_ADC_THERM_SHDN_THRESH, 0x8C},
+	{MAX98512_R0016_MEAS_ADC_THERM_HYSTERESIS, 0x8},
+	{MAX98512_R0018_PCM_RX_EN_A, 0x3},
+	{MAX98512_R0020_PCM_MODE_CFG, 0x58},
+	{MAX98512_R0022_PCM_CLK_SETUP, 0x26},
+	{MAX98512_R0023_PCM_SR_SETUP1, 0x8},
+	{MAX98512_R0041_MEAS_ADC_CFG, MAX98512_MEAS_ADC_CH0_EN | MAX98512_MEAS_ADC_CH1_EN | MAX98512_MEAS_ADC_CH2_EN}
+};
+
+static const GMAX_POWER_STEP Max98512PowerUpSteps[] = {
+	{{{MAX98512_R0400_GLOBAL_SHDN, MAX98512_GLOBAL_EN_MASK}}, 1, GMAX_POWER_SETTLE_QUIRK},
+	{{{MAX98512_R0038_AMP_EN, MAX98512_AMP_EN_MASK}}, 1, 0}
+};
+
+static const GMAX_POWER_STEP Max98512PowerDownSteps[] = {
+	{{{MAX98512_R0401_SOFT_RESET, GMAX_CHIP_SOFT_RESET}}, 1, 0}
+};
+
+static NTSTATUS
+Max98512ReadMonitor(
+	_In_ PGMAX_CONTEXT pDevice,
+	_Out_ GMAX_MONITOR_SAMPLE* Sample
+)
+/*++
+
+Routine Description:
+
+Two short bursts, MEAS_ADC_CH0_READ..BROWNOUT_STATUS and
+ENV_TRACK_BOOST_VOUT_READ, each its own telemetry command so power
+and volume commands can get in between them.
+
+--*/
+{
+	UINT8 adc[MAX98512_MONITOR_BURST_LEN];
+	NTSTATUS status;
+
+	GmaxCmdBegin(pDevice, GmaxPriorityTelemetry);
+	status = gmax_reg_bulk_read(pDevice, MAX98512_R004A_MEAS_ADC_CH0_READ, adc, sizeof(adc));
+	GmaxCmdEnd(pDevice);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	GmaxCmdBegin(pDevice, GmaxPriorityTelemetry);
+	status = gmax_reg_read(pDevice, MAX98512_R0085_ENV_TRACK_BOOST_VOUT_READ, &Sample->BoostVout);
+	GmaxCmdEnd(pDevice);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	Sample->Pvdd = adc[MAX98512_MEAS_ADC_CH_PVDD];
+	Sample->Therm = adc[MAX98512_MEAS_ADC_CH_THERM];
+	Sample->Vbat = adc[MAX98512_MEAS_ADC_CH_VBAT];
+	Sample->BrownoutStatus = adc[MAX98512_R004F_BROWNOUT_STATUS - MAX98512_R004A_MEAS_ADC_CH0_READ];
+	return status;
+}
+
+//
+// Amp blocks through IVADC_BYPASS, then GLOBAL_SHDN, SOFT_RESET, REV_ID
+//
+static const GMAX_REG_RANGE Max98512RegMap[] = {
+	{ 0x0000, MAX98512_R008D_IVADC_BYPASS + 1 },
+	{ MAX98512_R0400_GLOBAL_SHDN, MAX98512_R0402_REV_ID - MAX98512_R0400_GLOBAL_SHDN + 1 }
+};
+
+const GMAX_CHIP_OPS GmaxMax98512Ops = {
+	.Model = 98512,
+	.Hid = "MX98512",
+	.Features = GMAX_CHIP_IV_ROUTING | GMAX_CHIP_INTERRUPTS | GMAX_CHIP_VOLUME | GMAX_CHIP_BDE |
+		GMAX_CHIP_CLOCK_MONITOR,
+	.Regs = {
+		.RevId = MAX98512_R0402_REV_ID,
+		.SoftReset = MAX98512_R0401_SOFT_RESET,
+		.GlobalEnable = MAX98512_R0400_GLOBAL_SHDN,
+		.AmpEnable = MAX98512_R0038_AMP_EN,
+		.PcmModeCfg = MAX98512_R0020_PCM_MODE_CFG,
+		.ThermWarnThresh = MAX98512_R0014_MEAS_ADC_THERM_WARN_THRESH,
+		.AmpVolume = MAX98512_R0035_AMP_VOL_CTRL,
+		.SpeakerGain = MAX98512_R003A_SPK_GAIN
+	},
+	.RegMap = { Max98512RegMap, ARRAYSIZE(Max98512RegMap) },
+	.InitRegs = Max98512InitRegs,
+	.InitCount = ARRAYSIZE(Max98512InitRegs),
+	.PowerUp = Max98512PowerUpSteps,
+	.PowerUpCount = ARRAYSIZE(Max98512PowerUpSteps),
+	.PowerDown = Max98512PowerDownSteps,
+	.PowerDownCount = ARRAYSIZE(Max98512PowerDownSteps),
+	.ReadMonitor = Max98512ReadMonitor
+};
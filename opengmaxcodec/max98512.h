@@ -1,7 +1,7 @@
 #include "stdint.h"
 
-#ifndef _MAX98927_H
-#define _MAX98927_H
+#ifndef _MAX98512_H
+#define _MAX98512_H
 
 /* Register Values */
 #define MAX98512_R0001_INT_RAW1 0x0001
@@ -126,6 +126,38 @@
 #define MAX98512_R0401_SOFT_RESET 0x0401
 #define MAX98512_R0402_REV_ID 0x0402
 
+/* MAX98512_R0001_INT_RAW1 .. MAX98512_R000D_INT_FLAG_CLR1 */
+#define MAX98512_INT1_THERMSHDN_BGN (0x1 << 0)
+#define MAX98512_INT1_THERMSHDN_END (0x1 << 1)
+#define MAX98512_INT1_THERMWARN_BGN (0x1 << 2)
+#define MAX98512_INT1_THERMWARN_END (0x1 << 3)
+#define MAX98512_INT1_BDE_ACTIVE_BGN (0x1 << 4)
+#define MAX98512_INT1_BDE_ACTIVE_END (0x1 << 5)
+#define MAX98512_INT1_BDE_LEVEL_CHANGE (0x1 << 6)
+#define MAX98512_INT1_BDE_L4 (0x1 << 7)
+
+/* MAX98512_R0002_INT_RAW2 .. MAX98512_R000E_INT_FLAG_CLR2 */
+#define MAX98512_INT2_WDOG_ERR (0x1 << 0)
+#define MAX98512_INT2_CLK_ERR (0x1 << 1)
+#define MAX98512_INT2_CLK_RECOVER (0x1 << 2)
+#define MAX98512_INT2_PWRUP_DONE (0x1 << 3)
+#define MAX98512_INT2_PWRDN_DONE (0x1 << 4)
+#define MAX98512_INT2_SPK_OVC (0x1 << 5)
+
+/* MAX98512_R0003_INT_RAW3 .. MAX98512_R000F_INT_FLAG_CLR3 */
+#define MAX98512_INT3_BST_CURLIM (0x1 << 0)
+#define MAX98512_INT3_BST_UVLO (0x1 << 1)
+#define MAX98512_INT3_PVDD_UVLO (0x1 << 2)
+
+/* MAX98512_R0010_IRQ_CTRL */
+#define MAX98512_IRQ_CTRL_EN (0x1 << 0)
+#define MAX98512_IRQ_CTRL_POL_HIGH (0x1 << 1)
+#define MAX98512_IRQ_CTRL_MODE_PUSH_PULL (0x1 << 2)
+
+/* MAX98512_R0011_CLK_MON */
+#define MAX98512_CLK_MON_CMON_ENA (0x1 << 0)
+#define MAX98512_CLK_MON_CMON_AUTORESTART_ENA (0x1 << 1)
+
 /* MAX98512_R0018_PCM_RX_EN_A */
 #define MAX98512_PCM_RX_CH0_EN (0x1 << 0)
 #define MAX98512_PCM_RX_CH1_EN (0x1 << 1)
@@ -290,12 +322,22 @@
 #define MAX98512_MEAS_I_EN (0x1 << 1)
 #define MAX98512_MEAS_VI_EN (0x3 << 0)
 
+/* MAX98512_R0041_MEAS_ADC_CFG */
+#define MAX98512_MEAS_ADC_CH0_EN (0x1 << 0)
+#define MAX98512_MEAS_ADC_CH1_EN (0x1 << 1)
+#define MAX98512_MEAS_ADC_CH2_EN (0x1 << 2)
+
+/* MAX98512_R004A_MEAS_ADC_CH0_READ .. MAX98512_R004C_MEAS_ADC_CH2_READ */
+#define MAX98512_MEAS_ADC_CH_PVDD 0
+#define MAX98512_MEAS_ADC_CH_THERM 1
+#define MAX98512_MEAS_ADC_CH_VBAT 2
+
 /* MAX98512_R003E_BOOST_CTRL0 */
 #define MAX98512_BOOST_CTRL0_VOUT_MASK (0x1F << 0)
 #define MAX98512_BOOST_CTRL0_PVDD_MASK (0x1 << 7)
 #define MAX98512_BOOST_CTRL0_PVDD_EN_SHIFT (7)
 
-/* MAX98512_R0052_BROWNOUT_EN */
+/* MAX98512_R0050_BROWNOUT_EN */
 #define MAX98512_BROWNOUT_BDE_EN (0x1 << 0)
 #define MAX98512_BROWNOUT_AMP_EN (0x1 << 1)
 #define MAX98512_BROWNOUT_DSP_EN (0x1 << 2)
@@ -310,10 +352,10 @@
 #define MAX98512_BROWNOUT_LVL_INF_HOLD_L4 (0x1 << 1)
 
 
-/* MAX98512_R0100_SOFT_RESET */
+/* MAX98512_R0401_SOFT_RESET */
 #define MAX98512_SOFT_RESET (0x1 << 0)
 
-/* MAX98512_R00FF_GLOBAL_SHDN */
+/* MAX98512_R0400_GLOBAL_SHDN */
 #define MAX98512_GLOBAL_EN_MASK (0x1 << 0)
 
 #define MAX98512_GLOBAL_SHIFT 0
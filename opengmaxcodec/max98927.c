@@ -0,0 +1,130 @@
+/*++
+
+Module Name:
+
+max98927.c
+
+Abstract:
+
+MAX98927 operations. The PCM block sits at the same addresses as on
+the MAX98512, so the IV slot routing and the volume ramp are shared;
+the amp, measurement and global registers are shifted. Interrupts and
+brownout profiles are not wired up, the monitor poll covers them.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+#include "max98927.h"
+
+#define MAX98927_MONITOR_BURST_LEN (MAX98927_R004E_MEAS_ADC_CH2_READ - MAX98927_R004C_MEAS_ADC_CH0_READ + 1)
+
+static const GMAX_BOOT_REG Max98927InitRegs[] = {
+	{MAX98927_R0014_MEAS_ADC_THERM_WARN_THRESH, GMAX_THERM_WARN_THRESH},
+	{MAX98927_R0015_MEAS_ADC_THERM_SHDN_THRESH, 0x8C},
+	{MAX98927_R0016_MEAS_ADC_THERM_HYSTERESIS, 0x8},
+	{MAX98927_R0018_PCM_RX_EN_A, 0x3},
+	{MAX98927_R0020_PCM_MODE_CFG, 0x58},
+	{MAX98927_R0022_PCM_CLK_SETUP, 0x26},
+	{MAX98927_R0023_PCM_SR_SETUP1, 0x8},
+	{MAX98927_R0037_AMP_DSP_CFG, 0x03},		// DC blocker
+	{MAX98927_R003F_MEAS_DSP_CFG, 0xF7},		// IV DC blocker
+	{MAX98927_R0040_BOOST_CTRL0, 0x1C},
+	{MAX98927_R0042_BOOST_CTRL1, 0x3E},
+	{MAX98927_R0043_MEAS_ADC_CFG, MAX98927_MEAS_ADC_CH0_EN | MAX98927_MEAS_ADC_CH1_EN | MAX98927_MEAS_ADC_CH2_EN},
+	{MAX98927_R0044_MEAS_ADC_BASE_MSB, 0x00},
+	{MAX98927_R0045_MEAS_ADC_BASE_LSB, 0x24},
+	{MAX98927_R0082_ENV_TRACK_VOUT_HEADROOM, 0x08},
+	{MAX98927_R0086_ENV_TRACK_CTRL, 0x01}
+};
+
+static const GMAX_POWER_STEP Max98927PowerUpSteps[] = {
+	{{{MAX98927_R00FF_GLOBAL_SHDN, MAX98927_GLOBAL_EN_MASK}}, 1, GMAX_POWER_SETTLE_QUIRK},
+	{{{MAX98927_R003A_AMP_EN, MAX98927_AMP_EN_MASK}}, 1, 0}
+};
+
+static const GMAX_POWER_STEP Max98927PowerDownSteps[] = {
+	{{{MAX98927_R0100_SOFT_RESET, GMAX_CHIP_SOFT_RESET}}, 1, 0}
+};
+
+static NTSTATUS
+Max98927ReadMonitor(
+	_In_ PGMAX_CONTEXT pDevice,
+	_Out_ GMAX_MONITOR_SAMPLE* Sample
+)
+/*++
+
+Routine Description:
+
+The ADC channels (PVDD, thermal, VBAT in the same order as the
+MAX98512), then BROWNOUT_STATUS and ENV_TRACK_BOOST_VOUT_READ, which
+are not adjacent here. One telemetry command per transfer.
+
+--*/
+{
+	UINT8 adc[MAX98927_MONITOR_BURST_LEN];
+	NTSTATUS status;
+
+	GmaxCmdBegin(pDevice, GmaxPriorityTelemetry);
+	status = gmax_reg_bulk_read(pDevice, MAX98927_R004C_MEAS_ADC_CH0_READ, adc, sizeof(adc));
+	GmaxCmdEnd(pDevice);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	GmaxCmdBegin(pDevice, GmaxPriorityTelemetry);
+	status = gmax_reg_read(pDevice, MAX98927_R0051_BROWNOUT_STATUS, &Sample->BrownoutStatus);
+	GmaxCmdEnd(pDevice);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	GmaxCmdBegin(pDevice, GmaxPriorityTelemetry);
+	status = gmax_reg_read(pDevice, MAX98927_R0087_ENV_TRACK_BOOST_VOUT_READ, &Sample->BoostVout);
+	GmaxCmdEnd(pDevice);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	Sample->Pvdd = adc[0];
+	Sample->Therm = adc[1];
+	Sample->Vbat = adc[2];
+	return status;
+}
+
+//
+// Amp blocks through ENV_TRACK_BOOST_VOUT_READ, GLOBAL_SHDN and
+// SOFT_RESET, then REV_ID on its own
+//
+static const GMAX_REG_RANGE Max98927RegMap[] = {
+	{ 0x0000, MAX98927_R0087_ENV_TRACK_BOOST_VOUT_READ + 1 },
+	{ MAX98927_R00FF_GLOBAL_SHDN, MAX98927_R0100_SOFT_RESET - MAX98927_R00FF_GLOBAL_SHDN + 1 },
+	{ MAX98927_R01FF_REV_ID, 1 }
+};
+
+const GMAX_CHIP_OPS GmaxMax98927Ops = {
+	.Model = 98927,
+	.Hid = "MX98927",
+	.Features = GMAX_CHIP_IV_ROUTING | GMAX_CHIP_VOLUME,
+	.Regs = {
+		.RevId = MAX98927_R01FF_REV_ID,
+		.SoftReset = MAX98927_R0100_SOFT_RESET,
+		.GlobalEnable = MAX98927_R00FF_GLOBAL_SHDN,
+		.AmpEnable = MAX98927_R003A_AMP_EN,
+		.PcmModeCfg = MAX98927_R0020_PCM_MODE_CFG,
+		.ThermWarnThresh = MAX98927_R0014_MEAS_ADC_THERM_WARN_THRESH,
+		.AmpVolume = MAX98927_R0036_AMP_VOL_CTRL,
+		.SpeakerGain = MAX98927_R003C_SPK_GAIN
+	},
+	.RegMap = { Max98927RegMap, ARRAYSIZE(Max98927RegMap) },
+	.InitRegs = Max98927InitRegs,
+	.InitCount = ARRAYSIZE(Max98927InitRegs),
+	.PowerUp = Max98927PowerUpSteps,
+	.PowerUpCount = ARRAYSIZE(Max98927PowerUpSteps),
+	.PowerDown = Max98927PowerDownSteps,
+	.PowerDownCount = ARRAYSIZE(Max98927PowerDownSteps),
+	.ReadMonitor = Max98927ReadMonitor
+};
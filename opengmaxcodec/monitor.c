@@ -0,0 +1,257 @@
+/*++
+
+Module Name:
+
+monitor.c
+
+Abstract:
+
+Samples the measurement ADC (PVDD, thermal, VBAT), the brownout status
+and the envelope tracking boost voltage while a stream is running.
+
+The chip's ReadMonitor does the reads, each short burst a separate
+telemetry class command, so a stream-start sequence waits for at most
+one short transfer.
+
+The poll period adapts: fast while the temperature or brownout level
+is rising, backing off exponentially while things are stable, and the
+timer is not armed at all when no stream is active.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+EVT_WDF_TIMER GmaxEvtMonitorTimer;
+
+ULONG
+GmaxMonitorNextPeriod(
+	_In_ ULONG CurrentPeriodMs,
+	_In_ const GMAX_MONITOR_SAMPLE* Previous,
+	_In_ const GMAX_MONITOR_SAMPLE* Sample,
+	_In_ UINT8 ThermWarnThreshold
+)
+/*++
+
+Routine Description:
+
+Picks the delay until the next poll from the last two samples. Kept
+free of any WDF state so the policy can be exercised on its own.
+
+--*/
+{
+	BOOLEAN rising = FALSE;
+
+	//
+	// Any brownout level active, not just a new one
+	//
+	if (Sample->BrownoutStatus != 0) {
+		rising = TRUE;
+	}
+
+	if (Sample->Therm > Previous->Therm ||
+		Sample->Therm + GMAX_MONITOR_THERM_MARGIN >= ThermWarnThreshold) {
+		rising = TRUE;
+	}
+
+	if (rising) {
+		return GMAX_MONITOR_FAST_PERIOD_MS;
+	}
+
+	return min(CurrentPeriodMs * 2, GMAX_MONITOR_SLOW_PERIOD_MS);
+}
+
+static UINT8
+GmaxMonitorThermWarnThreshold(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+The thermal warning threshold as StartCodec wrote it, which a tuning
+profile may have moved.
+
+--*/
+{
+	const GMAX_TUNING_IMAGE* image = &pDevice->Tuning.Image;
+	ULONG index;
+
+	if (GmaxTuningFind(image, pDevice->Chip->Regs.ThermWarnThresh, &index)) {
+		return image->Value[index];
+	}
+	return GMAX_THERM_WARN_THRESH;
+}
+
+static NTSTATUS
+GmaxMonitorPoll(
+	_In_ PGMAX_CONTEXT pDevice,
+	_Out_ GMAX_MONITOR_SAMPLE* Sample
+)
+{
+	NTSTATUS status;
+
+	RtlZeroMemory(Sample, sizeof(*Sample));
+
+	status = pDevice->Chip->ReadMonitor(pDevice, Sample);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	Sample->TimestampMs = (UINT32)(KeQueryInterruptTime() / 10000);
+	return status;
+}
+
+VOID
+GmaxEvtMonitorTimer(
+	_In_ WDFTIMER Timer
+)
+{
+	PGMAX_CONTEXT pDevice = GetDeviceContext(WdfTimerGetParentObject(Timer));
+	GMAX_MONITOR* monitor = &pDevice->Monitor;
+	GMAX_MONITOR_SAMPLE sample;
+	GMAX_MONITOR_SAMPLE previous;
+	BOOLEAN havePrevious;
+
+	if (!monitor->Running) {
+		return;
+	}
+
+	if (!NT_SUCCESS(GmaxMonitorPoll(pDevice, &sample))) {
+		monitor->PeriodMs = GMAX_MONITOR_SLOW_PERIOD_MS;
+		goto rearm;
+	}
+
+	WdfSpinLockAcquire(monitor->Lock);
+
+	havePrevious = monitor->Count > 0;
+	if (havePrevious) {
+		previous = monitor->Ring[(monitor->Head + monitor->Count - 1) % GMAX_MONITOR_RING_SIZE];
+	}
+
+	if (monitor->Count == GMAX_MONITOR_RING_SIZE) {
+		monitor->Head = (monitor->Head + 1) % GMAX_MONITOR_RING_SIZE;
+		monitor->Count--;
+	}
+	monitor->Ring[(monitor->Head + monitor->Count) % GMAX_MONITOR_RING_SIZE] = sample;
+	monitor->Count++;
+	monitor->PollCount++;
+
+	WdfSpinLockRelease(monitor->Lock);
+
+	monitor->PeriodMs = GmaxMonitorNextPeriod(monitor->PeriodMs,
+		havePrevious ? &previous : &sample,
+		&sample,
+		GmaxMonitorThermWarnThreshold(pDevice));
+
+rearm:
+	if (monitor->Running) {
+		WdfTimerStart(Timer, WDF_REL_TIMEOUT_IN_MS(monitor->PeriodMs));
+	}
+}
+
+NTSTATUS
+GmaxMonitorInitialize(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	GMAX_MONITOR* monitor = &pDevice->Monitor;
+	WDF_TIMER_CONFIG timerConfig;
+	WDF_OBJECT_ATTRIBUTES attributes;
+	NTSTATUS status;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+
+	status = WdfSpinLockCreate(&attributes, &monitor->Lock);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	//
+	// Passive-level timers must be one-shot, the callback re-arms
+	// itself with the adaptive period.
+	//
+	WDF_TIMER_CONFIG_INIT(&timerConfig, GmaxEvtMonitorTimer);
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+	attributes.ExecutionLevel = WdfExecutionLevelPassive;
+
+	return WdfTimerCreate(&timerConfig, &attributes, &monitor->Timer);
+}
+
+VOID
+GmaxMonitorUpdate(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Starts the monitor when the amp is powered with an active stream and
+stops it otherwise. Idle and warm standby cost no bus traffic.
+
+--*/
+{
+	GMAX_MONITOR* monitor = &pDevice->Monitor;
+	BOOLEAN run = pDevice->Codec.PoweredOn && pDevice->CSAudioRequestsOn;
+
+	if (!monitor->Timer || run == monitor->Running) {
+		return;
+	}
+
+	monitor->Running = run;
+	if (run) {
+		monitor->PeriodMs = GMAX_MONITOR_FAST_PERIOD_MS;
+		WdfTimerStart(monitor->Timer, WDF_REL_TIMEOUT_IN_MS(monitor->PeriodMs));
+	}
+	else {
+		WdfTimerStop(monitor->Timer, FALSE);
+	}
+}
+
+VOID
+GmaxMonitorStop(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	GMAX_MONITOR* monitor = &pDevice->Monitor;
+
+	if (!monitor->Timer) {
+		return;
+	}
+
+	monitor->Running = FALSE;
+	WdfTimerStop(monitor->Timer, TRUE);
+}
+
+ULONG
+GmaxMonitorCopySamples(
+	_In_ PGMAX_CONTEXT pDevice,
+	_Out_writes_bytes_(Count * sizeof(GMAX_MONITOR_SAMPLE)) GMAX_MONITOR_SAMPLE* Samples,
+	_In_ ULONG Count
+)
+{
+	GMAX_MONITOR* monitor = &pDevice->Monitor;
+	ULONG copied;
+	ULONG first;
+
+	WdfSpinLockAcquire(monitor->Lock);
+
+	copied = min(Count, monitor->Count);
+	first = monitor->Head + monitor->Count - copied;
+	for (ULONG i = 0; i < copied; i++) {
+		Samples[i] = monitor->Ring[(first + i) % GMAX_MONITOR_RING_SIZE];
+	}
+
+	WdfSpinLockRelease(monitor->Lock);
+
+	return copied;
+}
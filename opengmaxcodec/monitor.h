@@ -0,0 +1,69 @@
+#pragma once
+
+//
+// Periodic thermal / brownout / boost monitor
+//
+
+#define GMAX_MONITOR_RING_SIZE 64
+
+#define GMAX_MONITOR_FAST_PERIOD_MS 100
+#define GMAX_MONITOR_SLOW_PERIOD_MS 2000
+
+//
+// Thermal warning threshold the init tables program into
+// MEAS_ADC_THERM_WARN_THRESH. The monitor compares against the value
+// the tuning image writes, this only when the image has none.
+//
+#define GMAX_THERM_WARN_THRESH 0x75
+
+//
+// Therm codes this close to the warning threshold count as "rising"
+//
+#define GMAX_MONITOR_THERM_MARGIN 8
+
+typedef struct _GMAX_MONITOR
+{
+	WDFTIMER Timer;
+	WDFSPINLOCK Lock;
+
+	BOOLEAN Running;
+	ULONG PeriodMs;
+
+	GMAX_MONITOR_SAMPLE Ring[GMAX_MONITOR_RING_SIZE];
+	ULONG Head;
+	ULONG Count;
+
+	ULONG PollCount;
+} GMAX_MONITOR;
+
+struct _GMAX_CONTEXT;
+
+NTSTATUS
+GmaxMonitorInitialize(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+VOID
+GmaxMonitorUpdate(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+VOID
+GmaxMonitorStop(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+ULONG
+GmaxMonitorNextPeriod(
+	_In_ ULONG CurrentPeriodMs,
+	_In_ const GMAX_MONITOR_SAMPLE* Previous,
+	_In_ const GMAX_MONITOR_SAMPLE* Sample,
+	_In_ UINT8 ThermWarnThreshold
+);
+
+ULONG
+GmaxMonitorCopySamples(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_Out_writes_bytes_(Count * sizeof(GMAX_MONITOR_SAMPLE)) GMAX_MONITOR_SAMPLE* Samples,
+	_In_ ULONG Count
+);
@@ -1,5 +1,6 @@
 #include "opengmaxcodec.h"
 #include "max98512.h"
+#include "tdmslots.h"
 
 #define bool int
 
@@ -15,6 +16,7 @@ DriverEntry(
 	NTSTATUS               status = STATUS_SUCCESS;
 	WDF_DRIVER_CONFIG      config;
 	WDF_OBJECT_ATTRIBUTES  attributes;
+	ULONGLONG              start = KeQueryInterruptTimePrecise(NULL);
 
 	GmaxPrint(DEBUG_LEVEL_INFO, DBG_INIT,
 		"Driver Entry\n");
@@ -38,43 +40,17 @@ DriverEntry(
 	{
 		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_INIT,
 			"WdfDriverCreate failed with status 0x%x\n", status);
+		return status;
 	}
 
-	return status;
-}
-
-typedef enum platform {
-	PlatformNone,
-	PlatformRyzen,
-	PlatformAmberLake,
-	PlatformTigerLake
-} Platform;
-
-static Platform GetPlatform() {
-	int cpuinfo[4];
-	__cpuidex(cpuinfo, 0, 0);
-
-	int temp = cpuinfo[2];
-	cpuinfo[2] = cpuinfo[3];
-	cpuinfo[3] = temp;
-
-	char vendorName[13];
-	RtlZeroMemory(vendorName, 13);
-	memcpy(vendorName, &cpuinfo[1], 12);
-
-	__cpuidex(cpuinfo, 1, 0);
-
-	UINT16 family = (cpuinfo[0] >> 8) & 0xF;
-	UINT8 model = (cpuinfo[0] >> 4) & 0xF;
-	UINT8 stepping = cpuinfo[0] & 0xF;
-	if (family == 0xF || family == 0x6) {
-		model += (((cpuinfo[0] >> 16) & 0xF) << 4);
-	}
-	if (family == 0xF) {
-		family += (cpuinfo[0] >> 20) & 0xFF;
-	}
+	//
+	// Firmware tables that cannot be read leave the CPU match or the
+	// default quirks
+	//
+	GmaxPlatformIdentify();
 
-	return PlatformQcom;
+	GmaxTimelineDriverEntry(start, status);
+	return status;
 }
 
 NTSTATUS gmax_reg_read(
@@ -82,89 +58,116 @@ NTSTATUS gmax_reg_read(
 	uint16_t reg,
 	uint8_t* data
 ) {
-	uint8_t buf[2];
-	buf[0] = (reg >> 8) & 0xff;
-	buf[1] = reg & 0xff;
-
 	uint8_t raw_data = 0;
-	NTSTATUS status = SpbXferDataSynchronously(&pDevice->I2CContext, buf, sizeof(buf), &raw_data, sizeof(uint8_t));
+	NTSTATUS status = gmax_reg_bulk_read(pDevice, reg, &raw_data, 1);
 	*data = raw_data;
 	return status;
 }
 
+NTSTATUS gmax_reg_message_write(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ SPB_MESSAGE* message
+) {
+	const uint8_t* buf = message->Buffer;
+	uint32_t len = (uint32_t)message->Range.BufferLength - 2;
+	uint16_t reg = (uint16_t)(buf[0] << 8 | buf[1]);
+
+	ULONGLONG start = KeQueryInterruptTimePrecise(NULL);
+	NTSTATUS status = SpbMessageWrite(&pDevice->I2CContext, message);
+	if (NT_SUCCESS(status)) {
+		GmaxRegStatsWrite(pDevice, reg, &buf[2], len, KeQueryInterruptTimePrecise(NULL) - start);
+		GmaxShadowStore(pDevice, reg, &buf[2], len);
+	}
+	GmaxTimelineBus(pDevice, GmaxStageBusWrite, reg, start, status);
+	return status;
+}
+
 NTSTATUS gmax_reg_write(
 	_In_ PGMAX_CONTEXT pDevice,
 	uint16_t reg,
 	uint8_t data
 ) {
-	uint8_t buf[3];
-	buf[0] = (reg >> 8) & 0xff;
-	buf[1] = reg & 0xff;
-	buf[2] = data;
-	return SpbWriteDataSynchronously(&pDevice->I2CContext, buf, sizeof(buf));
+	SPB_MESSAGE message;
+	NTSTATUS status = SpbMessageBegin(&pDevice->I2CContext, &message, 3);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	SpbMessageAddress(&message, reg);
+	SpbMessageByte(&message, data);
+	status = gmax_reg_message_write(pDevice, &message);
+	SpbMessageEnd(&pDevice->I2CContext, &message);
+	return status;
 }
 
-NTSTATUS gmax_reg_update(
+NTSTATUS gmax_reg_bulk_read(
 	_In_ PGMAX_CONTEXT pDevice,
 	uint16_t reg,
-	uint8_t mask,
-	uint8_t val
+	uint8_t* data,
+	uint32_t len
 ) {
-	uint8_t tmp = 0, orig = 0;
-
-	NTSTATUS status = gmax_reg_read(pDevice, reg, &orig);
+	SPB_MESSAGE message;
+	NTSTATUS status = SpbMessageBegin(&pDevice->I2CContext, &message, 2);
 	if (!NT_SUCCESS(status)) {
 		return status;
 	}
 
-	tmp = orig & ~mask;
-	tmp |= val & mask;
+	SpbMessageAddress(&message, reg);
 
-	if (tmp != orig) {
-		status = gmax_reg_write(pDevice, reg, tmp);
+	ULONGLONG start = KeQueryInterruptTimePrecise(NULL);
+	status = SpbMessageXfer(&pDevice->I2CContext, &message, data, len);
+	if (NT_SUCCESS(status)) {
+		GmaxRegStatsRead(pDevice, reg, data, len, KeQueryInterruptTimePrecise(NULL) - start);
+		GmaxShadowStore(pDevice, reg, data, len);
 	}
+	GmaxTimelineBus(pDevice, GmaxStageBusXfer, reg, start, status);
+	SpbMessageEnd(&pDevice->I2CContext, &message);
 	return status;
 }
 
-struct initreg {
-	UINT16 reg;
-	UINT8 val;
-};
-
-struct initreg max98512_initregs[] = {
-	{MAX98512_R0014_MEAS_ADC_THERM_WARN_THRESH, 0x75},
-	{MAX98512_R0015_MEAS_ADC_THERM_SHDN_THRESH, 0x8C},
-	{MAX98512_R0016_MEAS_ADC_THERM_HYSTERESIS, 0x8},
-	{MAX98512_R0018_PCM_RX_EN_A, 0x3},
-	{MAX98512_R0020_PCM_MODE_CFG, 0x58},
-	{MAX98512_R0022_PCM_CLK_SETUP, 0x26},
-	{MAX98512_R0023_PCM_SR_SETUP1, 0x8}
-};
-
-NTSTATUS toggleI2CAmp(
+NTSTATUS gmax_reg_bulk_write(
 	_In_ PGMAX_CONTEXT pDevice,
-	BOOLEAN enable
+	uint16_t reg,
+	const uint8_t* data,
+	uint32_t len
 ) {
-	return gmax_reg_write(pDevice, pDevice->chipModel == 98512 ? MAX98512_R0038_AMP_EN, enable & 0x1);
+	SPB_MESSAGE message;
+	NTSTATUS status = SpbMessageBegin(&pDevice->I2CContext, &message, len + 2);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	SpbMessageAddress(&message, reg);
+	SpbMessageCopy(&pDevice->I2CContext, &message, data, len);
+	status = gmax_reg_message_write(pDevice, &message);
+	SpbMessageEnd(&pDevice->I2CContext, &message);
+	return status;
 }
 
-NTSTATUS enableOutput(
+NTSTATUS gmax_reg_update(
 	_In_ PGMAX_CONTEXT pDevice,
-	BOOLEAN enable
+	uint16_t reg,
+	uint8_t mask,
+	uint8_t val
 ) {
-	NTSTATUS status;
-	status = gmax_reg_write(pDevice, pDevice->chipModel == 98512 ? MAX98512_R0400_GLOBAL_SHDN, 1);
+	uint8_t tmp = 0, orig = 0;
+
+	NTSTATUS status = gmax_reg_read(pDevice, reg, &orig);
 	if (!NT_SUCCESS(status)) {
 		return status;
 	}
 
-	LARGE_INTEGER Interval;
-	Interval.QuadPart = -20;
-	KeDelayExecutionThread(KernelMode, FALSE, &Interval);
-	return toggleI2CAmp(pDevice, enable);
-}
-
+	tmp = orig & ~mask;
+	tmp |= val & mask;
 
+	if (tmp != orig) {
+		status = gmax_reg_write(pDevice, reg, tmp);
+	}
+	else {
+		GmaxRegStatsNoopUpdate(pDevice, reg);
+	}
+	return status;
+}
 
 NTSTATUS
 GetDeviceHID(
@@ -233,8 +236,12 @@ GetDeviceHID(
 	}
 
 	PGMAX_CONTEXT pDevice = GetDeviceContext(FxDevice);
-	if (strncmp(outputBuffer->Argument[0].Data, "MX98512", outputBuffer->Argument[0].DataLength) == 0) {
-		pDevice->chipModel = 98512;
+	const GMAX_CHIP_OPS* chip = GmaxChipFromHid(outputBuffer->Argument[0].Data, outputBuffer->Argument[0].DataLength);
+	if (chip) {
+		pDevice->Chip = chip;
+		RtlZeroMemory(pDevice->Config.Hid, sizeof(pDevice->Config.Hid));
+		RtlCopyMemory(pDevice->Config.Hid, outputBuffer->Argument[0].Data,
+			min(outputBuffer->Argument[0].DataLength, sizeof(pDevice->Config.Hid)));
 	}
 	else {
 		status = STATUS_ACPI_INVALID_ARGUMENT;
@@ -429,118 +436,178 @@ Exit:
 	return status;
 }
 
-NTSTATUS
-StartCodec(
-	PGMAX_CONTEXT pDevice
-) {
-	NTSTATUS status = STATUS_SUCCESS;
-	if (!pDevice->SetUID) {
-		status = STATUS_INVALID_DEVICE_STATE;
+static NTSTATUS
+GmaxDiscoverConfig(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Resolves the configuration from firmware: _UID, _HID and the _DSD
+IV-sense slot properties, then builds the init image from them.
+
+--*/
+{
+	GMAX_BOOT_CONFIG* config = &pDevice->Config;
+	UINT16 interleave_mode = 0;
+	UINT16 vmon_slot_no = 0;
+	UINT16 imon_slot_no = 0;
+	BOOLEAN useDefaults = FALSE;
+	NTSTATUS status;
+
+	GmaxTimelineBegin(pDevice, GmaxStageAcpiUid);
+	status = GetDeviceUID(pDevice->FxDevice, &pDevice->UID);
+	GmaxTimelineEnd(pDevice, status);
+	if (!NT_SUCCESS(status)) {
 		return status;
 	}
 
-	UINT8 data = 0;
-	gmax_reg_read(pDevice, pDevice->chipModel == 98512 ? MAX98512_REV_ID_0, &data);
+	GmaxTimelineBegin(pDevice, GmaxStageAcpiHid);
+	status = GetDeviceHID(pDevice->FxDevice);
+	GmaxTimelineEnd(pDevice, status);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
 
-	BOOLEAN useDefaults = FALSE;
+	GmaxTimelineBegin(pDevice, GmaxStageAcpiDsd);
 
-	INT32 rightSpeaker = 1;
-	if (GetPlatform() == PlatformAmberLake)
-		rightSpeaker = 0;
+	if (!NT_SUCCESS(GetIntegerProperty(pDevice->FxDevice, "interleave_mode", &interleave_mode))) {
+		DbgPrint("Warning: unable to get interleave_mode. Using defaults.\n");
+		useDefaults = TRUE;
+	}
+	interleave_mode = interleave_mode & 1;
 
-	if (pDevice->chipModel == 98512) { //max98512
-		for (int i = 0; i < sizeof(max98512_initregs) / sizeof(struct initreg); i++) {
-			struct initreg regval = max98512_initregs[i];
-			status = gmax_reg_write(pDevice, regval.reg, regval.val);
-			if (!NT_SUCCESS(status)) {
-				return status;
-			}
-		}
+	if (!NT_SUCCESS(GetIntegerProperty(pDevice->FxDevice, "vmon-slot-no", &vmon_slot_no))) {
+		DbgPrint("Warning: unable to get vmon-slot-no. Using defaults.\n");
+		useDefaults = TRUE;
+	}
+	if (!NT_SUCCESS(GetIntegerProperty(pDevice->FxDevice, "imon-slot-no", &imon_slot_no))) {
+		DbgPrint("Warning: unable to get imon-slot-no. Using defaults.\n");
+		useDefaults = TRUE;
+	}
+	GmaxTimelineEnd(pDevice, useDefaults ? STATUS_NOT_FOUND : STATUS_SUCCESS);
 
-		UINT16 ampVolume = 60;
-		UINT16 speakerGain = 1;
+	if (useDefaults) {
+		interleave_mode = 0;
+		vmon_slot_no = pDevice->Quirk->VmonSlot[pDevice->UID == 0 ? 0 : 1];
+		imon_slot_no = pDevice->Quirk->ImonSlot[pDevice->UID == 0 ? 0 : 1];
+	}
 
-		UINT16 interleave_mode = 0;
-		UINT16 vmon_slot_no = 0;
-		UINT16 imon_slot_no = 0;
+	config->Uid = pDevice->UID;
+	config->ChipModel = pDevice->Chip->Model;
+	config->RevId = 0;
+	config->Interleave = (UINT8)interleave_mode;
+	config->VmonSlot = (UINT8)vmon_slot_no;
+	config->ImonSlot = (UINT8)imon_slot_no;
+	config->DsdDefaults = useDefaults;
+
+	if (!GmaxBootBuildImage(config, pDevice->Chip->InitRegs, pDevice->Chip->InitCount,
+		GmaxChipHas(pDevice, GMAX_CHIP_IV_ROUTING), pDevice->Quirk->RightSpeakerUid)) {
+		return STATUS_BUFFER_OVERFLOW;
+	}
 
-		if (!NT_SUCCESS(GetIntegerProperty(pDevice->FxDevice, "interleave_mode", &interleave_mode))) {
-			DbgPrint("Warning: unable to get vmon-slot-no. Using defaults.\n");
-			useDefaults = TRUE;
-		}
-		interleave_mode = interleave_mode & 1;
+	pDevice->ConfigSource = GmaxConfigDiscovered;
+	return STATUS_SUCCESS;
+}
 
-		if (!NT_SUCCESS(GetIntegerProperty(pDevice->FxDevice, "vmon-slot-no", &vmon_slot_no))) {
-			DbgPrint("Warning: unable to get vmon-slot-no. Using defaults.\n");
-			useDefaults = TRUE;
-		}
-		if (!NT_SUCCESS(GetIntegerProperty(pDevice->FxDevice, "imon-slot-no", &vmon_slot_no))) {
-			DbgPrint("Warning: unable to get vmon-slot-no. Using defaults.\n");
-			useDefaults = TRUE;
-		}
+static VOID
+GmaxCodecPoweredUp(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
 
-		if (useDefaults) {
-			interleave_mode = 0;
-			if (pDevice->UID == 0) {
-				vmon_slot_no = 4;
-				imon_slot_no = 5;
-			}
-			else {
-				vmon_slot_no = 6;
-				imon_slot_no = 7;
-			}
-		}
+Routine Description:
 
-		UINT16 temp = (1 << vmon_slot_no) | (1 << imon_slot_no);
-		status = gmax_reg_write(pDevice, MAX98512_R001A_PCM_TX_EN_A, temp);
-		if (!NT_SUCCESS(status)) {
-			return status;
-		}
+The power-up sequence finished and the amp has settled, possibly well
+after StartCodec returned.
 
-		status = gmax_reg_write(pDevice, MAX98512_R001B_PCM_TX_EN_B, (temp >> 8) | 0xff00);
-		if (!NT_SUCCESS(status)) {
-			return status;
-		}
+--*/
+{
+	GmaxReportEvent(pDevice, GmaxEventPowerUp, 0);
+}
 
-		temp = ~temp;
-		status = gmax_reg_write(pDevice, MAX98512_R001C_PCM_TX_HIZ_CTRL_A, temp);
-		if (!NT_SUCCESS(status)) {
-			return status;
-		}
+static NTSTATUS
+StartCodecStep(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ GMAX_CODEC_STEP Step
+)
+/*++
 
-		status = gmax_reg_write(pDevice, MAX98512_R001D_PCM_TX_HIZ_CTRL_B, (temp >> 8) | 0xff00);
-		if (!NT_SUCCESS(status)) {
-			return status;
-		}
+Routine Description:
 
-		status = gmax_reg_write(pDevice, MAX98512_R001E_PCM_TX_CH_SRC_A, (imon_slot_no << MAX98927_PCM_TX_CH_SRC_A_I_SHIFT |
-			vmon_slot_no) & 0xFF);
-		if (!NT_SUCCESS(status)) {
-			return status;
-		}
+Runs one StartCodec step on the bus. Blocks the chip does not have
+succeed without a transfer.
 
-		status = gmax_reg_write(pDevice, MAX98512_R001F_PCM_TX_CH_SRC_B, interleave_mode != 0 ? MAX98927_PCM_TX_CH_INTERLEAVE_MASK : 0);
-		if (!NT_SUCCESS(status)) {
-			return status;
-		}
+--*/
+{
+	UINT8 revId = 0;
+	NTSTATUS status;
 
-		status = gmax_reg_write(pDevice, MAX98512_R0024_PCM_SR_SETUP2, interleave_mode != 0 ? 0x85 : 0x88);
-		if (!NT_SUCCESS(status)) {
-			return status;
-		}
+	switch (Step) {
+	case GmaxCodecStepReset:
+		return GmaxPowerDown(pDevice);
 
-		status = gmax_reg_write(pDevice, MAX98512_R0025_PCM_TO_SPK_MONOMIX_A, pDevice->UID == rightSpeaker ? 0x40 : 0);
-		if (!NT_SUCCESS(status)) {
-			return status;
-		}
+	case GmaxCodecStepRevId:
+		status = gmax_reg_read(pDevice, pDevice->Chip->Regs.RevId, &revId);
 
-		status = gmax_reg_write(pDevice, MAX98512_R0026_PCM_TO_SPK_MONOMIX_B, 1);
-		if (!NT_SUCCESS(status)) {
-			return status;
+		//
+		// Recorded in the boot cache the first time it is seen. The
+		// registry write is left to a work item, off the resume path.
+		//
+		if (NT_SUCCESS(status) && revId != pDevice->Config.RevId) {
+			pDevice->Config.RevId = revId;
+			GmaxConfigStoreLater(pDevice);
 		}
+		return status;
+
+	case GmaxCodecStepTuning:
+		return GmaxTuningWrite(pDevice);
+
+	case GmaxCodecStepVolume:
+		return GmaxChipHas(pDevice, GMAX_CHIP_VOLUME) ? GmaxVolumeApply(pDevice) : STATUS_SUCCESS;
+
+	case GmaxCodecStepBde:
+		return GmaxChipHas(pDevice, GMAX_CHIP_BDE) ? GmaxBdeApply(pDevice) : STATUS_SUCCESS;
+
+	case GmaxCodecStepInterrupts:
+		return GmaxChipHas(pDevice, GMAX_CHIP_INTERRUPTS) ? GmaxEnableInterrupts(pDevice) : STATUS_SUCCESS;
+
+	case GmaxCodecStepPowerUp:
+		return GmaxPowerUp(pDevice, GmaxCodecPoweredUp);
+
+	default:
+		return STATUS_SUCCESS;
+	}
+}
+
+NTSTATUS
+StartCodec(
+	PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Runs the steps codecstate.h hands out, in order, until one fails or
+the power-up has started. The amp may still be running from a
+power-down that failed, in which case it is reset first.
+
+--*/
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	GMAX_CODEC_STEP step;
+
+	if (!pDevice->SetUID) {
+		status = STATUS_INVALID_DEVICE_STATE;
+		return status;
 	}
 
-	status = enableOutput(pDevice, TRUE);
+	step = GmaxCodecStartFirst(&pDevice->Codec);
+	while (step != GmaxCodecStepDone) {
+		status = StartCodecStep(pDevice, step);
+		step = GmaxCodecStartStep(&pDevice->Codec, step, NT_SUCCESS(status));
+	}
 
 	/*uint16_t regs[] = {0x0001,0x0002,0x0003,0x0004,0x0005,0x0006,0x0007,0x0008,0x0009,0x000A,0x000B,0x000C,0x000D,0x000E,0x000F,0x0010,0x0011,0x0012,0x0013,0x0014,0x0015,0x0016,0x0017,0x0018,0x0019,0x001A,0x001B,0x001C,0x001D,0x001E,0x001F,0x0020,0x0021,0x0022,0x0023,0x0024,0x0025,0x0026,0x0027,0x0028,0x002B,0x002C,0x002E,0x002F,0x0030,0x0031,0x0032,0x0033,0x0034,0x0035,0x0036,0x0037,0x0038,0x0039,0x003A,0x003B,0x003C,0x003D,0x003E,0x003F,0x0040,0x0041,0x0042,0x0043,0x0044,0x0045,0x0046,0x0047,0x0048,0x0049,0x004A,0x004B,0x004C,0x004D,0x004E,0x0051,0x0052,0x0053,0x0054,0x0055,0x005A,0x005B,0x005C,0x005D,0x005E,0x005F,0x0060,0x0061,0x0072,0x0073,0x0074,0x0075,0x0076,0x0077,0x0078,0x0079,0x007A,0x007B,0x007C,0x007D,0x007E,0x007F,0x0080,0x0081,0x0082,0x0083,0x0084,0x0085,0x0086,0x0087,0x00FF,0x0100,0x01FF};
 	for (int i = 0; i < sizeof(regs) / sizeof(uint16_t); i++) {
@@ -551,19 +618,56 @@ StartCodec(
 		DbgPrint("Reg 0x%04x:\n\t0x%02x", reg, data);
 	}*/
 
-	pDevice->DevicePoweredOn = TRUE;
+	if (pDevice->Codec.PoweredOn) {
+		GmaxMonitorUpdate(pDevice);
+	}
 	return status;
 }
 
 NTSTATUS
 StopCodec(
 	PGMAX_CONTEXT pDevice
-) {
+)
+/*++
+
+Routine Description:
+
+Powers the amp down. The codec counts as stopped either way, nothing
+else may use the bus for it, but when the power-down fails the amp
+may still be playing: it is marked as needing a reset and handed to
+recovery, and the next StartCodec resets it first if recovery could
+not.
+
+--*/
+{
 	NTSTATUS status;
+	ULONGLONG previous;
+	GMAX_CODEC_NEXT next;
+
+	//
+	// The monitor, volume and clock timers must be stopped before
+	// taking the bus, their callbacks may be waiting for a command slot.
+	//
+	GmaxMonitorStop(pDevice);
+	GmaxVolumeStop(pDevice);
+	GmaxClockStop(pDevice);
+
+	GmaxCmdBegin(pDevice, GmaxPriorityPower);
+	previous = SpbSetDeadline(&pDevice->I2CContext, GMAX_RESUME_DEADLINE_MS);
+	status = GmaxPowerDown(pDevice);
+	next = GmaxCodecStopped(&pDevice->Codec, NT_SUCCESS(status));
+	GmaxBdeInvalidate(pDevice);
+	SpbRestoreDeadline(&pDevice->I2CContext, previous);
+	GmaxCmdEnd(pDevice);
+
+	if (next != GmaxCodecNone) {
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Power-down failed 0x%x, amp left to recovery\n", status);
+		GmaxRecoveryNext(pDevice, next);
+		return status;
+	}
 
-	status = gmax_reg_write(pDevice, pDevice->chipModel == 98512 ? MAX98512_SOFT_RESET, 1);
-	
-	pDevice->DevicePoweredOn = FALSE;
+	GmaxReportEvent(pDevice, GmaxEventPowerDown, 0);
 	return status;
 }
 
@@ -618,10 +722,15 @@ CsAudioCallbackFunction(
 			pDevice->CSAudioRequestsOn = TRUE;
 		}
 	}
+	if (localArg.endpointRequest == CSAudioEndpointOverrideFormat) {
+		GmaxFormatOverride(pDevice, &localArg.formatOverride);
+	}
+
+	GmaxMonitorUpdate(pDevice);
 }
 
-NTSTATUS
-OnPrepareHardware(
+static NTSTATUS
+GmaxPrepareHardware(
 	_In_  WDFDEVICE     FxDevice,
 	_In_  WDFCMRESLIST  FxResourcesRaw,
 	_In_  WDFCMRESLIST  FxResourcesTranslated
@@ -650,8 +759,6 @@ Status
 	BOOLEAN fSpbResourceFound = FALSE;
 	NTSTATUS status = STATUS_INSUFFICIENT_RESOURCES;
 
-	UNREFERENCED_PARAMETER(FxResourcesRaw);
-
 	//
 	// Parse the peripheral's resources.
 	//
@@ -690,6 +797,19 @@ Status
 				}
 			}
 			break;
+		case CmResourceTypeInterrupt:
+			//
+			// GPIO-routed IRQ pin from the amp. Optional, without it
+			// faults are simply not reported.
+			//
+			status = GmaxInterruptCreate(pDevice,
+				WdfCmResourceListGetDescriptor(FxResourcesRaw, i),
+				pDescriptor);
+			if (!NT_SUCCESS(status))
+			{
+				return status;
+			}
+			break;
 		default:
 			//
 			// Ignoring all other resource types.
@@ -707,25 +827,93 @@ Status
 		status = STATUS_NOT_FOUND;
 	}
 
+	GmaxTimelineBegin(pDevice, GmaxStageSpbOpen);
 	status = SpbTargetInitialize(FxDevice, &pDevice->I2CContext);
+	GmaxTimelineEnd(pDevice, status);
 
 	if (!NT_SUCCESS(status))
 	{
 		return status;
 	}
 
-	status = GetDeviceUID(FxDevice, &pDevice->UID);
+	//
+	// The boot cache is keyed on what is known without evaluating
+	// firmware, including the board quirks baked into the image and
+	// the firmware identity read in DriverEntry
+	//
+	RtlZeroMemory(&pDevice->Config, sizeof(pDevice->Config));
+	pDevice->Config.ConnectionLow = pDevice->I2CContext.I2cResHubId.LowPart;
+	pDevice->Config.ConnectionHigh = (UINT32)pDevice->I2CContext.I2cResHubId.HighPart;
+	pDevice->Config.TableHash = GmaxChipTableHash() ^ GmaxPlatformQuirkHash(pDevice->Quirk);
+	pDevice->Config.FirmwareHash = GmaxPlatformFirmwareHash();
+
+	GmaxTimelineBegin(pDevice, GmaxStageBootCache);
+	status = GmaxConfigLoad(pDevice);
+	GmaxTimelineEnd(pDevice, status);
+	if (NT_SUCCESS(status)) {
+		const GMAX_CHIP_OPS* chip = GmaxChipFromModel(pDevice->Config.ChipModel);
+
+		if (chip) {
+			pDevice->UID = pDevice->Config.Uid;
+			pDevice->Chip = chip;
+		}
+		else {
+			status = STATUS_REVISION_MISMATCH;
+		}
+	}
+
 	if (!NT_SUCCESS(status)) {
-		return status;
+		status = GmaxDiscoverConfig(pDevice);
+		if (!NT_SUCCESS(status)) {
+			return status;
+		}
+
+		status = GmaxConfigStore(pDevice);
+		if (!NT_SUCCESS(status)) {
+			GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+				"Unable to store boot cache 0x%x\n", status);
+			status = STATUS_SUCCESS;
+		}
 	}
 
-	status = GetDeviceHID(FxDevice);
+	GmaxTimelineBegin(pDevice, GmaxStageTuningLoad);
+	status = GmaxTuningLoad(pDevice);
+	GmaxTimelineEnd(pDevice, status);
 	if (!NT_SUCCESS(status)) {
-		return status;
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Tuning not applied 0x%x\n", status);
+		status = STATUS_SUCCESS;
 	}
 
 	pDevice->SetUID = TRUE;
 
+	status = GmaxBdeRegisterPowerSource(pDevice);
+	if (!NT_SUCCESS(status)) {
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Power source notification unavailable 0x%x\n", status);
+		status = STATUS_SUCCESS;
+	}
+
+	return status;
+}
+
+NTSTATUS
+OnPrepareHardware(
+	_In_  WDFDEVICE     FxDevice,
+	_In_  WDFCMRESLIST  FxResourcesRaw,
+	_In_  WDFCMRESLIST  FxResourcesTranslated
+)
+{
+	PGMAX_CONTEXT pDevice = GetDeviceContext(FxDevice);
+	NTSTATUS status;
+
+	GmaxTimelineBegin(pDevice, GmaxStagePrepareHardware);
+	status = GmaxPrepareHardware(FxDevice, FxResourcesRaw, FxResourcesTranslated);
+	GmaxTimelineEnd(pDevice, status);
+
+	if (NT_SUCCESS(status)) {
+		ExReInitializeRundownProtection(&pDevice->HardwareRundown);
+	}
 	return status;
 }
 
@@ -755,6 +943,15 @@ Status
 
 	UNREFERENCED_PARAMETER(FxResourcesTranslated);
 
+	//
+	// The default queue is not power managed and keeps dispatching;
+	// wait out the IOCTLs already running and fail the rest
+	//
+	ExWaitForRundownProtectionRelease(&pDevice->HardwareRundown);
+
+	GmaxBdeUnregisterPowerSource(pDevice);
+	GmaxRecoveryStop(pDevice);
+
 	SpbTargetDeinitialize(FxDevice, &pDevice->I2CContext);
 
 	if (pDevice->CSAudioAPICallbackObj) {
@@ -770,19 +967,12 @@ Status
 	return status;
 }
 
-NTSTATUS
-OnSelfManagedIoInit(
-	_In_
-	WDFDEVICE FxDevice
+static NTSTATUS
+GmaxRegisterCsAudioCallback(
+	_In_ PGMAX_CONTEXT pDevice
 ) {
-	PGMAX_CONTEXT pDevice = GetDeviceContext(FxDevice);
 	NTSTATUS status = STATUS_SUCCESS;
 
-	if (!pDevice->SetUID) {
-		status = STATUS_INVALID_DEVICE_STATE;
-		return status;
-	}
-
 	// CS Audio Callback
 
 	UNICODE_STRING CSAudioCallbackAPI;
@@ -815,6 +1005,28 @@ OnSelfManagedIoInit(
 	return status;
 }
 
+NTSTATUS
+OnSelfManagedIoInit(
+	_In_
+	WDFDEVICE FxDevice
+) {
+	PGMAX_CONTEXT pDevice = GetDeviceContext(FxDevice);
+	NTSTATUS status = STATUS_SUCCESS;
+
+	GmaxTimelineBegin(pDevice, GmaxStageSelfManagedIoInit);
+	if (!pDevice->SetUID) {
+		status = STATUS_INVALID_DEVICE_STATE;
+	}
+	else {
+		GmaxTimelineBegin(pDevice, GmaxStageCallbackRegister);
+		status = GmaxRegisterCsAudioCallback(pDevice);
+		GmaxTimelineEnd(pDevice, status);
+	}
+	GmaxTimelineEnd(pDevice, status);
+
+	return status;
+}
+
 NTSTATUS
 OnD0Entry(
 	_In_  WDFDEVICE               FxDevice,
@@ -840,7 +1052,35 @@ Status
 	UNREFERENCED_PARAMETER(FxPreviousState);
 
 	PGMAX_CONTEXT pDevice = GetDeviceContext(FxDevice);
+	ULONGLONG previous;
+	GMAX_CODEC_NEXT next;
+
+	GmaxTimelineBegin(pDevice, GmaxStageD0Entry);
+
+	//
+	// A reset still being retried from Dx is done by StartCodec now
+	//
+	GmaxRecoveryStop(pDevice);
+	GmaxCodecD0Entry(&pDevice->Codec);
+
+	GmaxCmdBegin(pDevice, GmaxPriorityPower);
+	previous = SpbSetDeadline(&pDevice->I2CContext, GMAX_RESUME_DEADLINE_MS);
+	GmaxTimelineBegin(pDevice, GmaxStageStartCodec);
 	NTSTATUS status = StartCodec(pDevice);
+	GmaxTimelineEnd(pDevice, status);
+	SpbRestoreDeadline(&pDevice->I2CContext, previous);
+	GmaxCmdEnd(pDevice);
+
+	//
+	// A bus that is not answering must not hold up resume, the codec
+	// is started in the background once it recovers.
+	//
+	next = GmaxCodecD0EntryDone(GmaxIsBusFailure(status));
+	if (next != GmaxCodecNone) {
+		GmaxRecoveryNext(pDevice, next);
+		status = STATUS_SUCCESS;
+	}
+	GmaxTimelineEnd(pDevice, status);
 	return status;
 }
 
@@ -871,7 +1111,24 @@ Status
 	PGMAX_CONTEXT pDevice = GetDeviceContext(FxDevice);
 	NTSTATUS status = STATUS_SUCCESS;
 
+	GmaxTimelineBegin(pDevice, GmaxStageD0Exit);
+	GmaxCodecD0Exit(&pDevice->Codec);
+
+	//
+	// The framework connects and enables the interrupt again on the
+	// next D0 entry, whatever the work item disabled
+	//
+	pDevice->InterruptContext.Disabled = FALSE;
+
+	//
+	// A pass scheduled in D0 must not run in Dx, OnD0Entry schedules
+	// one again if the codec does not start. StopCodec schedules its
+	// own, bounded, when the amp could not be reset.
+	//
+	GmaxRecoveryStop(pDevice);
+
 	status = StopCodec(pDevice);
+	GmaxTimelineEnd(pDevice, status);
 
 	return STATUS_SUCCESS;
 }
@@ -888,6 +1145,7 @@ GmaxEvtDeviceAdd(
 	WDFDEVICE                     device;
 	WDFQUEUE                      queue;
 	PGMAX_CONTEXT               devContext;
+	ULONGLONG                     start = KeQueryInterruptTimePrecise(NULL);
 
 	UNREFERENCED_PARAMETER(Driver);
 
@@ -939,9 +1197,19 @@ GmaxEvtDeviceAdd(
 		WdfDeviceSetDeviceState(device, &deviceState);
 	}
 
+	//
+	// Not power managed: the event, statistics and diagnostic IOCTLs
+	// must not bring the amp back to D0, or polling for them would keep
+	// it from ever idling. None of them need the bus while powered down,
+	// the setters record what StartCodec applies. The queue therefore
+	// also dispatches while the hardware is released, so every IOCTL
+	// but the event wait holds HardwareRundown.
+	//
 	WDF_IO_QUEUE_CONFIG_INIT_DEFAULT_QUEUE(&queueConfig, WdfIoQueueDispatchParallel);
 
+	queueConfig.PowerManaged = WdfFalse;
 	queueConfig.EvtIoInternalDeviceControl = GmaxEvtInternalDeviceControl;
+	queueConfig.EvtIoDeviceControl = GmaxEvtDeviceControl;
 
 	status = WdfIoQueueCreate(device,
 		&queueConfig,
@@ -958,16 +1226,30 @@ GmaxEvtDeviceAdd(
 	}
 
 	//
-	// Create manual I/O queue to take care of hid report read requests
+	// Create manual I/O queue to hold pended event requests. It is not
+	// power managed so waiting clients neither keep the amp out of idle
+	// nor miss the power down event.
 	//
 
 	devContext = GetDeviceContext(device);
 
 	devContext->FxDevice = device;
 
+	ExInitializeRundownProtection(&devContext->HardwareRundown);
+	ExWaitForRundownProtectionRelease(&devContext->HardwareRundown);
+
+	status = GmaxTimelineInitialize(devContext, start);
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"GmaxTimelineInitialize failed 0x%x\n", status);
+
+		return status;
+	}
+
 	WDF_IO_QUEUE_CONFIG_INIT(&queueConfig, WdfIoQueueDispatchManual);
 
-	queueConfig.PowerManaged = WdfTrue;
+	queueConfig.PowerManaged = WdfFalse;
 
 	status = WdfIoQueueCreate(device,
 		&queueConfig,
@@ -983,6 +1265,114 @@ GmaxEvtDeviceAdd(
 		return status;
 	}
 
+	status = GmaxEventQueueInitialize(devContext);
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"GmaxEventQueueInitialize failed 0x%x\n", status);
+
+		return status;
+	}
+
+	status = GmaxSchedulerInitialize(devContext);
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"GmaxSchedulerInitialize failed 0x%x\n", status);
+
+		return status;
+	}
+
+	devContext->Quirk = GmaxPlatformQuirk();
+
+	status = GmaxVolumeInitialize(devContext);
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"GmaxVolumeInitialize failed 0x%x\n", status);
+
+		return status;
+	}
+
+	status = GmaxMonitorInitialize(devContext);
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"GmaxMonitorInitialize failed 0x%x\n", status);
+
+		return status;
+	}
+
+	GmaxBdeInitialize(devContext);
+
+	status = GmaxRecoveryInitialize(devContext);
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"GmaxRecoveryInitialize failed 0x%x\n", status);
+
+		return status;
+	}
+
+	status = GmaxClockInitialize(devContext);
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"GmaxClockInitialize failed 0x%x\n", status);
+
+		return status;
+	}
+
+	status = GmaxPowerInitialize(devContext);
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"GmaxPowerInitialize failed 0x%x\n", status);
+
+		return status;
+	}
+
+	status = GmaxShadowInitialize(devContext);
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"GmaxShadowInitialize failed 0x%x\n", status);
+
+		return status;
+	}
+
+	status = GmaxConfigInitialize(devContext);
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"GmaxConfigInitialize failed 0x%x\n", status);
+
+		return status;
+	}
+
+	//
+	// Until _HID or the boot cache says otherwise
+	//
+	devContext->Chip = &GmaxMax98512Ops;
+
+	status = GmaxFormatInitialize(devContext, GmaxChipInitValue(devContext->Chip, devContext->Chip->Regs.PcmModeCfg));
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"GmaxFormatInitialize failed 0x%x\n", status);
+
+		return status;
+	}
+
+	status = WdfDeviceCreateDeviceInterface(device, &GUID_DEVINTERFACE_GMAX, NULL);
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"WdfDeviceCreateDeviceInterface failed 0x%x\n", status);
+
+		return status;
+	}
+
 	WDF_DEVICE_POWER_POLICY_IDLE_SETTINGS IdleSettings;
 
 	WDF_DEVICE_POWER_POLICY_IDLE_SETTINGS_INIT(&IdleSettings, IdleCannotWakeFromS0);
@@ -992,6 +1382,7 @@ GmaxEvtDeviceAdd(
 
 	WdfDeviceAssignS0IdleSettings(devContext->FxDevice, &IdleSettings);
 
+	GmaxTimelineEnd(devContext, status);
 	return status;
 }
 
@@ -1007,21 +1398,319 @@ GmaxEvtInternalDeviceControl(
 	NTSTATUS            status = STATUS_SUCCESS;
 	WDFDEVICE           device;
 	PGMAX_CONTEXT     devContext;
+	BOOLEAN             pended = FALSE;
+	BOOLEAN             guarded = FALSE;
 
-	UNREFERENCED_PARAMETER(OutputBufferLength);
 	UNREFERENCED_PARAMETER(InputBufferLength);
 
 	device = WdfIoQueueGetDevice(Queue);
 	devContext = GetDeviceContext(device);
 
+	//
+	// Pended event requests live on ReportQueue, which outlives the
+	// hardware. Everything else reaches state OnReleaseHardware frees.
+	//
+	if (IoControlCode != IOCTL_GMAX_GET_EVENTS) {
+		if (!ExAcquireRundownProtection(&devContext->HardwareRundown)) {
+			WdfRequestComplete(Request, STATUS_DEVICE_NOT_READY);
+			return;
+		}
+		guarded = TRUE;
+	}
+
 	switch (IoControlCode)
 	{
+	case IOCTL_GMAX_GET_EVENTS:
+		if (OutputBufferLength < sizeof(GMAX_EVENT_RECORD)) {
+			status = STATUS_BUFFER_TOO_SMALL;
+			break;
+		}
+
+		status = WdfRequestForwardToIoQueue(Request, devContext->ReportQueue);
+		if (NT_SUCCESS(status)) {
+			pended = TRUE;
+			GmaxCompleteEventRequests(devContext);
+		}
+		break;
+	case IOCTL_GMAX_GET_MONITOR_SAMPLES:
+	{
+		GMAX_MONITOR_SAMPLE* samples;
+		size_t bufferLength;
+
+		status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(GMAX_MONITOR_SAMPLE),
+			(PVOID*)&samples,
+			&bufferLength);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		ULONG count = GmaxMonitorCopySamples(devContext,
+			samples,
+			(ULONG)(bufferLength / sizeof(GMAX_MONITOR_SAMPLE)));
+		WdfRequestSetInformation(Request, count * sizeof(GMAX_MONITOR_SAMPLE));
+		break;
+	}
+	case IOCTL_GMAX_GET_SCHEDULER_STATS:
+	{
+		GMAX_SCHEDULER_STATS* stats;
+
+		status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(GMAX_SCHEDULER_STATS),
+			(PVOID*)&stats,
+			NULL);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		GmaxSchedulerGetStats(devContext, stats);
+		WdfRequestSetInformation(Request, sizeof(GMAX_SCHEDULER_STATS));
+		break;
+	}
+	case IOCTL_GMAX_SET_VOLUME:
+	{
+		GMAX_VOLUME_REQUEST* volumeRequest;
+
+		status = WdfRequestRetrieveInputBuffer(Request,
+			sizeof(GMAX_VOLUME_REQUEST),
+			(PVOID*)&volumeRequest,
+			NULL);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		status = GmaxSetVolume(devContext, volumeRequest);
+		break;
+	}
+	case IOCTL_GMAX_SET_GAIN_LIMIT:
+	{
+		GMAX_GAIN_LIMIT* limit;
+
+		status = WdfRequestRetrieveInputBuffer(Request,
+			sizeof(GMAX_GAIN_LIMIT),
+			(PVOID*)&limit,
+			NULL);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		status = GmaxSetGainLimit(devContext, limit);
+		break;
+	}
+	case IOCTL_GMAX_GET_FORMAT:
+	{
+		GMAX_FORMAT_INFO* info;
+
+		status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(GMAX_FORMAT_INFO),
+			(PVOID*)&info,
+			NULL);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		GmaxFormatGetInfo(devContext, info);
+		WdfRequestSetInformation(Request, sizeof(GMAX_FORMAT_INFO));
+		break;
+	}
+	case IOCTL_GMAX_GET_REG_STATS:
+	{
+		GMAX_REG_STATS* stats;
+		size_t bufferLength;
+
+		status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(GMAX_REG_STATS),
+			(PVOID*)&stats,
+			&bufferLength);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		ULONG count = GmaxRegStatsCopy(devContext,
+			stats,
+			(ULONG)(bufferLength / sizeof(GMAX_REG_STATS)));
+		WdfRequestSetInformation(Request, count * sizeof(GMAX_REG_STATS));
+		break;
+	}
+	case IOCTL_GMAX_RESET_REG_STATS:
+		GmaxRegStatsReset(devContext);
+		break;
+	case IOCTL_GMAX_SET_SPB_CAPTURE:
+	{
+		UINT32* enable;
+
+		status = WdfRequestRetrieveInputBuffer(Request,
+			sizeof(UINT32),
+			(PVOID*)&enable,
+			NULL);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		if (*enable) {
+			status = SpbCaptureStart(&devContext->I2CContext);
+		}
+		else {
+			SpbCaptureStop(&devContext->I2CContext);
+		}
+		break;
+	}
+	case IOCTL_GMAX_GET_SPB_CAPTURE:
+	{
+		PUCHAR buffer;
+		size_t bufferLength;
+
+		status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(GMAX_SPB_CAPTURE_HEADER),
+			(PVOID*)&buffer,
+			&bufferLength);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		ULONG written = SpbCaptureDrain(&devContext->I2CContext,
+			buffer,
+			(ULONG)min(bufferLength, MAXULONG));
+		if (written == 0) {
+			status = STATUS_DEVICE_NOT_READY;
+			break;
+		}
+		WdfRequestSetInformation(Request, written);
+		break;
+	}
+	case IOCTL_GMAX_GET_LOCK_PROFILE:
+	{
+		GMAX_LOCK_PROFILE* profile;
+
+		status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(GMAX_LOCK_PROFILE),
+			(PVOID*)&profile,
+			NULL);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		SpbGetLockProfile(&devContext->I2CContext, profile);
+		WdfRequestSetInformation(Request, sizeof(GMAX_LOCK_PROFILE));
+		break;
+	}
+	case IOCTL_GMAX_RESET_LOCK_PROFILE:
+		SpbResetLockProfile(&devContext->I2CContext);
+		break;
+	case IOCTL_GMAX_GET_REG_IMAGE:
+	{
+		GMAX_REG_IMAGE* image;
+
+		status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(GMAX_REG_IMAGE),
+			(PVOID*)&image,
+			NULL);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		status = GmaxShadowSnapshot(devContext, image);
+		if (NT_SUCCESS(status)) {
+			WdfRequestSetInformation(Request, sizeof(GMAX_REG_IMAGE));
+		}
+		break;
+	}
+	case IOCTL_GMAX_GET_SPB_STATS:
+	{
+		GMAX_SPB_STATS* stats;
+
+		status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(GMAX_SPB_STATS),
+			(PVOID*)&stats,
+			NULL);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		SpbGetStats(&devContext->I2CContext, stats);
+		WdfRequestSetInformation(Request, sizeof(GMAX_SPB_STATS));
+		break;
+	}
+	case IOCTL_GMAX_RESET_SPB_STATS:
+		SpbResetStats(&devContext->I2CContext);
+		break;
+	case IOCTL_GMAX_GET_TIMELINE:
+	{
+		PUCHAR buffer;
+		size_t bufferLength;
+
+		status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(GMAX_TIMELINE_HEADER),
+			(PVOID*)&buffer,
+			&bufferLength);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		WdfRequestSetInformation(Request, GmaxTimelineCopy(devContext,
+			buffer,
+			(ULONG)min(bufferLength, MAXULONG)));
+		break;
+	}
+	case IOCTL_GMAX_GET_VOLUME_STATS:
+	{
+		GMAX_VOLUME_STATS* stats;
+
+		status = WdfRequestRetrieveOutputBuffer(Request,
+			sizeof(GMAX_VOLUME_STATS),
+			(PVOID*)&stats,
+			NULL);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		GmaxVolumeGetStats(devContext, stats);
+		WdfRequestSetInformation(Request, sizeof(GMAX_VOLUME_STATS));
+		break;
+	}
+	case IOCTL_GMAX_SET_BDE_PROFILE:
+	{
+		UINT32* profile;
+
+		status = WdfRequestRetrieveInputBuffer(Request,
+			sizeof(UINT32),
+			(PVOID*)&profile,
+			NULL);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		status = GmaxBdeSetProfile(devContext, (GMAX_BDE_PROFILE)*profile);
+		break;
+	}
 	default:
 		status = STATUS_NOT_SUPPORTED;
 		break;
 	}
 
-	WdfRequestComplete(Request, status);
+	if (guarded) {
+		ExReleaseRundownProtection(&devContext->HardwareRundown);
+	}
+
+	if (!pended) {
+		WdfRequestComplete(Request, status);
+	}
 
 	return;
 }
+
+VOID
+GmaxEvtDeviceControl(
+	IN WDFQUEUE     Queue,
+	IN WDFREQUEST   Request,
+	IN size_t       OutputBufferLength,
+	IN size_t       InputBufferLength,
+	IN ULONG        IoControlCode
+)
+{
+	GmaxEvtInternalDeviceControl(Queue,
+		Request,
+		OutputBufferLength,
+		InputBufferLength,
+		IoControlCode);
+}
@@ -19,7 +19,30 @@
 
 #include <stdint.h>
 
+#include "gmaxioctl.h"
 #include "spb.h"
+#include "intflags.h"
+#include "interrupt.h"
+#include "events.h"
+#include "monitor.h"
+#include "scheduler.h"
+#include "volramp.h"
+#include "volume.h"
+#include "bde.h"
+#include "format.h"
+#include "regstats.h"
+#include "shadow.h"
+#include "codecstate.h"
+#include "recovery.h"
+#include "config.h"
+#include "tuning.h"
+#include "platform.h"
+#include "powerseq.h"
+#include "chip.h"
+#include "clkmon.h"
+#include "clock.h"
+#include "power.h"
+#include "timeline.h"
 
 #define JACKDESC_RGB(r, g, b) \
     ((COLORREF)((r << 16) | (g << 8) | (b)))
@@ -74,14 +97,54 @@ typedef struct _GMAX_CONTEXT
 
 	WDFQUEUE ReportQueue;
 
+	GMAX_EVENT_QUEUE EventQueue;
+
 	SPB_CONTEXT I2CContext;
 
+	//
+	// Run down from EvtDeviceAdd until OnPrepareHardware has set up
+	// the SPB context, and again from OnReleaseHardware on. IOCTLs hold
+	// it while they run.
+	//
+	EX_RUNDOWN_REF HardwareRundown;
+
+	GMAX_SCHEDULER Scheduler;
+
+	GMAX_INTERRUPT_CONTEXT InterruptContext;
+
+	GMAX_MONITOR Monitor;
+
+	GMAX_VOLUME Volume;
+
+	GMAX_BDE Bde;
+
+	GMAX_FORMAT Format;
+
+	GMAX_REGSTATS RegStats;
+
+	GMAX_SHADOW Shadow;
+
+	GMAX_RECOVERY Recovery;
+
+	GMAX_BOOT_CONFIG Config;
+	GMAX_CONFIG_SOURCE ConfigSource;
+	WDFWORKITEM ConfigWorkItem;	// rewrites the boot cache off the D0 path
+
+	GMAX_TUNING Tuning;
+
+	GMAX_CLOCK Clock;
+
+	GMAX_POWER Power;
+
+	GMAX_TIMELINE Timeline;
+
 	BOOLEAN SetUID;
 	INT32 UID;
 
-	UINT32 chipModel;
+	const GMAX_CHIP_OPS* Chip;
+	const GMAX_PLATFORM_QUIRK* Quirk;
 
-	BOOLEAN DevicePoweredOn;
+	GMAX_CODEC_STATE Codec;
 
 	PCALLBACK_OBJECT CSAudioAPICallback;
 	PVOID CSAudioAPICallbackObj;
@@ -106,6 +169,54 @@ EVT_WDFDEVICE_WDM_IRP_PREPROCESS GmaxEvtWdmPreprocessMnQueryId;
 
 EVT_WDF_IO_QUEUE_IO_INTERNAL_DEVICE_CONTROL GmaxEvtInternalDeviceControl;
 
+EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL GmaxEvtDeviceControl;
+
+NTSTATUS
+StartCodec(
+	PGMAX_CONTEXT pDevice
+);
+
+NTSTATUS gmax_reg_read(
+	_In_ PGMAX_CONTEXT pDevice,
+	uint16_t reg,
+	uint8_t* data
+);
+
+NTSTATUS gmax_reg_write(
+	_In_ PGMAX_CONTEXT pDevice,
+	uint16_t reg,
+	uint8_t data
+);
+
+NTSTATUS gmax_reg_update(
+	_In_ PGMAX_CONTEXT pDevice,
+	uint16_t reg,
+	uint8_t mask,
+	uint8_t val
+);
+
+NTSTATUS gmax_reg_bulk_read(
+	_In_ PGMAX_CONTEXT pDevice,
+	uint16_t reg,
+	uint8_t* data,
+	uint32_t len
+);
+
+NTSTATUS gmax_reg_bulk_write(
+	_In_ PGMAX_CONTEXT pDevice,
+	uint16_t reg,
+	const uint8_t* data,
+	uint32_t len
+);
+
+//
+// Sends a message built in place, register address first
+//
+NTSTATUS gmax_reg_message_write(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ SPB_MESSAGE* message
+);
+
 //
 // Helper macros
 //
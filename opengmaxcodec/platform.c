@@ -0,0 +1,444 @@
+/*++
+
+Module Name:
+
+platform.c
+
+Abstract:
+
+Board identification and the quirk table. DriverEntry reads the SMBIOS
+system manufacturer and product, the FADT OEM IDs and the CPU once;
+the first GmaxPlatformQuirks entry they match is what every device
+uses for speaker assignment, default IV slots, speaker gain and the
+power-up delay. A new board is a new table entry.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include <ntddk.h>
+#include "opengmaxcodec.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+#define GMAX_FIRMWARE_ACPI 'ACPI'
+#define GMAX_FIRMWARE_RSMB 'RSMB'
+#define GMAX_ACPI_FADT 'PCAF'
+
+#define GMAX_SMBIOS_BIOS_INFORMATION 0
+#define GMAX_SMBIOS_SYSTEM_INFORMATION 1
+#define GMAX_SMBIOS_END_OF_TABLE 127
+
+#if defined(_M_ARM64)
+#define GMAX_ARM64_MIDR_EL1 ARM64_SYSREG(3, 0, 0, 0, 0)
+#define GMAX_MIDR_IMPLEMENTER_QUALCOMM 0x51
+#endif
+
+#include <pshpack1.h>
+
+//
+// RawSMBIOSData, as the RSMB firmware table provider returns it
+//
+typedef struct _GMAX_RAW_SMBIOS
+{
+	UCHAR Used20CallingMethod;
+	UCHAR MajorVersion;
+	UCHAR MinorVersion;
+	UCHAR DmiRevision;
+	ULONG Length;
+	UCHAR Data[1];
+} GMAX_RAW_SMBIOS;
+
+typedef struct _GMAX_ACPI_HEADER
+{
+	UCHAR Signature[4];
+	ULONG Length;
+	UCHAR Revision;
+	UCHAR Checksum;
+	UCHAR OemId[GMAX_PLATFORM_OEM_ID_LEN];
+	UCHAR OemTableId[GMAX_PLATFORM_OEM_TABLE_ID_LEN];
+	ULONG OemRevision;
+	ULONG CreatorId;
+	ULONG CreatorRevision;
+} GMAX_ACPI_HEADER;
+
+#include <poppack.h>
+
+static const GMAX_PLATFORM_QUIRK GmaxPlatformQuirks[] = {
+	//
+	// Amber Lake boards have the amps the other way round
+	//
+	{
+		.Name = "Amber Lake",
+		.Cpu = GmaxCpuAmberLake,
+		.RightSpeakerUid = 0,
+		.VmonSlot = {4, 6},
+		.ImonSlot = {5, 7},
+		.SpeakerGain = GMAX_SPK_GAIN_DEFAULT,
+		.PowerUpDelayUs = 2
+	},
+
+	//
+	// Everything else, must stay last
+	//
+	{
+		.Name = "Default",
+		.RightSpeakerUid = 1,
+		.VmonSlot = {4, 6},
+		.ImonSlot = {5, 7},
+		.SpeakerGain = GMAX_SPK_GAIN_DEFAULT,
+		.PowerUpDelayUs = 2
+	}
+};
+
+static GMAX_PLATFORM_ID GmaxPlatform;
+static const GMAX_PLATFORM_QUIRK* GmaxPlatformMatched = &GmaxPlatformQuirks[ARRAYSIZE(GmaxPlatformQuirks) - 1];
+
+static VOID
+GmaxPlatformCopyString(
+	_Out_writes_(Size) PCHAR Out,
+	_In_ ULONG Size,
+	_In_reads_(Length) const UCHAR* In,
+	_In_ ULONG Length
+)
+{
+	ULONG i;
+
+	//
+	// OEM IDs are space padded
+	//
+	while (Length > 0 && (In[Length - 1] == ' ' || In[Length - 1] == '\0')) {
+		Length--;
+	}
+
+	for (i = 0; i < Length && i + 1 < Size; i++) {
+		Out[i] = In[i] >= 0x20 && In[i] < 0x7F ? (CHAR)In[i] : '?';
+	}
+	Out[i] = '\0';
+}
+
+static NTSTATUS
+GmaxPlatformFirmwareTable(
+	_In_ ULONG Provider,
+	_In_ ULONG Table,
+	_Out_ PVOID* Buffer,
+	_Out_ ULONG* Length
+)
+{
+	ULONG length = 0;
+	PVOID buffer;
+	NTSTATUS status;
+
+	*Buffer = NULL;
+	*Length = 0;
+
+	status = ExGetSystemFirmwareTable(Provider, Table, NULL, 0, &length);
+	if (status != STATUS_BUFFER_TOO_SMALL || length == 0) {
+		return NT_SUCCESS(status) ? STATUS_NOT_FOUND : status;
+	}
+
+	buffer = ExAllocatePoolWithTag(PagedPool, length, GMAX_POOL_TAG);
+	if (!buffer) {
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	status = ExGetSystemFirmwareTable(Provider, Table, buffer, length, &length);
+	if (!NT_SUCCESS(status)) {
+		ExFreePoolWithTag(buffer, GMAX_POOL_TAG);
+		return status;
+	}
+
+	*Buffer = buffer;
+	*Length = length;
+	return STATUS_SUCCESS;
+}
+
+static VOID
+GmaxPlatformSmbiosString(
+	_In_ const UCHAR* Strings,
+	_In_ const UCHAR* End,
+	_In_ UCHAR Index,
+	_Out_writes_(Size) PCHAR Out,
+	_In_ ULONG Size
+)
+{
+	const UCHAR* s = Strings;
+
+	//
+	// Strings are numbered from 1, 0 means none
+	//
+	for (UCHAR i = 1; Index && s < End && *s; i++) {
+		const UCHAR* e = s;
+
+		while (e < End && *e) {
+			e++;
+		}
+		if (i == Index) {
+			GmaxPlatformCopyString(Out, Size, s, (ULONG)(e - s));
+			return;
+		}
+		s = e + 1;
+	}
+}
+
+static NTSTATUS
+GmaxPlatformReadSmbios(
+	_Inout_ GMAX_PLATFORM_ID* Id
+)
+{
+	GMAX_RAW_SMBIOS* raw;
+	const UCHAR* p;
+	const UCHAR* end;
+	ULONG length;
+	NTSTATUS status;
+
+	status = GmaxPlatformFirmwareTable(GMAX_FIRMWARE_RSMB, 0, (PVOID*)&raw, &length);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	status = STATUS_NOT_FOUND;
+	if (length <= FIELD_OFFSET(GMAX_RAW_SMBIOS, Data)) {
+		goto exit;
+	}
+
+	p = raw->Data;
+	end = raw->Data + min(raw->Length, length - FIELD_OFFSET(GMAX_RAW_SMBIOS, Data));
+
+	while (p + 4 <= end) {
+		UCHAR type = p[0];
+		const UCHAR* strings = p + p[1];
+		const UCHAR* next = strings;
+
+		if (p[1] < 4 || strings > end) {
+			break;
+		}
+
+		//
+		// The string set ends with a double NUL
+		//
+		while (next + 1 < end && (next[0] || next[1])) {
+			next++;
+		}
+		next += 2;
+
+		if (type == GMAX_SMBIOS_BIOS_INFORMATION && p[1] >= 9) {
+			GmaxPlatformSmbiosString(strings, end, p[5], Id->BiosVersion, sizeof(Id->BiosVersion));
+			GmaxPlatformSmbiosString(strings, end, p[8], Id->BiosDate, sizeof(Id->BiosDate));
+		}
+		if (type == GMAX_SMBIOS_SYSTEM_INFORMATION && p[1] >= 6) {
+			GmaxPlatformSmbiosString(strings, end, p[4], Id->Manufacturer, sizeof(Id->Manufacturer));
+			GmaxPlatformSmbiosString(strings, end, p[5], Id->Product, sizeof(Id->Product));
+			status = STATUS_SUCCESS;
+		}
+		if (type == GMAX_SMBIOS_END_OF_TABLE) {
+			break;
+		}
+		p = next;
+	}
+
+exit:
+	ExFreePoolWithTag(raw, GMAX_POOL_TAG);
+	return status;
+}
+
+static NTSTATUS
+GmaxPlatformReadAcpi(
+	_Inout_ GMAX_PLATFORM_ID* Id
+)
+{
+	GMAX_ACPI_HEADER* fadt;
+	ULONG length;
+	NTSTATUS status;
+
+	status = GmaxPlatformFirmwareTable(GMAX_FIRMWARE_ACPI, GMAX_ACPI_FADT, (PVOID*)&fadt, &length);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	if (length >= sizeof(*fadt)) {
+		GmaxPlatformCopyString(Id->OemId, sizeof(Id->OemId), fadt->OemId, sizeof(fadt->OemId));
+		GmaxPlatformCopyString(Id->OemTableId, sizeof(Id->OemTableId), fadt->OemTableId, sizeof(fadt->OemTableId));
+		Id->OemRevision = fadt->OemRevision;
+	}
+	else {
+		status = STATUS_INVALID_BUFFER_SIZE;
+	}
+
+	ExFreePoolWithTag(fadt, GMAX_POOL_TAG);
+	return status;
+}
+
+static GMAX_CPU
+GmaxPlatformReadCpu(
+	VOID
+)
+{
+#if defined(_M_ARM64)
+	ULONG64 midr = _ReadStatusReg(GMAX_ARM64_MIDR_EL1);
+
+	if (((midr >> 24) & 0xFF) == GMAX_MIDR_IMPLEMENTER_QUALCOMM) {
+		return GmaxCpuQualcomm;
+	}
+	return GmaxCpuUnknown;
+#elif defined(_M_AMD64) || defined(_M_IX86)
+	int cpuinfo[4];
+	char vendorName[13];
+	UINT32 family;
+	UINT32 model;
+
+	__cpuidex(cpuinfo, 0, 0);
+	RtlCopyMemory(&vendorName[0], &cpuinfo[1], 4);
+	RtlCopyMemory(&vendorName[4], &cpuinfo[3], 4);
+	RtlCopyMemory(&vendorName[8], &cpuinfo[2], 4);
+	vendorName[12] = '\0';
+
+	__cpuidex(cpuinfo, 1, 0);
+	family = (cpuinfo[0] >> 8) & 0xF;
+	model = (cpuinfo[0] >> 4) & 0xF;
+	if (family == 0xF || family == 0x6) {
+		model += ((cpuinfo[0] >> 16) & 0xF) << 4;
+	}
+	if (family == 0xF) {
+		family += (cpuinfo[0] >> 20) & 0xFF;
+	}
+
+	if (!strcmp(vendorName, "AuthenticAMD") && family >= 0x17) {
+		return GmaxCpuRyzen;
+	}
+	if (!strcmp(vendorName, "GenuineIntel") && family == 0x6) {
+		if (model == 0x8E) {
+			return GmaxCpuAmberLake;
+		}
+		if (model == 0x8C || model == 0x8D) {
+			return GmaxCpuTigerLake;
+		}
+	}
+	return GmaxCpuUnknown;
+#else
+	return GmaxCpuUnknown;
+#endif
+}
+
+static BOOLEAN
+GmaxPlatformMatchString(
+	_In_opt_ PCSTR Pattern,
+	_In_ PCSTR Value
+)
+{
+	return !Pattern || !strcmp(Pattern, Value);
+}
+
+static const GMAX_PLATFORM_QUIRK*
+GmaxPlatformMatch(
+	_In_ const GMAX_PLATFORM_ID* Id
+)
+{
+	for (ULONG i = 0; i < ARRAYSIZE(GmaxPlatformQuirks); i++) {
+		const GMAX_PLATFORM_QUIRK* quirk = &GmaxPlatformQuirks[i];
+
+		if (GmaxPlatformMatchString(quirk->Manufacturer, Id->Manufacturer) &&
+			GmaxPlatformMatchString(quirk->Product, Id->Product) &&
+			GmaxPlatformMatchString(quirk->OemId, Id->OemId) &&
+			GmaxPlatformMatchString(quirk->OemTableId, Id->OemTableId) &&
+			(quirk->Cpu == GmaxCpuAny || quirk->Cpu == Id->Cpu)) {
+			return quirk;
+		}
+	}
+	return &GmaxPlatformQuirks[ARRAYSIZE(GmaxPlatformQuirks) - 1];
+}
+
+NTSTATUS
+GmaxPlatformIdentify(
+	VOID
+)
+/*++
+
+Routine Description:
+
+Identifies the board and selects its quirks. Called once from
+DriverEntry; a board whose firmware tables cannot be read is matched
+on the CPU alone.
+
+Return Value:
+
+The SMBIOS read status, or the FADT one if SMBIOS is missing. The
+quirks are selected either way.
+
+--*/
+{
+	GMAX_PLATFORM_ID* id = &GmaxPlatform;
+	NTSTATUS smbiosStatus;
+	NTSTATUS acpiStatus;
+
+	RtlZeroMemory(id, sizeof(*id));
+
+	smbiosStatus = GmaxPlatformReadSmbios(id);
+	acpiStatus = GmaxPlatformReadAcpi(id);
+	id->Cpu = GmaxPlatformReadCpu();
+
+	GmaxPlatformMatched = GmaxPlatformMatch(id);
+
+	GmaxPrint(DEBUG_LEVEL_INFO, DBG_INIT,
+		"Platform \"%s\" \"%s\" BIOS \"%s\" \"%s\" OEM \"%s\" \"%s\" rev %u CPU %d: %s quirks\n",
+		id->Manufacturer, id->Product, id->BiosVersion, id->BiosDate,
+		id->OemId, id->OemTableId, id->OemRevision, id->Cpu,
+		GmaxPlatformMatched->Name);
+
+	return NT_SUCCESS(smbiosStatus) ? smbiosStatus : acpiStatus;
+}
+
+const GMAX_PLATFORM_QUIRK*
+GmaxPlatformQuirk(
+	VOID
+)
+{
+	return GmaxPlatformMatched;
+}
+
+UINT32
+GmaxPlatformQuirkHash(
+	_In_ const GMAX_PLATFORM_QUIRK* Quirk
+)
+/*++
+
+Routine Description:
+
+Hash of the quirks that end up in the init image, for the boot cache
+key.
+
+--*/
+{
+	UINT32 hash = (UINT32)Quirk->RightSpeakerUid;
+
+	for (ULONG i = 0; i < ARRAYSIZE(Quirk->VmonSlot); i++) {
+		hash = (hash * 31) ^ Quirk->VmonSlot[i];
+		hash = (hash * 31) ^ Quirk->ImonSlot[i];
+	}
+	return hash;
+}
+
+UINT32
+GmaxPlatformFirmwareHash(
+	VOID
+)
+/*++
+
+Routine Description:
+
+Hash of the firmware identity for the boot cache key. A BIOS update
+that changes _DSD or _UID changes the BIOS version or date, or the
+FADT OEM revision, without any ACPI method being evaluated.
+
+--*/
+{
+	const GMAX_PLATFORM_ID* id = &GmaxPlatform;
+	UINT32 hash;
+
+	hash = GmaxBootCrc32((const UINT8*)id->BiosVersion, (UINT32)strlen(id->BiosVersion));
+	hash = (hash * 31) ^ GmaxBootCrc32((const UINT8*)id->BiosDate, (UINT32)strlen(id->BiosDate));
+	return (hash * 31) ^ id->OemRevision;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+//
+// Board identification and quirks. The platform is identified once in
+// DriverEntry and matched against a compiled table; every device gets a
+// pointer to the matching entry, so start and resume never identify.
+//
+
+#define GMAX_PLATFORM_MAX_STRING 64
+#define GMAX_PLATFORM_OEM_ID_LEN 6
+#define GMAX_PLATFORM_OEM_TABLE_ID_LEN 8
+
+typedef enum _GMAX_CPU
+{
+	GmaxCpuAny = 0,
+	GmaxCpuUnknown,
+	GmaxCpuRyzen,
+	GmaxCpuAmberLake,
+	GmaxCpuTigerLake,
+	GmaxCpuQualcomm
+} GMAX_CPU;
+
+//
+// What the firmware and CPU say about the board. SMBIOS strings come
+// from the BIOS and System Information structures, the OEM IDs and
+// revision from the FADT header, all without trailing padding.
+//
+typedef struct _GMAX_PLATFORM_ID
+{
+	CHAR Manufacturer[GMAX_PLATFORM_MAX_STRING];
+	CHAR Product[GMAX_PLATFORM_MAX_STRING];
+	CHAR BiosVersion[GMAX_PLATFORM_MAX_STRING];
+	CHAR BiosDate[GMAX_PLATFORM_MAX_STRING];
+	CHAR OemId[GMAX_PLATFORM_OEM_ID_LEN + 1];
+	CHAR OemTableId[GMAX_PLATFORM_OEM_TABLE_ID_LEN + 1];
+	ULONG OemRevision;
+	GMAX_CPU Cpu;
+} GMAX_PLATFORM_ID;
+
+//
+// One board. NULL strings and GmaxCpuAny match anything; the first
+// entry that matches wins and the last entry matches every board.
+//
+typedef struct _GMAX_PLATFORM_QUIRK
+{
+	PCSTR Name;
+
+	PCSTR Manufacturer;
+	PCSTR Product;
+	PCSTR OemId;
+	PCSTR OemTableId;
+	GMAX_CPU Cpu;
+
+	INT32 RightSpeakerUid;	// amp that gets the right channel in the mono mix
+	UINT8 VmonSlot[2];	// IV slots for _UID 0 and the other amp, when _DSD has none
+	UINT8 ImonSlot[2];
+	UINT8 SpeakerGain;	// SPK_GAIN register value at start
+	UINT16 PowerUpDelayUs;	// GLOBAL_EN to AMP_EN
+} GMAX_PLATFORM_QUIRK;
+
+NTSTATUS
+GmaxPlatformIdentify(
+	VOID
+);
+
+const GMAX_PLATFORM_QUIRK*
+GmaxPlatformQuirk(
+	VOID
+);
+
+UINT32
+GmaxPlatformQuirkHash(
+	_In_ const GMAX_PLATFORM_QUIRK* Quirk
+);
+
+UINT32
+GmaxPlatformFirmwareHash(
+	VOID
+);
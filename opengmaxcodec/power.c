@@ -0,0 +1,269 @@
+/*++
+
+Module Name:
+
+power.c
+
+Abstract:
+
+Runs the chip's power-up and power-down sequences (powerseq.h) without
+putting a thread to sleep while the amp settles. Steps are written as
+far as the settle times allow; a wait of up to GMAX_POWER_STALL_MAX_US
+is spun out, anything longer arms a high-resolution timer whose
+callback queues a work item to write the next step at PASSIVE_LEVEL.
+The caller gets control back as soon as the first wait is handed off.
+
+Each pass through the steps is one power command, so other commands
+get the bus while the amp settles.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+EVT_WDF_TIMER GmaxEvtPowerTimer;
+EVT_WDF_WORKITEM GmaxEvtPowerWorkItem;
+
+static NTSTATUS
+GmaxPowerRun(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Writes every step that is due. Called with the power command held.
+
+Return Value:
+
+STATUS_PENDING when the timer was armed for the next step,
+STATUS_CANCELLED when the sequence was replaced or cancelled, otherwise
+the status of the sequence.
+
+--*/
+{
+	GMAX_POWER* power = &pDevice->Power;
+	const GMAX_POWER_STEP* step;
+	GMAX_POWER_SEQ_ACTION action;
+	NTSTATUS status = STATUS_SUCCESS;
+
+	for (;;) {
+		ULONGLONG now = KeQueryInterruptTimePrecise(NULL);
+		ULONGLONG remaining;
+
+		action = GmaxPowerSeqNext(&power->Seq, now, &step);
+		if (action == GmaxPowerSeqStop) {
+			break;
+		}
+
+		if (action == GmaxPowerSeqWrite) {
+			for (ULONG i = 0; i < step->Count && NT_SUCCESS(status); i++) {
+				status = gmax_reg_write(pDevice, step->Writes[i].Reg, step->Writes[i].Value);
+			}
+			GmaxPowerSeqWritten(&power->Seq, NT_SUCCESS(status), KeQueryInterruptTimePrecise(NULL));
+			continue;
+		}
+
+		remaining = power->Seq.DueAt - now;
+		if (remaining <= GMAX_POWER_STALL_MAX_US * 10) {
+			KeStallExecutionProcessor((ULONG)((remaining + 9) / 10));
+			continue;
+		}
+
+		power->Pending = TRUE;
+		power->Deferred++;
+		WdfTimerStart(power->Timer, WDF_REL_TIMEOUT_IN_US((remaining + 9) / 10));
+		return STATUS_PENDING;
+	}
+
+	switch (power->Seq.State) {
+	case GmaxPowerSeqDone:
+		return STATUS_SUCCESS;
+	case GmaxPowerSeqFailed:
+		return status;
+	default:
+		return STATUS_CANCELLED;
+	}
+}
+
+static VOID
+GmaxPowerFinish(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ NTSTATUS Status
+)
+{
+	GMAX_POWER* power = &pDevice->Power;
+	ULONG elapsedUs;
+
+	if (!NT_SUCCESS(Status)) {
+		power->Failed++;
+		return;
+	}
+
+	elapsedUs = (ULONG)min((KeQueryInterruptTimePrecise(NULL) - power->StartedAt) / 10, MAXULONG);
+	power->LastUs = elapsedUs;
+	power->MaxUs = max(power->MaxUs, elapsedUs);
+
+	if (power->Complete) {
+		power->Complete(pDevice);
+	}
+}
+
+static NTSTATUS
+GmaxPowerStart(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_reads_(Count) const GMAX_POWER_STEP* Steps,
+	_In_ UINT32 Count,
+	_In_opt_ GMAX_POWER_COMPLETE* Complete
+)
+{
+	GMAX_POWER* power = &pDevice->Power;
+	NTSTATUS status;
+
+	GmaxCmdBegin(pDevice, GmaxPriorityPower);
+
+	//
+	// A sequence still waiting on the timer is superseded. Its timer or
+	// work item may still run, and finds nothing pending.
+	//
+	if (power->Pending) {
+		power->Pending = FALSE;
+		WdfTimerStop(power->Timer, FALSE);
+	}
+
+	power->StartedAt = KeQueryInterruptTimePrecise(NULL);
+	power->Complete = Complete;
+	power->Sequences++;
+	GmaxPowerSeqStart(&power->Seq, Steps, Count, pDevice->Quirk->PowerUpDelayUs, power->StartedAt);
+
+	status = GmaxPowerRun(pDevice);
+	if (status != STATUS_PENDING) {
+		GmaxPowerFinish(pDevice, status);
+	}
+
+	GmaxCmdEnd(pDevice);
+	return status;
+}
+
+VOID
+GmaxEvtPowerTimer(
+	_In_ WDFTIMER Timer
+)
+{
+	PGMAX_CONTEXT pDevice = GetDeviceContext(WdfTimerGetParentObject(Timer));
+
+	WdfWorkItemEnqueue(pDevice->Power.WorkItem);
+}
+
+VOID
+GmaxEvtPowerWorkItem(
+	_In_ WDFWORKITEM WorkItem
+)
+{
+	PGMAX_CONTEXT pDevice = GetDeviceContext(WdfWorkItemGetParentObject(WorkItem));
+	GMAX_POWER* power = &pDevice->Power;
+	NTSTATUS status;
+
+	GmaxCmdBegin(pDevice, GmaxPriorityPower);
+	if (!power->Pending) {
+		GmaxCmdEnd(pDevice);
+		return;
+	}
+
+	power->Pending = FALSE;
+	status = GmaxPowerRun(pDevice);
+	if (status != STATUS_PENDING) {
+		GmaxPowerFinish(pDevice, status);
+	}
+	GmaxCmdEnd(pDevice);
+
+	//
+	// Nobody is waiting on the result, a bus that stopped answering
+	// mid-sequence goes to recovery like a failed resume
+	//
+	if (status != STATUS_PENDING && GmaxIsBusFailure(status)) {
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Power sequence failed 0x%x\n", status);
+		GmaxRecoveryRetry(pDevice);
+	}
+}
+
+NTSTATUS
+GmaxPowerInitialize(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	WDF_TIMER_CONFIG timerConfig;
+	WDF_WORKITEM_CONFIG workItemConfig;
+	WDF_OBJECT_ATTRIBUTES attributes;
+	NTSTATUS status;
+
+	WDF_TIMER_CONFIG_INIT(&timerConfig, GmaxEvtPowerTimer);
+	timerConfig.UseHighResolutionTimer = WdfTrue;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+
+	status = WdfTimerCreate(&timerConfig, &attributes, &pDevice->Power.Timer);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	WDF_WORKITEM_CONFIG_INIT(&workItemConfig, GmaxEvtPowerWorkItem);
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+
+	return WdfWorkItemCreate(&workItemConfig, &attributes, &pDevice->Power.WorkItem);
+}
+
+NTSTATUS
+GmaxPowerUp(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_opt_ GMAX_POWER_COMPLETE* Complete
+)
+/*++
+
+Routine Description:
+
+Starts the chip's power-up sequence. Complete is called once the amp
+has settled after the last step, from this call or from the work item.
+
+Return Value:
+
+STATUS_SUCCESS when the amp is up or the rest of the sequence is
+running from the timer, otherwise the status of the write that failed.
+
+--*/
+{
+	NTSTATUS status = GmaxPowerStart(pDevice,
+		pDevice->Chip->PowerUp, pDevice->Chip->PowerUpCount, Complete);
+
+	return status == STATUS_PENDING ? STATUS_SUCCESS : status;
+}
+
+NTSTATUS
+GmaxPowerDown(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Runs the chip's power-down sequence, superseding a power-up that is
+still settling. Power-down steps have no settle time, so the sequence
+is done when this returns.
+
+--*/
+{
+	NTSTATUS status = GmaxPowerStart(pDevice,
+		pDevice->Chip->PowerDown, pDevice->Chip->PowerDownCount, NULL);
+
+	return status == STATUS_PENDING ? STATUS_SUCCESS : status;
+}
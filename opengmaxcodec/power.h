@@ -0,0 +1,51 @@
+#pragma once
+
+//
+// Timer-driven power sequencing, see powerseq.h
+//
+
+//
+// Settle times up to this are spun out inline, longer ones hand the
+// rest of the sequence to a high-resolution timer
+//
+#define GMAX_POWER_STALL_MAX_US 10
+
+struct _GMAX_CONTEXT;
+
+typedef VOID
+GMAX_POWER_COMPLETE(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+typedef struct _GMAX_POWER
+{
+	GMAX_POWER_SEQ Seq;
+	GMAX_POWER_COMPLETE* Complete;
+	BOOLEAN Pending;		// the timer owns the rest of Seq
+
+	WDFTIMER Timer;			// high resolution, DISPATCH_LEVEL
+	WDFWORKITEM WorkItem;		// runs the steps at PASSIVE_LEVEL
+
+	ULONGLONG StartedAt;		// interrupt time, 100ns
+	ULONG Sequences;
+	ULONG Deferred;			// settle waits handed to the timer
+	ULONG Failed;
+	ULONG LastUs;			// start to settled
+	ULONG MaxUs;
+} GMAX_POWER;
+
+NTSTATUS
+GmaxPowerInitialize(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+NTSTATUS
+GmaxPowerUp(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_opt_ GMAX_POWER_COMPLETE* Complete
+);
+
+NTSTATUS
+GmaxPowerDown(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
@@ -0,0 +1,138 @@
+#pragma once
+
+//
+// Power sequencing state machine. A sequence is a list of steps, each a
+// batch of register writes followed by the time the amp needs to settle
+// before the next step. Nothing here waits: the caller writes the batch
+// Next hands out, reports it with Written, and comes back when DueAt
+// has passed. Pure so the host simulation (tools/gmaxpowersim) runs it
+// on virtual time.
+//
+
+#define GMAX_POWER_STEP_MAX_WRITES 4
+
+//
+// SettleUs value taken from the platform quirks (PowerUpDelayUs)
+//
+#define GMAX_POWER_SETTLE_QUIRK 0xFFFFFFFF
+
+typedef struct _GMAX_POWER_WRITE
+{
+	uint16_t Reg;
+	uint8_t Value;
+} GMAX_POWER_WRITE;
+
+typedef struct _GMAX_POWER_STEP
+{
+	GMAX_POWER_WRITE Writes[GMAX_POWER_STEP_MAX_WRITES];
+	uint32_t Count;
+	uint32_t SettleUs;	// after the batch, before the next step
+} GMAX_POWER_STEP;
+
+typedef enum {
+	GmaxPowerSeqIdle,
+	GmaxPowerSeqRunning,
+	GmaxPowerSeqDone,
+	GmaxPowerSeqFailed
+} GMAX_POWER_SEQ_STATE;
+
+typedef enum {
+	GmaxPowerSeqWrite,	// write *Step now
+	GmaxPowerSeqWait,	// nothing until DueAt
+	GmaxPowerSeqStop	// done, failed or cancelled
+} GMAX_POWER_SEQ_ACTION;
+
+typedef struct _GMAX_POWER_SEQ
+{
+	const GMAX_POWER_STEP* Steps;
+	uint32_t Count;
+	uint32_t Next;
+	uint32_t QuirkSettleUs;
+	uint64_t DueAt;		// 100ns, when step Next may be written
+	GMAX_POWER_SEQ_STATE State;
+} GMAX_POWER_SEQ;
+
+static __inline void
+GmaxPowerSeqStart(
+	GMAX_POWER_SEQ* Seq,
+	const GMAX_POWER_STEP* Steps,
+	uint32_t Count,
+	uint32_t QuirkSettleUs,
+	uint64_t Now
+)
+{
+	Seq->Steps = Steps;
+	Seq->Count = Count;
+	Seq->Next = 0;
+	Seq->QuirkSettleUs = QuirkSettleUs;
+	Seq->DueAt = Now;
+	Seq->State = Count ? GmaxPowerSeqRunning : GmaxPowerSeqDone;
+}
+
+static __inline void
+GmaxPowerSeqCancel(
+	GMAX_POWER_SEQ* Seq
+)
+{
+	Seq->State = GmaxPowerSeqIdle;
+}
+
+//
+// The last step's settle time counts too, a sequence is done once the
+// amp has settled after it
+//
+static __inline GMAX_POWER_SEQ_ACTION
+GmaxPowerSeqNext(
+	GMAX_POWER_SEQ* Seq,
+	uint64_t Now,
+	const GMAX_POWER_STEP** Step
+)
+{
+	*Step = 0;
+	if (Seq->State != GmaxPowerSeqRunning) {
+		return GmaxPowerSeqStop;
+	}
+	if (Now < Seq->DueAt) {
+		return GmaxPowerSeqWait;
+	}
+	if (Seq->Next == Seq->Count) {
+		Seq->State = GmaxPowerSeqDone;
+		return GmaxPowerSeqStop;
+	}
+	*Step = &Seq->Steps[Seq->Next];
+	return GmaxPowerSeqWrite;
+}
+
+static __inline uint32_t
+GmaxPowerSeqSettleUs(
+	const GMAX_POWER_SEQ* Seq,
+	const GMAX_POWER_STEP* Step
+)
+{
+	return Step->SettleUs == GMAX_POWER_SETTLE_QUIRK ? Seq->QuirkSettleUs : Step->SettleUs;
+}
+
+//
+// Records the outcome of the batch Next handed out. Now is when the
+// last write of the batch completed, the settle time runs from there.
+//
+static __inline void
+GmaxPowerSeqWritten(
+	GMAX_POWER_SEQ* Seq,
+	int Ok,
+	uint64_t Now
+)
+{
+	if (Seq->State != GmaxPowerSeqRunning) {
+		return;
+	}
+	if (!Ok) {
+		Seq->State = GmaxPowerSeqFailed;
+		return;
+	}
+
+	Seq->DueAt = Now + (uint64_t)GmaxPowerSeqSettleUs(Seq, &Seq->Steps[Seq->Next]) * 10;
+	if (++Seq->Next == Seq->Count && Seq->DueAt == Now) {
+		Seq->State = GmaxPowerSeqDone;
+	}
+}
@@ -0,0 +1,203 @@
+/*++
+
+Module Name:
+
+recovery.c
+
+Abstract:
+
+Brings the amp back after the SPB circuit breaker opens. Instead of
+power transitions waiting on a wedged bus, transfers fail fast while
+the breaker is open and a passive timer runs a recovery pass when the
+cooldown ends: soft reset, drop every register shadow, and if the
+device is in D0, run StartCodec again. A failed pass reopens the
+breaker with a longer cooldown, which schedules the next one.
+
+A power-down that failed in StopCodec is retried the same way, for up
+to GMAX_RECOVERY_DX_ATTEMPTS passes once the device has left D0. What a
+pass does is decided in codecstate.h, shared with tools/gmaxsoak.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+EVT_WDF_TIMER GmaxEvtRecoveryTimer;
+SPB_BREAKER_OPENED GmaxSpbBreakerOpened;
+
+BOOLEAN
+GmaxIsBusFailure(
+	_In_ NTSTATUS Status
+)
+/*++
+
+Routine Description:
+
+Failures that mean the bus or the amp is not answering, as opposed to
+a bad request. STATUS_DEVICE_NOT_READY is what an open breaker returns.
+
+--*/
+{
+	return Status == STATUS_IO_TIMEOUT ||
+		Status == STATUS_CANCELLED ||
+		Status == STATUS_NO_SUCH_DEVICE ||
+		Status == STATUS_DEVICE_PROTOCOL_ERROR ||
+		Status == STATUS_DEVICE_NOT_READY;
+}
+
+VOID
+GmaxSpbBreakerOpened(
+	_In_ PVOID Context,
+	_In_ ULONG CooldownMs
+)
+{
+	PGMAX_CONTEXT pDevice = (PGMAX_CONTEXT)Context;
+
+	GmaxReportEvent(pDevice, GmaxEventBusFault, (UINT16)min(CooldownMs, MAXUINT16));
+	GmaxRecoverySchedule(pDevice, CooldownMs);
+}
+
+VOID
+GmaxRecoveryRetry(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Schedules the next pass after a failed bus sequence: when the breaker
+is open, for the end of its cooldown (transfers before then would
+fail fast anyway), otherwise after one base cooldown.
+
+--*/
+{
+	SPB_BREAKER* breaker = &pDevice->I2CContext.Breaker;
+	ULONGLONG now = KeQueryInterruptTimePrecise(NULL);
+	ULONG delayMs = SPB_BREAKER_COOLDOWN_MS;
+
+	if (breaker->State == SpbBreakerOpen) {
+		delayMs = breaker->OpenUntil > now ?
+			(ULONG)((breaker->OpenUntil - now) / 10000) + 1 :
+			1;
+	}
+
+	GmaxRecoverySchedule(pDevice, delayMs);
+}
+
+VOID
+GmaxRecoveryNext(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ GMAX_CODEC_NEXT Next
+)
+{
+	if (Next == GmaxCodecRetry) {
+		GmaxRecoveryRetry(pDevice);
+	}
+	else if (Next == GmaxCodecRestart) {
+		GmaxRecoverySchedule(pDevice, 1);
+	}
+}
+
+VOID
+GmaxEvtRecoveryTimer(
+	_In_ WDFTIMER Timer
+)
+{
+	PGMAX_CONTEXT pDevice = GetDeviceContext(WdfTimerGetParentObject(Timer));
+	GMAX_RECOVERY* recovery = &pDevice->Recovery;
+	ULONGLONG previous;
+	GMAX_CODEC_NEXT next;
+	NTSTATUS status;
+
+	recovery->Attempts++;
+
+	GmaxCmdBegin(pDevice, GmaxPriorityPower);
+	if (!GmaxCodecRecoveryBegin(&pDevice->Codec)) {
+		GmaxCmdEnd(pDevice);
+		return;
+	}
+
+	previous = SpbSetDeadline(&pDevice->I2CContext, GMAX_RECOVERY_DEADLINE_MS);
+
+	status = GmaxPowerDown(pDevice);
+	if (NT_SUCCESS(status)) {
+		GmaxBdeInvalidate(pDevice);
+	}
+	if (GmaxCodecRecoveryReset(&pDevice->Codec, NT_SUCCESS(status))) {
+		status = StartCodec(pDevice);
+	}
+
+	SpbRestoreDeadline(&pDevice->I2CContext, previous);
+	GmaxCmdEnd(pDevice);
+
+	if (NT_SUCCESS(status)) {
+		GmaxPrint(DEBUG_LEVEL_INFO, DBG_PNP,
+			"Bus recovered after %u attempts\n", recovery->Attempts);
+		GmaxReportEvent(pDevice, GmaxEventBusRecovered, (UINT16)min(recovery->Attempts, MAXUINT16));
+		recovery->Attempts = 0;
+		recovery->Recovered++;
+		GmaxInterruptRestore(pDevice);
+		return;
+	}
+
+	next = GmaxCodecRecoveryDone(&pDevice->Codec, FALSE);
+	if (next == GmaxCodecNone) {
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Amp not reset after %u passes in Dx, left to StartCodec\n", pDevice->Codec.DxAttempts);
+		return;
+	}
+
+	GmaxRecoveryNext(pDevice, next);
+}
+
+NTSTATUS
+GmaxRecoveryInitialize(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	WDF_TIMER_CONFIG timerConfig;
+	WDF_OBJECT_ATTRIBUTES attributes;
+
+	pDevice->I2CContext.BreakerOpened = GmaxSpbBreakerOpened;
+	pDevice->I2CContext.BreakerContext = pDevice;
+	pDevice->I2CContext.RandomSeed = (ULONG)KeQueryInterruptTime();
+
+	WDF_TIMER_CONFIG_INIT(&timerConfig, GmaxEvtRecoveryTimer);
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+	attributes.ExecutionLevel = WdfExecutionLevelPassive;
+
+	return WdfTimerCreate(&timerConfig, &attributes, &pDevice->Recovery.Timer);
+}
+
+VOID
+GmaxRecoverySchedule(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ ULONG DelayMs
+)
+{
+	if (!pDevice->Recovery.Timer) {
+		return;
+	}
+
+	WdfTimerStart(pDevice->Recovery.Timer, WDF_REL_TIMEOUT_IN_MS(max(DelayMs, 1)));
+}
+
+VOID
+GmaxRecoveryStop(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	if (!pDevice->Recovery.Timer) {
+		return;
+	}
+
+	WdfTimerStop(pDevice->Recovery.Timer, TRUE);
+}
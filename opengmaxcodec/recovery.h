@@ -0,0 +1,50 @@
+#pragma once
+
+//
+// Background bus recovery after the SPB circuit breaker opens
+//
+
+typedef struct _GMAX_RECOVERY
+{
+	WDFTIMER Timer;
+
+	ULONG Attempts;		// since the last successful pass
+	ULONG Recovered;
+} GMAX_RECOVERY;
+
+struct _GMAX_CONTEXT;
+
+NTSTATUS
+GmaxRecoveryInitialize(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+VOID
+GmaxRecoverySchedule(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ ULONG DelayMs
+);
+
+VOID
+GmaxRecoveryRetry(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+//
+// Acts on a GmaxCodecRetry or GmaxCodecRestart from codecstate.h
+//
+VOID
+GmaxRecoveryNext(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ GMAX_CODEC_NEXT Next
+);
+
+VOID
+GmaxRecoveryStop(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+BOOLEAN
+GmaxIsBusFailure(
+	_In_ NTSTATUS Status
+);
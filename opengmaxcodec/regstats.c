@@ -0,0 +1,209 @@
+/*++
+
+Module Name:
+
+regstats.c
+
+Abstract:
+
+Per-register access heatmap. Reads, writes, no-op read-modify-writes
+and bus time are counted per register without taking a lock. A read
+that returns the value last seen on the bus counts as a cache hit and
+a write of that value as redundant, which shows which reads a register
+cache could serve and which writes could be dropped.
+
+Bulk transfers count one access for each register they cover; their
+bus time is charged to the register they start at.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+
+#define GMAX_REGSTATS_KNOWN 0x100
+
+ULONG
+GmaxRegStatsIndex(
+	_In_ const GMAX_CHIP_OPS* Chip,
+	_In_ UINT16 Reg
+)
+/*++
+
+Routine Description:
+
+Slot of a register: its offset in the chip's register map, counting
+the ranges before it. The map has a handful of ranges, so a scan is
+as quick as any lookup structure.
+
+--*/
+{
+	const GMAX_CHIP_REG_MAP* map = &Chip->RegMap;
+	ULONG index = 0;
+
+	for (UINT32 i = 0; i < map->Count; i++) {
+		const GMAX_REG_RANGE* range = &map->Ranges[i];
+
+		if (Reg >= range->Base && Reg - range->Base < range->Count) {
+			index += Reg - range->Base;
+			return index < GMAX_REGSTATS_OTHER ? index : GMAX_REGSTATS_OTHER;
+		}
+		index += range->Count;
+	}
+	return GMAX_REGSTATS_OTHER;
+}
+
+UINT16
+GmaxRegStatsAddress(
+	_In_ const GMAX_CHIP_OPS* Chip,
+	_In_ ULONG Index
+)
+{
+	const GMAX_CHIP_REG_MAP* map = &Chip->RegMap;
+
+	if (Index >= GMAX_REGSTATS_OTHER) {
+		return GMAX_REG_STATS_OTHER;
+	}
+
+	for (UINT32 i = 0; i < map->Count; i++) {
+		const GMAX_REG_RANGE* range = &map->Ranges[i];
+
+		if (Index < range->Count) {
+			return (UINT16)(range->Base + Index);
+		}
+		Index -= range->Count;
+	}
+	return GMAX_REG_STATS_OTHER;
+}
+
+#if GMAX_REGSTATS_ENABLED
+
+VOID
+GmaxRegStatsRead(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ UINT16 Reg,
+	_In_reads_(Length) const UINT8* Data,
+	_In_ UINT32 Length,
+	_In_ ULONGLONG BusTime
+)
+{
+	GMAX_REGSTATS* stats = &pDevice->RegStats;
+
+	InterlockedAdd64(&stats->Entry[GmaxRegStatsIndex(pDevice->Chip, Reg)].BusTime, (LONG64)BusTime);
+
+	for (UINT32 i = 0; i < Length; i++) {
+		ULONG index = GmaxRegStatsIndex(pDevice->Chip, (UINT16)(Reg + i));
+		LONG value = GMAX_REGSTATS_KNOWN | Data[i];
+
+		InterlockedIncrement(&stats->Entry[index].Reads);
+		if (InterlockedExchange(&stats->Last[index], value) == value) {
+			InterlockedIncrement(&stats->Entry[index].CacheHits);
+		}
+		else {
+			InterlockedIncrement(&stats->Entry[index].CacheMisses);
+		}
+	}
+}
+
+VOID
+GmaxRegStatsWrite(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ UINT16 Reg,
+	_In_reads_(Length) const UINT8* Data,
+	_In_ UINT32 Length,
+	_In_ ULONGLONG BusTime
+)
+{
+	GMAX_REGSTATS* stats = &pDevice->RegStats;
+
+	InterlockedAdd64(&stats->Entry[GmaxRegStatsIndex(pDevice->Chip, Reg)].BusTime, (LONG64)BusTime);
+
+	for (UINT32 i = 0; i < Length; i++) {
+		ULONG index = GmaxRegStatsIndex(pDevice->Chip, (UINT16)(Reg + i));
+		LONG value = GMAX_REGSTATS_KNOWN | Data[i];
+
+		InterlockedIncrement(&stats->Entry[index].Writes);
+		if (InterlockedExchange(&stats->Last[index], value) == value) {
+			InterlockedIncrement(&stats->Entry[index].RedundantWrites);
+		}
+	}
+}
+
+VOID
+GmaxRegStatsNoopUpdate(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ UINT16 Reg
+)
+{
+	InterlockedIncrement(&pDevice->RegStats.Entry[GmaxRegStatsIndex(pDevice->Chip, Reg)].NoopUpdates);
+}
+
+#endif
+
+ULONG
+GmaxRegStatsCopy(
+	_In_ PGMAX_CONTEXT pDevice,
+	_Out_writes_(Count) GMAX_REG_STATS* Stats,
+	_In_ ULONG Count
+)
+/*++
+
+Routine Description:
+
+Copies the counters of every register that has been accessed, in
+address order. Each counter is read on its own, so a snapshot taken
+during traffic can be a few accesses apart between fields.
+
+--*/
+{
+	GMAX_REGSTATS* regStats = &pDevice->RegStats;
+	ULONG copied = 0;
+
+	for (ULONG index = 0; index < GMAX_REGSTATS_COUNT && copied < Count; index++) {
+		GMAX_REGSTATS_ENTRY* entry = &regStats->Entry[index];
+		GMAX_REG_STATS* out = &Stats[copied];
+
+		out->Reads = (UINT32)ReadNoFence(&entry->Reads);
+		out->Writes = (UINT32)ReadNoFence(&entry->Writes);
+		out->NoopUpdates = (UINT32)ReadNoFence(&entry->NoopUpdates);
+		if (out->Reads == 0 && out->Writes == 0 && out->NoopUpdates == 0) {
+			continue;
+		}
+
+		out->Reg = GmaxRegStatsAddress(pDevice->Chip, index);
+		out->Reserved = 0;
+		out->RedundantWrites = (UINT32)ReadNoFence(&entry->RedundantWrites);
+		out->CacheHits = (UINT32)ReadNoFence(&entry->CacheHits);
+		out->CacheMisses = (UINT32)ReadNoFence(&entry->CacheMisses);
+		out->BusTime = (UINT64)ReadNoFence64(&entry->BusTime);
+		copied++;
+	}
+
+	return copied;
+}
+
+VOID
+GmaxRegStatsReset(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	GMAX_REGSTATS* regStats = &pDevice->RegStats;
+
+	//
+	// Last values are kept so hit and redundancy tracking carries on
+	// across the reset
+	//
+	for (ULONG index = 0; index < GMAX_REGSTATS_COUNT; index++) {
+		GMAX_REGSTATS_ENTRY* entry = &regStats->Entry[index];
+
+		InterlockedExchange(&entry->Reads, 0);
+		InterlockedExchange(&entry->Writes, 0);
+		InterlockedExchange(&entry->RedundantWrites, 0);
+		InterlockedExchange(&entry->NoopUpdates, 0);
+		InterlockedExchange(&entry->CacheHits, 0);
+		InterlockedExchange(&entry->CacheMisses, 0);
+		InterlockedExchange64(&entry->BusTime, 0);
+	}
+}
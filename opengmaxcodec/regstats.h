@@ -0,0 +1,110 @@
+#pragma once
+
+//
+// Per-register access counters
+//
+// Every gmax_reg_* access lands in a flat array indexed by a compact
+// register index. Counters are updated with interlocked operations and
+// no lock, so they stay on in release builds; define
+// GMAX_REGSTATS_ENABLED to 0 to compile them out.
+//
+
+#ifndef GMAX_REGSTATS_ENABLED
+#define GMAX_REGSTATS_ENABLED 1
+#endif
+
+//
+// Registers in the chip's register map take the slots of the register
+// image, anything else the last slot
+//
+#define GMAX_REGSTATS_OTHER GMAX_REG_IMAGE_COUNT
+#define GMAX_REGSTATS_COUNT (GMAX_REGSTATS_OTHER + 1)
+
+typedef struct _GMAX_REGSTATS_ENTRY
+{
+	volatile LONG Reads;
+	volatile LONG Writes;
+	volatile LONG RedundantWrites;
+	volatile LONG NoopUpdates;
+	volatile LONG CacheHits;
+	volatile LONG CacheMisses;
+	volatile LONG64 BusTime;
+} GMAX_REGSTATS_ENTRY;
+
+typedef struct _GMAX_REGSTATS
+{
+	GMAX_REGSTATS_ENTRY Entry[GMAX_REGSTATS_COUNT];
+
+	//
+	// Last value seen on the bus with bit 8 set, 0 while unknown
+	//
+	volatile LONG Last[GMAX_REGSTATS_COUNT];
+} GMAX_REGSTATS;
+
+struct _GMAX_CONTEXT;
+struct _GMAX_CHIP_OPS;
+
+//
+// Compact index of a register in the chip's register map, shared with
+// the register shadow
+//
+ULONG
+GmaxRegStatsIndex(
+	_In_ const struct _GMAX_CHIP_OPS* Chip,
+	_In_ UINT16 Reg
+);
+
+UINT16
+GmaxRegStatsAddress(
+	_In_ const struct _GMAX_CHIP_OPS* Chip,
+	_In_ ULONG Index
+);
+
+#if GMAX_REGSTATS_ENABLED
+
+VOID
+GmaxRegStatsRead(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ UINT16 Reg,
+	_In_reads_(Length) const UINT8* Data,
+	_In_ UINT32 Length,
+	_In_ ULONGLONG BusTime
+);
+
+VOID
+GmaxRegStatsWrite(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ UINT16 Reg,
+	_In_reads_(Length) const UINT8* Data,
+	_In_ UINT32 Length,
+	_In_ ULONGLONG BusTime
+);
+
+VOID
+GmaxRegStatsNoopUpdate(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ UINT16 Reg
+);
+
+#define GmaxRegStatsNow() KeQueryInterruptTimePrecise(NULL)
+
+#else
+
+#define GmaxRegStatsRead(pDevice, Reg, Data, Length, BusTime)
+#define GmaxRegStatsWrite(pDevice, Reg, Data, Length, BusTime)
+#define GmaxRegStatsNoopUpdate(pDevice, Reg)
+#define GmaxRegStatsNow() 0
+
+#endif
+
+ULONG
+GmaxRegStatsCopy(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_Out_writes_(Count) GMAX_REG_STATS* Stats,
+	_In_ ULONG Count
+);
+
+VOID
+GmaxRegStatsReset(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
@@ -0,0 +1,150 @@
+/*++
+
+Module Name:
+
+scheduler.c
+
+Abstract:
+
+Arbitrates register commands between the driver's issuers by priority
+class. A command is a transaction or a short sequence bracketed by
+GmaxCmdBegin/GmaxCmdEnd. When the bus is released it is handed to the
+highest class with a waiter, so a stream start never queues behind
+telemetry. Bulk low priority work brackets each transaction on its own,
+which lets urgent commands in between them.
+
+Commands nest on the owning thread, so a power sequence may call helpers
+that bracket their own transactions.
+
+Environment:
+
+Kernel mode, PASSIVE_LEVEL
+
+--*/
+
+#include "opengmaxcodec.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+NTSTATUS
+GmaxSchedulerInitialize(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	GMAX_SCHEDULER* scheduler = &pDevice->Scheduler;
+	WDF_OBJECT_ATTRIBUTES attributes;
+
+	for (int i = 0; i < GmaxPriorityMax; i++) {
+		KeInitializeEvent(&scheduler->Wake[i], SynchronizationEvent, FALSE);
+	}
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+
+	return WdfSpinLockCreate(&attributes, &scheduler->Lock);
+}
+
+static BOOLEAN
+GmaxHigherPriorityWaiting(
+	_In_ GMAX_SCHEDULER* scheduler,
+	_In_ GMAX_PRIORITY Priority
+)
+{
+	for (int i = 0; i < Priority; i++) {
+		if (scheduler->Waiting[i]) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+VOID
+GmaxCmdBegin(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ GMAX_PRIORITY Priority
+)
+{
+	GMAX_SCHEDULER* scheduler = &pDevice->Scheduler;
+	GMAX_PRIORITY_STATS* stats = &scheduler->Stats.Class[Priority];
+	PKTHREAD thread = KeGetCurrentThread();
+	ULONGLONG start = KeQueryInterruptTimePrecise(NULL);
+	BOOLEAN waited = FALSE;
+
+	WdfSpinLockAcquire(scheduler->Lock);
+
+	if (scheduler->Owner == thread) {
+		scheduler->OwnerDepth++;
+		WdfSpinLockRelease(scheduler->Lock);
+		return;
+	}
+
+	scheduler->Waiting[Priority]++;
+	while (scheduler->Owner != NULL ||
+		GmaxHigherPriorityWaiting(scheduler, Priority)) {
+		waited = TRUE;
+		WdfSpinLockRelease(scheduler->Lock);
+
+		KeWaitForSingleObject(&scheduler->Wake[Priority],
+			Executive,
+			KernelMode,
+			FALSE,
+			NULL);
+
+		WdfSpinLockAcquire(scheduler->Lock);
+	}
+	scheduler->Waiting[Priority]--;
+
+	scheduler->Owner = thread;
+	scheduler->OwnerDepth = 1;
+
+	ULONGLONG wait = KeQueryInterruptTimePrecise(NULL) - start;
+	stats->Commands++;
+	stats->TotalWait += wait;
+	if (wait > stats->MaxWait) {
+		stats->MaxWait = wait;
+	}
+	if (waited) {
+		stats->Preempted++;
+	}
+
+	WdfSpinLockRelease(scheduler->Lock);
+}
+
+VOID
+GmaxCmdEnd(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	GMAX_SCHEDULER* scheduler = &pDevice->Scheduler;
+
+	WdfSpinLockAcquire(scheduler->Lock);
+
+	NT_ASSERT(scheduler->Owner == KeGetCurrentThread());
+
+	if (--scheduler->OwnerDepth == 0) {
+		scheduler->Owner = NULL;
+
+		for (int i = 0; i < GmaxPriorityMax; i++) {
+			if (scheduler->Waiting[i]) {
+				KeSetEvent(&scheduler->Wake[i], 0, FALSE);
+				break;
+			}
+		}
+	}
+
+	WdfSpinLockRelease(scheduler->Lock);
+}
+
+VOID
+GmaxSchedulerGetStats(
+	_In_ PGMAX_CONTEXT pDevice,
+	_Out_ GMAX_SCHEDULER_STATS* Stats
+)
+{
+	GMAX_SCHEDULER* scheduler = &pDevice->Scheduler;
+
+	WdfSpinLockAcquire(scheduler->Lock);
+	*Stats = scheduler->Stats;
+	WdfSpinLockRelease(scheduler->Lock);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+//
+// Priority arbitration of register commands
+//
+
+typedef struct _GMAX_SCHEDULER
+{
+	WDFSPINLOCK Lock;
+
+	PKTHREAD Owner;
+	ULONG OwnerDepth;
+
+	ULONG Waiting[GmaxPriorityMax];
+	KEVENT Wake[GmaxPriorityMax];
+
+	GMAX_SCHEDULER_STATS Stats;
+} GMAX_SCHEDULER;
+
+struct _GMAX_CONTEXT;
+
+NTSTATUS
+GmaxSchedulerInitialize(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+VOID
+GmaxCmdBegin(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ GMAX_PRIORITY Priority
+);
+
+VOID
+GmaxCmdEnd(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+VOID
+GmaxSchedulerGetStats(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_Out_ GMAX_SCHEDULER_STATS* Stats
+);
@@ -0,0 +1,211 @@
+/*++
+
+Module Name:
+
+shadow.c
+
+Abstract:
+
+Register shadow. Each value gmax_reg_* reads or writes successfully is
+stored in a per-device register image. Writers serialize on a spin
+lock and bump Sequence before and after the update. Readers copy the
+image without any lock and retry if Sequence was odd or changed, so
+telemetry and IOCTL readers never queue on SpbLock or the controller
+lock behind StartCodec or a volume ramp.
+
+The image holds what the driver last saw, not what the chip holds
+now: status and measurement registers change on their own, and a soft
+reset drops the whole image until the registers are seen again.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+
+C_ASSERT(GMAX_REG_IMAGE_COUNT == GMAX_REGSTATS_OTHER);
+
+NTSTATUS
+GmaxShadowInitialize(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	WDF_OBJECT_ATTRIBUTES attributes;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+
+	return WdfSpinLockCreate(&attributes, &pDevice->Shadow.Lock);
+}
+
+VOID
+GmaxShadowStore(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ UINT16 Reg,
+	_In_reads_(Length) const UINT8* Data,
+	_In_ UINT32 Length
+)
+/*++
+
+Routine Description:
+
+Publishes registers just transferred on the bus. A write setting
+SOFT_RESET invalidates the image instead, the chip is back at its
+defaults.
+
+--*/
+{
+	GMAX_SHADOW* shadow = &pDevice->Shadow;
+
+	if (!shadow->Lock) {
+		return;
+	}
+
+	if (Reg == pDevice->Chip->Regs.SoftReset && Length != 0 && (Data[0] & GMAX_CHIP_SOFT_RESET)) {
+		GmaxShadowInvalidate(pDevice);
+		return;
+	}
+
+	WdfSpinLockAcquire(shadow->Lock);
+	InterlockedIncrement(&shadow->Sequence);
+
+	for (UINT32 i = 0; i < Length; i++) {
+		ULONG index = GmaxRegStatsIndex(pDevice->Chip, (UINT16)(Reg + i));
+
+		if (index >= GMAX_REG_IMAGE_COUNT) {
+			continue;
+		}
+		shadow->Value[index] = Data[i];
+		shadow->Valid[index / 8] |= (UINT8)(1 << (index % 8));
+	}
+	shadow->UpdateTime = KeQueryInterruptTime();
+
+	InterlockedIncrement(&shadow->Sequence);
+	WdfSpinLockRelease(shadow->Lock);
+}
+
+VOID
+GmaxShadowInvalidate(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	GMAX_SHADOW* shadow = &pDevice->Shadow;
+
+	if (!shadow->Lock) {
+		return;
+	}
+
+	WdfSpinLockAcquire(shadow->Lock);
+	InterlockedIncrement(&shadow->Sequence);
+	RtlZeroMemory(shadow->Valid, sizeof(shadow->Valid));
+	shadow->UpdateTime = KeQueryInterruptTime();
+	InterlockedIncrement(&shadow->Sequence);
+	WdfSpinLockRelease(shadow->Lock);
+}
+
+NTSTATUS
+GmaxShadowRead(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ UINT16 Reg,
+	_Out_ UINT8* Value
+)
+/*++
+
+Routine Description:
+
+Returns the last value seen for a register without taking a lock.
+Callable at any IRQL.
+
+Return Value:
+
+STATUS_NOT_FOUND if the register is untracked or has not been seen
+since load or the last soft reset, STATUS_DEVICE_BUSY if a writer
+stayed mid-update for every retry.
+
+--*/
+{
+	GMAX_SHADOW* shadow = &pDevice->Shadow;
+	ULONG index = GmaxRegStatsIndex(pDevice->Chip, Reg);
+
+	*Value = 0;
+	if (index >= GMAX_REG_IMAGE_COUNT) {
+		return STATUS_NOT_FOUND;
+	}
+
+	for (ULONG retry = 0; retry < GMAX_SHADOW_MAX_RETRIES; retry++) {
+		LONG sequence = shadow->Sequence;
+		BOOLEAN valid;
+		UINT8 value;
+
+		KeMemoryBarrier();
+		if (sequence & 1) {
+			YieldProcessor();
+			continue;
+		}
+
+		valid = (shadow->Valid[index / 8] >> (index % 8)) & 1;
+		value = shadow->Value[index];
+
+		KeMemoryBarrier();
+		if (shadow->Sequence != sequence) {
+			continue;
+		}
+
+		if (!valid) {
+			return STATUS_NOT_FOUND;
+		}
+		*Value = value;
+		return STATUS_SUCCESS;
+	}
+
+	return STATUS_DEVICE_BUSY;
+}
+
+NTSTATUS
+GmaxShadowSnapshot(
+	_In_ PGMAX_CONTEXT pDevice,
+	_Out_ GMAX_REG_IMAGE* Image
+)
+/*++
+
+Routine Description:
+
+Copies a consistent register image without taking a lock, for
+IOCTL_GMAX_GET_REG_IMAGE.
+
+--*/
+{
+	GMAX_SHADOW* shadow = &pDevice->Shadow;
+
+	for (ULONG retry = 0; retry < GMAX_SHADOW_MAX_RETRIES; retry++) {
+		LONG sequence = shadow->Sequence;
+		ULONGLONG updateTime;
+
+		KeMemoryBarrier();
+		if (sequence & 1) {
+			YieldProcessor();
+			continue;
+		}
+
+		RtlCopyMemory(Image->Valid, shadow->Valid, sizeof(Image->Valid));
+		RtlCopyMemory(Image->Value, shadow->Value, sizeof(Image->Value));
+		updateTime = shadow->UpdateTime;
+
+		KeMemoryBarrier();
+		if (shadow->Sequence != sequence) {
+			continue;
+		}
+
+		Image->Sequence = (UINT32)sequence;
+		Image->AgeMs = updateTime ? (UINT32)((KeQueryInterruptTime() - updateTime) / 10000) : 0;
+		Image->RangeCount = min(pDevice->Chip->RegMap.Count, GMAX_REG_IMAGE_RANGES);
+		RtlZeroMemory(Image->Ranges, sizeof(Image->Ranges));
+		RtlCopyMemory(Image->Ranges, pDevice->Chip->RegMap.Ranges, Image->RangeCount * sizeof(GMAX_REG_RANGE));
+		return STATUS_SUCCESS;
+	}
+
+	RtlZeroMemory(Image, sizeof(*Image));
+	return STATUS_DEVICE_BUSY;
+}
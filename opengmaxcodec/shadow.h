@@ -0,0 +1,59 @@
+#pragma once
+
+//
+// Register image published through a sequence lock
+//
+// Every value gmax_reg_* sees on the bus lands here. Writers serialize
+// on Lock; readers take no lock at all and retry if Sequence moved
+// under them, so diagnostics read cached state at any IRQL without
+// touching SpbLock or the controller lock.
+//
+
+//
+// Reader retries before giving up on a writer that stays mid-update,
+// e.g. a reader that interrupted it on the same processor
+//
+#define GMAX_SHADOW_MAX_RETRIES 64
+
+typedef struct _GMAX_SHADOW
+{
+	WDFSPINLOCK Lock;		// writers only
+	volatile LONG Sequence;		// odd while an update is in progress
+
+	UINT8 Value[GMAX_REG_IMAGE_COUNT];
+	UINT8 Valid[GMAX_REG_IMAGE_VALID_BYTES];
+	ULONGLONG UpdateTime;		// interrupt time of the last update
+} GMAX_SHADOW;
+
+struct _GMAX_CONTEXT;
+
+NTSTATUS
+GmaxShadowInitialize(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+VOID
+GmaxShadowStore(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ UINT16 Reg,
+	_In_reads_(Length) const UINT8* Data,
+	_In_ UINT32 Length
+);
+
+VOID
+GmaxShadowInvalidate(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+NTSTATUS
+GmaxShadowRead(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ UINT16 Reg,
+	_Out_ UINT8* Value
+);
+
+NTSTATUS
+GmaxShadowSnapshot(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_Out_ GMAX_REG_IMAGE* Image
+);
@@ -26,25 +26,25 @@ Revision History:
 static ULONG GmaxDebugLevel = 100;
 static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
 
-NTSTATUS
+static NTSTATUS
 SpbDoWriteDataSynchronously(
 	IN SPB_CONTEXT* SpbContext,
-	IN PVOID Data,
-	IN ULONG Length
+	IN SPB_MESSAGE* Message,
+	IN PWDF_REQUEST_SEND_OPTIONS Options
 )
 /*++
 
 Routine Description:
 
 This helper routine abstracts creating and sending an I/O
-request (I2C Write) to the Spb I/O target.
+request (I2C Write) to the Spb I/O target. The message is
+already in memory the target can use, so it is sent as is.
 
 Arguments:
 
 SpbContext - Pointer to the current device context
-Address    - The I2C register address to write to
-Data       - A buffer to receive the data at at the above address
-Length     - The amount of data to be read from the above address
+Message    - The register address and payload to send
+Options    - Send options carrying the transfer timeout
 
 Return Value:
 
@@ -52,58 +52,23 @@ NTSTATUS Status indicating success or failure
 
 --*/
 {
-	PUCHAR buffer;
-	ULONG length;
-	WDFMEMORY memory;
 	WDF_MEMORY_DESCRIPTOR memoryDescriptor;
 	NTSTATUS status;
 
-	length = Length;
-	memory = NULL;
-
-	if (length > DEFAULT_SPB_BUFFER_SIZE)
-	{
-		status = WdfMemoryCreate(
-			WDF_NO_OBJECT_ATTRIBUTES,
-			NonPagedPool,
-			GMAX_POOL_TAG,
-			length,
-			&memory,
-			(PVOID*)&buffer);
-
-		if (!NT_SUCCESS(status))
-		{
-			GmaxPrint(
-				DEBUG_LEVEL_ERROR,
-				DBG_IOCTL,
-				"Error allocating memory for Spb write - %!STATUS!",
-				status);
-			goto exit;
-		}
-
-		WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(
-			&memoryDescriptor,
-			memory,
-			NULL);
-	}
-	else
-	{
-		buffer = (PUCHAR)WdfMemoryGetBuffer(SpbContext->WriteMemory, NULL);
-
-		WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
-			&memoryDescriptor,
-			(PVOID)buffer,
-			length);
-	}
+	WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(
+		&memoryDescriptor,
+		Message->Memory,
+		&Message->Range);
 
-	RtlCopyMemory(buffer, Data, length);
+	InterlockedIncrement64(&SpbContext->Transfers);
+	InterlockedExchangeAdd64(&SpbContext->BytesSent, (LONG64)Message->Range.BufferLength);
 
 	status = WdfIoTargetSendWriteSynchronously(
 		SpbContext->SpbIoTarget,
 		NULL,
 		&memoryDescriptor,
 		NULL,
-		NULL,
+		Options,
 		NULL);
 
 	if (!NT_SUCCESS(status))
@@ -113,22 +78,140 @@ NTSTATUS Status indicating success or failure
 			DBG_IOCTL,
 			"Error writing to Spb - %!STATUS!",
 			status);
-		goto exit;
 	}
 
-exit:
+	return status;
+}
 
-	if (NULL != memory)
+NTSTATUS
+SpbMessageBegin(
+	_In_ SPB_CONTEXT* SpbContext,
+	_Out_ SPB_MESSAGE* Message,
+	_In_ ULONG Capacity
+)
+/*++
+
+Routine Description:
+
+Starts an empty message with room for Capacity bytes, in one of the
+preallocated buffers when one is free and large enough. SpbMessageEnd
+gives the buffer back.
+
+--*/
+{
+	PVOID buffer;
+	NTSTATUS status;
+
+	RtlZeroMemory(Message, sizeof(*Message));
+	Message->Slot = SPB_MESSAGE_NO_SLOT;
+	Message->Capacity = Capacity;
+
+	if (Capacity <= DEFAULT_SPB_BUFFER_SIZE && SpbContext->MessageMemory) {
+		for (LONG slot = 0; slot < SPB_MESSAGE_SLOTS; slot++) {
+			if (!InterlockedBitTestAndSet(&SpbContext->MessageSlots, slot)) {
+				Message->Memory = SpbContext->MessageMemory;
+				Message->Range.BufferOffset = (size_t)slot * DEFAULT_SPB_BUFFER_SIZE;
+				Message->Buffer = SpbContext->MessageBuffer + Message->Range.BufferOffset;
+				Message->Slot = slot;
+				return STATUS_SUCCESS;
+			}
+		}
+	}
+
+	status = WdfMemoryCreate(
+		WDF_NO_OBJECT_ATTRIBUTES,
+		NonPagedPool,
+		GMAX_POOL_TAG,
+		Capacity,
+		&Message->Memory,
+		&buffer);
+
+	if (!NT_SUCCESS(status))
 	{
-		WdfObjectDelete(memory);
+		GmaxPrint(
+			DEBUG_LEVEL_ERROR,
+			DBG_IOCTL,
+			"Error allocating memory for Spb write - %!STATUS!",
+			status);
+		Message->Memory = NULL;
+		return status;
 	}
 
-	return status;
+	InterlockedIncrement(&SpbContext->Allocations);
+	Message->Buffer = (PUCHAR)buffer;
+	Message->Allocated = TRUE;
+	return STATUS_SUCCESS;
+}
+
+VOID
+SpbMessageInitMemory(
+	_Out_ SPB_MESSAGE* Message,
+	_In_ WDFMEMORY Memory,
+	_In_ ULONG Offset,
+	_In_ ULONG Length
+)
+/*++
+
+Routine Description:
+
+Wraps Length bytes at Offset in a buffer the caller built and owns,
+register address first. Sending it copies nothing.
+
+--*/
+{
+	RtlZeroMemory(Message, sizeof(*Message));
+	Message->Memory = Memory;
+	Message->Range.BufferOffset = Offset;
+	Message->Range.BufferLength = Length;
+	Message->Buffer = (PUCHAR)WdfMemoryGetBuffer(Memory, NULL) + Offset;
+	Message->Capacity = Length;
+	Message->Slot = SPB_MESSAGE_NO_SLOT;
+}
+
+VOID
+SpbMessageEnd(
+	_In_ SPB_CONTEXT* SpbContext,
+	_Inout_ SPB_MESSAGE* Message
+)
+{
+	if (Message->Slot != SPB_MESSAGE_NO_SLOT) {
+		InterlockedBitTestAndReset(&SpbContext->MessageSlots, Message->Slot);
+	}
+	else if (Message->Allocated) {
+		WdfObjectDelete(Message->Memory);
+	}
+
+	Message->Memory = NULL;
+	Message->Buffer = NULL;
+	Message->Slot = SPB_MESSAGE_NO_SLOT;
+	Message->Allocated = FALSE;
+}
+
+VOID
+SpbMessageCopy(
+	_In_ SPB_CONTEXT* SpbContext,
+	_Inout_ SPB_MESSAGE* Message,
+	_In_reads_bytes_(Length) const VOID* Data,
+	_In_ ULONG Length
+)
+/*++
+
+Routine Description:
+
+Appends a payload that already sits in another buffer. The only copy
+on the write path, counted in BytesCopied.
+
+--*/
+{
+	RtlCopyMemory(Message->Buffer + Message->Range.BufferLength, Data, Length);
+	Message->Range.BufferLength += Length;
+	InterlockedExchangeAdd64(&SpbContext->BytesCopied, Length);
 }
 
 NTSTATUS
 SpbLockController(
-	IN SPB_CONTEXT* SpbContext
+	IN SPB_CONTEXT* SpbContext,
+	IN PWDF_REQUEST_SEND_OPTIONS Options
 )
 /*++
 
@@ -159,7 +242,7 @@ SpbLockController(
 		IOCTL_SPB_LOCK_CONTROLLER,
 		NULL,
 		NULL,
-		NULL,
+		Options,
 		NULL);
 
 	if (!NT_SUCCESS(status))
@@ -176,7 +259,8 @@ SpbLockController(
 
 NTSTATUS
 SpbUnlockController(
-	IN SPB_CONTEXT* SpbContext
+	IN SPB_CONTEXT* SpbContext,
+	IN PWDF_REQUEST_SEND_OPTIONS Options
 )
 /*++
 
@@ -207,7 +291,7 @@ SpbUnlockController(
 		IOCTL_SPB_UNLOCK_CONTROLLER,
 		NULL,
 		NULL,
-		NULL,
+		Options,
 		NULL);
 
 	if (!NT_SUCCESS(status))
@@ -222,68 +306,267 @@ SpbUnlockController(
 	return status;
 }
 
-NTSTATUS
-SpbWriteDataSynchronously(
-	IN SPB_CONTEXT* SpbContext,
-	IN PVOID Data,
+static VOID
+SpbCaptureCopyIn(
+	IN SPB_CAPTURE* Capture,
+	IN const VOID* Data,
 	IN ULONG Length
 )
+{
+	const UCHAR* data = (const UCHAR*)Data;
+	ULONG first = min(Length, SPB_CAPTURE_SIZE - Capture->Head);
+
+	RtlCopyMemory(Capture->Ring + Capture->Head, data, first);
+	RtlCopyMemory(Capture->Ring, data + first, Length - first);
+	Capture->Head = (Capture->Head + Length) % SPB_CAPTURE_SIZE;
+}
+
+static VOID
+SpbCaptureCopyOut(
+	IN SPB_CAPTURE* Capture,
+	IN ULONG Offset,
+	OUT VOID* Data,
+	IN ULONG Length
+)
+{
+	UCHAR* data = (UCHAR*)Data;
+	ULONG first = min(Length, SPB_CAPTURE_SIZE - Offset);
+
+	RtlCopyMemory(data, Capture->Ring + Offset, first);
+	RtlCopyMemory(data + first, Capture->Ring, Length - first);
+}
+
+static ULONG
+SpbCaptureRecordSize(
+	IN const GMAX_SPB_RECORD* Record
+)
+{
+	ULONG payload = min(Record->WriteLength, GMAX_SPB_CAPTURE_MAX_PAYLOAD) +
+		min(Record->ReadLength, GMAX_SPB_CAPTURE_MAX_PAYLOAD);
+
+	return sizeof(GMAX_SPB_RECORD) + ((payload + 3) & ~3UL);
+}
+
+static ULONG
+SpbCapturePeekSize(
+	IN SPB_CAPTURE* Capture
+)
+{
+	GMAX_SPB_RECORD record;
+
+	SpbCaptureCopyOut(Capture, Capture->Tail, &record, sizeof(record));
+	return SpbCaptureRecordSize(&record);
+}
+
+static VOID
+SpbCaptureLog(
+	IN SPB_CONTEXT* SpbContext,
+	IN GMAX_SPB_DIRECTION Direction,
+	IN PVOID SendData,
+	IN ULONG SendLength,
+	IN PVOID ReadData,
+	IN ULONG ReadLength,
+	IN NTSTATUS Status,
+	IN ULONGLONG Start
+)
 /*++
 
 Routine Description:
 
-This routine abstracts creating and sending an I/O
-request (I2C Write) to the Spb I/O target and utilizes
-a helper routine to do work inside of locked code.
+Appends one transfer to the capture ring, overwriting the oldest
+records when it is full. Called with the SPB lock held, so records
+are in bus order.
 
-Arguments:
+--*/
+{
+	SPB_CAPTURE* capture = &SpbContext->Capture;
+	ULONGLONG end = KeQueryInterruptTimePrecise(NULL);
+	static const UCHAR pad[4] = { 0 };
+	GMAX_SPB_RECORD record;
+	ULONG writeStored;
+	ULONG readStored;
+	ULONG size;
+
+	if (!capture->Enabled) {
+		return;
+	}
 
-SpbContext - Pointer to the current device context
-Address    - The I2C register address to write to
-Data       - A buffer to receive the data at at the above address
-Length     - The amount of data to be read from the above address
+	if (!NT_SUCCESS(Status)) {
+		ReadLength = 0;
+	}
 
-Return Value:
+	RtlZeroMemory(&record, sizeof(record));
+	record.Timestamp = (UINT32)((Start - capture->StartTime) / 10);
+	record.Latency = (UINT32)((end - Start) / 10);
+	record.Status = Status;
+	record.Direction = (UINT8)Direction;
+	record.WriteLength = (UINT16)min(SendLength, MAXUINT16);
+	record.ReadLength = (UINT16)min(ReadLength, MAXUINT16);
 
-NTSTATUS Status indicating success or failure
+	writeStored = min(record.WriteLength, GMAX_SPB_CAPTURE_MAX_PAYLOAD);
+	readStored = min(record.ReadLength, GMAX_SPB_CAPTURE_MAX_PAYLOAD);
+	size = SpbCaptureRecordSize(&record);
+
+	WdfSpinLockAcquire(capture->Lock);
+
+	if (capture->Ring) {
+		while (SPB_CAPTURE_SIZE - capture->Used < size) {
+			ULONG oldest = SpbCapturePeekSize(capture);
+
+			capture->Tail = (capture->Tail + oldest) % SPB_CAPTURE_SIZE;
+			capture->Used -= oldest;
+			capture->Records--;
+			capture->Dropped++;
+		}
+
+		SpbCaptureCopyIn(capture, &record, sizeof(record));
+		SpbCaptureCopyIn(capture, SendData, writeStored);
+		SpbCaptureCopyIn(capture, ReadData, readStored);
+		SpbCaptureCopyIn(capture, pad, size - sizeof(record) - writeStored - readStored);
+		capture->Used += size;
+		capture->Records++;
+	}
+
+	WdfSpinLockRelease(capture->Lock);
+}
+
+NTSTATUS
+SpbCaptureStart(
+	IN SPB_CONTEXT* SpbContext
+)
+/*++
+
+Routine Description:
+
+Empties the capture ring and starts logging transfers. The ring is
+allocated on first use so a driver that never captures pays nothing.
 
 --*/
 {
+	SPB_CAPTURE* capture = &SpbContext->Capture;
+	WDFMEMORY memory = NULL;
+	PVOID ring = NULL;
 	NTSTATUS status;
 
-	WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
-	SpbLockController(SpbContext);
+	if (!capture->Lock) {
+		return STATUS_DEVICE_NOT_READY;
+	}
 
-	status = SpbDoWriteDataSynchronously(
-		SpbContext,
-		Data,
-		Length);
+	if (!capture->Memory) {
+		status = WdfMemoryCreate(
+			WDF_NO_OBJECT_ATTRIBUTES,
+			NonPagedPool,
+			GMAX_POOL_TAG,
+			SPB_CAPTURE_SIZE,
+			&memory,
+			&ring);
 
-	SpbUnlockController(SpbContext);
-	WdfWaitLockRelease(SpbContext->SpbLock);
+		if (!NT_SUCCESS(status))
+		{
+			GmaxPrint(
+				DEBUG_LEVEL_ERROR,
+				DBG_IOCTL,
+				"Error allocating Spb capture ring - %!STATUS!",
+				status);
+			return status;
+		}
+	}
 
-	return status;
+	WdfSpinLockAcquire(capture->Lock);
+
+	if (memory) {
+		capture->Memory = memory;
+		capture->Ring = (PUCHAR)ring;
+	}
+	capture->Head = 0;
+	capture->Tail = 0;
+	capture->Used = 0;
+	capture->Records = 0;
+	capture->Dropped = 0;
+	capture->StartTime = KeQueryInterruptTimePrecise(NULL);
+	capture->Enabled = TRUE;
+
+	WdfSpinLockRelease(capture->Lock);
+
+	return STATUS_SUCCESS;
 }
 
-NTSTATUS
-SpbXferDataSynchronously(
-	_In_ SPB_CONTEXT* SpbContext,
-	_In_ PVOID SendData,
-	_In_ ULONG SendLength,
-	_In_reads_bytes_(Length) PVOID Data,
-	_In_ ULONG Length
+VOID
+SpbCaptureStop(
+	IN SPB_CONTEXT* SpbContext
+)
+{
+	SpbContext->Capture.Enabled = FALSE;
+}
+
+ULONG
+SpbCaptureDrain(
+	IN SPB_CONTEXT* SpbContext,
+	_Out_writes_bytes_(Length) PUCHAR Buffer,
+	IN ULONG Length
+)
+/*++
+
+Routine Description:
+
+Moves as many whole records as fit after a GMAX_SPB_CAPTURE_HEADER
+into Buffer and returns the bytes written. Records that do not fit
+stay in the ring for the next call.
+
+--*/
+{
+	SPB_CAPTURE* capture = &SpbContext->Capture;
+	GMAX_SPB_CAPTURE_HEADER header;
+	ULONG written = sizeof(header);
+
+	if (!capture->Lock || Length < sizeof(header)) {
+		return 0;
+	}
+
+	RtlZeroMemory(&header, sizeof(header));
+	header.Version = GMAX_SPB_CAPTURE_VERSION;
+
+	WdfSpinLockAcquire(capture->Lock);
+
+	while (capture->Records > 0) {
+		ULONG size = SpbCapturePeekSize(capture);
+
+		if (Length - written < size) {
+			break;
+		}
+
+		SpbCaptureCopyOut(capture, capture->Tail, Buffer + written, size);
+		capture->Tail = (capture->Tail + size) % SPB_CAPTURE_SIZE;
+		capture->Used -= size;
+		capture->Records--;
+		header.Records++;
+		written += size;
+	}
+
+	header.Dropped = capture->Dropped;
+	header.StartTime = capture->StartTime;
+
+	WdfSpinLockRelease(capture->Lock);
+
+	header.Bytes = written - sizeof(header);
+	RtlCopyMemory(Buffer, &header, sizeof(header));
+	return written;
+}
+
+static NTSTATUS
+SpbDoReadDataSynchronously(
+	IN SPB_CONTEXT* SpbContext,
+	_Out_writes_bytes_(Length) PVOID Data,
+	IN ULONG Length,
+	IN PWDF_REQUEST_SEND_OPTIONS Options
 )
 /*++
+
 Routine Description:
+
 This helper routine abstracts creating and sending an I/O
 request (I2C Read) to the Spb I/O target.
-Arguments:
-SpbContext - Pointer to the current device context
-Address    - The I2C register address to read from
-Data       - A buffer to receive the data at at the above address
-Length     - The amount of data to be read from the above address
-Return Value:
-NTSTATUS Status indicating success or failure
+
 --*/
 {
 	PUCHAR buffer;
@@ -292,31 +575,9 @@ NTSTATUS Status indicating success or failure
 	NTSTATUS status;
 	ULONG_PTR bytesRead;
 
-	WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
-	SpbLockController(SpbContext);
-
 	memory = NULL;
-	status = STATUS_INVALID_PARAMETER;
 	bytesRead = 0;
 
-	//
-	// Xfer transactions start by writing an address pointer
-	//
-	status = SpbDoWriteDataSynchronously(
-		SpbContext,
-		SendData,
-		SendLength);
-
-	if (!NT_SUCCESS(status))
-	{
-		GmaxPrint(
-			DEBUG_LEVEL_ERROR,
-			DBG_IOCTL,
-			"Error setting address pointer for Spb read - %!STATUS!",
-			status);
-		goto exit;
-	}
-
 	if (Length > DEFAULT_SPB_BUFFER_SIZE)
 	{
 		status = WdfMemoryCreate(
@@ -353,16 +614,22 @@ NTSTATUS Status indicating success or failure
 	}
 
 
+	InterlockedIncrement64(&SpbContext->Transfers);
+
 	status = WdfIoTargetSendReadSynchronously(
 		SpbContext->SpbIoTarget,
 		NULL,
 		&memoryDescriptor,
 		NULL,
-		NULL,
+		Options,
 		&bytesRead);
 
-	if (!NT_SUCCESS(status) ||
-		bytesRead != Length)
+	if (NT_SUCCESS(status) && bytesRead != Length)
+	{
+		status = STATUS_DEVICE_PROTOCOL_ERROR;
+	}
+
+	if (!NT_SUCCESS(status))
 	{
 		GmaxPrint(
 			DEBUG_LEVEL_ERROR,
@@ -376,6 +643,8 @@ NTSTATUS Status indicating success or failure
 	// Copy back to the caller's buffer
 	//
 	RtlCopyMemory(Data, buffer, Length);
+	InterlockedExchangeAdd64(&SpbContext->BytesRead, Length);
+	InterlockedExchangeAdd64(&SpbContext->BytesCopied, Length);
 
 exit:
 	if (NULL != memory)
@@ -383,12 +652,423 @@ exit:
 		WdfObjectDelete(memory);
 	}
 
-	SpbUnlockController(SpbContext);
+	return status;
+}
+
+static BOOLEAN
+SpbRetryable(
+	IN NTSTATUS Status
+)
+/*++
+
+Routine Description:
+
+Bus level failures worth another attempt: timeouts (including a send
+cancelled at its deadline), an address NACK and a short or NACKed
+data phase. These are also the failures the breaker counts.
+
+--*/
+{
+	return Status == STATUS_IO_TIMEOUT ||
+		Status == STATUS_CANCELLED ||
+		Status == STATUS_NO_SUCH_DEVICE ||
+		Status == STATUS_DEVICE_PROTOCOL_ERROR;
+}
+
+static ULONGLONG
+SpbCurrentDeadline(
+	IN SPB_CONTEXT* SpbContext
+)
+{
+	if (SpbContext->DeadlineThread != KeGetCurrentThread()) {
+		return 0;
+	}
+	return SpbContext->Deadline;
+}
+
+static GMAX_LOCK_OP
+SpbLockOp(
+	IN GMAX_SPB_DIRECTION Direction,
+	IN SPB_MESSAGE* Message,
+	IN ULONG Length
+)
+{
+	PUCHAR send = Message->Buffer;
+	ULONG sendLength = (ULONG)Message->Range.BufferLength;
+	ULONG bytes = Direction == GmaxSpbXfer ? Length : sendLength - min(sendLength, 2);
+	GMAX_LOCK_OP op;
+
+	op.Reg = sendLength >= 2 ? (uint16_t)(send[0] << 8 | send[1]) : GMAX_LOCK_REG_UNKNOWN;
+	op.Direction = (uint8_t)Direction;
+	op.Length = (uint8_t)min(bytes, MAXUINT8);
+	return op;
+}
+
+static VOID
+SpbProfileRecord(
+	IN SPB_CONTEXT* SpbContext,
+	IN BOOLEAN Hold,
+	IN GMAX_LOCK Lock,
+	IN ULONGLONG Start,
+	IN ULONGLONG End,
+	IN GMAX_LOCK_OP Op,
+	IN GMAX_LOCK_OP Holder
+)
+/*++
+
+Routine Description:
+
+Adds one wait or hold interval (interrupt time) to the lock profile.
+
+--*/
+{
+	GMAX_LOCK_PROFILE* profile = &SpbContext->LockProfile;
+	ULONGLONG us = (End - Start) / 10;
+
+	if (!SpbContext->ProfileLock) {
+		return;
+	}
+
+	WdfSpinLockAcquire(SpbContext->ProfileLock);
+	GmaxLockRecord(
+		Hold ? &profile->Hold[Lock] : &profile->Wait[Lock],
+		(uint32_t)min(us, MAXUINT32),
+		(uint32_t)(End / 10000),
+		Op,
+		Holder);
+	WdfSpinLockRelease(SpbContext->ProfileLock);
+}
+
+static VOID
+SpbReleaseLock(
+	IN SPB_CONTEXT* SpbContext,
+	IN ULONGLONG Acquired
+)
+{
+	SpbProfileRecord(SpbContext, TRUE, GmaxLockSpb, Acquired,
+		KeQueryInterruptTimePrecise(NULL), SpbContext->Owner, SpbContext->Owner);
 	WdfWaitLockRelease(SpbContext->SpbLock);
+}
+
+VOID
+SpbGetLockProfile(
+	IN SPB_CONTEXT* SpbContext,
+	_Out_ GMAX_LOCK_PROFILE* Profile
+)
+{
+	RtlZeroMemory(Profile, sizeof(*Profile));
+
+	if (!SpbContext->ProfileLock) {
+		return;
+	}
+
+	WdfSpinLockAcquire(SpbContext->ProfileLock);
+	*Profile = SpbContext->LockProfile;
+	WdfSpinLockRelease(SpbContext->ProfileLock);
+}
+
+VOID
+SpbResetLockProfile(
+	IN SPB_CONTEXT* SpbContext
+)
+{
+	if (!SpbContext->ProfileLock) {
+		return;
+	}
+
+	WdfSpinLockAcquire(SpbContext->ProfileLock);
+	RtlZeroMemory(&SpbContext->LockProfile, sizeof(SpbContext->LockProfile));
+	WdfSpinLockRelease(SpbContext->ProfileLock);
+}
+
+static BOOLEAN
+SpbSendOptions(
+	OUT WDF_REQUEST_SEND_OPTIONS* Options,
+	IN ULONGLONG Deadline
+)
+/*++
+
+Routine Description:
+
+Sets the timeout of the next send from what is left of the deadline
+now, so the controller lock, the write and the read of one transfer
+share the deadline instead of each getting a fresh timeout. FALSE when
+the deadline has passed.
+
+--*/
+{
+	ULONGLONG timeout = SpbSendTimeout(KeQueryInterruptTimePrecise(NULL), Deadline);
+
+	if (timeout == 0) {
+		return FALSE;
+	}
+
+	WDF_REQUEST_SEND_OPTIONS_INIT(Options, WDF_REQUEST_SEND_OPTION_TIMEOUT);
+	WDF_REQUEST_SEND_OPTIONS_SET_TIMEOUT(Options, -(LONGLONG)timeout);
+	return TRUE;
+}
+
+static NTSTATUS
+SpbTransfer(
+	IN SPB_CONTEXT* SpbContext,
+	IN GMAX_SPB_DIRECTION Direction,
+	IN SPB_MESSAGE* Message,
+	_Out_writes_bytes_opt_(Length) PVOID Data,
+	IN ULONG Length
+)
+/*++
+
+Routine Description:
+
+Runs one write or write-then-read under the controller lock, retrying
+bus failures with jittered backoff until SPB_MAX_ATTEMPTS or the
+caller's deadline. Every send carries a timeout, so a wedged
+controller costs at most the deadline instead of hanging the caller.
+
+While the breaker is open transfers fail at once with
+STATUS_DEVICE_NOT_READY. The owner is told when it opens so it can
+schedule a recovery for when the cooldown ends.
+
+Time spent waiting for and holding SpbLock and the controller lock
+goes into the lock profile, tagged with the transfer's register.
+
+--*/
+{
+	WDF_REQUEST_SEND_OPTIONS options;
+	WDF_REQUEST_SEND_OPTIONS unlockOptions;
+	ULONGLONG deadline = SpbCurrentDeadline(SpbContext);
+	GMAX_LOCK_OP op = SpbLockOp(Direction, Message, Length);
+	GMAX_LOCK_OP unknown = { GMAX_LOCK_REG_UNKNOWN, 0, 0 };
+	NTSTATUS status;
+	BOOLEAN tripped = FALSE;
+
+	for (ULONG attempt = 0;; attempt++) {
+		ULONGLONG waitStart;
+		ULONGLONG start;
+		ULONG backoff;
+
+		waitStart = KeQueryInterruptTimePrecise(NULL);
+		WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
+
+		start = KeQueryInterruptTimePrecise(NULL);
+		SpbProfileRecord(SpbContext, FALSE, GmaxLockSpb, waitStart, start, op, SpbContext->Owner);
+		SpbContext->Owner = op;
+
+		if (!SpbBreakerAllow(&SpbContext->Breaker, start)) {
+			SpbContext->FastFails++;
+			SpbReleaseLock(SpbContext, start);
+			return STATUS_DEVICE_NOT_READY;
+		}
+
+		if (!SpbSendOptions(&options, deadline)) {
+			status = STATUS_IO_TIMEOUT;
+		}
+		else {
+			status = SpbLockController(SpbContext, &options);
+			if (NT_SUCCESS(status)) {
+				ULONGLONG locked = KeQueryInterruptTimePrecise(NULL);
+
+				//
+				// Whoever held the controller is another client of the bus
+				//
+				SpbProfileRecord(SpbContext, FALSE, GmaxLockController, start, locked, op, unknown);
+
+				//
+				// Xfer transactions start by writing an address pointer
+				//
+				status = SpbSendOptions(&options, deadline) ?
+					SpbDoWriteDataSynchronously(
+						SpbContext,
+						Message,
+						&options) :
+					STATUS_IO_TIMEOUT;
+
+				if (NT_SUCCESS(status) && Direction == GmaxSpbXfer) {
+					status = SpbSendOptions(&options, deadline) ?
+						SpbDoReadDataSynchronously(
+							SpbContext,
+							Data,
+							Length,
+							&options) :
+						STATUS_IO_TIMEOUT;
+				}
+
+				//
+				// Always released, even past the deadline, but only
+				// given what is left of it (SpbUnlockTimeout)
+				//
+				WDF_REQUEST_SEND_OPTIONS_INIT(&unlockOptions, WDF_REQUEST_SEND_OPTION_TIMEOUT);
+				WDF_REQUEST_SEND_OPTIONS_SET_TIMEOUT(&unlockOptions,
+					-(LONGLONG)SpbUnlockTimeout(KeQueryInterruptTimePrecise(NULL), deadline));
+				SpbUnlockController(SpbContext, &unlockOptions);
+				SpbProfileRecord(SpbContext, TRUE, GmaxLockController, locked,
+					KeQueryInterruptTimePrecise(NULL), op, op);
+			}
+
+			SpbCaptureLog(SpbContext, Direction, Message->Buffer, (ULONG)Message->Range.BufferLength,
+				Data, Length, status, start);
+		}
+
+		if (NT_SUCCESS(status) || !SpbRetryable(status)) {
+			if (NT_SUCCESS(status)) {
+				SpbBreakerRecord(&SpbContext->Breaker, TRUE, start);
+			}
+			SpbReleaseLock(SpbContext, start);
+			return status;
+		}
+
+		backoff = SpbBackoffUs(attempt, RtlRandomEx(&SpbContext->RandomSeed));
+		if (attempt + 1 >= SPB_MAX_ATTEMPTS ||
+			SpbSendTimeout(KeQueryInterruptTimePrecise(NULL) + backoff * 10ULL, deadline) == 0) {
+			tripped = (BOOLEAN)SpbBreakerRecord(&SpbContext->Breaker, FALSE, KeQueryInterruptTimePrecise(NULL));
+			SpbReleaseLock(SpbContext, start);
+			break;
+		}
+
+		SpbContext->Retries++;
+		SpbReleaseLock(SpbContext, start);
+
+		LARGE_INTEGER interval;
+		interval.QuadPart = WDF_REL_TIMEOUT_IN_US(backoff);
+		KeDelayExecutionThread(KernelMode, FALSE, &interval);
+	}
+
+	GmaxPrint(
+		DEBUG_LEVEL_ERROR,
+		DBG_IOCTL,
+		"Spb transfer failed after retries - %!STATUS!",
+		status);
+
+	if (tripped && SpbContext->BreakerOpened) {
+		SpbContext->BreakerOpened(SpbContext->BreakerContext, SpbContext->Breaker.CooldownMs);
+	}
 
 	return status;
 }
 
+NTSTATUS
+SpbMessageWrite(
+	_In_ SPB_CONTEXT* SpbContext,
+	_In_ SPB_MESSAGE* Message
+)
+/*++
+
+Routine Description:
+
+This routine sends a message (I2C Write) to the Spb I/O target
+under the SPB lock, with the retry and breaker handling of every
+transfer.
+
+Arguments:
+
+SpbContext - Pointer to the current device context
+Message    - Register address and payload, built in place
+
+Return Value:
+
+NTSTATUS Status indicating success or failure
+
+--*/
+{
+	return SpbTransfer(SpbContext, GmaxSpbWrite, Message, NULL, 0);
+}
+
+NTSTATUS
+SpbMessageXfer(
+	_In_ SPB_CONTEXT* SpbContext,
+	_In_ SPB_MESSAGE* Message,
+	_Out_writes_bytes_(Length) PVOID Data,
+	_In_ ULONG Length
+)
+/*++
+Routine Description:
+This helper routine sends a message holding a register address,
+then reads Length bytes from that address.
+Arguments:
+SpbContext - Pointer to the current device context
+Message    - The register address to read from
+Data       - A buffer to receive the data at at the above address
+Length     - The amount of data to be read from the above address
+Return Value:
+NTSTATUS Status indicating success or failure
+--*/
+{
+	return SpbTransfer(SpbContext, GmaxSpbXfer, Message, Data, Length);
+}
+
+VOID
+SpbGetStats(
+	IN SPB_CONTEXT* SpbContext,
+	_Out_ GMAX_SPB_STATS* Stats
+)
+{
+	RtlZeroMemory(Stats, sizeof(*Stats));
+	Stats->Transfers = (UINT64)SpbContext->Transfers;
+	Stats->BytesSent = (UINT64)SpbContext->BytesSent;
+	Stats->BytesRead = (UINT64)SpbContext->BytesRead;
+	Stats->BytesCopied = (UINT64)SpbContext->BytesCopied;
+	Stats->Allocations = (UINT32)SpbContext->Allocations;
+	Stats->Retries = SpbContext->Retries;
+	Stats->FastFails = SpbContext->FastFails;
+}
+
+VOID
+SpbResetStats(
+	IN SPB_CONTEXT* SpbContext
+)
+{
+	InterlockedExchange64(&SpbContext->Transfers, 0);
+	InterlockedExchange64(&SpbContext->BytesSent, 0);
+	InterlockedExchange64(&SpbContext->BytesRead, 0);
+	InterlockedExchange64(&SpbContext->BytesCopied, 0);
+	InterlockedExchange(&SpbContext->Allocations, 0);
+	SpbContext->Retries = 0;
+	SpbContext->FastFails = 0;
+}
+
+ULONGLONG
+SpbSetDeadline(
+	IN SPB_CONTEXT* SpbContext,
+	IN ULONG TimeoutMs
+)
+/*++
+
+Routine Description:
+
+Bounds every transfer the calling thread makes until SpbRestoreDeadline
+to finish within TimeoutMs from now. There is one deadline per target,
+not one per thread: callers set it only while holding the power command
+(GmaxCmdBegin with GmaxPriorityPower), so two sequences never own it at
+once. Transfers from other threads are not bounded by it.
+
+A nested sequence keeps the earlier of its own and the enclosing
+deadline, so a deadline taken at the top of OnD0Entry covers everything
+StartCodec calls. Returns the value to hand to SpbRestoreDeadline.
+
+--*/
+{
+	ULONGLONG previous = SpbCurrentDeadline(SpbContext);
+	ULONGLONG deadline = KeQueryInterruptTimePrecise(NULL) + TimeoutMs * 10000ULL;
+
+	if (previous == 0 || deadline < previous) {
+		SpbContext->Deadline = deadline;
+	}
+	SpbContext->DeadlineThread = KeGetCurrentThread();
+	return previous;
+}
+
+VOID
+SpbRestoreDeadline(
+	IN SPB_CONTEXT* SpbContext,
+	IN ULONGLONG Previous
+)
+{
+	SpbContext->Deadline = Previous;
+	if (Previous == 0) {
+		SpbContext->DeadlineThread = NULL;
+	}
+}
+
 VOID
 SpbTargetDeinitialize(
 	IN WDFDEVICE FxDevice,
@@ -422,16 +1102,40 @@ NTSTATUS Status indicating success or failure
 	if (SpbContext->SpbLock != NULL)
 	{
 		WdfObjectDelete(SpbContext->SpbLock);
+		SpbContext->SpbLock = NULL;
 	}
 
 	if (SpbContext->ReadMemory != NULL)
 	{
 		WdfObjectDelete(SpbContext->ReadMemory);
+		SpbContext->ReadMemory = NULL;
+	}
+
+	if (SpbContext->MessageMemory != NULL)
+	{
+		WdfObjectDelete(SpbContext->MessageMemory);
+		SpbContext->MessageMemory = NULL;
+		SpbContext->MessageBuffer = NULL;
+	}
+
+	SpbContext->Capture.Enabled = FALSE;
+	if (SpbContext->Capture.Memory != NULL)
+	{
+		WdfObjectDelete(SpbContext->Capture.Memory);
+		SpbContext->Capture.Memory = NULL;
+		SpbContext->Capture.Ring = NULL;
+	}
+
+	if (SpbContext->Capture.Lock != NULL)
+	{
+		WdfObjectDelete(SpbContext->Capture.Lock);
+		SpbContext->Capture.Lock = NULL;
 	}
 
-	if (SpbContext->WriteMemory != NULL)
+	if (SpbContext->ProfileLock != NULL)
 	{
-		WdfObjectDelete(SpbContext->WriteMemory);
+		WdfObjectDelete(SpbContext->ProfileLock);
+		SpbContext->ProfileLock = NULL;
 	}
 }
 
@@ -528,15 +1232,16 @@ NTSTATUS Status indicating success or failure
 
 	//
 	// Allocate some fixed-size buffers from NonPagedPool for typical
-	// Spb transaction sizes to avoid pool fragmentation in most cases
+	// Spb transaction sizes to avoid pool fragmentation in most cases.
+	// Messages are built straight into the write slots.
 	//
 	status = WdfMemoryCreate(
 		WDF_NO_OBJECT_ATTRIBUTES,
 		NonPagedPool,
 		GMAX_POOL_TAG,
-		DEFAULT_SPB_BUFFER_SIZE,
-		&SpbContext->WriteMemory,
-		NULL);
+		SPB_MESSAGE_SLOTS * DEFAULT_SPB_BUFFER_SIZE,
+		&SpbContext->MessageMemory,
+		(PVOID*)&SpbContext->MessageBuffer);
 
 	if (!NT_SUCCESS(status))
 	{
@@ -547,6 +1252,7 @@ NTSTATUS Status indicating success or failure
 			status);
 		goto exit;
 	}
+	SpbContext->MessageSlots = 0;
 
 	status = WdfMemoryCreate(
 		WDF_NO_OBJECT_ATTRIBUTES,
@@ -583,6 +1289,34 @@ NTSTATUS Status indicating success or failure
 		goto exit;
 	}
 
+	status = WdfSpinLockCreate(
+		WDF_NO_OBJECT_ATTRIBUTES,
+		&SpbContext->Capture.Lock);
+
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(
+			DEBUG_LEVEL_ERROR,
+			DBG_IOCTL,
+			"Error creating Spb capture lock - %!STATUS!",
+			status);
+		goto exit;
+	}
+
+	status = WdfSpinLockCreate(
+		WDF_NO_OBJECT_ATTRIBUTES,
+		&SpbContext->ProfileLock);
+
+	if (!NT_SUCCESS(status))
+	{
+		GmaxPrint(
+			DEBUG_LEVEL_ERROR,
+			DBG_IOCTL,
+			"Error creating Spb lock profile lock - %!STATUS!",
+			status);
+		goto exit;
+	}
+
 exit:
 
 	if (!NT_SUCCESS(status))
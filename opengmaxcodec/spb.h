@@ -23,9 +23,66 @@ Revision History:
 #include <wdm.h>
 #include <wdf.h>
 
+#include "spbretry.h"
+#include "lockprof.h"
+
 #define DEFAULT_SPB_BUFFER_SIZE 64
 #define RESHUB_USE_HELPER_ROUTINES
 
+#define SPB_CAPTURE_SIZE (32 * 1024)
+
+//
+// Preallocated message buffers, DEFAULT_SPB_BUFFER_SIZE each. A message
+// that finds them all in use, or needs more room, gets its own.
+//
+#define SPB_MESSAGE_SLOTS 4
+#define SPB_MESSAGE_NO_SLOT (-1)
+
+//
+// Transfer capture ring, see IOCTL_GMAX_SET_SPB_CAPTURE
+//
+
+typedef struct _SPB_CAPTURE
+{
+	WDFSPINLOCK Lock;
+	WDFMEMORY Memory;
+	PUCHAR Ring;
+	ULONG Head;		// next byte written
+	ULONG Tail;		// oldest record
+	ULONG Used;
+	ULONG Records;
+	ULONG Dropped;
+	ULONGLONG StartTime;
+	BOOLEAN Enabled;
+} SPB_CAPTURE;
+
+//
+// Called when the circuit breaker opens, with the cooldown before the
+// bus will be tried again
+//
+typedef VOID
+SPB_BREAKER_OPENED(
+	_In_ PVOID Context,
+	_In_ ULONG CooldownMs
+);
+
+//
+// One transfer's write phase, built in place in memory the I/O target
+// is handed directly: the register address, then the payload. Either
+// taken from the context by SpbMessageBegin or a range of a buffer the
+// caller built ahead of time (SpbMessageInitMemory).
+//
+
+typedef struct _SPB_MESSAGE
+{
+	WDFMEMORY Memory;
+	WDFMEMORY_OFFSET Range;	// of Memory that is sent
+	PUCHAR Buffer;		// first byte of the range
+	ULONG Capacity;
+	LONG Slot;		// SPB_MESSAGE_NO_SLOT unless from the preallocated set
+	BOOLEAN Allocated;	// Memory is the message's own, deleted at the end
+} SPB_MESSAGE;
+
 //
 // SPB (I2C) context
 //
@@ -34,17 +91,74 @@ typedef struct _SPB_CONTEXT
 {
 	WDFIOTARGET SpbIoTarget;
 	LARGE_INTEGER I2cResHubId;
-	WDFMEMORY WriteMemory;
+	WDFMEMORY MessageMemory;
+	PUCHAR MessageBuffer;
+	volatile LONG MessageSlots;	// bit per slot in use
 	WDFMEMORY ReadMemory;
 	WDFWAITLOCK SpbLock;
+	SPB_CAPTURE Capture;
+
+	SPB_BREAKER Breaker;
+	SPB_BREAKER_OPENED* BreakerOpened;
+	PVOID BreakerContext;
+	ULONG RandomSeed;
+	ULONG Retries;
+	ULONG FastFails;
+
+	volatile LONG64 Transfers;
+	volatile LONG64 BytesSent;
+	volatile LONG64 BytesRead;
+	volatile LONG64 BytesCopied;
+	volatile LONG Allocations;
+
+	PKTHREAD DeadlineThread;
+	ULONGLONG Deadline;	// interrupt time, 0 for none
+
+	WDFSPINLOCK ProfileLock;
+	GMAX_LOCK_PROFILE LockProfile;
+	GMAX_LOCK_OP Owner;	// operation that last held SpbLock
 } SPB_CONTEXT;
 
 NTSTATUS
-SpbXferDataSynchronously(
+SpbMessageBegin(
 	_In_ SPB_CONTEXT* SpbContext,
-	_In_ PVOID SendData,
-	_In_ ULONG SendLength,
-	_In_reads_bytes_(Length) PVOID Data,
+	_Out_ SPB_MESSAGE* Message,
+	_In_ ULONG Capacity
+);
+
+VOID
+SpbMessageInitMemory(
+	_Out_ SPB_MESSAGE* Message,
+	_In_ WDFMEMORY Memory,
+	_In_ ULONG Offset,
+	_In_ ULONG Length
+);
+
+VOID
+SpbMessageEnd(
+	_In_ SPB_CONTEXT* SpbContext,
+	_Inout_ SPB_MESSAGE* Message
+);
+
+VOID
+SpbMessageCopy(
+	_In_ SPB_CONTEXT* SpbContext,
+	_Inout_ SPB_MESSAGE* Message,
+	_In_reads_bytes_(Length) const VOID* Data,
+	_In_ ULONG Length
+);
+
+NTSTATUS
+SpbMessageWrite(
+	_In_ SPB_CONTEXT* SpbContext,
+	_In_ SPB_MESSAGE* Message
+);
+
+NTSTATUS
+SpbMessageXfer(
+	_In_ SPB_CONTEXT* SpbContext,
+	_In_ SPB_MESSAGE* Message,
+	_Out_writes_bytes_(Length) PVOID Data,
 	_In_ ULONG Length
 );
 
@@ -61,8 +175,79 @@ SpbTargetInitialize(
 );
 
 NTSTATUS
-SpbWriteDataSynchronously(
+SpbCaptureStart(
+	IN SPB_CONTEXT* SpbContext
+);
+
+VOID
+SpbCaptureStop(
+	IN SPB_CONTEXT* SpbContext
+);
+
+ULONG
+SpbCaptureDrain(
 	IN SPB_CONTEXT* SpbContext,
-	IN PVOID Data,
+	_Out_writes_bytes_(Length) PUCHAR Buffer,
 	IN ULONG Length
-);
\ No newline at end of file
+);
+
+ULONGLONG
+SpbSetDeadline(
+	IN SPB_CONTEXT* SpbContext,
+	IN ULONG TimeoutMs
+);
+
+VOID
+SpbRestoreDeadline(
+	IN SPB_CONTEXT* SpbContext,
+	IN ULONGLONG Previous
+);
+
+VOID
+SpbGetLockProfile(
+	IN SPB_CONTEXT* SpbContext,
+	_Out_ GMAX_LOCK_PROFILE* Profile
+);
+
+VOID
+SpbResetLockProfile(
+	IN SPB_CONTEXT* SpbContext
+);
+
+VOID
+SpbGetStats(
+	IN SPB_CONTEXT* SpbContext,
+	_Out_ GMAX_SPB_STATS* Stats
+);
+
+VOID
+SpbResetStats(
+	IN SPB_CONTEXT* SpbContext
+);
+
+//
+// Message builders, writing straight into the I/O buffer. Capacity is
+// checked by the caller when it begins the message.
+//
+
+static __inline VOID
+SpbMessageAddress(
+	_Inout_ SPB_MESSAGE* Message,
+	_In_ UINT16 Reg
+)
+{
+	PUCHAR p = Message->Buffer + Message->Range.BufferLength;
+
+	p[0] = (UCHAR)(Reg >> 8);
+	p[1] = (UCHAR)Reg;
+	Message->Range.BufferLength += 2;
+}
+
+static __inline VOID
+SpbMessageByte(
+	_Inout_ SPB_MESSAGE* Message,
+	_In_ UINT8 Value
+)
+{
+	Message->Buffer[Message->Range.BufferLength++] = Value;
+}
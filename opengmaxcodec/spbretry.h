@@ -0,0 +1,150 @@
+#pragma once
+
+//
+// SPB deadline, retry and circuit breaker policy. Pure so the host bus
+// simulator (tools/gmaxbussim) runs exactly what spb.c runs.
+//
+
+#define SPB_TRANSFER_TIMEOUT_MS 20	// per send, tightened by the deadline
+#define SPB_UNLOCK_TIMEOUT_MS 2		// controller unlock past the deadline
+#define SPB_MAX_ATTEMPTS 3
+#define SPB_BACKOFF_BASE_US 250
+#define SPB_BACKOFF_MAX_US 4000
+
+//
+// Operations failing in a row before the breaker opens, and how long it
+// stays open before letting a trial through. The cooldown doubles each
+// time a trial fails.
+//
+#define SPB_BREAKER_THRESHOLD 3
+#define SPB_BREAKER_COOLDOWN_MS 100
+#define SPB_BREAKER_MAX_COOLDOWN_MS 5000
+
+typedef enum {
+	SpbBreakerClosed,
+	SpbBreakerOpen,
+	SpbBreakerHalfOpen	// cooldown over, the next result decides
+} SPB_BREAKER_STATE;
+
+typedef struct _SPB_BREAKER
+{
+	SPB_BREAKER_STATE State;
+	uint32_t Failures;
+	uint32_t CooldownMs;
+	uint64_t OpenUntil;	// interrupt time, 100ns
+	uint32_t Trips;
+} SPB_BREAKER;
+
+//
+// Exponential backoff with equal jitter: half the step is fixed, half
+// random, so retries from both amps on a shared bus spread out.
+//
+static __inline uint32_t
+SpbBackoffUs(
+	uint32_t Attempt,
+	uint32_t Random
+)
+{
+	uint32_t step = SPB_BACKOFF_BASE_US << (Attempt < 8 ? Attempt : 8);
+
+	if (step > SPB_BACKOFF_MAX_US) {
+		step = SPB_BACKOFF_MAX_US;
+	}
+	return step / 2 + Random % (step / 2 + 1);
+}
+
+//
+// Timeout for the next send in 100ns units, 0 when the deadline (0 for
+// none) has already passed
+//
+static __inline uint64_t
+SpbSendTimeout(
+	uint64_t Now,
+	uint64_t Deadline
+)
+{
+	uint64_t timeout = SPB_TRANSFER_TIMEOUT_MS * 10000ULL;
+
+	if (Deadline == 0) {
+		return timeout;
+	}
+	if (Now >= Deadline) {
+		return 0;
+	}
+	return Deadline - Now < timeout ? Deadline - Now : timeout;
+}
+
+//
+// Timeout for releasing the controller. The unlock is sent even when
+// the deadline has passed, with at most SPB_UNLOCK_TIMEOUT_MS past it.
+//
+static __inline uint64_t
+SpbUnlockTimeout(
+	uint64_t Now,
+	uint64_t Deadline
+)
+{
+	uint64_t timeout = SpbSendTimeout(Now, Deadline);
+
+	return timeout > SPB_UNLOCK_TIMEOUT_MS * 10000ULL ? timeout : SPB_UNLOCK_TIMEOUT_MS * 10000ULL;
+}
+
+static __inline int
+SpbBreakerAllow(
+	SPB_BREAKER* Breaker,
+	uint64_t Now
+)
+{
+	if (Breaker->State != SpbBreakerOpen) {
+		return 1;
+	}
+	if (Now < Breaker->OpenUntil) {
+		return 0;
+	}
+	Breaker->State = SpbBreakerHalfOpen;
+	return 1;
+}
+
+//
+// Records the outcome of an operation that reached the bus. Returns
+// nonzero when this failure opened the breaker.
+//
+static __inline int
+SpbBreakerRecord(
+	SPB_BREAKER* Breaker,
+	int Success,
+	uint64_t Now
+)
+{
+	if (Success) {
+		Breaker->State = SpbBreakerClosed;
+		Breaker->Failures = 0;
+		Breaker->CooldownMs = 0;
+		return 0;
+	}
+
+	if (Breaker->State == SpbBreakerOpen) {
+		return 0;
+	}
+
+	Breaker->Failures++;
+	if (Breaker->State != SpbBreakerHalfOpen &&
+		Breaker->Failures < SPB_BREAKER_THRESHOLD) {
+		return 0;
+	}
+
+	if (Breaker->CooldownMs == 0) {
+		Breaker->CooldownMs = SPB_BREAKER_COOLDOWN_MS;
+	}
+	else if (Breaker->CooldownMs < SPB_BREAKER_MAX_COOLDOWN_MS) {
+		Breaker->CooldownMs *= 2;
+		if (Breaker->CooldownMs > SPB_BREAKER_MAX_COOLDOWN_MS) {
+			Breaker->CooldownMs = SPB_BREAKER_MAX_COOLDOWN_MS;
+		}
+	}
+
+	Breaker->State = SpbBreakerOpen;
+	Breaker->OpenUntil = Now + Breaker->CooldownMs * 10000ULL;
+	Breaker->Trips++;
+	return 1;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+//
+// PCM TX slot routing for the IV-sense feedback, PCM_TX_EN_A through
+// PCM_TX_CH_SRC_B. Pure so the host TDM simulator (gmaxdsp/tdm.c) can
+// check exactly what StartCodec writes.
+//
+
+#include "max98512.h"
+
+#define GMAX_TX_SLOT_MAP_FIRST MAX98512_R001A_PCM_TX_EN_A
+#define GMAX_TX_SLOT_MAP_LEN (MAX98512_R001F_PCM_TX_CH_SRC_B - MAX98512_R001A_PCM_TX_EN_A + 1)
+
+//
+// In interleave mode V and I alternate frame by frame in the VMON slot
+// and the IV ADC runs at half the PCM rate (PCM_SR_SETUP2 low nibble).
+//
+static __inline void
+GmaxBuildTxSlotMap(
+	unsigned VmonSlot,
+	unsigned ImonSlot,
+	int Interleave,
+	uint8_t Map[GMAX_TX_SLOT_MAP_LEN]
+)
+{
+	uint16_t enabled = (uint16_t)(1u << (VmonSlot & 0xF));
+
+	if (!Interleave) {
+		enabled |= (uint16_t)(1u << (ImonSlot & 0xF));
+	}
+
+	Map[MAX98512_R001A_PCM_TX_EN_A - GMAX_TX_SLOT_MAP_FIRST] = enabled & 0xFF;
+	Map[MAX98512_R001B_PCM_TX_EN_B - GMAX_TX_SLOT_MAP_FIRST] = (enabled >> 8) & 0xFF;
+
+	//
+	// Every slot this amp does not drive is left to the other amps
+	//
+	Map[MAX98512_R001C_PCM_TX_HIZ_CTRL_A - GMAX_TX_SLOT_MAP_FIRST] = ~enabled & 0xFF;
+	Map[MAX98512_R001D_PCM_TX_HIZ_CTRL_B - GMAX_TX_SLOT_MAP_FIRST] = (~enabled >> 8) & 0xFF;
+
+	Map[MAX98512_R001E_PCM_TX_CH_SRC_A - GMAX_TX_SLOT_MAP_FIRST] =
+		((ImonSlot & 0xF) << MAX98512_PCM_TX_CH_SRC_A_I_SHIFT) |
+		((VmonSlot & 0xF) << MAX98512_PCM_TX_CH_SRC_A_V_SHIFT);
+	Map[MAX98512_R001F_PCM_TX_CH_SRC_B - GMAX_TX_SLOT_MAP_FIRST] =
+		Interleave ? MAX98512_PCM_TX_CH_INTERLEAVE_MASK : 0;
+}
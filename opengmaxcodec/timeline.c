@@ -0,0 +1,263 @@
+/*++
+
+Module Name:
+
+timeline.c
+
+Abstract:
+
+Timestamps the stages of device start (DriverEntry, EvtDeviceAdd,
+PrepareHardware with the SPB open and ACPI evaluation, D0Entry and
+SelfManagedIoInit) and of later power transitions into a per-device buffer
+read with IOCTL_GMAX_GET_TIMELINE. Register transfers made inside a
+stage are recorded as nested records, so a trace viewer shows which
+part of a callback went to the bus.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+//
+// DriverEntry runs before there is a device to record it in
+//
+static ULONGLONG GmaxDriverEntryStart;
+static ULONGLONG GmaxDriverEntryEnd;
+static NTSTATUS GmaxDriverEntryStatus;
+
+static VOID
+GmaxTimelineAppend(
+	_In_ GMAX_TIMELINE* Timeline,
+	_In_ GMAX_STAGE Stage,
+	_In_ ULONG Depth,
+	_In_ ULONGLONG Start,
+	_In_ ULONGLONG End,
+	_In_ NTSTATUS Status,
+	_In_ UINT16 Data
+)
+/*++
+
+Routine Description:
+
+Adds a record with the timeline lock held.
+
+--*/
+{
+	GMAX_TIMELINE_RECORD* record;
+	ULONG ringSize = GMAX_TIMELINE_DEPTH - Timeline->BootCount;
+
+	if (!Timeline->BootDone) {
+		if (Timeline->Count == GMAX_TIMELINE_BOOT_DEPTH) {
+			Timeline->Dropped++;
+			return;
+		}
+		record = &Timeline->Records[Timeline->Count++];
+	}
+	else if (Timeline->Count - Timeline->BootCount < ringSize) {
+		record = &Timeline->Records[Timeline->BootCount +
+			(Timeline->Head + Timeline->Count - Timeline->BootCount) % ringSize];
+		Timeline->Count++;
+	}
+	else {
+		record = &Timeline->Records[Timeline->BootCount + Timeline->Head];
+		Timeline->Head = (Timeline->Head + 1) % ringSize;
+		Timeline->Dropped++;
+	}
+
+	record->Start = Start;
+	record->Duration = (UINT32)min((End - Start) / 10, MAXUINT32);
+	record->Status = Status;
+	record->Stage = (UINT8)Stage;
+	record->Depth = (UINT8)Depth;
+	record->Data = Data;
+	record->Reserved = 0;
+}
+
+VOID
+GmaxTimelineDriverEntry(
+	_In_ ULONGLONG Start,
+	_In_ NTSTATUS Status
+)
+{
+	GmaxDriverEntryStart = Start;
+	GmaxDriverEntryEnd = KeQueryInterruptTimePrecise(NULL);
+	GmaxDriverEntryStatus = Status;
+}
+
+NTSTATUS
+GmaxTimelineInitialize(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ ULONGLONG DeviceAddStart
+)
+{
+	GMAX_TIMELINE* timeline = &pDevice->Timeline;
+	WDF_OBJECT_ATTRIBUTES attributes;
+	NTSTATUS status;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+
+	status = WdfSpinLockCreate(&attributes, &timeline->Lock);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	GmaxTimelineAppend(timeline, GmaxStageDriverEntry, 0,
+		GmaxDriverEntryStart, GmaxDriverEntryEnd, GmaxDriverEntryStatus, 0);
+
+	timeline->Open[0].Start = DeviceAddStart;
+	timeline->Open[0].Thread = KeGetCurrentThread();
+	timeline->Open[0].Stage = GmaxStageDeviceAdd;
+	timeline->Depth = 1;
+	return STATUS_SUCCESS;
+}
+
+VOID
+GmaxTimelineBegin(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ GMAX_STAGE Stage
+)
+{
+	GMAX_TIMELINE* timeline = &pDevice->Timeline;
+	ULONGLONG now = KeQueryInterruptTimePrecise(NULL);
+
+	WdfSpinLockAcquire(timeline->Lock);
+	if (timeline->Depth < GMAX_TIMELINE_NESTING) {
+		timeline->Open[timeline->Depth].Start = now;
+		timeline->Open[timeline->Depth].Thread = KeGetCurrentThread();
+		timeline->Open[timeline->Depth].Stage = Stage;
+	}
+	timeline->Depth++;
+	WdfSpinLockRelease(timeline->Lock);
+}
+
+VOID
+GmaxTimelineEnd(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ NTSTATUS Status
+)
+/*++
+
+Routine Description:
+
+Records the innermost open stage. SelfManagedIoInit runs once, after
+the first D0Entry, and ends the boot part of the timeline.
+
+--*/
+{
+	GMAX_TIMELINE* timeline = &pDevice->Timeline;
+	ULONGLONG now = KeQueryInterruptTimePrecise(NULL);
+	GMAX_TIMELINE_FRAME* frame;
+	ULONG depth;
+
+	WdfSpinLockAcquire(timeline->Lock);
+	if (timeline->Depth == 0) {
+		WdfSpinLockRelease(timeline->Lock);
+		return;
+	}
+
+	depth = --timeline->Depth;
+	if (depth < GMAX_TIMELINE_NESTING) {
+		frame = &timeline->Open[depth];
+		GmaxTimelineAppend(timeline, frame->Stage, depth, frame->Start, now, Status, 0);
+
+		if (frame->Stage == GmaxStageSelfManagedIoInit && depth == 0 && !timeline->BootDone) {
+			timeline->BootDone = TRUE;
+			timeline->BootCount = timeline->Count;
+		}
+	}
+	WdfSpinLockRelease(timeline->Lock);
+}
+
+VOID
+GmaxTimelineBus(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ GMAX_STAGE Stage,
+	_In_ UINT16 Reg,
+	_In_ ULONGLONG Start,
+	_In_ NTSTATUS Status
+)
+/*++
+
+Routine Description:
+
+Records a register transfer made inside an open stage. Transfers from
+other threads, such as a timer running while PnP holds a stage open,
+are not part of the stage and are left out.
+
+--*/
+{
+	GMAX_TIMELINE* timeline = &pDevice->Timeline;
+	ULONGLONG now;
+
+	if (timeline->Depth == 0) {
+		return;
+	}
+
+	now = KeQueryInterruptTimePrecise(NULL);
+
+	WdfSpinLockAcquire(timeline->Lock);
+	if (timeline->Depth != 0 && timeline->Open[0].Thread == KeGetCurrentThread()) {
+		GmaxTimelineAppend(timeline, Stage, min(timeline->Depth, GMAX_TIMELINE_NESTING),
+			Start, now, Status, Reg);
+	}
+	WdfSpinLockRelease(timeline->Lock);
+}
+
+ULONG
+GmaxTimelineCopy(
+	_In_ PGMAX_CONTEXT pDevice,
+	_Out_writes_bytes_(Length) PUCHAR Buffer,
+	_In_ ULONG Length
+)
+{
+	GMAX_TIMELINE* timeline = &pDevice->Timeline;
+	GMAX_TIMELINE_HEADER* header = (GMAX_TIMELINE_HEADER*)Buffer;
+	GMAX_TIMELINE_RECORD* records = (GMAX_TIMELINE_RECORD*)(header + 1);
+	ULONG capacity;
+	ULONG ringCount;
+	ULONG ringSize;
+	ULONG copied = 0;
+
+	if (Length < sizeof(GMAX_TIMELINE_HEADER)) {
+		return 0;
+	}
+	capacity = (Length - sizeof(GMAX_TIMELINE_HEADER)) / sizeof(GMAX_TIMELINE_RECORD);
+
+	WdfSpinLockAcquire(timeline->Lock);
+
+	if (!timeline->BootDone) {
+		for (; copied < timeline->Count && copied < capacity; copied++) {
+			records[copied] = timeline->Records[copied];
+		}
+		header->BootRecords = copied;
+	}
+	else {
+		ringSize = GMAX_TIMELINE_DEPTH - timeline->BootCount;
+		ringCount = timeline->Count - timeline->BootCount;
+
+		for (; copied < timeline->BootCount && copied < capacity; copied++) {
+			records[copied] = timeline->Records[copied];
+		}
+		header->BootRecords = copied;
+
+		for (ULONG i = 0; i < ringCount && copied < capacity; i++) {
+			records[copied++] = timeline->Records[timeline->BootCount + (timeline->Head + i) % ringSize];
+		}
+	}
+
+	header->Version = GMAX_TIMELINE_VERSION;
+	header->Records = copied;
+	header->Dropped = timeline->Dropped;
+	header->StartTime = GmaxDriverEntryStart;
+
+	WdfSpinLockRelease(timeline->Lock);
+
+	return sizeof(GMAX_TIMELINE_HEADER) + copied * sizeof(GMAX_TIMELINE_RECORD);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+//
+// Stage timeline of device start and power transitions
+//
+// Records up to the end of SelfManagedIoInit stay for the life of the
+// device (up to GMAX_TIMELINE_BOOT_DEPTH); later ones share the rest of
+// the buffer as a ring.
+//
+
+#define GMAX_TIMELINE_DEPTH 256
+#define GMAX_TIMELINE_BOOT_DEPTH 128
+#define GMAX_TIMELINE_NESTING 4
+
+typedef struct _GMAX_TIMELINE_FRAME
+{
+	ULONGLONG Start;
+	PKTHREAD Thread;
+	GMAX_STAGE Stage;
+} GMAX_TIMELINE_FRAME;
+
+typedef struct _GMAX_TIMELINE
+{
+	WDFSPINLOCK Lock;
+
+	GMAX_TIMELINE_RECORD Records[GMAX_TIMELINE_DEPTH];
+	ULONG Count;
+	ULONG BootCount;	// set when boot ends
+	ULONG Head;		// oldest ring record, relative to BootCount
+	ULONG Dropped;
+	BOOLEAN BootDone;
+
+	//
+	// Stages begun and not yet ended. Bus transfers are recorded while
+	// one is open, from the thread that opened it.
+	//
+	GMAX_TIMELINE_FRAME Open[GMAX_TIMELINE_NESTING];
+	volatile ULONG Depth;
+} GMAX_TIMELINE;
+
+struct _GMAX_CONTEXT;
+
+//
+// Called at the end of DriverEntry, before any device exists
+//
+VOID
+GmaxTimelineDriverEntry(
+	_In_ ULONGLONG Start,
+	_In_ NTSTATUS Status
+);
+
+//
+// Records DriverEntry and opens GmaxStageDeviceAdd from DeviceAddStart
+//
+NTSTATUS
+GmaxTimelineInitialize(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ ULONGLONG DeviceAddStart
+);
+
+VOID
+GmaxTimelineBegin(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ GMAX_STAGE Stage
+);
+
+VOID
+GmaxTimelineEnd(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ NTSTATUS Status
+);
+
+VOID
+GmaxTimelineBus(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ GMAX_STAGE Stage,
+	_In_ UINT16 Reg,
+	_In_ ULONGLONG Start,
+	_In_ NTSTATUS Status
+);
+
+//
+// Header and records, oldest first. Returns the bytes written, 0 when
+// Length cannot hold the header.
+//
+ULONG
+GmaxTimelineCopy(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_Out_writes_bytes_(Length) PUCHAR Buffer,
+	_In_ ULONG Length
+);
@@ -0,0 +1,422 @@
+/*++
+
+Module Name:
+
+tuning.c
+
+Abstract:
+
+Binary tuning file (tuningfile.h, built by tools/gmaxtune). The file is
+read once in OnPrepareHardware, from the GmaxTuning registry value or
+the file GmaxTuningFile names, validated, and the selected profile is
+applied for this amp's _UID on top of the init image from the boot
+cache. The result is compiled into bursts of consecutive registers
+that StartCodec writes on every start and resume without parsing the
+file again. The bursts are laid out once, address first, in a buffer
+the SPB target is handed directly, so a start copies nothing.
+
+Registers the driver manages at runtime (volume, BDE) are still
+written after the image and override a profile. A profile may not
+write outside the chip's register map, nor the registers the driver
+sequences itself: soft reset, the power enables and the interrupt
+enables. A file that does not
+validate, or lacks the profile, is ignored and the init image is
+written unchanged.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+#include "max98512.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+static VOID
+GmaxTuningSeed(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	GMAX_TUNING_IMAGE* image = &pDevice->Tuning.Image;
+
+	image->Count = 0;
+	for (ULONG i = 0; i < pDevice->Config.RegCount; i++) {
+		image->Reg[i] = pDevice->Config.Image[i].Reg;
+		image->Value[i] = pDevice->Config.Image[i].Value;
+		image->Count++;
+	}
+	GmaxTuningCompile(image);
+
+	pDevice->Tuning.Source = GmaxTuningSourceNone;
+	pDevice->Tuning.Profile[0] = '\0';
+}
+
+static VOID
+GmaxTuningGetLimits(
+	_In_ PGMAX_CONTEXT pDevice,
+	_Out_ GMAX_TUNING_LIMITS* Limits
+)
+/*++
+
+Routine Description:
+
+What a profile may write on this chip: its register map, less soft
+reset, GLOBAL_EN and AMP_EN, and on chips with interrupts INT_EN1..3
+and IRQ_CTRL, which GmaxEnableInterrupts and the ISR own.
+
+--*/
+{
+	const GMAX_CHIP_OPS* chip = pDevice->Chip;
+
+	RtlZeroMemory(Limits, sizeof(*Limits));
+
+	Limits->RangeCount = min(chip->RegMap.Count, GMAX_TUNING_MAX_RANGES);
+	for (ULONG i = 0; i < Limits->RangeCount; i++) {
+		Limits->Ranges[i].Base = chip->RegMap.Ranges[i].Base;
+		Limits->Ranges[i].Count = chip->RegMap.Ranges[i].Count;
+	}
+
+	GmaxTuningReserve(Limits, chip->Regs.SoftReset, 1);
+	GmaxTuningReserve(Limits, chip->Regs.GlobalEnable, 1);
+	GmaxTuningReserve(Limits, chip->Regs.AmpEnable, 1);
+	if (GmaxChipHas(pDevice, GMAX_CHIP_INTERRUPTS)) {
+		GmaxTuningReserve(Limits, MAX98512_R000A_INT_EN1, GMAX_INT_REG_COUNT);
+		GmaxTuningReserve(Limits, MAX98512_R0010_IRQ_CTRL, 1);
+	}
+}
+
+static NTSTATUS
+GmaxTuningQuery(
+	_In_ WDFKEY Key,
+	_In_ PCWSTR Name,
+	_In_ ULONG Type,
+	_Out_writes_bytes_(Size) PVOID Buffer,
+	_In_ ULONG Size,
+	_Out_ ULONG* Length
+)
+{
+	UNICODE_STRING valueName;
+	ULONG type = 0;
+	NTSTATUS status;
+
+	RtlInitUnicodeString(&valueName, Name);
+	RtlZeroMemory(Buffer, Size);
+	*Length = 0;
+
+	//
+	// Strings keep room for a terminator
+	//
+	status = WdfRegistryQueryValue(Key, &valueName,
+		Type == REG_SZ ? Size - sizeof(WCHAR) : Size,
+		Buffer, Length, &type);
+	if (NT_SUCCESS(status) && type != Type) {
+		status = STATUS_OBJECT_TYPE_MISMATCH;
+	}
+	return status;
+}
+
+static NTSTATUS
+GmaxTuningReadFile(
+	_In_ PCWSTR Path,
+	_Out_writes_bytes_(Size) PUCHAR Buffer,
+	_In_ ULONG Size,
+	_Out_ ULONG* Length
+)
+{
+	WCHAR ntPath[GMAX_TUNING_MAX_PATH + 4];
+	FILE_STANDARD_INFORMATION info;
+	OBJECT_ATTRIBUTES attributes;
+	IO_STATUS_BLOCK ioStatus;
+	UNICODE_STRING name;
+	HANDLE file;
+	NTSTATUS status;
+
+	*Length = 0;
+
+	//
+	// The INF writes a DOS path (%13%\...)
+	//
+	status = RtlStringCchPrintfW(ntPath, ARRAYSIZE(ntPath),
+		Path[0] && Path[1] == L':' ? L"\\??\\%ws" : L"%ws", Path);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	RtlInitUnicodeString(&name, ntPath);
+	InitializeObjectAttributes(&attributes, &name,
+		OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE, NULL, NULL);
+
+	status = ZwOpenFile(&file, GENERIC_READ | SYNCHRONIZE, &attributes, &ioStatus,
+		FILE_SHARE_READ, FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	status = ZwQueryInformationFile(file, &ioStatus, &info, sizeof(info), FileStandardInformation);
+	if (NT_SUCCESS(status) && info.EndOfFile.QuadPart > Size) {
+		status = STATUS_FILE_TOO_LARGE;
+	}
+
+	if (NT_SUCCESS(status)) {
+		status = ZwReadFile(file, NULL, NULL, NULL, &ioStatus, Buffer,
+			(ULONG)info.EndOfFile.QuadPart, NULL, NULL);
+		if (NT_SUCCESS(status)) {
+			*Length = (ULONG)ioStatus.Information;
+		}
+	}
+
+	ZwClose(file);
+	return status;
+}
+
+static NTSTATUS
+GmaxTuningStatus(
+	_In_ GMAX_TUNING_RESULT Result
+)
+{
+	switch (Result) {
+	case GmaxTuningOk:
+		return STATUS_SUCCESS;
+	case GmaxTuningBadVersion:
+		return STATUS_REVISION_MISMATCH;
+	case GmaxTuningNoProfile:
+		return STATUS_NOT_FOUND;
+	case GmaxTuningTooManyRegs:
+		return STATUS_BUFFER_OVERFLOW;
+	default:
+		return STATUS_DATA_ERROR;
+	}
+}
+
+static NTSTATUS
+GmaxTuningLoadFile(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	GMAX_TUNING* tuning = &pDevice->Tuning;
+	WCHAR text[GMAX_TUNING_MAX_PATH + 1];
+	GMAX_TUNING_LIMITS limits;
+	GMAX_TUNING_RESULT result;
+	PUCHAR buffer;
+	ULONG length = 0;
+	ULONG profile;
+	UINT8 uid;
+	WDFKEY key;
+	NTSTATUS status;
+
+	GmaxTuningSeed(pDevice);
+
+	status = WdfDeviceOpenRegistryKey(pDevice->FxDevice,
+		PLUGPLAY_REGKEY_DEVICE,
+		KEY_READ,
+		WDF_NO_OBJECT_ATTRIBUTES,
+		&key);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	buffer = ExAllocatePoolWithTag(PagedPool, GMAX_TUNING_MAX_SIZE, GMAX_POOL_TAG);
+	if (!buffer) {
+		WdfRegistryClose(key);
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	status = GmaxTuningQuery(key, GMAX_TUNING_VALUE, REG_BINARY, buffer, GMAX_TUNING_MAX_SIZE, &length);
+	if (NT_SUCCESS(status)) {
+		tuning->Source = GmaxTuningSourceRegistry;
+	}
+	else if (NT_SUCCESS(GmaxTuningQuery(key, GMAX_TUNING_FILE_VALUE, REG_SZ, text, sizeof(text), &length))) {
+		status = GmaxTuningReadFile(text, buffer, GMAX_TUNING_MAX_SIZE, &length);
+		if (!NT_SUCCESS(status)) {
+			GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+				"Unable to read tuning file %ws 0x%x\n", text, status);
+			goto exit;
+		}
+		tuning->Source = GmaxTuningSourceFile;
+	}
+	else {
+		status = STATUS_SUCCESS;
+		goto exit;
+	}
+
+	//
+	// Profile names are ASCII
+	//
+	RtlStringCchCopyA(tuning->Profile, sizeof(tuning->Profile), GMAX_TUNING_DEFAULT_PROFILE);
+	if (NT_SUCCESS(GmaxTuningQuery(key, GMAX_TUNING_PROFILE_VALUE, REG_SZ, text, sizeof(text), &profile))) {
+		ULONG i;
+
+		for (i = 0; text[i] && i < GMAX_TUNING_MAX_NAME && text[i] < 0x80; i++) {
+			tuning->Profile[i] = (CHAR)text[i];
+		}
+		if (i > 0 && !text[i]) {
+			tuning->Profile[i] = '\0';
+		}
+		else {
+			RtlStringCchCopyA(tuning->Profile, sizeof(tuning->Profile), GMAX_TUNING_DEFAULT_PROFILE);
+		}
+	}
+
+	result = GmaxTuningValidate(buffer, length);
+	if (result == GmaxTuningOk) {
+		profile = GmaxTuningFindProfile(buffer, tuning->Profile);
+		if (!profile) {
+			result = GmaxTuningNoProfile;
+		}
+	}
+
+	if (result == GmaxTuningOk) {
+		uid = pDevice->UID >= 0 && pDevice->UID < GMAX_TUNING_UID_ANY ?
+			(UINT8)pDevice->UID : GMAX_TUNING_UID_ANY;
+		GmaxTuningGetLimits(pDevice, &limits);
+		result = GmaxTuningApplyProfile(buffer, profile, uid, &limits, &tuning->Image);
+	}
+
+	status = GmaxTuningStatus(result);
+	if (!NT_SUCCESS(status)) {
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Tuning profile %s rejected (%d), writing the init image\n", tuning->Profile, result);
+		GmaxTuningSeed(pDevice);
+		goto exit;
+	}
+
+	GmaxTuningCompile(&tuning->Image);
+
+	GmaxPrint(DEBUG_LEVEL_INFO, DBG_PNP,
+		"Tuning profile %s: %d registers in %d bursts\n",
+		tuning->Profile, tuning->Image.Count, tuning->Image.Bursts);
+
+exit:
+	ExFreePoolWithTag(buffer, GMAX_POOL_TAG);
+	WdfRegistryClose(key);
+	return status;
+}
+
+static NTSTATUS
+GmaxTuningBuildWire(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Lays the bursts out as they go on the bus, each register address
+followed by its values. Burst b starts at BurstStart[b] + 2 * b.
+
+--*/
+{
+	GMAX_TUNING* tuning = &pDevice->Tuning;
+	const GMAX_TUNING_IMAGE* image = &tuning->Image;
+	WDF_OBJECT_ATTRIBUTES attributes;
+	PUCHAR wire;
+	NTSTATUS status;
+
+	if (tuning->Wire) {
+		WdfObjectDelete(tuning->Wire);
+		tuning->Wire = NULL;
+	}
+
+	if (image->Count == 0) {
+		return STATUS_SUCCESS;
+	}
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+
+	status = WdfMemoryCreate(&attributes,
+		NonPagedPool,
+		GMAX_POOL_TAG,
+		image->Count + 2 * image->Bursts,
+		&tuning->Wire,
+		(PVOID*)&wire);
+	if (!NT_SUCCESS(status)) {
+		tuning->Wire = NULL;
+		return status;
+	}
+
+	for (ULONG b = 0; b < image->Bursts; b++) {
+		ULONG start = image->BurstStart[b];
+		PUCHAR p = wire + start + 2 * b;
+
+		p[0] = (UCHAR)(image->Reg[start] >> 8);
+		p[1] = (UCHAR)image->Reg[start];
+		RtlCopyMemory(p + 2, &image->Value[start], image->BurstLength[b]);
+	}
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS
+GmaxTuningLoad(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Builds the image StartCodec writes, from pDevice->Config and the
+tuning file if one is configured. Call once the configuration is
+resolved.
+
+Return Value:
+
+STATUS_SUCCESS with no tuning configured. On any other failure the
+image is the init image alone and the start can go ahead.
+
+--*/
+{
+	GMAX_TUNING_IMAGE* image = &pDevice->Tuning.Image;
+	NTSTATUS status = GmaxTuningLoadFile(pDevice);
+	NTSTATUS wireStatus;
+
+	//
+	// The slot size follows whatever PCM_MODE_CFG will be written, from
+	// the chip's init table or a profile
+	//
+	for (ULONG i = 0; i < image->Count; i++) {
+		if (image->Reg[i] == pDevice->Chip->Regs.PcmModeCfg) {
+			GmaxFormatSetSlot(pDevice, image->Value[i]);
+		}
+	}
+
+	//
+	// Without the wire image the bursts are staged per write
+	//
+	wireStatus = GmaxTuningBuildWire(pDevice);
+	if (!NT_SUCCESS(wireStatus)) {
+		GmaxPrint(DEBUG_LEVEL_ERROR, DBG_PNP,
+			"Unable to lay out tuning bursts 0x%x\n", wireStatus);
+	}
+
+	return status;
+}
+
+NTSTATUS
+GmaxTuningWrite(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	const GMAX_TUNING* tuning = &pDevice->Tuning;
+	const GMAX_TUNING_IMAGE* image = &tuning->Image;
+
+	for (ULONG b = 0; b < image->Bursts; b++) {
+		ULONG start = image->BurstStart[b];
+		ULONG length = image->BurstLength[b];
+		SPB_MESSAGE message;
+		NTSTATUS status;
+
+		if (tuning->Wire) {
+			SpbMessageInitMemory(&message, tuning->Wire, start + 2 * b, length + 2);
+			status = gmax_reg_message_write(pDevice, &message);
+		}
+		else {
+			status = gmax_reg_bulk_write(pDevice, image->Reg[start], &image->Value[start], length);
+		}
+		if (!NT_SUCCESS(status)) {
+			return status;
+		}
+	}
+	return STATUS_SUCCESS;
+}
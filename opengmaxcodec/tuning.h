@@ -0,0 +1,45 @@
+#pragma once
+
+//
+// Tuning file loaded once at start and compiled into burst writes
+//
+
+#include "tuningfile.h"
+
+//
+// Values under the device's hardware key. GmaxTuning holds the file
+// itself (REG_BINARY); otherwise GmaxTuningFile names it (REG_SZ), e.g.
+// a file the INF copies into the driver store. GmaxTuningProfile picks
+// the profile, "default" when absent.
+//
+#define GMAX_TUNING_VALUE L"GmaxTuning"
+#define GMAX_TUNING_FILE_VALUE L"GmaxTuningFile"
+#define GMAX_TUNING_PROFILE_VALUE L"GmaxTuningProfile"
+#define GMAX_TUNING_DEFAULT_PROFILE "default"
+#define GMAX_TUNING_MAX_PATH 260
+
+typedef enum {
+	GmaxTuningSourceNone,		// init image only
+	GmaxTuningSourceRegistry,
+	GmaxTuningSourceFile
+} GMAX_TUNING_SOURCE;
+
+typedef struct _GMAX_TUNING
+{
+	GMAX_TUNING_IMAGE Image;	// what StartCodec writes
+	WDFMEMORY Wire;			// Image's bursts as sent, see GmaxTuningBuildWire
+	GMAX_TUNING_SOURCE Source;
+	CHAR Profile[GMAX_TUNING_MAX_NAME + 1];
+} GMAX_TUNING;
+
+struct _GMAX_CONTEXT;
+
+NTSTATUS
+GmaxTuningLoad(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+NTSTATUS
+GmaxTuningWrite(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
@@ -0,0 +1,404 @@
+#pragma once
+
+//
+// Binary tuning file: named profiles of register runs, each run a full
+// value or a value under a mask, optionally limited to one _UID. Pure
+// so the host compiler (tools/gmaxtune) builds and checks exactly what
+// the driver loads.
+//
+// Little-endian layout:
+//
+//   header   u32 magic, u16 version, u16 profiles, u32 size, u32 crc32
+//            of everything after the header
+//   profile  u8 name length, name, u16 runs
+//   run      u16 first register, u8 length, u8 uid (0xFF for all),
+//            u8 flags, values[length], masks[length] if masked
+//
+// A profile is applied on top of the driver's init image: later runs
+// win, a masked run keeps the image's bits outside the mask. The result
+// is compiled once into bursts of consecutive registers.
+//
+
+#define GMAX_TUNING_MAGIC 0x4E544D47	// "GMTN"
+#define GMAX_TUNING_VERSION 1
+#define GMAX_TUNING_HEADER 16
+#define GMAX_TUNING_MAX_SIZE (16 * 1024)
+#define GMAX_TUNING_MAX_NAME 31
+#define GMAX_TUNING_MAX_RUN 62		// DEFAULT_SPB_BUFFER_SIZE less the address
+#define GMAX_TUNING_MAX_REGS 256	// in a compiled image
+#define GMAX_TUNING_UID_ANY 0xFF
+#define GMAX_TUNING_RUN_MASKED 0x01
+
+typedef enum {
+	GmaxTuningOk,
+	GmaxTuningTruncated,
+	GmaxTuningBadMagic,
+	GmaxTuningBadVersion,
+	GmaxTuningBadChecksum,
+	GmaxTuningBadRun,		// zero length, too long or past 0xFFFF
+	GmaxTuningBadName,
+	GmaxTuningNoProfile,
+	GmaxTuningUnknownBase,		// masked run on a register outside the init image
+	GmaxTuningTooManyRegs,
+	GmaxTuningOutsideMap,		// run on a register the chip does not decode
+	GmaxTuningReserved		// run on a register the driver sequences itself
+} GMAX_TUNING_RESULT;
+
+#define GMAX_TUNING_MAX_RANGES 4
+#define GMAX_TUNING_MAX_RESERVED 8
+
+typedef struct _GMAX_TUNING_RANGE
+{
+	uint16_t Base;
+	uint16_t Count;
+} GMAX_TUNING_RANGE;
+
+//
+// Registers a profile may write: those in the chip's register map, less
+// the ones the driver sequences itself (soft reset, the enables of the
+// power sequence, the interrupt enables). A profile writing those would
+// fight StartCodec, the power sequencer or the ISR.
+//
+typedef struct _GMAX_TUNING_LIMITS
+{
+	uint32_t RangeCount;
+	GMAX_TUNING_RANGE Ranges[GMAX_TUNING_MAX_RANGES];
+	uint32_t ReservedCount;
+	GMAX_TUNING_RANGE Reserved[GMAX_TUNING_MAX_RESERVED];
+} GMAX_TUNING_LIMITS;
+
+//
+// Register values in ascending order, then the bursts that write them
+//
+typedef struct _GMAX_TUNING_IMAGE
+{
+	uint16_t Count;
+	uint16_t Bursts;
+	uint16_t Reg[GMAX_TUNING_MAX_REGS];
+	uint8_t Value[GMAX_TUNING_MAX_REGS];
+	uint16_t BurstStart[GMAX_TUNING_MAX_REGS];	// index into Reg/Value
+	uint8_t BurstLength[GMAX_TUNING_MAX_REGS];
+} GMAX_TUNING_IMAGE;
+
+static __inline uint32_t
+GmaxTuningCrc32(
+	const uint8_t* Data,
+	uint32_t Length
+)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	for (uint32_t i = 0; i < Length; i++) {
+		crc ^= Data[i];
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+		}
+	}
+	return ~crc;
+}
+
+static __inline uint32_t
+GmaxTuningGet16(
+	const uint8_t* Data
+)
+{
+	return (uint32_t)Data[0] | ((uint32_t)Data[1] << 8);
+}
+
+static __inline uint32_t
+GmaxTuningGet32(
+	const uint8_t* Data
+)
+{
+	return GmaxTuningGet16(Data) | (GmaxTuningGet16(Data + 2) << 16);
+}
+
+//
+// Checks the header and walks every profile and run. Everything after
+// this may read the buffer without bounds checks.
+//
+static __inline GMAX_TUNING_RESULT
+GmaxTuningValidate(
+	const uint8_t* Data,
+	uint32_t Length
+)
+{
+	uint32_t offset = GMAX_TUNING_HEADER;
+	uint32_t profiles;
+
+	if (Length < GMAX_TUNING_HEADER) {
+		return GmaxTuningTruncated;
+	}
+	if (GmaxTuningGet32(Data) != GMAX_TUNING_MAGIC) {
+		return GmaxTuningBadMagic;
+	}
+	if (GmaxTuningGet16(Data + 4) != GMAX_TUNING_VERSION) {
+		return GmaxTuningBadVersion;
+	}
+	if (GmaxTuningGet32(Data + 8) != Length || Length > GMAX_TUNING_MAX_SIZE) {
+		return GmaxTuningTruncated;
+	}
+	if (GmaxTuningGet32(Data + 12) != GmaxTuningCrc32(Data + GMAX_TUNING_HEADER, Length - GMAX_TUNING_HEADER)) {
+		return GmaxTuningBadChecksum;
+	}
+
+	profiles = GmaxTuningGet16(Data + 6);
+	for (uint32_t p = 0; p < profiles; p++) {
+		uint32_t nameLength;
+		uint32_t runs;
+
+		if (offset + 1 > Length) {
+			return GmaxTuningTruncated;
+		}
+		nameLength = Data[offset];
+		if (nameLength == 0 || nameLength > GMAX_TUNING_MAX_NAME) {
+			return GmaxTuningBadName;
+		}
+		if (offset + 1 + nameLength + 2 > Length) {
+			return GmaxTuningTruncated;
+		}
+		runs = GmaxTuningGet16(Data + offset + 1 + nameLength);
+		offset += 1 + nameLength + 2;
+
+		for (uint32_t r = 0; r < runs; r++) {
+			uint32_t reg, runLength, bytes;
+
+			if (offset + 5 > Length) {
+				return GmaxTuningTruncated;
+			}
+			reg = GmaxTuningGet16(Data + offset);
+			runLength = Data[offset + 2];
+			if (runLength == 0 || runLength > GMAX_TUNING_MAX_RUN || reg + runLength > 0x10000) {
+				return GmaxTuningBadRun;
+			}
+			bytes = runLength * ((Data[offset + 4] & GMAX_TUNING_RUN_MASKED) ? 2 : 1);
+			if (offset + 5 + bytes > Length) {
+				return GmaxTuningTruncated;
+			}
+			offset += 5 + bytes;
+		}
+	}
+
+	return offset == Length ? GmaxTuningOk : GmaxTuningTruncated;
+}
+
+//
+// Offset of the named profile in a validated file, 0 if absent
+//
+static __inline uint32_t
+GmaxTuningFindProfile(
+	const uint8_t* Data,
+	const char* Name
+)
+{
+	uint32_t profiles = GmaxTuningGet16(Data + 6);
+	uint32_t offset = GMAX_TUNING_HEADER;
+
+	for (uint32_t p = 0; p < profiles; p++) {
+		uint32_t nameLength = Data[offset];
+		uint32_t runs = GmaxTuningGet16(Data + offset + 1 + nameLength);
+		uint32_t i = 0;
+
+		while (i < nameLength && Name[i] == (char)Data[offset + 1 + i]) {
+			i++;
+		}
+		if (i == nameLength && Name[i] == '\0') {
+			return offset;
+		}
+
+		offset += 1 + nameLength + 2;
+		for (uint32_t r = 0; r < runs; r++) {
+			offset += 5 + Data[offset + 2] * ((Data[offset + 4] & GMAX_TUNING_RUN_MASKED) ? 2 : 1);
+		}
+	}
+	return 0;
+}
+
+static __inline int
+GmaxTuningFind(
+	const GMAX_TUNING_IMAGE* Image,
+	uint16_t Reg,
+	uint32_t* Index
+)
+{
+	uint32_t i = 0;
+
+	while (i < Image->Count && Image->Reg[i] < Reg) {
+		i++;
+	}
+	*Index = i;
+	return i < Image->Count && Image->Reg[i] == Reg;
+}
+
+//
+// Sets one register, keeping the image sorted
+//
+static __inline GMAX_TUNING_RESULT
+GmaxTuningSet(
+	GMAX_TUNING_IMAGE* Image,
+	uint16_t Reg,
+	uint8_t Value,
+	uint8_t Mask
+)
+{
+	uint32_t i;
+
+	if (GmaxTuningFind(Image, Reg, &i)) {
+		Image->Value[i] = (uint8_t)((Image->Value[i] & ~Mask) | (Value & Mask));
+		return GmaxTuningOk;
+	}
+
+	if (Mask != 0xFF) {
+		return GmaxTuningUnknownBase;
+	}
+	if (Image->Count >= GMAX_TUNING_MAX_REGS) {
+		return GmaxTuningTooManyRegs;
+	}
+
+	for (uint32_t j = Image->Count; j > i; j--) {
+		Image->Reg[j] = Image->Reg[j - 1];
+		Image->Value[j] = Image->Value[j - 1];
+	}
+	Image->Reg[i] = Reg;
+	Image->Value[i] = Value;
+	Image->Count++;
+	return GmaxTuningOk;
+}
+
+static __inline void
+GmaxTuningReserve(
+	GMAX_TUNING_LIMITS* Limits,
+	uint16_t Base,
+	uint16_t Count
+)
+{
+	if (Limits->ReservedCount < GMAX_TUNING_MAX_RESERVED) {
+		Limits->Reserved[Limits->ReservedCount].Base = Base;
+		Limits->Reserved[Limits->ReservedCount].Count = Count;
+		Limits->ReservedCount++;
+	}
+}
+
+static __inline int
+GmaxTuningInRanges(
+	const GMAX_TUNING_RANGE* Ranges,
+	uint32_t Count,
+	uint32_t Reg,
+	uint32_t Length
+)
+{
+	for (uint32_t i = 0; i < Count; i++) {
+		if (Reg >= Ranges[i].Base && Reg + Length <= (uint32_t)Ranges[i].Base + Ranges[i].Count) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static __inline int
+GmaxTuningOverlaps(
+	const GMAX_TUNING_RANGE* Ranges,
+	uint32_t Count,
+	uint32_t Reg,
+	uint32_t Length
+)
+{
+	for (uint32_t i = 0; i < Count; i++) {
+		if (Reg < (uint32_t)Ranges[i].Base + Ranges[i].Count && Ranges[i].Base < Reg + Length) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//
+// Whether a run of Length registers from Reg may be written. A run must
+// lie inside one range of the map, a burst does not cross a gap in it.
+//
+static __inline GMAX_TUNING_RESULT
+GmaxTuningCheckRun(
+	const GMAX_TUNING_LIMITS* Limits,
+	uint32_t Reg,
+	uint32_t Length
+)
+{
+	if (!GmaxTuningInRanges(Limits->Ranges, Limits->RangeCount, Reg, Length)) {
+		return GmaxTuningOutsideMap;
+	}
+	if (GmaxTuningOverlaps(Limits->Reserved, Limits->ReservedCount, Reg, Length)) {
+		return GmaxTuningReserved;
+	}
+	return GmaxTuningOk;
+}
+
+//
+// Applies a profile of a validated file for one _UID. Every run of the
+// profile is checked against Limits, those for other amps too.
+//
+static __inline GMAX_TUNING_RESULT
+GmaxTuningApplyProfile(
+	const uint8_t* Data,
+	uint32_t Profile,
+	uint8_t Uid,
+	const GMAX_TUNING_LIMITS* Limits,
+	GMAX_TUNING_IMAGE* Image
+)
+{
+	uint32_t nameLength = Data[Profile];
+	uint32_t runs = GmaxTuningGet16(Data + Profile + 1 + nameLength);
+	uint32_t offset = Profile + 1 + nameLength + 2;
+
+	for (uint32_t r = 0; r < runs; r++) {
+		uint32_t reg = GmaxTuningGet16(Data + offset);
+		uint32_t length = Data[offset + 2];
+		uint8_t uid = Data[offset + 3];
+		int masked = (Data[offset + 4] & GMAX_TUNING_RUN_MASKED) != 0;
+		const uint8_t* values = Data + offset + 5;
+		GMAX_TUNING_RESULT check = GmaxTuningCheckRun(Limits, reg, length);
+
+		if (check != GmaxTuningOk) {
+			return check;
+		}
+
+		if (uid == GMAX_TUNING_UID_ANY || uid == Uid) {
+			for (uint32_t i = 0; i < length; i++) {
+				GMAX_TUNING_RESULT result = GmaxTuningSet(Image, (uint16_t)(reg + i),
+					values[i], masked ? values[length + i] : 0xFF);
+
+				if (result != GmaxTuningOk) {
+					return result;
+				}
+			}
+		}
+
+		offset += 5 + length * (masked ? 2 : 1);
+	}
+	return GmaxTuningOk;
+}
+
+//
+// Splits the image into bursts of consecutive registers
+//
+static __inline void
+GmaxTuningCompile(
+	GMAX_TUNING_IMAGE* Image
+)
+{
+	uint32_t i = 0;
+
+	Image->Bursts = 0;
+	while (i < Image->Count) {
+		uint32_t length = 1;
+
+		while (i + length < Image->Count &&
+			length < GMAX_TUNING_MAX_RUN &&
+			Image->Reg[i + length] == Image->Reg[i] + length) {
+			length++;
+		}
+
+		Image->BurstStart[Image->Bursts] = (uint16_t)i;
+		Image->BurstLength[Image->Bursts] = (uint8_t)length;
+		Image->Bursts++;
+		i += length;
+	}
+}
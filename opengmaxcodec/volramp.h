@@ -0,0 +1,211 @@
+#pragma once
+
+//
+// Volume ramp policy: the AMP_VOL_CTRL / SPK_GAIN level arithmetic,
+// where a ramp should be at a given moment, and how steps the bus kept
+// the timer from writing fold into the next write. Nothing here waits
+// or touches the bus: volume.c keeps a GMAX_VOLUME_RAMP under its lock,
+// ticks it from its timer and writes the split level. Pure so the host
+// ramp simulation (tools/gmaxvolsim) runs exactly what volume.c runs.
+//
+
+#include "max98512.h"
+
+#define GMAX_VOLUME_STEP_MS 16
+
+//
+// AMP_VOL_CTRL code <-> 1/100 dB, -16 dB to +15.75 dB in 0.25 dB steps.
+// The scale is uniform both ways, so the conversions are arithmetic
+// rather than a table lookup or search.
+//
+#define GMAX_AMP_VOL_MIN -1600
+#define GMAX_AMP_VOL_STEP 25
+#define GMAX_VOL(n) (GMAX_AMP_VOL_MIN + GMAX_AMP_VOL_STEP * (n))
+#define GMAX_AMP_VOL_MAX GMAX_VOL(MAX98512_AMP_VOL_MASK)
+
+//
+// One SPK_GAIN step (3 dB) in AMP_VOL_CTRL codes
+//
+#define GMAX_SPK_GAIN_STEP_CODES (300 / GMAX_AMP_VOL_STEP)
+
+typedef struct _GMAX_VOLUME_RAMP
+{
+	//
+	// Ramp ends as combined levels: AMP_VOL_CTRL code plus
+	// GMAX_SPK_GAIN_STEP_CODES per SPK_GAIN step above 1
+	//
+	int32_t Start;
+	int32_t Target;
+
+	uint64_t StartTime;	// interrupt time, 100ns
+	uint32_t Steps;
+	uint32_t LastStep;
+	uint8_t Ramping;
+} GMAX_VOLUME_RAMP;
+
+//
+// What one timer tick of a ramp comes to
+//
+typedef struct _GMAX_VOLUME_TICK
+{
+	int32_t Level;		// combined level to write now
+	uint32_t Coalesced;	// step deadlines folded into this write
+	uint64_t Lateness;	// 100ns, tick time minus the step's deadline
+	uint64_t NextDeadline;	// next step, 0 once the ramp has ended
+} GMAX_VOLUME_TICK;
+
+//
+// Nearest AMP_VOL_CTRL code, clamped to the range
+//
+static __inline uint8_t
+GmaxVolumeCode(
+	int32_t Volume
+)
+{
+	if (Volume <= GMAX_AMP_VOL_MIN) {
+		return 0;
+	}
+	if (Volume >= GMAX_AMP_VOL_MAX) {
+		return MAX98512_AMP_VOL_MASK;
+	}
+
+	return (uint8_t)((Volume - GMAX_AMP_VOL_MIN + GMAX_AMP_VOL_STEP / 2) / GMAX_AMP_VOL_STEP);
+}
+
+//
+// Combined level of an AMP_VOL_CTRL code at a SPK_GAIN code
+//
+static __inline int32_t
+GmaxVolumeRegLevel(
+	uint8_t Code,
+	uint8_t Gain
+)
+{
+	return Code + GMAX_SPK_GAIN_STEP_CODES * ((Gain > 1 ? Gain : 1) - 1);
+}
+
+//
+// Combined level for an AMP_VOL_CTRL setting in 1/100 dB, which may be
+// below the register's range, at a SPK_GAIN code. Never below 0, the
+// lowest AMP_VOL_CTRL code at SPK_GAIN 1.
+//
+static __inline int32_t
+GmaxVolumeLevel(
+	int32_t Volume,
+	uint8_t Gain
+)
+{
+	int32_t code;
+
+	if (Volume >= GMAX_AMP_VOL_MIN) {
+		code = GmaxVolumeCode(Volume);
+	}
+	else {
+		code = -((GMAX_AMP_VOL_MIN - Volume + GMAX_AMP_VOL_STEP / 2) / GMAX_AMP_VOL_STEP);
+	}
+
+	code += GMAX_SPK_GAIN_STEP_CODES * ((Gain > 1 ? Gain : 1) - 1);
+	return code > 0 ? code : 0;
+}
+
+//
+// AMP_VOL_CTRL code and SPK_GAIN for a combined level. SPK_GAIN stays at
+// MaxGain while AMP_VOL_CTRL can make up the rest and drops a step for
+// every 3 dB past the AMP_VOL_CTRL floor.
+//
+static __inline uint8_t
+GmaxVolumeSplit(
+	int32_t Level,
+	uint8_t MaxGain,
+	uint8_t* Gain
+)
+{
+	uint8_t gain = MaxGain;
+	int32_t code = Level - GMAX_SPK_GAIN_STEP_CODES * ((gain > 1 ? gain : 1) - 1);
+
+	while (code < 0 && gain > 1) {
+		code += GMAX_SPK_GAIN_STEP_CODES;
+		gain--;
+	}
+
+	*Gain = gain;
+	if (code < 0) {
+		return 0;
+	}
+	return (uint8_t)(code < MAX98512_AMP_VOL_MASK ? code : MAX98512_AMP_VOL_MASK);
+}
+
+//
+// Starts a ramp from the level last written to Target over RampMs,
+// from StartTime on. A ramp of 0 ms, or to where the amp already is,
+// is not a ramp: the next tick writes Target. Returns whether a ramp
+// is running.
+//
+static __inline int
+GmaxVolumeRampStart(
+	GMAX_VOLUME_RAMP* Ramp,
+	int32_t From,
+	int32_t Target,
+	uint64_t StartTime,
+	uint32_t RampMs
+)
+{
+	Ramp->Start = From;
+	Ramp->Target = Target;
+	Ramp->StartTime = StartTime;
+	Ramp->Steps = (RampMs + GMAX_VOLUME_STEP_MS - 1) / GMAX_VOLUME_STEP_MS;
+	if (Ramp->Steps == 0) {
+		Ramp->Steps = 1;
+	}
+	Ramp->LastStep = 0;
+	Ramp->Ramping = RampMs != 0 && Target != From;
+	return Ramp->Ramping;
+}
+
+//
+// Where the ramp should be at Now. Each tick computes the step due
+// rather than advancing one, so when the bus held the timer off the
+// missed steps are folded into this write and the ramp still ends on
+// time.
+//
+static __inline void
+GmaxVolumeRampTick(
+	GMAX_VOLUME_RAMP* Ramp,
+	uint64_t Now,
+	GMAX_VOLUME_TICK* Tick
+)
+{
+	uint64_t stepLength = GMAX_VOLUME_STEP_MS * 10000ULL;
+	uint64_t deadline;
+	uint64_t step;
+
+	Tick->Level = Ramp->Target;
+	Tick->Coalesced = 0;
+	Tick->Lateness = 0;
+	Tick->NextDeadline = 0;
+
+	if (!Ramp->Ramping) {
+		return;
+	}
+
+	step = Now < Ramp->StartTime ? 0 : (Now - Ramp->StartTime) / stepLength;
+	if (step > Ramp->Steps) {
+		step = Ramp->Steps;
+	}
+	deadline = Ramp->StartTime + step * stepLength;
+
+	if (step > Ramp->LastStep + 1) {
+		Tick->Coalesced = (uint32_t)step - Ramp->LastStep - 1;
+	}
+	Ramp->LastStep = (uint32_t)step;
+	Tick->Lateness = Now > deadline ? Now - deadline : 0;
+
+	Tick->Level = Ramp->Start + (int32_t)((int64_t)(Ramp->Target - Ramp->Start) * (int64_t)step / Ramp->Steps);
+
+	if (step < Ramp->Steps) {
+		Tick->NextDeadline = deadline + stepLength;
+	}
+	else {
+		Ramp->Ramping = 0;
+	}
+}
@@ -0,0 +1,411 @@
+/*++
+
+Module Name:
+
+volume.c
+
+Abstract:
+
+Amplifier digital volume (AMP_VOL_CTRL) and speaker gain (SPK_GAIN).
+
+Volume changes are ramped in GMAX_VOLUME_STEP_MS steps from a passive
+timer. Each tick computes where the ramp should be at that moment rather
+than advancing one step, so when the bus was busy the missed steps are
+folded into a single write and the ramp still ends on time. A new
+request supersedes a running ramp from the value last written. The
+ramp and level arithmetic are in volramp.h; this file owns the timer,
+the lock and the bus.
+
+Gain limits set by speaker protection and the brownout guard are kept
+per source and the largest is subtracted from the requested level. A
+limit may be scheduled ahead, so it lands just before the audio that
+needs it. Attenuation past the bottom of the AMP_VOL_CTRL range is taken
+from SPK_GAIN. Ramps run on a combined level of both registers, so a
+ramp crosses a SPK_GAIN step without a jump: at the AMP_VOL floor the
+gain drops 3 dB and AMP_VOL rises 3 dB in the same command.
+
+Environment:
+
+Kernel mode
+
+--*/
+
+#include "opengmaxcodec.h"
+#include "max98512.h"
+
+static ULONG GmaxDebugLevel = 100;
+static ULONG GmaxDebugCatagories = DBG_INIT || DBG_PNP || DBG_IOCTL;
+
+EVT_WDF_TIMER GmaxEvtVolumeTimer;
+
+C_ASSERT(GMAX_AMP_VOL_MAX == 1575);
+
+//
+// SPK_GAIN PCM code -> 1/100 dB, code 0 mutes the speaker path
+//
+static const INT16 GmaxSpkGainTable[] = {
+	-32768, 300, 600, 900, 1200, 1500, 1800
+};
+
+UINT8
+GmaxVolumeToReg(
+	_In_ INT32 Volume
+)
+/*++
+
+Routine Description:
+
+Nearest AMP_VOL_CTRL code, clamped to the range.
+
+--*/
+{
+	return GmaxVolumeCode(Volume);
+}
+
+INT32
+GmaxRegToVolume(
+	_In_ UINT8 Reg
+)
+{
+	return GMAX_VOL(Reg & MAX98512_AMP_VOL_MASK);
+}
+
+UINT8
+GmaxSpeakerGainToReg(
+	_In_ INT32 Gain
+)
+{
+	UINT8 best = 0;
+
+	for (UINT8 i = 1; i < sizeof(GmaxSpkGainTable) / sizeof(INT16); i++) {
+		if (Gain >= GmaxSpkGainTable[i] - 150) {
+			best = i;
+		}
+	}
+	return best;
+}
+
+NTSTATUS
+GmaxVolumeInitialize(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	GMAX_VOLUME* volume = &pDevice->Volume;
+	WDF_TIMER_CONFIG timerConfig;
+	WDF_OBJECT_ATTRIBUTES attributes;
+	NTSTATUS status;
+
+	volume->Current = GMAX_AMP_VOLUME_DEFAULT;
+	volume->SpeakerGain = pDevice->Quirk->SpeakerGain;
+	volume->Requested = GmaxRegToVolume(GMAX_AMP_VOLUME_DEFAULT);
+	volume->RequestedGain = pDevice->Quirk->SpeakerGain;
+	volume->Ramp.Target = GmaxVolumeLevel(volume->Requested, volume->RequestedGain);
+	volume->Ramp.Start = volume->Ramp.Target;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+
+	status = WdfSpinLockCreate(&attributes, &volume->Lock);
+	if (!NT_SUCCESS(status)) {
+		return status;
+	}
+
+	WDF_TIMER_CONFIG_INIT(&timerConfig, GmaxEvtVolumeTimer);
+	timerConfig.TolerableDelay = 0;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = pDevice->FxDevice;
+	attributes.ExecutionLevel = WdfExecutionLevelPassive;
+
+	return WdfTimerCreate(&timerConfig, &attributes, &volume->Timer);
+}
+
+NTSTATUS
+GmaxVolumeApply(
+	_In_ PGMAX_CONTEXT pDevice
+)
+/*++
+
+Routine Description:
+
+Programs the target volume and speaker gain straight away. Used when
+powering up, where there is nothing audible to ramp from.
+
+--*/
+{
+	GMAX_VOLUME* volume = &pDevice->Volume;
+	UINT8 target;
+	UINT8 gain;
+	NTSTATUS status;
+
+	WdfSpinLockAcquire(volume->Lock);
+	volume->Ramp.Ramping = FALSE;
+	target = GmaxVolumeSplit(volume->Ramp.Target, volume->RequestedGain, &gain);
+	WdfSpinLockRelease(volume->Lock);
+
+	status = gmax_reg_write(pDevice, pDevice->Chip->Regs.AmpVolume, target & MAX98512_AMP_VOL_MASK);
+	if (NT_SUCCESS(status)) {
+		status = gmax_reg_write(pDevice, pDevice->Chip->Regs.SpeakerGain, gain & MAX98512_SPK_PCM_GAIN_MASK);
+	}
+
+	WdfSpinLockAcquire(volume->Lock);
+	volume->Current = target;
+	volume->SpeakerGain = gain;
+	volume->Ramp.Start = volume->Ramp.Target;
+	WdfSpinLockRelease(volume->Lock);
+
+	return status;
+}
+
+VOID
+GmaxVolumeStop(
+	_In_ PGMAX_CONTEXT pDevice
+)
+{
+	GMAX_VOLUME* volume = &pDevice->Volume;
+
+	if (!volume->Timer) {
+		return;
+	}
+
+	WdfTimerStop(volume->Timer, TRUE);
+
+	//
+	// A ramp cut short by power down resumes at its target
+	//
+	WdfSpinLockAcquire(volume->Lock);
+	volume->Ramp.Ramping = FALSE;
+	WdfSpinLockRelease(volume->Lock);
+}
+
+static VOID
+GmaxVolumeRetarget(
+	_In_ GMAX_VOLUME* volume,
+	_In_ ULONG RampMs,
+	_In_ ULONG DelayUs
+)
+/*++
+
+Routine Description:
+
+Starts a ramp to the requested level less the gain limit. Called with
+the volume lock held.
+
+--*/
+{
+	INT32 limit = 0;
+
+	for (int i = 0; i < GmaxLimitSourceMax; i++) {
+		limit = max(limit, volume->Limit[i]);
+	}
+
+	if (volume->Ramp.Ramping) {
+		volume->Stats.RampsSuperseded++;
+	}
+
+	volume->Generation++;
+	if (GmaxVolumeRampStart(&volume->Ramp,
+		GmaxVolumeRegLevel(volume->Current, volume->SpeakerGain),
+		GmaxVolumeLevel(volume->Requested - limit, volume->RequestedGain),
+		KeQueryInterruptTimePrecise(NULL) + DelayUs * 10ULL,
+		RampMs)) {
+		volume->Stats.RampsStarted++;
+	}
+}
+
+static VOID
+GmaxVolumeKick(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ ULONG DelayUs
+)
+{
+	//
+	// The write itself happens on the timer so callers never block on
+	// the bus. Powered down, the values are applied by StartCodec.
+	//
+	if (pDevice->Codec.PoweredOn) {
+		WdfTimerStart(pDevice->Volume.Timer, WDF_REL_TIMEOUT_IN_US(max(1, DelayUs)));
+	}
+}
+
+NTSTATUS
+GmaxSetVolume(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ const GMAX_VOLUME_REQUEST* Request
+)
+{
+	GMAX_VOLUME* volume = &pDevice->Volume;
+
+	if (!GmaxChipHas(pDevice, GMAX_CHIP_VOLUME)) {
+		return STATUS_NOT_SUPPORTED;
+	}
+	if (Request->RampMs > GMAX_VOLUME_RAMP_MAX_MS) {
+		return STATUS_INVALID_PARAMETER;
+	}
+
+	WdfSpinLockAcquire(volume->Lock);
+
+	volume->Requested = Request->Volume;
+	if (Request->SpeakerGain != GMAX_SPK_GAIN_UNCHANGED) {
+		volume->RequestedGain = GmaxSpeakerGainToReg(Request->SpeakerGain);
+	}
+	GmaxVolumeRetarget(volume, Request->RampMs, 0);
+
+	WdfSpinLockRelease(volume->Lock);
+
+	GmaxVolumeKick(pDevice, 0);
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS
+GmaxSetGainLimit(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ const GMAX_GAIN_LIMIT* Limit
+)
+{
+	GMAX_VOLUME* volume = &pDevice->Volume;
+
+	if (!GmaxChipHas(pDevice, GMAX_CHIP_VOLUME)) {
+		return STATUS_NOT_SUPPORTED;
+	}
+	if (Limit->Attenuation < 0 || Limit->Source >= GmaxLimitSourceMax ||
+		Limit->RampMs > GMAX_VOLUME_RAMP_MAX_MS) {
+		return STATUS_INVALID_PARAMETER;
+	}
+
+	WdfSpinLockAcquire(volume->Lock);
+
+	if (Limit->Attenuation == volume->Limit[Limit->Source]) {
+		WdfSpinLockRelease(volume->Lock);
+		return STATUS_SUCCESS;
+	}
+
+	volume->Limit[Limit->Source] = Limit->Attenuation;
+	GmaxVolumeRetarget(volume, Limit->RampMs, Limit->DelayUs);
+
+	WdfSpinLockRelease(volume->Lock);
+
+	GmaxVolumeKick(pDevice, Limit->DelayUs);
+	return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+GmaxVolumeWrite(
+	_In_ PGMAX_CONTEXT pDevice,
+	_In_ UINT8 Amp,
+	_In_ UINT8 Gain
+)
+/*++
+
+Routine Description:
+
+Writes AMP_VOL_CTRL and SPK_GAIN where they differ from the chip,
+inside the caller's register command. When both change they move in
+opposite directions; the one going down is written first, so between
+the two writes the output dips by at most a gain step instead of
+peaking.
+
+--*/
+{
+	GMAX_VOLUME* volume = &pDevice->Volume;
+	const GMAX_CHIP_REGS* regs = &pDevice->Chip->Regs;
+	NTSTATUS status = STATUS_SUCCESS;
+
+	if (Gain < volume->SpeakerGain) {
+		status = gmax_reg_write(pDevice, regs->SpeakerGain, Gain & MAX98512_SPK_PCM_GAIN_MASK);
+		if (!NT_SUCCESS(status)) {
+			return status;
+		}
+		volume->SpeakerGain = Gain;
+	}
+
+	if (Amp != volume->Current) {
+		status = gmax_reg_write(pDevice, regs->AmpVolume, Amp & MAX98512_AMP_VOL_MASK);
+		if (!NT_SUCCESS(status)) {
+			return status;
+		}
+		WdfSpinLockAcquire(volume->Lock);
+		volume->Current = Amp;
+		WdfSpinLockRelease(volume->Lock);
+	}
+
+	if (Gain != volume->SpeakerGain) {
+		status = gmax_reg_write(pDevice, regs->SpeakerGain, Gain & MAX98512_SPK_PCM_GAIN_MASK);
+		if (NT_SUCCESS(status)) {
+			volume->SpeakerGain = Gain;
+		}
+	}
+
+	return status;
+}
+
+VOID
+GmaxEvtVolumeTimer(
+	_In_ WDFTIMER Timer
+)
+{
+	PGMAX_CONTEXT pDevice = GetDeviceContext(WdfTimerGetParentObject(Timer));
+	GMAX_VOLUME* volume = &pDevice->Volume;
+	GMAX_VOLUME_TICK tick;
+	ULONGLONG now;
+	ULONG generation;
+	UINT8 desired;
+	UINT8 gain;
+
+	if (!pDevice->Codec.PoweredOn) {
+		return;
+	}
+
+	GmaxCmdBegin(pDevice, GmaxPriorityVolume);
+
+	now = KeQueryInterruptTimePrecise(NULL);
+
+	WdfSpinLockAcquire(volume->Lock);
+
+	generation = volume->Generation;
+	GmaxVolumeRampTick(&volume->Ramp, now, &tick);
+
+	volume->Stats.StepsCoalesced += tick.Coalesced;
+	volume->Stats.TotalLateness += tick.Lateness;
+	if (tick.Lateness > volume->Stats.MaxLateness) {
+		volume->Stats.MaxLateness = tick.Lateness;
+	}
+
+	desired = GmaxVolumeSplit(tick.Level, volume->RequestedGain, &gain);
+
+	WdfSpinLockRelease(volume->Lock);
+
+	if (desired != volume->Current || gain != volume->SpeakerGain) {
+		ULONGLONG busStart = KeQueryInterruptTimePrecise(NULL);
+
+		GmaxVolumeWrite(pDevice, desired, gain);
+
+		WdfSpinLockAcquire(volume->Lock);
+		volume->Stats.BusTime += KeQueryInterruptTimePrecise(NULL) - busStart;
+		volume->Stats.StepsWritten++;
+		WdfSpinLockRelease(volume->Lock);
+	}
+
+	GmaxCmdEnd(pDevice);
+
+	//
+	// A superseding request has already restarted the timer.
+	//
+	if (tick.NextDeadline && generation == volume->Generation) {
+		now = KeQueryInterruptTimePrecise(NULL);
+		WdfTimerStart(Timer, tick.NextDeadline > now ? -(LONGLONG)(tick.NextDeadline - now) : WDF_REL_TIMEOUT_IN_US(1));
+	}
+}
+
+VOID
+GmaxVolumeGetStats(
+	_In_ PGMAX_CONTEXT pDevice,
+	_Out_ GMAX_VOLUME_STATS* Stats
+)
+{
+	GMAX_VOLUME* volume = &pDevice->Volume;
+
+	WdfSpinLockAcquire(volume->Lock);
+	*Stats = volume->Stats;
+	WdfSpinLockRelease(volume->Lock);
+}
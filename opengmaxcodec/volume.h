@@ -0,0 +1,80 @@
+#pragma once
+
+//
+// AMP_VOL_CTRL / SPK_GAIN control with timed ramps. The ramp policy
+// is in volramp.h.
+//
+
+//
+// Register defaults applied at StartCodec
+//
+#define GMAX_AMP_VOLUME_DEFAULT 60
+#define GMAX_SPK_GAIN_DEFAULT 1
+
+typedef struct _GMAX_VOLUME
+{
+	WDFTIMER Timer;
+	WDFSPINLOCK Lock;
+
+	UINT8 Current;		// last value written to AMP_VOL_CTRL
+	UINT8 SpeakerGain;	// last value written to SPK_GAIN
+
+	INT32 Requested;	// 1/100 dB, before the limit
+	UINT8 RequestedGain;
+	INT32 Limit[GmaxLimitSourceMax];	// 1/100 dB of attenuation
+
+	ULONG Generation;
+	GMAX_VOLUME_RAMP Ramp;
+
+	GMAX_VOLUME_STATS Stats;
+} GMAX_VOLUME;
+
+struct _GMAX_CONTEXT;
+
+UINT8
+GmaxVolumeToReg(
+	_In_ INT32 Volume
+);
+
+INT32
+GmaxRegToVolume(
+	_In_ UINT8 Reg
+);
+
+UINT8
+GmaxSpeakerGainToReg(
+	_In_ INT32 Gain
+);
+
+NTSTATUS
+GmaxVolumeInitialize(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+NTSTATUS
+GmaxVolumeApply(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+VOID
+GmaxVolumeStop(
+	_In_ struct _GMAX_CONTEXT* pDevice
+);
+
+NTSTATUS
+GmaxSetVolume(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ const GMAX_VOLUME_REQUEST* Request
+);
+
+NTSTATUS
+GmaxSetGainLimit(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_In_ const GMAX_GAIN_LIMIT* Limit
+);
+
+VOID
+GmaxVolumeGetStats(
+	_In_ struct _GMAX_CONTEXT* pDevice,
+	_Out_ GMAX_VOLUME_STATS* Stats
+);
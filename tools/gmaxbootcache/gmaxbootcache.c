@@ -0,0 +1,253 @@
+/*++
+
+Module Name:
+
+gmaxbootcache.c
+
+Abstract:
+
+Checks and inspects the driver's boot cache (opengmaxcodec/bootcache.h).
+
+selftest round-trips a configuration through the encoder and decoder
+and then damages the encoding every way the registry value could be
+damaged: each single bit flipped, each truncation, a version from
+another driver build and an unsorted image. Every damaged copy must be
+rejected, or the driver would trust a bad cache instead of falling
+back to discovery.
+
+decode prints a cache taken from the registry, either a raw file or
+the hex string `reg query ... /v GmaxBootCache` prints.
+
+Usage: gmaxbootcache selftest
+       gmaxbootcache decode <file>
+       gmaxbootcache hex <hex digits>
+
+Environment:
+
+Host, portable C
+
+--*/
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../opengmaxcodec/bootcache.h"
+
+static const char* ResultNames[] = {
+	"ok",
+	"truncated",
+	"bad magic",
+	"bad version",
+	"bad length",
+	"bad checksum",
+	"bad image"
+};
+
+static void
+SampleConfig(
+	GMAX_BOOT_CONFIG* Config,
+	int32_t Uid
+)
+{
+	static const GMAX_BOOT_REG table[] = {
+		{ 0x0014, 0x10, 0 }, { 0x0015, 0x8C, 0 }, { 0x0016, 0x08, 0 }, { 0x0018, 0x03, 0 },
+		{ 0x0020, 0x58, 0 }, { 0x0022, 0x26, 0 }, { 0x0023, 0x08, 0 }, { 0x0041, 0x07, 0 },
+	};
+
+	memset(Config, 0, sizeof(*Config));
+	Config->ConnectionLow = 0x00010002;
+	Config->ConnectionHigh = 0;
+	Config->TableHash = GmaxBootHashTable(table, sizeof(table) / sizeof(table[0]));
+	Config->FirmwareHash = 0x5EED0001;
+	Config->Uid = Uid;
+	Config->ChipModel = 98512;
+	memcpy(Config->Hid, "MX98512", 7);
+	Config->Interleave = 0;
+	Config->VmonSlot = Uid == 0 ? 4 : 6;
+	Config->ImonSlot = Uid == 0 ? 5 : 7;
+	GmaxBootBuildImage(Config, table, sizeof(table) / sizeof(table[0]), 1, 1);
+}
+
+static int
+SameConfig(
+	const GMAX_BOOT_CONFIG* A,
+	const GMAX_BOOT_CONFIG* B
+)
+{
+	if (A->ConnectionLow != B->ConnectionLow || A->ConnectionHigh != B->ConnectionHigh ||
+		A->TableHash != B->TableHash || A->FirmwareHash != B->FirmwareHash || A->Uid != B->Uid || A->ChipModel != B->ChipModel ||
+		memcmp(A->Hid, B->Hid, sizeof(A->Hid)) != 0 || A->RevId != B->RevId ||
+		A->Interleave != B->Interleave || A->VmonSlot != B->VmonSlot ||
+		A->ImonSlot != B->ImonSlot || A->DsdDefaults != B->DsdDefaults ||
+		A->RegCount != B->RegCount) {
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < A->RegCount; i++) {
+		if (A->Image[i].Reg != B->Image[i].Reg || A->Image[i].Value != B->Image[i].Value) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int
+SelfTest(
+	void
+)
+{
+	uint8_t encoded[GMAX_BOOT_CACHE_MAX_SIZE];
+	uint8_t damaged[GMAX_BOOT_CACHE_MAX_SIZE];
+	GMAX_BOOT_CONFIG config, decoded;
+	uint32_t size;
+	uint32_t flips = 0, truncations = 0;
+	int failures = 0;
+
+	for (int32_t uid = 0; uid < 2; uid++) {
+		SampleConfig(&config, uid);
+		size = GmaxBootCacheEncode(&config, encoded, sizeof(encoded));
+		if (size == 0 || GmaxBootCacheDecode(encoded, size, &decoded) != GmaxBootCacheOk ||
+			!SameConfig(&config, &decoded)) {
+			printf("FAIL round trip, uid %d\n", uid);
+			failures++;
+		}
+	}
+
+	if (GmaxBootCacheEncode(&config, encoded, size - 1) != 0) {
+		printf("FAIL encode into a short buffer\n");
+		failures++;
+	}
+
+	for (uint32_t bit = 0; bit < size * 8; bit++) {
+		memcpy(damaged, encoded, size);
+		damaged[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+		if (GmaxBootCacheDecode(damaged, size, &decoded) == GmaxBootCacheOk) {
+			printf("FAIL bit %u flipped and accepted\n", bit);
+			failures++;
+		}
+		flips++;
+	}
+
+	for (uint32_t length = 0; length < size; length++) {
+		if (GmaxBootCacheDecode(encoded, length, &decoded) == GmaxBootCacheOk) {
+			printf("FAIL truncated to %u bytes and accepted\n", length);
+			failures++;
+		}
+		truncations++;
+	}
+
+	//
+	// A well formed cache from another build, the checksum covers the body only
+	//
+	memcpy(damaged, encoded, size);
+	damaged[4] = GMAX_BOOT_CACHE_VERSION + 1;
+	if (GmaxBootCacheDecode(damaged, size, &decoded) != GmaxBootCacheBadVersion) {
+		printf("FAIL other version accepted\n");
+		failures++;
+	}
+
+	config.Image[1].Reg = config.Image[0].Reg;
+	size = GmaxBootCacheEncode(&config, encoded, sizeof(encoded));
+	if (GmaxBootCacheDecode(encoded, size, &decoded) != GmaxBootCacheBadImage) {
+		printf("FAIL unsorted image accepted\n");
+		failures++;
+	}
+
+	printf("round trip, %u bit flips, %u truncations, version and image checks: %s\n",
+		flips, truncations, failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
+
+static int
+Decode(
+	const uint8_t* Buffer,
+	uint32_t Length
+)
+{
+	GMAX_BOOT_CONFIG config;
+	GMAX_BOOT_CACHE_RESULT result = GmaxBootCacheDecode(Buffer, Length, &config);
+
+	if (result != GmaxBootCacheOk) {
+		printf("rejected: %s, the driver would run full discovery\n", ResultNames[result]);
+		return 1;
+	}
+
+	printf("version %u, %u bytes\n", GMAX_BOOT_CACHE_VERSION, Length);
+	printf("key       connection %08X:%08X  init table %08X  firmware %08X\n",
+		config.ConnectionHigh, config.ConnectionLow, config.TableHash, config.FirmwareHash);
+	printf("_HID      %.8s (chip %u, rev %02X)\n", (const char*)config.Hid, config.ChipModel, config.RevId);
+	printf("_UID      %d\n", config.Uid);
+	printf("_DSD      vmon slot %u, imon slot %u, interleave %u%s\n",
+		config.VmonSlot, config.ImonSlot, config.Interleave,
+		config.DsdDefaults ? " (defaults, _DSD missing)" : "");
+	printf("image     %u registers\n", config.RegCount);
+	for (uint32_t i = 0; i < config.RegCount; i++) {
+		printf("%s0x%04X=%02X", i % 6 ? "  " : "\n  ", config.Image[i].Reg, config.Image[i].Value);
+	}
+	printf("\n");
+	return 0;
+}
+
+static uint32_t
+ParseHex(
+	const char* Text,
+	uint8_t* Buffer,
+	uint32_t Capacity
+)
+{
+	uint32_t length = 0;
+	int high = -1;
+
+	for (; *Text; Text++) {
+		int digit;
+
+		if (!isxdigit((unsigned char)*Text)) {
+			continue;
+		}
+		digit = isdigit((unsigned char)*Text) ? *Text - '0' : (tolower((unsigned char)*Text) - 'a' + 10);
+		if (high < 0) {
+			high = digit;
+		}
+		else if (length < Capacity) {
+			Buffer[length++] = (uint8_t)(high << 4 | digit);
+			high = -1;
+		}
+	}
+	return length;
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	static uint8_t buffer[4096];
+
+	if (argc == 2 && !strcmp(argv[1], "selftest")) {
+		return SelfTest();
+	}
+
+	if (argc == 3 && !strcmp(argv[1], "decode")) {
+		FILE* file = fopen(argv[2], "rb");
+		size_t length;
+
+		if (!file) {
+			perror(argv[2]);
+			return 1;
+		}
+		length = fread(buffer, 1, sizeof(buffer), file);
+		fclose(file);
+		return Decode(buffer, (uint32_t)length);
+	}
+
+	if (argc == 3 && !strcmp(argv[1], "hex")) {
+		return Decode(buffer, ParseHex(argv[2], buffer, sizeof(buffer)));
+	}
+
+	fprintf(stderr, "usage: %s selftest | decode <file> | hex <hex digits>\n", argv[0]);
+	return 2;
+}
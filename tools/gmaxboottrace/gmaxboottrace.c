@@ -0,0 +1,739 @@
+/*++
+
+Module Name:
+
+gmaxboottrace.c
+
+Abstract:
+
+Simulates the start of one amp (DriverEntry, EvtDeviceAdd,
+PrepareHardware, the first D0Entry, SelfManagedIoInit) and a number of
+idle/resume cycles after it. The stages are the ones the driver records
+in its timeline (timeline.c), so the output can be compared with a
+device's timeline from gmaxregstat -t. The trace is written as Chrome
+trace JSON for Perfetto or chrome://tracing. Register transfers are
+slices nested in the stage that made them. Power-up steps left to the
+power work item are on a thread of their own.
+
+Callback costs other than the bus are estimates; the bus follows
+spb.c's retry policy (spbretry.h), StartCodec writes the tuning bursts
+of a MAX98512-like init image (tuningfile.h), and power-up runs the
+chip's sequence through powerseq.h. A summary of where the time went
+is printed per stage.
+
+Usage: gmaxboottrace [-o file] [-cache hit|miss] [-tuning none|registry|file]
+	[-resumes n] [-sleep-ms ms] [-settle-us us] [-nack p] [-seed n]
+
+Environment:
+
+Host, portable C
+
+--*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../opengmaxcodec/spbretry.h"
+#include "../../opengmaxcodec/powerseq.h"
+#include "../../opengmaxcodec/tuningfile.h"
+
+#define GMAX_POWER_STALL_MAX_US 10	// opengmaxcodec/power.h
+#define GMAX_IDLE_TIMEOUT_MS 1000	// S0 idle settings, opengmaxcodec.c
+#define GMAX_BDE_RUNS { {0x0050, 4}, {0x0058, 8}, {0x0070, 16} }	// opengmaxcodec/bde.h
+
+#define SIM_REG_INT_EN1 0x000A		// opengmaxcodec/max98512.h
+#define SIM_REG_INT_FLAG_CLR1 0x000D
+#define SIM_REG_IRQ_CTRL 0x0010
+#define SIM_REG_AMP_VOL 0x0035
+#define SIM_REG_AMP_EN 0x0038
+#define SIM_REG_SPK_GAIN 0x003A
+#define SIM_REG_GLOBAL_SHDN 0x0400
+#define SIM_REG_SOFT_RESET 0x0401
+#define SIM_REG_REV_ID 0x0402
+#define SIM_ENABLE 0x01
+
+//
+// Bus timing at 400 kHz, as gmaxbussim
+//
+#define SIM_TRANSFER_US 150		// three-byte write
+#define SIM_BYTE_US 23			// each byte after that
+#define SIM_RESTART_US 40		// repeated start of a read
+#define SIM_NACK_US 60
+#define SIM_TIMER_US 100		// high-resolution timer and work item
+
+//
+// Estimated costs outside the bus, in us
+//
+#define SIM_DRIVER_CREATE_US 150	// WdfDriverCreate
+#define SIM_PLATFORM_US 600		// GmaxPlatformIdentify, firmware tables
+#define SIM_DEVICE_CREATE_US 250	// WdfDeviceCreate and the default queue
+#define SIM_DEVICE_OBJECTS 14		// queues, locks, timers, work items
+#define SIM_OBJECT_US 20
+#define SIM_INTERFACE_US 150		// WdfDeviceCreateDeviceInterface
+#define SIM_RESOURCES_US 30
+#define SIM_SPB_OPEN_US 1200		// resource hub and SpbCx target open
+#define SIM_REGISTRY_US 120		// one value under the hardware key
+#define SIM_ACPI_EVAL_US 900		// IOCTL_ACPI_EVAL_METHOD_EX
+#define SIM_ACPI_DSD_US 700		// per _DSD property
+#define SIM_TUNING_FILE_US 1800		// open, read and close
+#define SIM_COMPILE_US 15
+#define SIM_POWER_SOURCE_US 80		// power setting registration
+#define SIM_CALLBACK_US 60		// ExCreateCallback and ExRegisterCallback
+#define SIM_PNP_GAP_US 500		// PnP manager between callbacks
+
+#define SIM_MAX_EVENTS 65536
+#define SIM_MAX_NESTING 8
+#define SIM_TID_PNP 1
+#define SIM_TID_WORK_ITEM 2
+
+#define SIM_US(x) ((uint64_t)(x) * 10)
+#define SIM_MS(x) ((uint64_t)(x) * 10000)
+
+//
+// opengmaxcodec/gmaxioctl.h GMAX_STAGE, then the work item
+//
+typedef enum {
+	SimStageDriverEntry,
+	SimStageDeviceAdd,
+	SimStagePrepareHardware,
+	SimStageSpbOpen,
+	SimStageBootCache,
+	SimStageAcpiUid,
+	SimStageAcpiHid,
+	SimStageAcpiDsd,
+	SimStageTuningLoad,
+	SimStageSelfManagedIoInit,
+	SimStageCallbackRegister,
+	SimStageD0Entry,
+	SimStageStartCodec,
+	SimStageD0Exit,
+	SimStageBusWrite,
+	SimStageBusXfer,
+	SimStagePowerWorkItem,
+	SimStageMax
+} SIM_STAGE;
+
+static const char* SimStageNames[SimStageMax] = {
+	"DriverEntry",
+	"EvtDeviceAdd",
+	"PrepareHardware",
+	"SPB open",
+	"boot cache",
+	"ACPI _UID",
+	"ACPI _HID",
+	"ACPI _DSD",
+	"tuning load",
+	"SelfManagedIoInit",
+	"CsAudio callback",
+	"D0Entry",
+	"StartCodec",
+	"D0Exit",
+	"write",
+	"read",
+	"power work item"
+};
+
+typedef enum {
+	SimTuningNone,
+	SimTuningRegistry,
+	SimTuningFile
+} SIM_TUNING;
+
+typedef struct _SIM_CONFIG {
+	const char* Output;
+	int CacheHit;
+	SIM_TUNING Tuning;
+	uint32_t Resumes;
+	uint32_t SleepMs;
+	uint32_t SettleUs;
+	double Nack;
+	uint64_t Seed;
+} SIM_CONFIG;
+
+typedef struct _SIM_EVENT {
+	uint64_t Start;			// 100ns
+	uint64_t End;
+	uint64_t BusTime;		// nested transfers, 100ns
+	uint32_t Transfers;
+	uint32_t Tid;
+	int Status;			// 0 or 1 for a failed transfer
+	uint16_t Data;			// register of a transfer
+	uint8_t Stage;
+	uint8_t Depth;
+	uint8_t Attempts;
+	uint8_t Boot;
+} SIM_EVENT;
+
+typedef struct _SIM_FRAME {
+	SIM_STAGE Stage;
+	uint64_t Start;
+	uint64_t BusTime;
+	uint32_t Transfers;
+} SIM_FRAME;
+
+typedef struct _SIM {
+	SIM_CONFIG Config;
+	uint64_t Random;
+	uint64_t Now;
+	uint32_t Tid;
+	int Boot;
+
+	SIM_FRAME Open[SIM_MAX_NESTING];
+	uint32_t Depth;
+
+	GMAX_TUNING_IMAGE Image;
+
+	//
+	// Power-up steps left to the work item
+	//
+	GMAX_POWER_SEQ Power;
+	int PowerPending;
+
+	SIM_EVENT Events[SIM_MAX_EVENTS];
+	uint32_t Count;
+} SIM;
+
+static const uint16_t SimImageRegs[] = { 0x0014, 0x0015, 0x0016, 0x0018, 0x0020, 0x0022, 0x0023, 0x0024, 0x0025, 0x0026, 0x0041 };
+static const uint8_t SimImageValues[] = { 0x10, 0x8C, 0x08, 0x03, 0x58, 0x26, 0x08, 0x88, 0x40, 0x01, 0x07 };
+
+static const GMAX_POWER_STEP SimPowerUpSteps[] = {
+	{{{SIM_REG_GLOBAL_SHDN, SIM_ENABLE}}, 1, GMAX_POWER_SETTLE_QUIRK},
+	{{{SIM_REG_AMP_EN, SIM_ENABLE}}, 1, 0}
+};
+
+static const GMAX_POWER_STEP SimPowerDownSteps[] = {
+	{{{SIM_REG_SOFT_RESET, SIM_ENABLE}}, 1, 0}
+};
+
+static uint64_t
+SimRandom(
+	uint64_t* State
+)
+{
+	// xorshift64*
+	*State ^= *State >> 12;
+	*State ^= *State << 25;
+	*State ^= *State >> 27;
+	return *State * 2685821657736338717ULL;
+}
+
+static double
+SimUniform(
+	uint64_t* State
+)
+{
+	return (SimRandom(State) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static SIM_EVENT*
+SimAppend(
+	SIM* Sim,
+	SIM_STAGE Stage,
+	uint64_t Start,
+	int Status
+)
+{
+	SIM_EVENT* event;
+
+	if (Sim->Count == SIM_MAX_EVENTS) {
+		return NULL;
+	}
+
+	event = &Sim->Events[Sim->Count++];
+	memset(event, 0, sizeof(*event));
+	event->Start = Start;
+	event->End = Sim->Now;
+	event->Stage = (uint8_t)Stage;
+	event->Depth = (uint8_t)Sim->Depth;
+	event->Tid = Sim->Tid;
+	event->Status = Status;
+	event->Boot = (uint8_t)Sim->Boot;
+	return event;
+}
+
+static void
+SimBegin(
+	SIM* Sim,
+	SIM_STAGE Stage
+)
+{
+	SIM_FRAME* frame = &Sim->Open[Sim->Depth++];
+
+	frame->Stage = Stage;
+	frame->Start = Sim->Now;
+	frame->BusTime = 0;
+	frame->Transfers = 0;
+}
+
+static void
+SimEnd(
+	SIM* Sim,
+	int Status
+)
+{
+	SIM_FRAME* frame = &Sim->Open[--Sim->Depth];
+	SIM_EVENT* event = SimAppend(Sim, frame->Stage, frame->Start, Status);
+
+	if (event) {
+		event->BusTime = frame->BusTime;
+		event->Transfers = frame->Transfers;
+	}
+}
+
+static void
+SimSpend(
+	SIM* Sim,
+	uint32_t Us
+)
+{
+	Sim->Now += SIM_US(Us);
+}
+
+//
+// One gmax_reg_* call: the transfer with spb.c's retries and backoff,
+// recorded like GmaxTimelineBus
+//
+static int
+SimBus(
+	SIM* Sim,
+	int Write,
+	uint16_t Reg,
+	uint32_t Length
+)
+{
+	uint64_t start = Sim->Now;
+	uint32_t bytes = 2 + Length;
+	uint32_t attempt;
+	int failed = 1;
+	SIM_EVENT* event;
+
+	for (attempt = 0; attempt < SPB_MAX_ATTEMPTS; attempt++) {
+		if (attempt) {
+			Sim->Now += SIM_US(SpbBackoffUs(attempt - 1, (uint32_t)SimRandom(&Sim->Random)));
+		}
+		if (SimUniform(&Sim->Random) < Sim->Config.Nack) {
+			Sim->Now += SIM_US(SIM_NACK_US);
+			continue;
+		}
+		Sim->Now += SIM_US(SIM_TRANSFER_US + SIM_BYTE_US * (bytes - 3) + (Write ? 0 : SIM_RESTART_US));
+		failed = 0;
+		break;
+	}
+
+	event = SimAppend(Sim, Write ? SimStageBusWrite : SimStageBusXfer, start, failed);
+	if (event) {
+		event->Data = Reg;
+		event->Attempts = (uint8_t)(attempt < SPB_MAX_ATTEMPTS ? attempt + 1 : attempt);
+	}
+	for (uint32_t d = 0; d < Sim->Depth; d++) {
+		Sim->Open[d].BusTime += Sim->Now - start;
+		Sim->Open[d].Transfers++;
+	}
+	return failed;
+}
+
+//
+// GmaxPowerRun: writes what is due, stalls out short settles and
+// leaves the rest to the work item
+//
+static int
+SimPowerRun(
+	SIM* Sim
+)
+{
+	const GMAX_POWER_STEP* step;
+	int failed = 0;
+
+	for (;;) {
+		GMAX_POWER_SEQ_ACTION action = GmaxPowerSeqNext(&Sim->Power, Sim->Now, &step);
+
+		if (action == GmaxPowerSeqStop) {
+			return failed;
+		}
+
+		if (action == GmaxPowerSeqWrite) {
+			for (uint32_t i = 0; i < step->Count && !failed; i++) {
+				failed = SimBus(Sim, 1, step->Writes[i].Reg, 1);
+			}
+			GmaxPowerSeqWritten(&Sim->Power, !failed, Sim->Now);
+			continue;
+		}
+
+		if (Sim->Power.DueAt - Sim->Now <= SIM_US(GMAX_POWER_STALL_MAX_US)) {
+			Sim->Now = Sim->Power.DueAt;
+			continue;
+		}
+
+		Sim->PowerPending = 1;
+		return 0;
+	}
+}
+
+static int
+SimPowerStart(
+	SIM* Sim,
+	const GMAX_POWER_STEP* Steps,
+	uint32_t Count
+)
+{
+	Sim->PowerPending = 0;
+	GmaxPowerSeqStart(&Sim->Power, Steps, Count, Sim->Config.SettleUs, Sim->Now);
+	return SimPowerRun(Sim);
+}
+
+//
+// The power timer fired: the work item finishes the sequence on its
+// own thread while PnP moves on
+//
+static void
+SimPowerWorkItem(
+	SIM* Sim
+)
+{
+	uint64_t now = Sim->Now;
+	uint32_t tid = Sim->Tid;
+	uint32_t depth = Sim->Depth;
+
+	if (!Sim->PowerPending) {
+		return;
+	}
+
+	Sim->Tid = SIM_TID_WORK_ITEM;
+	Sim->Depth = 0;
+	Sim->Now = Sim->Power.DueAt + SIM_US(SIM_TIMER_US);
+
+	while (Sim->PowerPending) {
+		Sim->PowerPending = 0;
+		SimBegin(Sim, SimStagePowerWorkItem);
+		SimEnd(Sim, SimPowerRun(Sim));
+		if (Sim->PowerPending) {
+			Sim->Now = Sim->Power.DueAt + SIM_US(SIM_TIMER_US);
+		}
+	}
+
+	Sim->Tid = tid;
+	Sim->Depth = depth;
+	if (Sim->Now < now) {
+		Sim->Now = now;
+	}
+}
+
+static int
+SimStartCodec(
+	SIM* Sim
+)
+{
+	static const struct {
+		uint16_t Reg;
+		uint32_t Length;
+	} bdeRuns[] = GMAX_BDE_RUNS;
+	int failed;
+
+	failed = SimBus(Sim, 0, SIM_REG_REV_ID, 1);
+
+	for (uint32_t b = 0; b < Sim->Image.Bursts && !failed; b++) {
+		failed = SimBus(Sim, 1, Sim->Image.Reg[Sim->Image.BurstStart[b]], Sim->Image.BurstLength[b]);
+	}
+
+	if (!failed) {
+		failed = SimBus(Sim, 1, SIM_REG_AMP_VOL, 1) || SimBus(Sim, 1, SIM_REG_SPK_GAIN, 1);
+	}
+
+	for (uint32_t r = 0; r < sizeof(bdeRuns) / sizeof(bdeRuns[0]) && !failed; r++) {
+		failed = SimBus(Sim, 1, bdeRuns[r].Reg, bdeRuns[r].Length);
+	}
+
+	if (!failed) {
+		failed = SimBus(Sim, 1, SIM_REG_INT_FLAG_CLR1, 3) ||
+			SimBus(Sim, 1, SIM_REG_INT_EN1, 3) ||
+			SimBus(Sim, 1, SIM_REG_IRQ_CTRL, 1);
+	}
+
+	if (!failed) {
+		failed = SimPowerStart(Sim, SimPowerUpSteps, 2);
+	}
+	return failed;
+}
+
+static void
+SimD0Entry(
+	SIM* Sim
+)
+{
+	SimBegin(Sim, SimStageD0Entry);
+	SimBegin(Sim, SimStageStartCodec);
+	SimEnd(Sim, SimStartCodec(Sim));
+
+	//
+	// A failed start goes to the recovery timer, resume succeeds
+	//
+	SimEnd(Sim, 0);
+}
+
+static void
+SimD0Exit(
+	SIM* Sim
+)
+{
+	SimBegin(Sim, SimStageD0Exit);
+	SimEnd(Sim, SimPowerStart(Sim, SimPowerDownSteps, 1));
+}
+
+static void
+SimDriverStart(
+	SIM* Sim
+)
+{
+	SimBegin(Sim, SimStageDriverEntry);
+	SimSpend(Sim, SIM_DRIVER_CREATE_US + SIM_PLATFORM_US);
+	SimEnd(Sim, 0);
+	SimSpend(Sim, SIM_PNP_GAP_US);
+
+	SimBegin(Sim, SimStageDeviceAdd);
+	SimSpend(Sim, SIM_DEVICE_CREATE_US + SIM_DEVICE_OBJECTS * SIM_OBJECT_US + SIM_INTERFACE_US);
+	SimEnd(Sim, 0);
+	SimSpend(Sim, SIM_PNP_GAP_US);
+
+	SimBegin(Sim, SimStagePrepareHardware);
+	SimSpend(Sim, SIM_RESOURCES_US);
+
+	SimBegin(Sim, SimStageSpbOpen);
+	SimSpend(Sim, SIM_SPB_OPEN_US);
+	SimEnd(Sim, 0);
+
+	SimBegin(Sim, SimStageBootCache);
+	SimSpend(Sim, SIM_REGISTRY_US);
+	SimEnd(Sim, !Sim->Config.CacheHit);
+
+	if (!Sim->Config.CacheHit) {
+		SimBegin(Sim, SimStageAcpiUid);
+		SimSpend(Sim, SIM_ACPI_EVAL_US);
+		SimEnd(Sim, 0);
+
+		SimBegin(Sim, SimStageAcpiHid);
+		SimSpend(Sim, SIM_ACPI_EVAL_US);
+		SimEnd(Sim, 0);
+
+		SimBegin(Sim, SimStageAcpiDsd);
+		SimSpend(Sim, 3 * SIM_ACPI_DSD_US);
+		SimEnd(Sim, 0);
+
+		SimSpend(Sim, SIM_REGISTRY_US);	// GmaxConfigStore
+	}
+
+	SimBegin(Sim, SimStageTuningLoad);
+	switch (Sim->Config.Tuning) {
+	case SimTuningRegistry:
+		SimSpend(Sim, 2 * SIM_REGISTRY_US + SIM_COMPILE_US);
+		break;
+	case SimTuningFile:
+		SimSpend(Sim, 2 * SIM_REGISTRY_US + SIM_TUNING_FILE_US + SIM_COMPILE_US);
+		break;
+	default:
+		SimSpend(Sim, 2 * SIM_REGISTRY_US);
+		break;
+	}
+	SimEnd(Sim, 0);
+
+	SimSpend(Sim, SIM_POWER_SOURCE_US);
+	SimEnd(Sim, 0);
+	SimSpend(Sim, SIM_PNP_GAP_US);
+
+	//
+	// WDF runs D0Entry before SelfManagedIoInit
+	//
+	SimD0Entry(Sim);
+	SimSpend(Sim, SIM_PNP_GAP_US);
+
+	SimBegin(Sim, SimStageSelfManagedIoInit);
+	SimBegin(Sim, SimStageCallbackRegister);
+	SimSpend(Sim, SIM_CALLBACK_US);
+	SimEnd(Sim, 0);
+	SimEnd(Sim, 0);
+	Sim->Boot = 0;
+
+	SimPowerWorkItem(Sim);
+}
+
+static void
+SimWriteTrace(
+	const SIM* Sim,
+	FILE* File
+)
+{
+	fprintf(File, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	fprintf(File, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"PnP\"}},\n",
+		SIM_TID_PNP);
+	fprintf(File, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"power work item\"}}",
+		SIM_TID_WORK_ITEM);
+
+	for (uint32_t i = 0; i < Sim->Count; i++) {
+		const SIM_EVENT* event = &Sim->Events[i];
+		int bus = event->Stage == SimStageBusWrite || event->Stage == SimStageBusXfer;
+
+		fprintf(File, ",\n{\"name\": \"%s", SimStageNames[event->Stage]);
+		if (bus) {
+			fprintf(File, " 0x%04X", event->Data);
+		}
+		fprintf(File, "\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.1f, \"dur\": %.1f, "
+			"\"args\": {\"failed\": %d, \"boot\": %u",
+			bus ? "bus" : "stage", event->Tid, event->Start / 10.0, (event->End - event->Start) / 10.0,
+			event->Status, event->Boot);
+		if (bus) {
+			fprintf(File, ", \"attempts\": %u}}", event->Attempts);
+		}
+		else {
+			fprintf(File, ", \"transfers\": %u, \"bus_us\": %.1f}}", event->Transfers, event->BusTime / 10.0);
+		}
+	}
+	fprintf(File, "\n]}\n");
+}
+
+static void
+SimSummary(
+	const SIM* Sim
+)
+{
+	uint64_t bootEnd = 0;
+
+	for (uint32_t i = 0; i < Sim->Count; i++) {
+		if (Sim->Events[i].Boot && Sim->Events[i].Stage == SimStageSelfManagedIoInit) {
+			bootEnd = Sim->Events[i].End;
+		}
+	}
+	printf("boot: %.2f ms from DriverEntry to the end of SelfManagedIoInit\n\n", bootEnd / 10000.0);
+
+	printf("%-18s %-6s %6s %10s %10s %10s %9s\n", "stage", "phase", "count", "mean-us", "max-us", "bus-us", "transfers");
+	for (int boot = 1; boot >= 0; boot--) {
+		for (unsigned stage = 0; stage < SimStageMax; stage++) {
+			uint64_t count = 0;
+			uint64_t total = 0;
+			uint64_t max = 0;
+			uint64_t busTime = 0;
+			uint64_t transfers = 0;
+
+			if (stage == SimStageBusWrite || stage == SimStageBusXfer) {
+				continue;
+			}
+			for (uint32_t i = 0; i < Sim->Count; i++) {
+				const SIM_EVENT* event = &Sim->Events[i];
+				uint64_t duration = event->End - event->Start;
+
+				if (event->Stage != stage || event->Boot != boot) {
+					continue;
+				}
+				count++;
+				total += duration;
+				busTime += event->BusTime;
+				transfers += event->Transfers;
+				if (duration > max) {
+					max = duration;
+				}
+			}
+			if (count == 0) {
+				continue;
+			}
+			printf("%-18s %-6s %6llu %10.1f %10.1f %10.1f %9.1f\n",
+				SimStageNames[stage], boot ? "boot" : "resume",
+				(unsigned long long)count,
+				total / 10.0 / count,
+				max / 10.0,
+				busTime / 10.0 / count,
+				(double)transfers / count);
+		}
+	}
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	SIM_CONFIG config = { "gmaxboot.json", 1, SimTuningRegistry, 3, 5000, 2, 0, 1 };
+	static SIM sim;
+	FILE* file;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "-o")) {
+			config.Output = argv[i + 1];
+		}
+		else if (!strcmp(argv[i], "-cache")) {
+			config.CacheHit = !strcmp(argv[i + 1], "hit");
+		}
+		else if (!strcmp(argv[i], "-tuning")) {
+			config.Tuning = !strcmp(argv[i + 1], "none") ? SimTuningNone :
+				!strcmp(argv[i + 1], "file") ? SimTuningFile : SimTuningRegistry;
+		}
+		else if (!strcmp(argv[i], "-resumes")) {
+			config.Resumes = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-sleep-ms")) {
+			config.SleepMs = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-settle-us")) {
+			config.SettleUs = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-nack")) {
+			config.Nack = atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-seed")) {
+			config.Seed = strtoull(argv[i + 1], NULL, 0);
+		}
+		else {
+			break;
+		}
+	}
+
+	if ((argc % 2) == 0) {
+		fprintf(stderr, "usage: %s [-o file] [-cache hit|miss] [-tuning none|registry|file] "
+			"[-resumes n] [-sleep-ms ms] [-settle-us us] [-nack p] [-seed n]\n", argv[0]);
+		return 2;
+	}
+
+	sim.Config = config;
+	sim.Random = config.Seed * 0x94D049BB133111EBULL | 1;
+	sim.Tid = SIM_TID_PNP;
+	sim.Boot = 1;
+
+	//
+	// A tuning profile adds registers after the init image
+	//
+	for (uint32_t i = 0; i < sizeof(SimImageRegs) / sizeof(SimImageRegs[0]); i++) {
+		GmaxTuningSet(&sim.Image, SimImageRegs[i], SimImageValues[i], 0xFF);
+	}
+	if (config.Tuning != SimTuningNone) {
+		for (uint16_t reg = 0x0080; reg < 0x00A0; reg++) {
+			GmaxTuningSet(&sim.Image, reg, (uint8_t)reg, 0xFF);
+		}
+	}
+	GmaxTuningCompile(&sim.Image);
+
+	SimDriverStart(&sim);
+
+	for (uint32_t r = 0; r < config.Resumes; r++) {
+		sim.Now += SIM_MS(GMAX_IDLE_TIMEOUT_MS);
+		SimD0Exit(&sim);
+		sim.Now += SIM_MS(config.SleepMs);
+		SimD0Entry(&sim);
+		SimPowerWorkItem(&sim);
+	}
+
+	file = fopen(config.Output, "w");
+	if (!file) {
+		fprintf(stderr, "unable to open %s\n", config.Output);
+		return 1;
+	}
+	SimWriteTrace(&sim, file);
+	fclose(file);
+
+	printf("gmaxboottrace: cache %s, tuning %s, %u resumes, settle %u us, nack %g, seed %llu\n",
+		config.CacheHit ? "hit" : "miss",
+		config.Tuning == SimTuningNone ? "none" : config.Tuning == SimTuningFile ? "file" : "registry",
+		config.Resumes, config.SettleUs, config.Nack, (unsigned long long)config.Seed);
+	printf("%u trace events written to %s\n", sim.Count, config.Output);
+	SimSummary(&sim);
+	return 0;
+}
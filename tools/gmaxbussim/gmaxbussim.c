@@ -0,0 +1,371 @@
+/*++
+
+Module Name:
+
+gmaxbussim.c
+
+Abstract:
+
+Resume latency under injected bus faults. Each simulated resume is the
+OnD0Entry register sequence, run once the way the driver used to (no
+send timeout, no retry) and once through the deadline, retry and
+circuit breaker policy in spbretry.h, on the same fault stream.
+
+Faults per attempt are a NACK (fails fast) or a hung transfer (the
+controller never completes it). A resume may also start on a wedged
+bus that stays dead for a while, which is what turns hung transfers
+into hung resumes.
+
+Usage: gmaxbussim [-n resumes] [-t transfers] [-nack p] [-hang p]
+	[-wedge p] [-wedge-ms ms] [-seed n]
+
+Environment:
+
+Host, portable C
+
+--*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../opengmaxcodec/spbretry.h"
+
+#define GMAX_RESUME_DEADLINE_MS 100	// opengmaxcodec/codecstate.h
+#define GMAX_RECOVERY_DEADLINE_MS 200
+#define SIM_TRANSFER_US 150
+#define SIM_NACK_US 60
+#define SIM_RESUME_GAP_MS 10000		// idle time between resumes
+
+typedef struct _SIM_CONFIG {
+	uint32_t Resumes;
+	uint32_t Transfers;
+	double Nack;
+	double Hang;
+	double Wedge;
+	uint32_t WedgeMs;
+	uint64_t Seed;
+} SIM_CONFIG;
+
+typedef enum {
+	SimOk,
+	SimNack,
+	SimHang
+} SIM_OUTCOME;
+
+typedef struct _SIM_RESULT {
+	uint64_t* LatencyUs;
+	uint64_t* ReadyUs;	// until the codec runs
+	uint32_t Failed;	// legacy: D0Entry failed, policy: handed to recovery
+	uint32_t Trips;
+	uint64_t Attempts;
+} SIM_RESULT;
+
+static uint64_t
+SimRandom(
+	uint64_t* State
+)
+{
+	// xorshift64*
+	*State ^= *State >> 12;
+	*State ^= *State << 25;
+	*State ^= *State >> 27;
+	return *State * 2685821657736338717ULL;
+}
+
+static double
+SimUniform(
+	uint64_t* State
+)
+{
+	return (SimRandom(State) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//
+// Fault for one attempt starting at Now (us into the resume). The
+// stream is keyed on the resume and attempt so both runs see the same
+// faults for the same attempt.
+//
+static SIM_OUTCOME
+SimFault(
+	const SIM_CONFIG* Config,
+	uint64_t Resume,
+	uint64_t Attempt,
+	uint64_t WedgeEndUs,
+	uint64_t Now
+)
+{
+	uint64_t state = (Config->Seed ^ (Resume * 0x9E3779B97F4A7C15ULL) ^ (Attempt * 0xBF58476D1CE4E5B9ULL)) | 1;
+	double u;
+
+	if (Now < WedgeEndUs) {
+		return SimHang;
+	}
+
+	u = SimUniform(&state);
+	if (u < Config->Hang) {
+		return SimHang;
+	}
+	if (u < Config->Hang + Config->Nack) {
+		return SimNack;
+	}
+	return SimOk;
+}
+
+static uint64_t
+SimLegacyResume(
+	const SIM_CONFIG* Config,
+	uint64_t Resume,
+	uint64_t WedgeEndUs,
+	SIM_RESULT* Result
+)
+{
+	uint64_t now = 0;
+
+	for (uint32_t t = 0; t < Config->Transfers; t++) {
+		SIM_OUTCOME fault = SimFault(Config, Resume, t, WedgeEndUs, now);
+
+		Result->Attempts++;
+		if (fault == SimHang) {
+			// Nothing bounds the send; it returns when the bus comes back
+			now = (WedgeEndUs > now ? WedgeEndUs : now + Config->WedgeMs * 1000ULL) + SIM_TRANSFER_US;
+			continue;
+		}
+		if (fault == SimNack) {
+			Result->Failed++;
+			return now + SIM_NACK_US;
+		}
+		now += SIM_TRANSFER_US;
+	}
+
+	return now;
+}
+
+//
+// One bus sequence under the policy: the resume itself or a recovery
+// pass. Returns the time it took and sets *Ok when every transfer went
+// through.
+//
+static uint64_t
+SimPolicySequence(
+	const SIM_CONFIG* Config,
+	uint64_t Resume,
+	uint64_t* Attempt,
+	uint64_t WedgeEndUs,
+	uint64_t StartUs,		// into the resume
+	uint64_t ClockUs,		// of the resume start, for the breaker
+	uint32_t DeadlineMs,
+	SPB_BREAKER* Breaker,
+	uint64_t* Jitter,
+	SIM_RESULT* Result,
+	int* Ok
+)
+{
+	uint64_t deadline = (ClockUs + StartUs + DeadlineMs * 1000ULL) * 10;
+	uint64_t now = StartUs;
+
+	*Ok = 0;
+	for (uint32_t t = 0; t < Config->Transfers; t++) {
+		for (uint32_t a = 0;; a++) {
+			uint64_t now100 = (ClockUs + now) * 10;
+			uint64_t timeout;
+			uint32_t backoff;
+			SIM_OUTCOME fault;
+
+			if (!SpbBreakerAllow(Breaker, now100)) {
+				return now - StartUs;
+			}
+
+			timeout = SpbSendTimeout(now100, deadline);
+			if (timeout == 0) {
+				fault = SimHang;
+			}
+			else {
+				fault = SimFault(Config, Resume, (*Attempt)++, WedgeEndUs, now);
+				Result->Attempts++;
+				now += fault == SimOk ? SIM_TRANSFER_US :
+					fault == SimNack ? SIM_NACK_US :
+					timeout / 10;
+			}
+
+			if (fault == SimOk) {
+				SpbBreakerRecord(Breaker, 1, (ClockUs + now) * 10);
+				break;
+			}
+
+			backoff = SpbBackoffUs(a, (uint32_t)SimRandom(Jitter));
+			if (a + 1 >= SPB_MAX_ATTEMPTS ||
+				SpbSendTimeout((ClockUs + now + backoff) * 10, deadline) == 0) {
+				Result->Trips += SpbBreakerRecord(Breaker, 0, (ClockUs + now) * 10);
+				return now - StartUs;
+			}
+			now += backoff;
+		}
+	}
+
+	*Ok = 1;
+	return now - StartUs;
+}
+
+//
+// Resume latency is when OnD0Entry returns. A failed resume is handed
+// to recovery, which retries when the breaker cooldown ends (or after
+// one base cooldown); *ReadyUs is when the codec finally runs.
+//
+static uint64_t
+SimPolicyResume(
+	const SIM_CONFIG* Config,
+	uint64_t Resume,
+	uint64_t WedgeEndUs,
+	uint64_t ClockUs,
+	SPB_BREAKER* Breaker,
+	uint64_t* Jitter,
+	SIM_RESULT* Result,
+	uint64_t* ReadyUs
+)
+{
+	uint64_t attempt = 0;
+	uint64_t resume;
+	uint64_t now;
+	int ok;
+
+	resume = SimPolicySequence(Config, Resume, &attempt, WedgeEndUs, 0, ClockUs,
+		GMAX_RESUME_DEADLINE_MS, Breaker, Jitter, Result, &ok);
+	now = resume;
+
+	if (!ok) {
+		Result->Failed++;
+	}
+
+	while (!ok) {
+		uint64_t clock100 = (ClockUs + now) * 10;
+
+		if (Breaker->State == SpbBreakerOpen && Breaker->OpenUntil > clock100) {
+			now += (Breaker->OpenUntil - clock100) / 10;
+		}
+		else {
+			now += SPB_BREAKER_COOLDOWN_MS * 1000ULL;
+		}
+
+		now += SimPolicySequence(Config, Resume, &attempt, WedgeEndUs, now, ClockUs,
+			GMAX_RECOVERY_DEADLINE_MS, Breaker, Jitter, Result, &ok);
+	}
+
+	*ReadyUs = now;
+	return resume;
+}
+
+static int
+CompareUint64(
+	const void* A,
+	const void* B
+)
+{
+	uint64_t a = *(const uint64_t*)A;
+	uint64_t b = *(const uint64_t*)B;
+
+	return a < b ? -1 : a > b;
+}
+
+static void
+SimReportRow(
+	const char* Name,
+	const SIM_CONFIG* Config,
+	uint64_t* Latency,
+	const SIM_RESULT* Result
+)
+{
+	uint32_t n = Config->Resumes;
+
+	qsort(Latency, n, sizeof(uint64_t), CompareUint64);
+	printf("%-14s %10.3f %10.3f %10.3f %10.3f %10.3f %8u %6u %10.2f\n",
+		Name,
+		Latency[n / 2] / 1000.0,
+		Latency[(uint64_t)(n - 1) * 99 / 100] / 1000.0,
+		Latency[(uint64_t)(n - 1) * 999 / 1000] / 1000.0,
+		Latency[(uint64_t)(n - 1) * 9999 / 10000] / 1000.0,
+		Latency[n - 1] / 1000.0,
+		Result->Failed,
+		Result->Trips,
+		(double)Result->Attempts / n);
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	SIM_CONFIG config = { 100000, 24, 0.001, 0.0005, 0.001, 2000, 1 };
+	SIM_RESULT legacy = { 0 };
+	SIM_RESULT policy = { 0 };
+	SPB_BREAKER breaker = { 0 };
+	uint64_t jitter = 0x243F6A8885A308D3ULL;
+	uint64_t wedgeRandom;
+	uint64_t clock = 0;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "-n")) {
+			config.Resumes = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-t")) {
+			config.Transfers = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-nack")) {
+			config.Nack = atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-hang")) {
+			config.Hang = atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-wedge")) {
+			config.Wedge = atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-wedge-ms")) {
+			config.WedgeMs = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-seed")) {
+			config.Seed = strtoull(argv[i + 1], NULL, 0);
+		}
+		else {
+			break;
+		}
+	}
+
+	if (config.Resumes == 0 || (argc % 2) == 0) {
+		fprintf(stderr, "usage: %s [-n resumes] [-t transfers] [-nack p] [-hang p] "
+			"[-wedge p] [-wedge-ms ms] [-seed n]\n", argv[0]);
+		return 2;
+	}
+
+	legacy.LatencyUs = (uint64_t*)malloc(config.Resumes * sizeof(uint64_t));
+	policy.LatencyUs = (uint64_t*)malloc(config.Resumes * sizeof(uint64_t));
+	policy.ReadyUs = (uint64_t*)malloc(config.Resumes * sizeof(uint64_t));
+	if (!legacy.LatencyUs || !policy.LatencyUs || !policy.ReadyUs) {
+		return 1;
+	}
+
+	wedgeRandom = config.Seed * 0x94D049BB133111EBULL | 1;
+	for (uint32_t r = 0; r < config.Resumes; r++) {
+		uint64_t wedgeEnd = SimUniform(&wedgeRandom) < config.Wedge ?
+			config.WedgeMs * 1000ULL : 0;
+
+		legacy.LatencyUs[r] = SimLegacyResume(&config, r, wedgeEnd, &legacy);
+		policy.LatencyUs[r] = SimPolicyResume(&config, r, wedgeEnd, clock, &breaker, &jitter, &policy,
+			&policy.ReadyUs[r]);
+		clock += policy.ReadyUs[r] + SIM_RESUME_GAP_MS * 1000ULL;
+	}
+
+	printf("%u resumes of %u transfers, nack %g hang %g per attempt, wedge %g for %u ms\n\n",
+		config.Resumes, config.Transfers, config.Nack, config.Hang, config.Wedge, config.WedgeMs);
+	printf("%-14s %10s %10s %10s %10s %10s %8s %6s %10s\n",
+		"", "p50 ms", "p99 ms", "p99.9 ms", "p99.99 ms", "max ms", "failed", "trips", "attempts");
+	SimReportRow("legacy", &config, legacy.LatencyUs, &legacy);
+	SimReportRow("policy", &config, policy.LatencyUs, &policy);
+	SimReportRow("policy ready", &config, policy.ReadyUs, &policy);
+
+	free(legacy.LatencyUs);
+	free(policy.LatencyUs);
+	free(policy.ReadyUs);
+	return 0;
+}
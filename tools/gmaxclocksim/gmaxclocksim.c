@@ -0,0 +1,309 @@
+/*++
+
+Module Name:
+
+gmaxclocksim.c
+
+Abstract:
+
+Recovery time after the DSP stops and restarts BCLK/LRCLK, on a
+simulated clock source and amp. Each cycle the clock stops for a
+random gap and comes back. The legacy recovery is a D0 cycle (soft
+reset and the full StartCodec sequence) started the moment the clock
+returns. The clock monitor path is what clock.c does: mute on CLK_ERR,
+then on CLK_RECOVER read back two registers and write what
+GmaxClockRecoveryPlan (clkmon.h) asks for. An amp that reset in the
+gap raises no CLK_RECOVER; the sentinel poll finds it at the first
+poll after the clock is back (earlier polls are not credited).
+
+Recovery time runs from the clock restart to audible output, the
+amp's turn-on time after AMP_EN included. The legacy row is a best
+case, it assumes the D0 cycle starts as soon as the clock is back.
+
+Usage: gmaxclocksim [-n cycles] [-t transfers] [-gap-ms ms]
+	[-reset p] [-global p] [-tick-us us] [-seed n]
+
+Environment:
+
+Host, portable C
+
+--*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../opengmaxcodec/clkmon.h"
+
+#define SIM_TRANSFER_US 150		// one register transfer at 400 kHz, as gmaxbussim
+#define SIM_CMON_DETECT_US 40		// clock monitor reaction to a stop or a restart
+#define SIM_IRQ_LATENCY_US 200		// GPIO interrupt to the passive-level ISR
+#define SIM_AMP_TURN_ON_US 1000		// AMP_EN to output
+#define SIM_TIMER_MIN_MS 1		// GmaxRecoverySchedule(pDevice, 1)
+
+#define SIM_SENTINEL_IMAGE 0x58		// PCM_MODE_CFG as written by StartCodec
+#define SIM_GLOBAL_EN 0x01
+
+typedef struct _SIM_CONFIG {
+	uint32_t Cycles;
+	uint32_t Transfers;		// StartCodec, rev ID through AMP_EN
+	uint32_t GapMs;
+	double Reset;			// amp resets while the clock is gone
+	double Global;			// amp drops GLOBAL_EN while the clock is gone
+	uint32_t TickUs;		// system timer resolution
+	uint64_t Seed;
+} SIM_CONFIG;
+
+typedef struct _SIM_RESULT {
+	uint64_t* RecoveryUs;
+	uint64_t Transfers;
+	uint32_t Plans[GmaxClockRestart + 1];
+} SIM_RESULT;
+
+static uint64_t
+SimRandom(
+	uint64_t* State
+)
+{
+	// xorshift64*
+	*State ^= *State >> 12;
+	*State ^= *State << 25;
+	*State ^= *State >> 27;
+	return *State * 2685821657736338717ULL;
+}
+
+static double
+SimUniform(
+	uint64_t* State
+)
+{
+	return (SimRandom(State) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//
+// KeDelayExecutionThread for less than a tick sleeps until the next one
+//
+static uint64_t
+SimTickSleep(
+	const SIM_CONFIG* Config,
+	uint64_t* Random
+)
+{
+	return 1 + (uint64_t)(SimUniform(Random) * Config->TickUs);
+}
+
+//
+// Soft reset, then StartCodec: the image and runtime registers, then
+// GLOBAL_EN, the settle sleep and AMP_EN. Returns the time to AMP_EN.
+//
+static uint64_t
+SimFullStart(
+	const SIM_CONFIG* Config,
+	uint64_t* Random,
+	SIM_RESULT* Result
+)
+{
+	uint32_t transfers = 1 + Config->Transfers;
+
+	Result->Transfers += transfers;
+	return (uint64_t)transfers * SIM_TRANSFER_US + SimTickSleep(Config, Random);
+}
+
+static uint64_t
+SimLegacyRecovery(
+	const SIM_CONFIG* Config,
+	uint64_t* Random,
+	SIM_RESULT* Result
+)
+{
+	return SimFullStart(Config, Random, Result) + SIM_AMP_TURN_ON_US;
+}
+
+//
+// The clock monitor path from the clock restart. The CLK_ERR handling
+// (interrupt service and the mute) may still be running when the clock
+// comes back after a short gap.
+//
+static uint64_t
+SimClockRecovery(
+	const SIM_CONFIG* Config,
+	uint64_t GapUs,
+	int Reset,
+	int GlobalDropped,
+	uint64_t* Random,
+	SIM_RESULT* Result
+)
+{
+	uint64_t lossDone = SIM_CMON_DETECT_US + SIM_IRQ_LATENCY_US + 3 * SIM_TRANSFER_US;
+	uint64_t now = SIM_CMON_DETECT_US + SIM_IRQ_LATENCY_US;
+	GMAX_CLOCK_PLAN plan;
+
+	Result->Transfers += 3;
+	if (lossDone > GapUs + now) {
+		now = lossDone - GapUs;
+	}
+
+	if (Reset) {
+		//
+		// No interrupt: the next sentinel poll, then the recovery timer
+		//
+		now += (uint64_t)(SimUniform(Random) * GMAX_CLOCK_POLL_MS * 1000) + SIM_TRANSFER_US;
+		now += ((SIM_TIMER_MIN_MS * 1000ULL + Config->TickUs - 1) / Config->TickUs) * Config->TickUs;
+		now += SimFullStart(Config, Random, Result);
+		Result->Transfers++;
+		Result->Plans[GmaxClockRestart]++;
+		return now + SIM_AMP_TURN_ON_US;
+	}
+
+	//
+	// Flag read and clear, then the read-back
+	//
+	now += (2 + GMAX_CLOCK_RECOVERY_READS) * SIM_TRANSFER_US;
+	Result->Transfers += 2 + GMAX_CLOCK_RECOVERY_READS;
+
+	plan = GmaxClockRecoveryPlan(
+		SIM_SENTINEL_IMAGE,
+		SIM_SENTINEL_IMAGE,
+		GlobalDropped ? 0 : SIM_GLOBAL_EN,
+		SIM_GLOBAL_EN);
+	Result->Plans[plan]++;
+
+	switch (plan) {
+	case GmaxClockAmpEnable:
+		now += SIM_TRANSFER_US;
+		Result->Transfers++;
+		break;
+	case GmaxClockPowerUp:
+		now += 2 * SIM_TRANSFER_US + SimTickSleep(Config, Random);
+		Result->Transfers += 2;
+		break;
+	default:
+		//
+		// Recovery timer, rounded up to the tick
+		//
+		now += ((SIM_TIMER_MIN_MS * 1000ULL + Config->TickUs - 1) / Config->TickUs) * Config->TickUs;
+		now += SimFullStart(Config, Random, Result);
+		break;
+	}
+
+	return now + SIM_AMP_TURN_ON_US;
+}
+
+static int
+CompareUint64(
+	const void* A,
+	const void* B
+)
+{
+	uint64_t a = *(const uint64_t*)A;
+	uint64_t b = *(const uint64_t*)B;
+
+	return a < b ? -1 : a > b;
+}
+
+static void
+SimReportRow(
+	const char* Name,
+	const SIM_CONFIG* Config,
+	SIM_RESULT* Result
+)
+{
+	uint64_t* r = Result->RecoveryUs;
+	uint32_t n = Config->Cycles;
+
+	qsort(r, n, sizeof(uint64_t), CompareUint64);
+	printf("%-10s %10.3f %10.3f %10.3f %10.3f %12.2f\n",
+		Name,
+		r[n / 2] / 1000.0,
+		r[(uint64_t)(n - 1) * 99 / 100] / 1000.0,
+		r[(uint64_t)(n - 1) * 999 / 1000] / 1000.0,
+		r[n - 1] / 1000.0,
+		(double)Result->Transfers / n);
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	SIM_CONFIG config = { 100000, 24, 500, 0.001, 0.01, 15625, 1 };
+	SIM_RESULT legacy = { 0 };
+	SIM_RESULT clock = { 0 };
+	uint64_t random;
+	uint64_t legacyRandom;
+	uint64_t clockRandom;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "-n")) {
+			config.Cycles = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-t")) {
+			config.Transfers = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-gap-ms")) {
+			config.GapMs = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-reset")) {
+			config.Reset = atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-global")) {
+			config.Global = atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-tick-us")) {
+			config.TickUs = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-seed")) {
+			config.Seed = strtoull(argv[i + 1], NULL, 0);
+		}
+		else {
+			break;
+		}
+	}
+
+	if (config.Cycles == 0 || config.TickUs == 0 || (argc % 2) == 0) {
+		fprintf(stderr, "usage: %s [-n cycles] [-t transfers] [-gap-ms ms] [-reset p] "
+			"[-global p] [-tick-us us] [-seed n]\n", argv[0]);
+		return 2;
+	}
+
+	legacy.RecoveryUs = (uint64_t*)malloc(config.Cycles * sizeof(uint64_t));
+	clock.RecoveryUs = (uint64_t*)malloc(config.Cycles * sizeof(uint64_t));
+	if (!legacy.RecoveryUs || !clock.RecoveryUs) {
+		return 1;
+	}
+
+	random = config.Seed * 0x94D049BB133111EBULL | 1;
+	legacyRandom = random ^ 0x243F6A8885A308D3ULL;
+	clockRandom = random ^ 0x13198A2E03707344ULL;
+
+	for (uint32_t c = 0; c < config.Cycles; c++) {
+		//
+		// Clock gap, exponential around -gap-ms, and what the amp did
+		// while it was gone
+		//
+		uint64_t gapUs = (uint64_t)(-(double)config.GapMs * 1000.0 * log1p(-SimUniform(&random) * 0.999999));
+		double u = SimUniform(&random);
+		int reset = u < config.Reset;
+		int globalDropped = !reset && u < config.Reset + config.Global;
+
+		legacy.RecoveryUs[c] = SimLegacyRecovery(&config, &legacyRandom, &legacy);
+		clock.RecoveryUs[c] = SimClockRecovery(&config, gapUs, reset, globalDropped, &clockRandom, &clock);
+	}
+
+	printf("%u clock restarts, gap %u ms mean, amp reset %g, GLOBAL_EN dropped %g, tick %u us, "
+		"StartCodec %u transfers\n\n",
+		config.Cycles, config.GapMs, config.Reset, config.Global, config.TickUs, config.Transfers);
+	printf("%-10s %10s %10s %10s %10s %12s\n",
+		"", "p50 ms", "p99 ms", "p99.9 ms", "max ms", "transfers");
+	SimReportRow("legacy", &config, &legacy);
+	SimReportRow("clkmon", &config, &clock);
+	printf("\nplans: AMP_EN only %u, power-up %u, full restart %u\n",
+		clock.Plans[GmaxClockAmpEnable], clock.Plans[GmaxClockPowerUp], clock.Plans[GmaxClockRestart]);
+
+	free(legacy.RecoveryUs);
+	free(clock.RecoveryUs);
+	return 0;
+}
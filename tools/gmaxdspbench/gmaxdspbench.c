@@ -0,0 +1,1279 @@
+/*++
+
+Module Name:
+
+gmaxdspbench.c
+
+Abstract:
+
+Equivalence checks and throughput of the gmaxdsp kernels. Every ISA
+path this CPU and build support is run on the same synthetic input as
+the scalar reference and compared with it, then timed.
+
+iv: IV-sense sums over TDM captures of sine V and I with noise, in
+every container, for frame counts around the vector widths and the
+float flush interval. The vector paths accumulate in float for up to
+GMAX_IV_FLUSH_FRAMES frames, so they are held to the float rounding of
+that many terms rather than to bit equality. Re from gmax_iv_process
+must also land on the synthetic coil resistance.
+
+thermal: closes the loop around gmax_thermal_update with a one-mass
+coil driven past its limit, IV-sense smoothing included, and fails if
+the coil overshoots MaxC. Then times the update for every amp.
+
+tdm: pack and unpack on every path must match the scalar bytes and
+round trip to the container's precision. The register images StartCodec
+writes (tdmslots.h) must place VMON and IMON in their own slots, IMON
+on the slot it was given rather than slot 0, leave IMON off in
+interleave mode and handle slots 8-15. Driving frames from those images
+and decoding them must give back every sample, across two decode calls.
+When the split falls inside an interleaved pair, the IMON half in the
+second call is dropped, as gmax_tdm_sim_decode documents, and must not
+be written anywhere.
+
+convert: every container pair, with and without dither, must give the
+scalar bytes on every path, including full scale inputs that saturate.
+The result must not depend on how the stream is split into calls.
+Throughput is timed for the common 24-in-32 to 16-bit narrowing.
+
+guard: programme at -20 dBFS with full scale bursts, fed in 10 ms
+calls. Every path must make the same decisions as scalar. Each burst
+must be attenuated by its first sample (lead). The guard decides within
+two windows of a frame going in, but a decision only comes back when
+the call that made it returns, so the decision delay is bounded by two
+windows plus one call less a frame (959 frames at a 5 ms window and
+10 ms calls).
+Throughput and the time one 10 ms call takes are reported for mono
+and stereo.
+
+Throughput is reported in frames (or samples) per second and as a
+multiple of real time at 48 kHz.
+
+Usage: gmaxdspbench [-test all|iv|thermal|tdm|convert|guard] [-ms per-measurement] [-seed n]
+
+Builds with the gmaxdsp sources and libm, e.g. from the repository root
+gcc -std=c11 -O2 tools/gmaxdspbench/gmaxdspbench.c gmaxdsp/[a-z]*.c -lm
+
+Environment:
+
+Host, portable C11
+
+--*/
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../gmaxdsp/dsp_internal.h"
+#include "../../opengmaxcodec/max98512.h"
+
+#define BENCH_RATE 48000
+#define BENCH_PI 3.14159265358979323846
+
+//
+// IV-sense capture: 8 slots, amp 0 on slots 0/1, amp 1 interleaved
+// in slot 4
+//
+#define BENCH_IV_SLOTS 8
+#define BENCH_IV_FRAMES 48000
+#define BENCH_IV_RE 6.0			// ohms
+#define BENCH_IV_VOLTS_FS 14.0
+#define BENCH_IV_AMPS_FS 3.0
+
+//
+// A float sum of n terms of one sign is within n * FLT_EPSILON of the
+// exact sum, relative to it
+//
+#define BENCH_IV_TOLERANCE (GMAX_IV_FLUSH_FRAMES * FLT_EPSILON)
+
+//
+// Thermal loop: 10 ms blocks for two minutes at 5 W into a coil that
+// would settle at 175 C unprotected
+//
+#define BENCH_THERMAL_BLOCK_MS 10.0f
+#define BENCH_THERMAL_SECONDS 120
+#define BENCH_THERMAL_POWER 5.0f
+#define BENCH_THERMAL_OVERSHOOT 1.0f	// C over MaxC allowed for quantization
+
+typedef struct _BENCH_CONFIG {
+	uint32_t Ms;
+	uint64_t Seed;
+} BENCH_CONFIG;
+
+static const GMAX_DSP_ISA BenchIsas[] = {
+	GmaxDspIsaScalar, GmaxDspIsaSse2, GmaxDspIsaAvx2, GmaxDspIsaNeon
+};
+
+static const char* const BenchIsaNames[GmaxDspIsaMax] = {
+	"auto", "scalar", "sse2", "avx2", "neon"
+};
+
+static const char* const BenchFormatNames[GmaxDspFormatMax] = {
+	"s16", "s24", "s32"
+};
+
+static uint64_t BenchRandom;
+
+static uint64_t
+SimRandom(
+	void
+)
+{
+	BenchRandom ^= BenchRandom << 13;
+	BenchRandom ^= BenchRandom >> 7;
+	BenchRandom ^= BenchRandom << 17;
+	return BenchRandom;
+}
+
+static double
+SimUniform(
+	void
+)
+{
+	return (double)(SimRandom() >> 11) / 9007199254740992.0;
+}
+
+static double
+BenchNow(
+	void
+)
+{
+	struct timespec ts;
+
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//
+// Runs Body until Ms have passed and returns Items per second
+//
+typedef void BENCH_BODY(void* Context);
+
+static double
+BenchRate(
+	BENCH_BODY* Body,
+	void* Context,
+	double Items,
+	uint32_t Ms
+)
+{
+	double start = BenchNow();
+	double elapsed;
+	uint64_t runs = 0;
+
+	do {
+		Body(Context);
+		runs++;
+		elapsed = BenchNow() - start;
+	} while (elapsed * 1000.0 < Ms);
+
+	return runs * Items / elapsed;
+}
+
+//
+// Selects Isa, or returns 0 when this CPU or build does not have it
+//
+static int
+BenchSelect(
+	GMAX_DSP_ISA Isa
+)
+{
+	return gmax_dsp_select_isa(Isa) == Isa;
+}
+
+static double
+BenchSample(
+	double Phase,
+	double Amplitude
+)
+{
+	return Amplitude * sin(Phase) + 0.02 * (SimUniform() - 0.5);
+}
+
+static int32_t
+BenchFixed(
+	double x
+)
+{
+	x = x < -1.0 ? -1.0 : x > 0.999 ? 0.999 : x;
+	return (int32_t)(x * 2147483648.0);
+}
+
+//
+// Capture of Frames TDM frames: a 1 kHz tone at Amplitude of full scale
+// on amp 0 and 250 Hz on amp 1, with I following V through BENCH_IV_RE
+//
+static uint8_t*
+BenchIvCapture(
+	GMAX_DSP_FORMAT Format,
+	size_t Frames,
+	double Amplitude
+)
+{
+	unsigned bytes = gmax_dsp_format_bytes(Format);
+	int32_t* words = calloc(Frames * BENCH_IV_SLOTS, sizeof(int32_t));
+	uint8_t* capture = malloc(Frames * BENCH_IV_SLOTS * bytes);
+	double ratio = BENCH_IV_VOLTS_FS / (BENCH_IV_RE * BENCH_IV_AMPS_FS);
+
+	if (!words || !capture) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+
+	for (size_t f = 0; f < Frames; f++) {
+		int32_t* w = words + f * BENCH_IV_SLOTS;
+		double v0 = BenchSample(2 * BENCH_PI * 1000.0 * f / BENCH_RATE, Amplitude);
+		double v1 = BenchSample(2 * BENCH_PI * 250.0 * (f / 2) / BENCH_RATE, Amplitude);
+
+		w[0] = BenchFixed(v0);
+		w[1] = BenchFixed(v0 * ratio);
+		w[4] = BenchFixed(f & 1 ? v1 * ratio : v1);
+		w[7] = (int32_t)SimRandom();	// another amp's slot, never read
+	}
+
+	gmax_pack_scalar(words, Frames * BENCH_IV_SLOTS, bytes, capture);
+	free(words);
+	return capture;
+}
+
+static void
+BenchIvConfig(
+	GMAX_DSP_FORMAT Format,
+	GMAX_IV_CONFIG* Config
+)
+{
+	memset(Config, 0, sizeof(*Config));
+	Config->SampleRate = BENCH_RATE;
+	Config->SlotCount = BENCH_IV_SLOTS;
+	Config->Format = Format;
+	Config->AmpCount = 2;
+	Config->Amp[0].VmonSlot = 0;
+	Config->Amp[0].ImonSlot = 1;
+	Config->Amp[1].VmonSlot = 4;
+	Config->Amp[1].Interleaved = 1;
+	for (unsigned a = 0; a < 2; a++) {
+		Config->Amp[a].VoltsFullScale = (float)BENCH_IV_VOLTS_FS;
+		Config->Amp[a].AmpsFullScale = (float)BENCH_IV_AMPS_FS;
+	}
+	Config->TimeConstantMs = 100.0f;
+	Config->MinCurrentRms = 0.01f;
+}
+
+static double
+BenchIvError(
+	const double* Sums,
+	const double* Reference
+)
+{
+	double scale = sqrt(Reference[0] * Reference[1]);
+	double error = 0.0;
+
+	for (int k = 0; k < 3; k++) {
+		double e = fabs(Sums[k] - Reference[k]) / (k < 2 ? Reference[k] : scale);
+
+		error = e > error ? e : error;
+	}
+	return error;
+}
+
+typedef struct _BENCH_IV_RUN {
+	GMAX_IV_STATE State;
+	const uint8_t* Capture;
+} BENCH_IV_RUN;
+
+static void
+BenchIvBody(
+	void* Context
+)
+{
+	BENCH_IV_RUN* run = Context;
+
+	gmax_iv_process(&run->State, run->Capture, BENCH_IV_FRAMES);
+}
+
+static int
+BenchIv(
+	const BENCH_CONFIG* Config
+)
+{
+	static const size_t counts[] = {
+		1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 4095, 4096, 4097, 4103, 8193, BENCH_IV_FRAMES
+	};
+	int failures = 0;
+
+	printf("iv: scalar against vector sums, tolerance %.2e\n", BENCH_IV_TOLERANCE);
+
+	for (GMAX_DSP_FORMAT format = 0; format < GmaxDspFormatMax; format++) {
+		uint8_t* capture = BenchIvCapture(format, BENCH_IV_FRAMES, 0.5);
+		GMAX_IV_STATE layout;
+		GMAX_IV_CONFIG config;
+
+		BenchIvConfig(format, &config);
+		gmax_iv_init(&layout, &config);
+
+		for (size_t b = 1; b < sizeof(BenchIsas) / sizeof(BenchIsas[0]); b++) {
+			double worst = 0.0;
+
+			if (!BenchSelect(BenchIsas[b])) {
+				continue;
+			}
+
+			for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+				for (unsigned a = 0; a < config.AmpCount; a++) {
+					size_t stride = layout.FrameBytes * (config.Amp[a].Interleaved ? 2 : 1);
+					size_t frames = config.Amp[a].Interleaved ? counts[c] / 2 : counts[c];
+					double reference[3] = { 0.0, 0.0, 0.0 };
+					double sums[3] = { 0.0, 0.0, 0.0 };
+					double error;
+
+					if (frames == 0) {
+						continue;
+					}
+					gmax_iv_sum_scalar(capture, frames, stride,
+						&layout.Layout[a].V, &layout.Layout[a].I, reference);
+					gmax_dsp_kernels()->IvSum(capture, frames, stride,
+						&layout.Layout[a].V, &layout.Layout[a].I, sums);
+
+					error = BenchIvError(sums, reference);
+					worst = error > worst ? error : worst;
+					if (!(error <= BENCH_IV_TOLERANCE)) {
+						printf("  FAIL %s %s amp %u, %zu frames: error %.3e\n",
+							BenchIsaNames[BenchIsas[b]], BenchFormatNames[format], a, frames, error);
+						failures++;
+					}
+				}
+			}
+			printf("  %-6s %s worst %.3e\n", BenchIsaNames[BenchIsas[b]], BenchFormatNames[format], worst);
+		}
+
+		free(capture);
+	}
+
+	//
+	// End to end: every path recovers the coil resistance, and the
+	// throughput of gmax_iv_process
+	//
+	printf("iv: gmax_iv_process, 2 amps on an %u slot s16 bus, Re %.1f ohm\n", BENCH_IV_SLOTS, BENCH_IV_RE);
+	for (size_t b = 0; b < sizeof(BenchIsas) / sizeof(BenchIsas[0]); b++) {
+		BENCH_IV_RUN run;
+		GMAX_IV_CONFIG config;
+		GMAX_IV_ESTIMATE estimate;
+		uint8_t* capture;
+		double rate;
+
+		if (!BenchSelect(BenchIsas[b])) {
+			printf("  %-6s not available\n", BenchIsaNames[BenchIsas[b]]);
+			continue;
+		}
+
+		capture = BenchIvCapture(GmaxDspFormatS16, BENCH_IV_FRAMES, 0.5);
+		BenchIvConfig(GmaxDspFormatS16, &config);
+		gmax_iv_init(&run.State, &config);
+		run.Capture = capture;
+
+		gmax_iv_process(&run.State, capture, BENCH_IV_FRAMES);
+		for (unsigned a = 0; a < config.AmpCount; a++) {
+			gmax_iv_get_estimate(&run.State, a, &estimate);
+			if (!(fabs(estimate.Re - BENCH_IV_RE) < 0.01 * BENCH_IV_RE)) {
+				printf("  FAIL %s amp %u: Re %.4f\n", BenchIsaNames[BenchIsas[b]], a, estimate.Re);
+				failures++;
+			}
+		}
+
+		rate = BenchRate(BenchIvBody, &run, BENCH_IV_FRAMES, Config->Ms);
+		printf("  %-6s %8.1f Mframes/s  %8.0fx real time  Re %.4f\n",
+			BenchIsaNames[BenchIsas[b]], rate * 1e-6, rate / BENCH_RATE, estimate.Re);
+		free(capture);
+	}
+
+	return failures;
+}
+
+static void
+BenchThermalConfig(
+	GMAX_THERMAL_CONFIG* Config
+)
+{
+	memset(Config, 0, sizeof(*Config));
+	Config->ReAmbient = (float)BENCH_IV_RE;
+	Config->AmbientC = 25.0f;
+	Config->MaxC = 120.0f;
+	Config->TempCoefficient = 0.00393f;
+	Config->ThermalResistance = 30.0f;
+	Config->TimeConstantMs = 2000.0f;
+	Config->HorizonMs = 500.0f;
+	Config->MeasureLagMs = 100.0f;
+	Config->ReleaseDbPerSec = 3.0f;
+	Config->MaxAttenuationDb = 20.0f;
+}
+
+typedef struct _BENCH_THERMAL_RUN {
+	GMAX_THERMAL_STATE State;
+	GMAX_IV_ESTIMATE Estimate[GMAX_DSP_MAX_AMPS];
+	int32_t Sink;
+} BENCH_THERMAL_RUN;
+
+static void
+BenchThermalBody(
+	void* Context
+)
+{
+	BENCH_THERMAL_RUN* run = Context;
+	int changed;
+
+	for (unsigned a = 0; a < GMAX_DSP_MAX_AMPS; a++) {
+		run->Sink += gmax_thermal_update(&run->State, a, &run->Estimate[a], BENCH_THERMAL_BLOCK_MS, &changed);
+		run->Estimate[a].Power = BENCH_THERMAL_POWER - run->Estimate[a].Power;
+	}
+}
+
+static int
+BenchThermal(
+	const BENCH_CONFIG* Config
+)
+{
+	GMAX_THERMAL_CONFIG config;
+	BENCH_THERMAL_RUN run;
+	float lag = 1.0f - expf(-BENCH_THERMAL_BLOCK_MS / 100.0f);
+	float heat;
+	float coil;
+	float measured = 0.0f;
+	float peak;
+	int32_t limit = 0;
+	int32_t maxLimit = 0;
+	uint32_t writes = 0;
+	int failures = 0;
+	double rate;
+
+	BenchThermalConfig(&config);
+	gmax_thermal_init(&run.State, &config);
+	heat = 1.0f - expf(-BENCH_THERMAL_BLOCK_MS / config.TimeConstantMs);
+	coil = config.AmbientC;
+	peak = coil;
+
+	//
+	// Applied power follows the limit at once, the estimate lags it by
+	// the IV-sense smoothing
+	//
+	for (uint32_t block = 0; block < BENCH_THERMAL_SECONDS * 1000 / BENCH_THERMAL_BLOCK_MS; block++) {
+		float power = BENCH_THERMAL_POWER * powf(10.0f, -limit / 1000.0f);
+		GMAX_IV_ESTIMATE estimate = { 0 };
+		int changed;
+
+		coil += (config.AmbientC + power * config.ThermalResistance - coil) * heat;
+		measured += (power - measured) * lag;
+		peak = coil > peak ? coil : peak;
+
+		estimate.Power = measured;
+		estimate.Re = config.ReAmbient * (1.0f + config.TempCoefficient * (coil - config.AmbientC));
+		limit = gmax_thermal_update(&run.State, 0, &estimate, BENCH_THERMAL_BLOCK_MS, &changed);
+		maxLimit = limit > maxLimit ? limit : maxLimit;
+		writes += changed;
+	}
+
+	printf("thermal: %.1f W for %u s, max %.0f C: peak %.2f C, final %.2f C, limit %.2f dB (max %.2f), %u writes\n",
+		BENCH_THERMAL_POWER, BENCH_THERMAL_SECONDS, config.MaxC, peak, coil,
+		limit / 100.0, maxLimit / 100.0, writes);
+	if (peak > config.MaxC + BENCH_THERMAL_OVERSHOOT) {
+		printf("  FAIL coil overshoots MaxC by %.2f C\n", peak - config.MaxC);
+		failures++;
+	}
+	if (limit == 0) {
+		printf("  FAIL no attenuation at a power that would settle at %.0f C\n",
+			config.AmbientC + BENCH_THERMAL_POWER * config.ThermalResistance);
+		failures++;
+	}
+
+	gmax_thermal_init(&run.State, &config);
+	run.Sink = 0;
+	for (unsigned a = 0; a < GMAX_DSP_MAX_AMPS; a++) {
+		memset(&run.Estimate[a], 0, sizeof(run.Estimate[a]));
+		run.Estimate[a].Power = 0.5f * (a + 1);
+		run.Estimate[a].Re = a & 1 ? 0.0f : config.ReAmbient * 1.2f;
+	}
+	rate = BenchRate(BenchThermalBody, &run, GMAX_DSP_MAX_AMPS, Config->Ms);
+	printf("  gmax_thermal_update %.1f M/s, %.1f ns per amp block\n", rate * 1e-6, 1e9 / rate);
+
+	return failures;
+}
+
+static int
+BenchTdmPack(
+	void
+)
+{
+	static const size_t counts[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 1000, 4099 };
+	enum { Max = 4099 };
+	int32_t* in = malloc(Max * sizeof(int32_t));
+	int32_t* out = malloc(Max * sizeof(int32_t));
+	uint8_t* reference = malloc(Max * 4 + 1);
+	uint8_t* packed = malloc(Max * 4 + 1);
+	int failures = 0;
+
+	if (!in || !out || !reference || !packed) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+	for (size_t n = 0; n < Max; n++) {
+		in[n] = (int32_t)SimRandom();
+	}
+	in[0] = INT32_MIN;
+	in[1] = INT32_MAX;
+
+	for (size_t b = 0; b < sizeof(BenchIsas) / sizeof(BenchIsas[0]); b++) {
+		int bad = 0;
+
+		if (!BenchSelect(BenchIsas[b])) {
+			continue;
+		}
+
+		for (GMAX_DSP_FORMAT format = 0; format < GmaxDspFormatMax; format++) {
+			unsigned bytes = gmax_dsp_format_bytes(format);
+			uint32_t mask = 0xFFFFFFFFu << (32 - 8 * bytes);
+
+			for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+				size_t count = counts[c];
+
+				//
+				// A guard byte past the end catches stores beyond Count
+				//
+				reference[count * bytes] = 0xA5;
+				packed[count * bytes] = 0xA5;
+				gmax_pack_scalar(in, count, bytes, reference);
+				gmax_tdm_pack(in, count, format, packed);
+				gmax_tdm_unpack(packed, count, format, out);
+
+				if (memcmp(reference, packed, count * bytes + 1)) {
+					printf("  FAIL %s %s pack of %zu differs from scalar\n",
+						BenchIsaNames[BenchIsas[b]], BenchFormatNames[format], count);
+					bad++;
+					continue;
+				}
+				for (size_t n = 0; n < count; n++) {
+					if ((uint32_t)out[n] != ((uint32_t)in[n] & mask)) {
+						printf("  FAIL %s %s unpack of %zu, sample %zu: %08x for %08x\n",
+							BenchIsaNames[BenchIsas[b]], BenchFormatNames[format], count, n,
+							(unsigned)out[n], (unsigned)in[n] & mask);
+						bad++;
+						break;
+					}
+				}
+			}
+		}
+		printf("  %-6s pack/unpack %s\n", BenchIsaNames[BenchIsas[b]], bad ? "FAILED" : "bit exact");
+		failures += bad;
+	}
+
+	free(in);
+	free(out);
+	free(reference);
+	free(packed);
+	return failures;
+}
+
+//
+// Slot layouts StartCodec can be given, one entry per amp on the bus
+//
+typedef struct _BENCH_TDM_BUS {
+	unsigned Slots;
+	unsigned Amps;
+	uint8_t Vmon[4];
+	uint8_t Imon[4];
+	uint8_t Interleave[4];
+} BENCH_TDM_BUS;
+
+static const BENCH_TDM_BUS BenchTdmBuses[] = {
+	{ 4, 2, { 0, 2 }, { 1, 3 }, { 0, 0 } },
+	{ 8, 2, { 1, 6 }, { 5, 2 }, { 0, 0 } },		// IMON below VMON, amps interlocked
+	{ 4, 2, { 0, 1 }, { 3, 3 }, { 1, 1 } },		// interleaved, IMON slot given but unused
+	{ 16, 3, { 8, 14, 3 }, { 9, 15, 0 }, { 0, 0, 1 } },	// slots in PCM_TX_EN_B
+	{ 16, 4, { 0, 4, 10, 13 }, { 1, 5, 11, 13 }, { 0, 0, 0, 1 } },
+};
+
+static int
+BenchTdmCheckSlots(
+	const BENCH_TDM_BUS* Bus,
+	const GMAX_TDM_SIM* Sim
+)
+{
+	int failures = 0;
+
+	for (unsigned a = 0; a < Bus->Amps; a++) {
+		const GMAX_TDM_SLOT* v = &Sim->Slot[Bus->Vmon[a]];
+		const GMAX_TDM_SLOT* i = &Sim->Slot[Bus->Imon[a]];
+
+		if (v->Amp != (int)a || v->Current != 0 || v->Interleaved != Bus->Interleave[a]) {
+			printf("  FAIL amp %u: VMON slot %u holds amp %d current %u\n",
+				a, Bus->Vmon[a], v->Amp, v->Current);
+			failures++;
+		}
+		if (Bus->Interleave[a]) {
+			if (Bus->Imon[a] != Bus->Vmon[a] && i->Amp == (int)a) {
+				printf("  FAIL amp %u: interleaved but still drives IMON slot %u\n", a, Bus->Imon[a]);
+				failures++;
+			}
+		}
+		else if (i->Amp != (int)a || i->Current != 1) {
+			printf("  FAIL amp %u: IMON slot %u holds amp %d current %u\n",
+				a, Bus->Imon[a], i->Amp, i->Current);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+static int
+BenchTdmRoundTrip(
+	const GMAX_TDM_SIM* Sim,
+	const BENCH_TDM_BUS* Bus,
+	uint64_t FirstFrame,
+	size_t Frames
+)
+{
+	unsigned bytes = gmax_dsp_format_bytes(Sim->Format);
+	uint32_t mask = 0xFFFFFFFFu << (32 - 8 * bytes);
+	uint8_t* frames = malloc(Frames * Sim->SlotCount * bytes);
+	int32_t* samples[4][4];
+	int failures = 0;
+
+	if (!frames) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+	for (unsigned a = 0; a < Bus->Amps; a++) {
+		for (int k = 0; k < 4; k++) {
+			samples[a][k] = calloc(Frames + 1, sizeof(int32_t));
+			if (!samples[a][k]) {
+				fprintf(stderr, "out of memory\n");
+				exit(2);
+			}
+		}
+		for (size_t n = 0; n < Frames; n++) {
+			samples[a][0][n] = (int32_t)(SimRandom() & mask);
+			samples[a][1][n] = (int32_t)(SimRandom() & mask);
+		}
+	}
+
+	//
+	// Driven in one call, decoded in two split at an odd frame, which
+	// splits an interleaved pair for one of the two FirstFrame phases
+	//
+	{
+		const int32_t* v[4] = { samples[0][0], samples[1][0], samples[2][0], samples[3][0] };
+		const int32_t* i[4] = { samples[0][1], samples[1][1], samples[2][1], samples[3][1] };
+		int32_t* vOut[4] = { samples[0][2], samples[1][2], samples[2][2], samples[3][2] };
+		int32_t* iOut[4] = { samples[0][3], samples[1][3], samples[2][3], samples[3][3] };
+		size_t split = Frames / 3 | 1;
+		uint64_t second = FirstFrame + split;
+
+		gmax_tdm_sim_drive(Sim, v, i, FirstFrame, Frames, frames);
+		gmax_tdm_sim_decode(Sim, frames, FirstFrame, split, vOut, iOut);
+		for (unsigned a = 0; a < Bus->Amps; a++) {
+			size_t done = Bus->Interleave[a] ?
+				(size_t)(second + (second & 1) - (FirstFrame + (FirstFrame & 1))) / 2 : split;
+
+			vOut[a] += done;
+			iOut[a] += done;
+		}
+		gmax_tdm_sim_decode(Sim, frames + split * Sim->SlotCount * bytes,
+			second, Frames - split, vOut, iOut);
+	}
+
+	for (unsigned a = 0; a < Bus->Amps; a++) {
+		uint64_t first = FirstFrame + (FirstFrame & 1);
+		size_t pairs = FirstFrame + Frames > first ? (size_t)(FirstFrame + Frames - first) / 2 : 0;
+		size_t count = Bus->Interleave[a] ? pairs : Frames;
+		uint64_t second = FirstFrame + (Frames / 3 | 1);
+		size_t dropped = Bus->Interleave[a] && (second & 1) ? (size_t)(second - first) / 2 : SIZE_MAX;
+
+		for (size_t n = 0; n < count; n++) {
+			int32_t expectI = n == dropped ? 0 : samples[a][1][n];
+
+			if (samples[a][2][n] != samples[a][0][n] || samples[a][3][n] != expectI) {
+				printf("  FAIL %u slots %s amp %u from frame %llu: sample %zu of %zu differs\n",
+					Sim->SlotCount, BenchFormatNames[Sim->Format], a,
+					(unsigned long long)FirstFrame, n, count);
+				failures++;
+				break;
+			}
+		}
+		for (int k = 0; k < 4; k++) {
+			free(samples[a][k]);
+		}
+	}
+
+	free(frames);
+	return failures;
+}
+
+typedef struct _BENCH_TDM_RUN {
+	const GMAX_TDM_SIM* Sim;
+	const int32_t* V[2];
+	const int32_t* I[2];
+	int32_t* VOut[2];
+	int32_t* IOut[2];
+	uint8_t* Frames;
+} BENCH_TDM_RUN;
+
+static void
+BenchTdmBody(
+	void* Context
+)
+{
+	BENCH_TDM_RUN* run = Context;
+
+	gmax_tdm_sim_drive(run->Sim, run->V, run->I, 0, BENCH_IV_FRAMES, run->Frames);
+	gmax_tdm_sim_decode(run->Sim, run->Frames, 0, BENCH_IV_FRAMES, run->VOut, run->IOut);
+}
+
+static int
+BenchTdm(
+	const BENCH_CONFIG* Config
+)
+{
+	static const uint8_t chansz[GmaxDspFormatMax] = {
+		MAX98512_PCM_MODE_CFG_CHANSZ_16, MAX98512_PCM_MODE_CFG_CHANSZ_24, MAX98512_PCM_MODE_CFG_CHANSZ_32
+	};
+	GMAX_TDM_REGS regs[4];
+	GMAX_TDM_SIM sim;
+	char error[128];
+	int failures = 0;
+
+	printf("tdm: pack/unpack against scalar\n");
+	failures += BenchTdmPack();
+
+	printf("tdm: StartCodec slot maps, driven and decoded on every path\n");
+	for (size_t b = 0; b < sizeof(BenchIsas) / sizeof(BenchIsas[0]); b++) {
+		int bad = 0;
+
+		if (!BenchSelect(BenchIsas[b])) {
+			continue;
+		}
+
+		for (size_t k = 0; k < sizeof(BenchTdmBuses) / sizeof(BenchTdmBuses[0]); k++) {
+			const BENCH_TDM_BUS* bus = &BenchTdmBuses[k];
+
+			for (GMAX_DSP_FORMAT format = 0; format < GmaxDspFormatMax; format++) {
+				for (unsigned a = 0; a < bus->Amps; a++) {
+					uint8_t* mode = &regs[a].Reg[MAX98512_R0020_PCM_MODE_CFG - GMAX_TDM_REG_FIRST];
+
+					gmax_tdm_driver_image(bus->Vmon[a], bus->Imon[a], bus->Interleave[a], &regs[a]);
+					*mode = (*mode & ~MAX98512_PCM_MODE_CFG_CHANSZ_MASK) | chansz[format];
+				}
+				if (gmax_tdm_sim_init(&sim, regs, bus->Amps, bus->Slots, error, sizeof(error))) {
+					printf("  FAIL bus %zu %s: %s\n", k, BenchFormatNames[format], error);
+					bad++;
+					continue;
+				}
+				bad += BenchTdmCheckSlots(bus, &sim);
+				bad += BenchTdmRoundTrip(&sim, bus, 0, 1001);
+				bad += BenchTdmRoundTrip(&sim, bus, 7, 600);
+			}
+		}
+		printf("  %-6s %zu buses x 3 containers %s\n", BenchIsaNames[BenchIsas[b]],
+			sizeof(BenchTdmBuses) / sizeof(BenchTdmBuses[0]), bad ? "FAILED" : "bit exact");
+		failures += bad;
+	}
+
+	//
+	// The image from before the slot fix: imon-slot-no read into the
+	// VMON slot, IMON left at slot 0 and still enabled
+	//
+	gmax_tdm_driver_image(1, 0, 0, &regs[0]);
+	gmax_tdm_driver_image(0, 1, 0, &regs[1]);
+	if (!gmax_tdm_sim_init(&sim, regs, 2, 4, error, sizeof(error))) {
+		printf("  FAIL two amps with swapped VMON/IMON on the same slots accepted\n");
+		failures++;
+	}
+	else {
+		printf("  overlapping slot maps rejected: %s\n", error);
+	}
+
+	//
+	// Throughput: a 2 amp, 16-bit, 4 slot bus driven and decoded
+	//
+	gmax_tdm_driver_image(0, 1, 0, &regs[0]);
+	gmax_tdm_driver_image(2, 3, 0, &regs[1]);
+	gmax_tdm_sim_init(&sim, regs, 2, 4, error, sizeof(error));
+	for (size_t b = 0; b < sizeof(BenchIsas) / sizeof(BenchIsas[0]); b++) {
+		BENCH_TDM_RUN run;
+		int32_t* buffer;
+		double rate;
+
+		if (!BenchSelect(BenchIsas[b])) {
+			continue;
+		}
+
+		buffer = calloc(8 * BENCH_IV_FRAMES, sizeof(int32_t));
+		run.Frames = malloc(BENCH_IV_FRAMES * 4 * 2);
+		if (!buffer || !run.Frames) {
+			fprintf(stderr, "out of memory\n");
+			exit(2);
+		}
+		run.Sim = &sim;
+		for (int a = 0; a < 2; a++) {
+			run.V[a] = buffer + (4 * a) * BENCH_IV_FRAMES;
+			run.I[a] = buffer + (4 * a + 1) * BENCH_IV_FRAMES;
+			run.VOut[a] = buffer + (4 * a + 2) * BENCH_IV_FRAMES;
+			run.IOut[a] = buffer + (4 * a + 3) * BENCH_IV_FRAMES;
+		}
+
+		rate = BenchRate(BenchTdmBody, &run, BENCH_IV_FRAMES, Config->Ms);
+		printf("  %-6s drive+decode %7.1f Mframes/s  %6.0fx real time\n",
+			BenchIsaNames[BenchIsas[b]], rate * 1e-6, rate / BENCH_RATE);
+		free(buffer);
+		free(run.Frames);
+	}
+
+	return failures;
+}
+
+#define BENCH_CONVERT_SAMPLES 9601		// 4800 stereo frames and one
+#define BENCH_CONVERT_SEED 0x9E3779B9u
+
+static const char* const BenchPcmNames[GmaxPcmMax] = {
+	"16", "24in32", "32"
+};
+
+//
+// Converts Samples in calls of Chunk samples. Returns the bytes written.
+//
+static size_t
+BenchConvert(
+	GMAX_PCM_CONTAINER In,
+	GMAX_PCM_CONTAINER Out,
+	int Dither,
+	const void* Input,
+	size_t Samples,
+	size_t Chunk,
+	uint8_t* Output
+)
+{
+	GMAX_PCM_CONVERTER converter;
+	size_t inBytes = In == GmaxPcm16 ? 2 : 4;
+	size_t outBytes = Out == GmaxPcm16 ? 2 : 4;
+
+	gmax_pcm_converter_init(&converter, In, Out, Dither, BENCH_CONVERT_SEED);
+	for (size_t n = 0; n < Samples; n += Chunk) {
+		size_t count = Samples - n < Chunk ? Samples - n : Chunk;
+
+		gmax_pcm_convert(&converter, (const uint8_t*)Input + n * inBytes, Output + n * outBytes, count);
+	}
+	return Samples * outBytes;
+}
+
+typedef struct _BENCH_CONVERT_RUN {
+	GMAX_PCM_CONVERTER Converter;
+	const void* In;
+	void* Out;
+} BENCH_CONVERT_RUN;
+
+static void
+BenchConvertBody(
+	void* Context
+)
+{
+	BENCH_CONVERT_RUN* run = Context;
+
+	gmax_pcm_convert(&run->Converter, run->In, run->Out, BENCH_CONVERT_SAMPLES);
+}
+
+static int
+BenchConvertCheck(
+	void
+)
+{
+	static const size_t chunks[] = { 1, 7, 1000, 1024, 1025 };
+	int32_t* input = malloc(BENCH_CONVERT_SAMPLES * sizeof(int32_t));
+	uint8_t* reference = malloc(BENCH_CONVERT_SAMPLES * 4);
+	uint8_t* output = malloc(BENCH_CONVERT_SAMPLES * 4);
+	int failures = 0;
+
+	if (!input || !reference || !output) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+
+	//
+	// Random words, so a 16-bit input is two random samples; the first
+	// few sit at and next to full scale to exercise saturation
+	//
+	for (size_t n = 0; n < BENCH_CONVERT_SAMPLES; n++) {
+		input[n] = (int32_t)SimRandom();
+	}
+	input[0] = INT32_MAX;
+	input[1] = INT32_MIN;
+	input[2] = INT32_MAX - 0x7F;
+	input[3] = 0x7FFF7FFF;
+	input[4] = (int32_t)0x80008000u;
+
+	//
+	// The reference itself: full scale saturates rather than wrapping
+	//
+	{
+		int16_t narrow[3];
+
+		gmax_dsp_select_isa(GmaxDspIsaScalar);
+		BenchConvert(GmaxPcm32, GmaxPcm16, 1, input, 3, 3, (uint8_t*)narrow);
+		if (narrow[0] != INT16_MAX || narrow[1] != INT16_MIN || narrow[2] != INT16_MAX) {
+			printf("  FAIL scalar 32 -> 16 full scale gives %d %d %d\n", narrow[0], narrow[1], narrow[2]);
+			failures++;
+		}
+	}
+
+	for (size_t b = 0; b < sizeof(BenchIsas) / sizeof(BenchIsas[0]); b++) {
+		int bad = 0;
+
+		if (!BenchSelect(BenchIsas[b])) {
+			continue;
+		}
+
+		for (GMAX_PCM_CONTAINER in = 0; in < GmaxPcmMax; in++) {
+			for (GMAX_PCM_CONTAINER out = 0; out < GmaxPcmMax; out++) {
+				for (int dither = 0; dither < 2; dither++) {
+					size_t bytes;
+
+					gmax_dsp_select_isa(GmaxDspIsaScalar);
+					bytes = BenchConvert(in, out, dither, input, BENCH_CONVERT_SAMPLES,
+						BENCH_CONVERT_SAMPLES, reference);
+					gmax_dsp_select_isa(BenchIsas[b]);
+
+					for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+						BenchConvert(in, out, dither, input, BENCH_CONVERT_SAMPLES, chunks[c], output);
+						if (memcmp(reference, output, bytes)) {
+							printf("  FAIL %s %s -> %s dither %d in calls of %zu differs from scalar\n",
+								BenchIsaNames[BenchIsas[b]], BenchPcmNames[in], BenchPcmNames[out],
+								dither, chunks[c]);
+							bad++;
+						}
+					}
+				}
+			}
+		}
+		printf("  %-6s 9 container pairs x dither %s\n", BenchIsaNames[BenchIsas[b]],
+			bad ? "FAILED" : "bit exact");
+		failures += bad;
+	}
+
+	free(input);
+	free(reference);
+	free(output);
+	return failures;
+}
+
+static int
+BenchConvertAll(
+	const BENCH_CONFIG* Config
+)
+{
+	int failures;
+
+	printf("convert: every path against scalar, whole and in calls of 1 to 1025 samples\n");
+	failures = BenchConvertCheck();
+
+	printf("convert: 24in32 -> 16 with TPDF dither\n");
+	for (size_t b = 0; b < sizeof(BenchIsas) / sizeof(BenchIsas[0]); b++) {
+		BENCH_CONVERT_RUN run;
+		int32_t* buffer;
+		double rate;
+
+		if (!BenchSelect(BenchIsas[b])) {
+			continue;
+		}
+
+		buffer = calloc(2 * BENCH_CONVERT_SAMPLES, sizeof(int32_t));
+		if (!buffer) {
+			fprintf(stderr, "out of memory\n");
+			exit(2);
+		}
+		for (size_t n = 0; n < BENCH_CONVERT_SAMPLES; n++) {
+			buffer[n] = (int32_t)(SimRandom() & 0xFFFFFF00u);
+		}
+		gmax_pcm_converter_init(&run.Converter, GmaxPcm24In32, GmaxPcm16, 1, BENCH_CONVERT_SEED);
+		run.In = buffer;
+		run.Out = buffer + BENCH_CONVERT_SAMPLES;
+
+		rate = BenchRate(BenchConvertBody, &run, BENCH_CONVERT_SAMPLES, Config->Ms);
+		printf("  %-6s %8.1f Msamples/s  %8.0fx real time stereo\n",
+			BenchIsaNames[BenchIsas[b]], rate * 1e-6, rate / (2 * BENCH_RATE));
+		free(buffer);
+	}
+
+	return failures;
+}
+
+#define BENCH_GUARD_FRAMES (10 * BENCH_RATE)
+#define BENCH_GUARD_CALL 480			// 10 ms
+#define BENCH_GUARD_BURST_EVERY 24000		// a burst every 500 ms
+#define BENCH_GUARD_BURST_LENGTH 96
+#define BENCH_GUARD_ACTIONS 4096
+
+static void
+BenchGuardConfig(
+	unsigned Channels,
+	GMAX_GUARD_CONFIG* Config
+)
+{
+	memset(Config, 0, sizeof(*Config));
+	Config->SampleRate = BENCH_RATE;
+	Config->Channels = Channels;
+	Config->LookAheadMs = 5.0f;
+	Config->CeilingDb = -6.0f;
+	Config->HoldMs = 50.0f;
+	Config->ReleaseDbPerSec = 20.0f;
+	Config->MaxAttenuationDb = 12.0f;
+	Config->MinIntervalMs = 20.0f;
+}
+
+static float*
+BenchGuardSignal(
+	unsigned Channels
+)
+{
+	float* samples = malloc(BENCH_GUARD_FRAMES * Channels * sizeof(float));
+
+	if (!samples) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+	for (size_t f = 0; f < BENCH_GUARD_FRAMES; f++) {
+		int burst = f % BENCH_GUARD_BURST_EVERY >= BENCH_GUARD_BURST_EVERY / 2 &&
+			f % BENCH_GUARD_BURST_EVERY < BENCH_GUARD_BURST_EVERY / 2 + BENCH_GUARD_BURST_LENGTH;
+
+		for (unsigned c = 0; c < Channels; c++) {
+			double x = 0.2 * (2.0 * SimUniform() - 1.0);
+
+			if (burst && c == Channels - 1) {
+				x = f & 1 ? 0.99 : -0.99;
+			}
+			samples[f * Channels + c] = (float)x;
+		}
+	}
+	return samples;
+}
+
+typedef struct _BENCH_GUARD_TRACE {
+	GMAX_GUARD_ACTION Action[BENCH_GUARD_ACTIONS];
+	uint64_t Emitted[BENCH_GUARD_ACTIONS];	// frames consumed when it came out
+	size_t Count;
+	double CallTotalUs;
+	double CallMaxUs;
+	uint32_t Calls;
+} BENCH_GUARD_TRACE;
+
+static void
+BenchGuardTrace(
+	unsigned Channels,
+	const float* Samples,
+	BENCH_GUARD_TRACE* Trace
+)
+{
+	static GMAX_GUARD_STATE state;
+	GMAX_GUARD_CONFIG config;
+
+	BenchGuardConfig(Channels, &config);
+	gmax_guard_init(&state, &config);
+	memset(Trace, 0, sizeof(*Trace));
+
+	for (size_t f = 0; f < BENCH_GUARD_FRAMES; f += BENCH_GUARD_CALL) {
+		GMAX_GUARD_ACTION actions[8];
+		double start = BenchNow();
+		size_t count = gmax_guard_process(&state, Samples + f * Channels, BENCH_GUARD_CALL, actions, 8);
+		double us = (BenchNow() - start) * 1e6;
+
+		Trace->CallTotalUs += us;
+		Trace->CallMaxUs = us > Trace->CallMaxUs ? us : Trace->CallMaxUs;
+		Trace->Calls++;
+
+		for (size_t a = 0; a < count && Trace->Count < BENCH_GUARD_ACTIONS; a++) {
+			Trace->Action[Trace->Count] = actions[a];
+			Trace->Emitted[Trace->Count] = f + BENCH_GUARD_CALL;
+			Trace->Count++;
+		}
+	}
+}
+
+typedef struct _BENCH_GUARD_RUN {
+	GMAX_GUARD_STATE State;
+	const float* Samples;
+} BENCH_GUARD_RUN;
+
+static void
+BenchGuardBody(
+	void* Context
+)
+{
+	BENCH_GUARD_RUN* run = Context;
+	GMAX_GUARD_ACTION actions[64];
+
+	gmax_guard_process(&run->State, run->Samples, BENCH_GUARD_FRAMES, actions, 64);
+}
+
+static int
+BenchGuard(
+	const BENCH_CONFIG* Config
+)
+{
+	static BENCH_GUARD_TRACE reference;
+	static BENCH_GUARD_TRACE trace;
+	static BENCH_GUARD_RUN run;
+	uint32_t window = (uint32_t)(5.0f * BENCH_RATE * 1e-3f + 0.5f);
+	int32_t needed = (int32_t)(20.0 * log10(0.99 / pow(10.0, -6.0 / 20.0)) * 100.0);
+	int failures = 0;
+
+	printf("guard: %u frame look-ahead, bursts of %u frames every %u\n",
+		window, BENCH_GUARD_BURST_LENGTH, BENCH_GUARD_BURST_EVERY);
+
+	for (unsigned channels = 1; channels <= 2; channels++) {
+		float* samples = BenchGuardSignal(channels);
+		uint64_t worstDelay = 0;
+		uint64_t minLead = UINT64_MAX;
+		uint32_t attacks = 0;
+
+		gmax_dsp_select_isa(GmaxDspIsaScalar);
+		BenchGuardTrace(channels, samples, &reference);
+
+		//
+		// Lead and decision delay of each burst's attack, from the
+		// scalar trace
+		//
+		for (uint64_t burst = BENCH_GUARD_BURST_EVERY / 2; burst < BENCH_GUARD_FRAMES; burst += BENCH_GUARD_BURST_EVERY) {
+			const GMAX_GUARD_ACTION* attack = NULL;
+			uint64_t emitted = 0;
+			int32_t before = 0;
+
+			for (size_t a = 0; a < reference.Count; a++) {
+				if (reference.Action[a].Frame <= burst) {
+					before = reference.Action[a].Attenuation;
+				}
+				if (!attack && reference.Action[a].Frame + window >= burst &&
+					reference.Action[a].Frame <= burst && reference.Action[a].Attenuation > 0) {
+					attack = &reference.Action[a];
+					emitted = reference.Emitted[a];
+				}
+			}
+
+			if (before < needed) {
+				printf("  FAIL %u ch burst at %llu: %.2f dB in effect at its first sample\n",
+					channels, (unsigned long long)burst, before / 100.0);
+				failures++;
+				continue;
+			}
+			if (attack) {
+				uint64_t lead = burst - attack->Frame;
+				uint64_t delay = emitted - attack->Frame;
+
+				attacks++;
+				minLead = lead < minLead ? lead : minLead;
+				worstDelay = delay > worstDelay ? delay : worstDelay;
+				if (delay > 2 * (uint64_t)window + BENCH_GUARD_CALL - 1) {
+					printf("  FAIL %u ch burst at %llu: decided %llu frames after its frame went in\n",
+						channels, (unsigned long long)burst, (unsigned long long)delay);
+					failures++;
+				}
+			}
+		}
+		printf("  %u ch: %zu actions, %u attacks, min lead %llu frames, worst decision delay %llu frames (%.1f ms)\n",
+			channels, reference.Count, attacks,
+			(unsigned long long)(attacks ? minLead : 0), (unsigned long long)worstDelay,
+			worstDelay * 1000.0 / BENCH_RATE);
+
+		for (size_t b = 0; b < sizeof(BenchIsas) / sizeof(BenchIsas[0]); b++) {
+			double rate;
+
+			if (!BenchSelect(BenchIsas[b])) {
+				continue;
+			}
+
+			BenchGuardTrace(channels, samples, &trace);
+			if (trace.Count != reference.Count ||
+				memcmp(trace.Action, reference.Action, trace.Count * sizeof(trace.Action[0]))) {
+				printf("  FAIL %s %u ch: decisions differ from scalar\n", BenchIsaNames[BenchIsas[b]], channels);
+				failures++;
+			}
+
+			BenchGuardConfig(channels, &run.State.Config);
+			gmax_guard_init(&run.State, &run.State.Config);
+			run.Samples = samples;
+			rate = BenchRate(BenchGuardBody, &run, BENCH_GUARD_FRAMES, Config->Ms);
+			printf("  %-6s %u ch %8.1f Mframes/s  %8.0fx real time  10 ms call mean %.2f us max %.2f us\n",
+				BenchIsaNames[BenchIsas[b]], channels, rate * 1e-6, rate / BENCH_RATE,
+				trace.CallTotalUs / trace.Calls, trace.CallMaxUs);
+		}
+
+		free(samples);
+	}
+
+	return failures;
+}
+
+typedef int BENCH_TEST(const BENCH_CONFIG* Config);
+
+static const struct {
+	const char* Name;
+	BENCH_TEST* Run;
+} BenchTests[] = {
+	{ "iv", BenchIv },
+	{ "thermal", BenchThermal },
+	{ "tdm", BenchTdm },
+	{ "convert", BenchConvertAll },
+	{ "guard", BenchGuard },
+};
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	BENCH_CONFIG config = { 200, 1 };
+	const char* test = "all";
+	int failures = 0;
+	int ran = 0;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "-test")) {
+			test = argv[i + 1];
+		}
+		else if (!strcmp(argv[i], "-ms")) {
+			config.Ms = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-seed")) {
+			config.Seed = strtoull(argv[i + 1], NULL, 0);
+		}
+		else {
+			break;
+		}
+	}
+
+	if (config.Seed == 0 || (argc % 2) == 0) {
+		fprintf(stderr, "usage: %s [-test all", argv[0]);
+		for (size_t t = 0; t < sizeof(BenchTests) / sizeof(BenchTests[0]); t++) {
+			fprintf(stderr, "|%s", BenchTests[t].Name);
+		}
+		fprintf(stderr, "] [-ms per-measurement] [-seed n]\n");
+		return 2;
+	}
+
+	for (size_t t = 0; t < sizeof(BenchTests) / sizeof(BenchTests[0]); t++) {
+		if (strcmp(test, "all") && strcmp(test, BenchTests[t].Name)) {
+			continue;
+		}
+		BenchRandom = config.Seed;
+		failures += BenchTests[t].Run(&config);
+		ran++;
+	}
+
+	if (ran == 0) {
+		fprintf(stderr, "unknown test %s\n", test);
+		return 2;
+	}
+
+	gmax_dsp_select_isa(GmaxDspIsaAuto);
+	printf("%s\n", failures ? "FAILED" : "passed");
+	return failures ? 1 : 0;
+}
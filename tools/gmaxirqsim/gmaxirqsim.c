@@ -0,0 +1,493 @@
+/*++
+
+Module Name:
+
+gmaxirqsim.c
+
+Abstract:
+
+Drives the interrupt service the ISR runs (opengmaxcodec/intflags.h)
+from a simulated IRQ line on the simulated amp (tools/simamp/simamp.h).
+The line is level triggered, as on the part: it is asserted while
+IRQ_CTRL is on and any INT_FLAGn bit is set with its INT_ENn bit.
+The transfers go through simamp's copy of spb.c's retry and breaker
+policy, and a transfer can be made to fail outright.
+
+Each case raises flags on the amp, runs the ISR the way interrupt.c
+does while the line is asserted, and checks:
+
+	every unmasked source costs exactly one burst read and one burst
+	write, decodes to its event and leaves the line low
+	a masked or spurious flag is read but never acknowledged, and
+	stays set on the amp
+	a failed read or acknowledge masks INT_EN1..3, which drops the
+	line; a failed mask leaves it up, for the work item to disable
+	no case asserts the line again once the ISR has returned
+
+Usage: gmaxirqsim [-v]
+
+Environment:
+
+Host, portable C
+
+--*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../simamp/simamp.h"
+#include "../../opengmaxcodec/intflags.h"
+
+#define SIM_ISR_LIMIT 8		// ISR runs per case before it counts as a storm
+
+//
+// opengmaxcodec/gmaxioctl.h GMAX_EVENT, the part interrupts decode to
+//
+typedef enum {
+	SimEventThermalWarn,
+	SimEventThermalWarnEnd,
+	SimEventThermalShutdown,
+	SimEventThermalShutdownEnd,
+	SimEventBrownoutActive,
+	SimEventBrownoutEnd,
+	SimEventBrownoutLevel,
+	SimEventClockLoss,
+	SimEventClockRecovered,
+	SimEventWatchdog,
+	SimEventSpeakerFault,
+	SimEventBoostFault
+} SIM_EVENT;
+
+//
+// GmaxIntMap, opengmaxcodec/interrupt.c
+//
+static const GMAX_INT_MAP SimIntMap[] = {
+	{0, MAX98512_INT1_THERMWARN_BGN, SimEventThermalWarn},
+	{0, MAX98512_INT1_THERMWARN_END, SimEventThermalWarnEnd},
+	{0, MAX98512_INT1_THERMSHDN_BGN, SimEventThermalShutdown},
+	{0, MAX98512_INT1_THERMSHDN_END, SimEventThermalShutdownEnd},
+	{0, MAX98512_INT1_BDE_ACTIVE_BGN, SimEventBrownoutActive},
+	{0, MAX98512_INT1_BDE_ACTIVE_END, SimEventBrownoutEnd},
+	{0, MAX98512_INT1_BDE_LEVEL_CHANGE, SimEventBrownoutLevel},
+	{0, MAX98512_INT1_BDE_L4, SimEventBrownoutLevel},
+	{1, MAX98512_INT2_CLK_ERR, SimEventClockLoss},
+	{1, MAX98512_INT2_CLK_RECOVER, SimEventClockRecovered},
+	{1, MAX98512_INT2_WDOG_ERR, SimEventWatchdog},
+	{1, MAX98512_INT2_SPK_OVC, SimEventSpeakerFault},
+	{2, MAX98512_INT3_BST_CURLIM, SimEventBoostFault},
+	{2, MAX98512_INT3_BST_UVLO, SimEventBoostFault},
+	{2, MAX98512_INT3_PVDD_UVLO, SimEventBoostFault}
+};
+
+#define SIM_INT_MAP_COUNT (sizeof(SimIntMap) / sizeof(SimIntMap[0]))
+
+typedef struct _SIM {
+	SIM_AMP Amp;
+	uint64_t Now;
+	uint64_t Random;
+
+	uint8_t Enabled[GMAX_INT_REG_COUNT];	// GMAX_INTERRUPT_CONTEXT.Enabled
+	uint32_t FailMask;			// transfer n of the case fails when bit n is set
+	uint32_t Transfers;
+	uint32_t Reads;
+	uint32_t Writes;
+	uint32_t Isrs;
+	uint32_t Events;
+	GMAX_INT_RESULT Result;
+	uint8_t Acked[GMAX_INT_REG_COUNT];	// last INT_FLAG_CLR write
+} SIM;
+
+static int SimVerbose;
+static int SimFailures;
+static int SimCases;
+
+static void
+SimCheck(
+	int Ok,
+	const char* Case,
+	const char* What
+)
+{
+	if (!Ok) {
+		printf("FAIL %s: %s\n", Case, What);
+		SimFailures++;
+	}
+	else if (SimVerbose) {
+		printf("  ok %s: %s\n", Case, What);
+	}
+}
+
+static int
+SimLine(
+	const SIM* Sim
+)
+{
+	const uint8_t* regs = Sim->Amp.Regs;
+
+	if (!(regs[MAX98512_R0010_IRQ_CTRL] & MAX98512_IRQ_CTRL_EN)) {
+		return 0;
+	}
+	for (int i = 0; i < GMAX_INT_REG_COUNT; i++) {
+		if (regs[MAX98512_R0007_INT_FLAG1 + i] & regs[MAX98512_R000A_INT_EN1 + i]) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//
+// gmax_reg_bulk_read/gmax_reg_bulk_write on the simulated bus
+//
+static int
+SimBurst(
+	SIM* Sim,
+	int Write,
+	uint16_t Reg,
+	uint8_t* Data,
+	uint32_t Length
+)
+{
+	SIM_AMP_RESULT result;
+	uint32_t n = Sim->Transfers++;
+
+	if (Write) {
+		Sim->Writes++;
+	}
+	else {
+		Sim->Reads++;
+	}
+
+	Sim->Amp.Faults.Nack = (n < 32 && (Sim->FailMask & (1u << n))) ? 1.0 : 0.0;
+	return SimAmpTransfer(&Sim->Amp, 0, Write, Reg, Data, Length, &result) == SimAmpSuccess;
+}
+
+//
+// GmaxEnableInterrupts
+//
+static void
+SimEnable(
+	SIM* Sim
+)
+{
+	uint8_t clear[GMAX_INT_REG_COUNT] = { 0xFF, 0xFF, 0xFF };
+	uint8_t enable[GMAX_INT_REG_COUNT];
+	uint8_t irq = MAX98512_IRQ_CTRL_EN;
+
+	memcpy(enable, GmaxIntEnableMask, sizeof(enable));
+	SimBurst(Sim, 1, MAX98512_R000D_INT_FLAG_CLR1, clear, sizeof(clear));
+	SimBurst(Sim, 1, MAX98512_R000A_INT_EN1, enable, sizeof(enable));
+	SimBurst(Sim, 1, MAX98512_R0010_IRQ_CTRL, &irq, 1);
+	memcpy(Sim->Enabled, GmaxIntEnableMask, sizeof(Sim->Enabled));
+}
+
+//
+// A fresh amp with the interrupts enabled, then counters from zero
+//
+static void
+SimStart(
+	SIM* Sim
+)
+{
+	SIM_AMP_FAULTS faults = { 0 };
+
+	memset(Sim, 0, sizeof(*Sim));
+	Sim->Random = 1;
+	SimAmpInitialize(&Sim->Amp, &faults, &Sim->Now, &Sim->Random);
+	SimEnable(Sim);
+
+	Sim->Transfers = Sim->Reads = Sim->Writes = 0;
+}
+
+//
+// GmaxEvtInterruptIsr and GmaxServiceInterrupt, one run
+//
+static void
+SimIsr(
+	SIM* Sim
+)
+{
+	uint8_t mask[GMAX_INT_REG_COUNT] = { 0 };
+	GMAX_INT_SERVICE service;
+	GMAX_INT_ACTION action;
+	int ok;
+
+	Sim->Isrs++;
+	action = GmaxIntServiceStart(&service, Sim->Enabled);
+	while (action != GmaxIntDone) {
+		switch (action) {
+		case GmaxIntReadFlags:
+			ok = SimBurst(Sim, 0, MAX98512_R0007_INT_FLAG1, service.Flags, sizeof(service.Flags));
+			break;
+		case GmaxIntClearFlags:
+			memcpy(Sim->Acked, service.Flags, sizeof(Sim->Acked));
+			ok = SimBurst(Sim, 1, MAX98512_R000D_INT_FLAG_CLR1, service.Flags, sizeof(service.Flags));
+			break;
+		default:
+			ok = SimBurst(Sim, 1, MAX98512_R000A_INT_EN1, mask, sizeof(mask));
+			break;
+		}
+		action = GmaxIntServiceNext(&service, ok);
+	}
+
+	Sim->Result = service.Result;
+	if (service.Result == GmaxIntClaimed) {
+		Sim->Events |= GmaxIntDecode(SimIntMap, SIM_INT_MAP_COUNT, service.Flags);
+	}
+}
+
+//
+// The GPIO controller: runs the ISR while the line is asserted. An ISR
+// that could not clear or mask the line returns with it still up; the
+// work item then disables the interrupt, modelled here by stopping.
+//
+static void
+SimServiceLine(
+	SIM* Sim
+)
+{
+	while (SimLine(Sim) && Sim->Isrs < SIM_ISR_LIMIT) {
+		SimIsr(Sim);
+		if (Sim->Result == GmaxIntFailed) {
+			break;
+		}
+	}
+}
+
+static void
+SimRaise(
+	SIM* Sim,
+	uint32_t Reg,
+	uint8_t Bits
+)
+{
+	Sim->Amp.Regs[MAX98512_R0007_INT_FLAG1 + Reg] |= Bits;
+}
+
+static uint8_t
+SimFlag(
+	const SIM* Sim,
+	uint32_t Reg
+)
+{
+	return Sim->Amp.Regs[MAX98512_R0007_INT_FLAG1 + Reg];
+}
+
+static uint32_t
+SimExpected(
+	uint32_t Reg,
+	uint8_t Bits
+)
+{
+	uint8_t flags[GMAX_INT_REG_COUNT] = { 0 };
+
+	flags[Reg] = Bits;
+	return GmaxIntDecode(SimIntMap, SIM_INT_MAP_COUNT, flags);
+}
+
+//
+// Every unmasked source on its own: one read, one write, its event,
+// line low
+//
+static void
+SimTestSources(
+	void
+)
+{
+	static SIM sim;
+	char name[64];
+
+	for (uint32_t reg = 0; reg < GMAX_INT_REG_COUNT; reg++) {
+		for (uint32_t bit = 0; bit < 8; bit++) {
+			uint8_t b = (uint8_t)(1u << bit);
+
+			if (!(GmaxIntEnableMask[reg] & b)) {
+				continue;
+			}
+
+			snprintf(name, sizeof(name), "source INT_FLAG%u bit %u", reg + 1, bit);
+			SimCases++;
+			SimStart(&sim);
+			SimRaise(&sim, reg, b);
+			SimCheck(SimLine(&sim), name, "line asserted");
+			SimServiceLine(&sim);
+
+			SimCheck(sim.Isrs == 1, name, "one ISR run");
+			SimCheck(sim.Result == GmaxIntClaimed, name, "claimed");
+			SimCheck(sim.Reads == 1 && sim.Writes == 1, name, "one burst read and one burst write");
+			SimCheck(sim.Acked[reg] == b, name, "acknowledges only its bit");
+			SimCheck(SimFlag(&sim, reg) == 0, name, "flag cleared on the amp");
+			SimCheck(sim.Events == SimExpected(reg, b) && sim.Events != 0, name, "decodes to its event");
+			SimCheck(!SimLine(&sim), name, "line low");
+		}
+	}
+}
+
+//
+// Every source at once still costs one read and one write
+//
+static void
+SimTestAll(
+	void
+)
+{
+	static SIM sim;
+	const char* name = "all sources";
+	uint32_t expected = 0;
+
+	SimCases++;
+	SimStart(&sim);
+	for (uint32_t reg = 0; reg < GMAX_INT_REG_COUNT; reg++) {
+		SimRaise(&sim, reg, GmaxIntEnableMask[reg]);
+		expected |= SimExpected(reg, GmaxIntEnableMask[reg]);
+	}
+	SimServiceLine(&sim);
+
+	SimCheck(sim.Isrs == 1, name, "one ISR run");
+	SimCheck(sim.Reads == 1 && sim.Writes == 1, name, "one burst read and one burst write");
+	SimCheck(sim.Events == expected, name, "every event decoded");
+	SimCheck(!SimLine(&sim), name, "line low");
+}
+
+//
+// Masked bits on their own never assert the line; an ISR run anyway
+// (a glitch, a shared line) reads and writes nothing back
+//
+static void
+SimTestMasked(
+	void
+)
+{
+	static SIM sim;
+	char name[64];
+
+	for (uint32_t reg = 0; reg < GMAX_INT_REG_COUNT; reg++) {
+		uint8_t masked = (uint8_t)~GmaxIntEnableMask[reg];
+
+		if (!masked) {
+			continue;
+		}
+
+		snprintf(name, sizeof(name), "masked INT_FLAG%u 0x%02x", reg + 1, masked);
+		SimCases++;
+		SimStart(&sim);
+		SimRaise(&sim, reg, masked);
+		SimCheck(!SimLine(&sim), name, "line not asserted");
+
+		SimIsr(&sim);
+		SimCheck(sim.Result == GmaxIntSpurious, name, "spurious");
+		SimCheck(sim.Reads == 1 && sim.Writes == 0, name, "one read, no acknowledge");
+		SimCheck(SimFlag(&sim, reg) == masked, name, "masked flags stay set");
+		SimCheck(sim.Events == 0, name, "no event");
+	}
+
+	SimCases++;
+	SimStart(&sim);
+	SimIsr(&sim);
+	SimCheck(sim.Result == GmaxIntSpurious, "spurious", "nothing set is spurious");
+	SimCheck(sim.Reads == 1 && sim.Writes == 0, "spurious", "one read, no acknowledge");
+}
+
+//
+// A masked flag next to a real one is left alone
+//
+static void
+SimTestMixed(
+	void
+)
+{
+	static SIM sim;
+	const char* name = "masked with CLK_ERR";
+
+	SimCases++;
+	SimStart(&sim);
+	SimRaise(&sim, 1, MAX98512_INT2_PWRUP_DONE | MAX98512_INT2_CLK_ERR);
+	SimServiceLine(&sim);
+
+	SimCheck(sim.Reads == 1 && sim.Writes == 1, name, "one burst read and one burst write");
+	SimCheck(sim.Acked[1] == MAX98512_INT2_CLK_ERR, name, "acknowledges CLK_ERR only");
+	SimCheck(SimFlag(&sim, 1) == MAX98512_INT2_PWRUP_DONE, name, "PWRUP_DONE stays set");
+	SimCheck(sim.Events == (1u << SimEventClockLoss), name, "clock loss only");
+	SimCheck(!SimLine(&sim), name, "line low");
+}
+
+//
+// Bus failures: the sources are masked and the line drops until the
+// recovery pass enables them again, clearing the flags it missed
+//
+static void
+SimTestBusFailure(
+	void
+)
+{
+	static SIM sim;
+	static const struct {
+		const char* Name;
+		uint32_t FailMask;
+		GMAX_INT_RESULT Result;
+		uint32_t Reads;
+		uint32_t Writes;
+	} cases[] = {
+		{ "read fails", 0x1, GmaxIntMasked, 1, 1 },
+		{ "acknowledge fails", 0x2, GmaxIntMasked, 1, 2 },
+		{ "read and mask fail", 0x3, GmaxIntFailed, 1, 1 },
+	};
+
+	for (uint32_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		const char* name = cases[c].Name;
+
+		SimCases++;
+		SimStart(&sim);
+		SimRaise(&sim, 0, MAX98512_INT1_THERMWARN_BGN);
+		sim.FailMask = cases[c].FailMask;
+		SimServiceLine(&sim);
+
+		SimCheck(sim.Isrs == 1, name, "one ISR run");
+		SimCheck(sim.Result == cases[c].Result, name, "result");
+		SimCheck(sim.Reads == cases[c].Reads && sim.Writes == cases[c].Writes, name, "transfers");
+		SimCheck(sim.Events == 0, name, "no event");
+
+		if (cases[c].Result == GmaxIntFailed) {
+			SimCheck(SimLine(&sim), name, "line still up, left to the work item");
+			continue;
+		}
+
+		SimCheck(!SimLine(&sim), name, "line low");
+		SimCheck(!sim.Enabled[0] && !sim.Enabled[1] && !sim.Enabled[2], name, "sources masked");
+
+		//
+		// The recovery pass's StartCodec
+		//
+		memset(&sim.Amp.Breaker, 0, sizeof(sim.Amp.Breaker));
+		sim.FailMask = 0;
+		sim.Isrs = 0;
+		SimEnable(&sim);
+		SimCheck(!SimLine(&sim) && sim.Enabled[0] == GmaxIntEnableMask[0], name, "enabled again, line low");
+	}
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-v")) {
+			SimVerbose = 1;
+		}
+		else {
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	SimTestSources();
+	SimTestAll();
+	SimTestMasked();
+	SimTestMixed();
+	SimTestBusFailure();
+
+	printf("gmaxirqsim: %d cases, %d failures\n", SimCases, SimFailures);
+	return SimFailures ? 1 : 0;
+}
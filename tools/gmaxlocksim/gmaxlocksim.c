@@ -0,0 +1,464 @@
+/*++
+
+Module Name:
+
+gmaxlocksim.c
+
+Abstract:
+
+Lock contention on a simulated bus. Each amp gets the driver's pair of
+locks: its own SpbLock, then the controller lock every client of the
+bus shares. Several issuer threads per amp run the driver's periodic
+traffic (volume ramp steps, monitor reads, interrupt service, tuning
+writes) while another client of the bus takes the controller lock on
+its own schedule. Waits and holds are booked with lockprof.h exactly
+as the driver books them, and printed as IOCTL_GMAX_GET_LOCK_PROFILE
+would report them.
+
+Bus time is modelled on a 400 kHz I2C bus: 22.5 us per byte plus the
+controller lock round trip.
+
+Usage: gmaxlocksim [-amps n] [-ms duration] [-touch-us us]
+	[-touch-ms period] [-scale x] [-seed n]
+
+Environment:
+
+Host, portable C with POSIX threads
+
+--*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../opengmaxcodec/lockprof.h"
+
+#define SIM_MAX_AMPS 4
+#define SIM_BYTE_NS 22500		// 9 bit times at 400 kHz
+#define SIM_LOCK_NS 30000		// IOCTL_SPB_LOCK_CONTROLLER round trip
+#define SIM_WRITE 0			// GMAX_SPB_DIRECTION
+#define SIM_XFER 1
+
+typedef struct _SIM_ISSUER {
+	const char* Name;
+	uint16_t Reg;			// max98512.h
+	uint8_t Direction;
+	uint8_t Length;
+	uint32_t PeriodUs;
+} SIM_ISSUER;
+
+//
+// What the driver sends on its own, per amp
+//
+static const SIM_ISSUER SimIssuers[] = {
+	{ "volume",	0x0035, SIM_WRITE, 1, 4000 },	// AMP_VOL_CTRL ramp step
+	{ "monitor",	0x004A, SIM_XFER, 6, 5000 },	// MEAS_ADC_CH0_READ..BROWNOUT_STATUS
+	{ "interrupt",	0x0001, SIM_XFER, 3, 8000 },	// INT_RAW1..3
+	{ "tuning",	0x003A, SIM_WRITE, 16, 20000 },
+};
+
+#define SIM_ISSUER_COUNT (sizeof(SimIssuers) / sizeof(SimIssuers[0]))
+
+typedef struct _SIM_AMP {
+	pthread_mutex_t SpbLock;
+	GMAX_LOCK_PROFILE Profile;	// booked under SpbLock, as the driver's ProfileLock never contends
+	GMAX_LOCK_OP Owner;
+} SIM_AMP;
+
+typedef struct _SIM {
+	pthread_mutex_t Controller;
+	SIM_AMP Amp[SIM_MAX_AMPS];
+	uint32_t Amps;
+	uint64_t StartNs;
+	uint64_t EndNs;
+	uint32_t TouchUs;
+	uint32_t TouchMs;
+	double Scale;			// issuer rate multiplier
+	uint64_t Seed;
+	uint64_t TouchHolds;
+} SIM;
+
+typedef struct _SIM_THREAD {
+	SIM* Sim;
+	SIM_AMP* Amp;
+	const SIM_ISSUER* Issuer;
+	uint64_t Random;
+} SIM_THREAD;
+
+static uint64_t
+SimNow(
+	void
+)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void
+SimSleepUntil(
+	uint64_t Ns
+)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t)(Ns / 1000000000ULL);
+	ts.tv_nsec = (long)(Ns % 1000000000ULL);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+	}
+}
+
+static uint64_t
+SimRandom(
+	uint64_t* State
+)
+{
+	// xorshift64*
+	*State ^= *State >> 12;
+	*State ^= *State << 25;
+	*State ^= *State >> 27;
+	return *State * 2685821657736338717ULL;
+}
+
+static uint32_t
+SimUs(
+	uint64_t Start,
+	uint64_t End
+)
+{
+	uint64_t us = (End - Start) / 1000;
+
+	return us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+static void
+SimBook(
+	SIM* Sim,
+	GMAX_LOCK_HISTOGRAM* Histogram,
+	uint64_t Start,
+	uint64_t End,
+	GMAX_LOCK_OP Op,
+	GMAX_LOCK_OP Holder
+)
+{
+	GmaxLockRecord(Histogram, SimUs(Start, End), (uint32_t)((End - Sim->StartNs) / 1000000), Op, Holder);
+}
+
+static void*
+SimIssuerThread(
+	void* Context
+)
+{
+	SIM_THREAD* thread = (SIM_THREAD*)Context;
+	SIM* sim = thread->Sim;
+	SIM_AMP* amp = thread->Amp;
+	const SIM_ISSUER* issuer = thread->Issuer;
+	GMAX_LOCK_OP op = { issuer->Reg, issuer->Direction, issuer->Length };
+	GMAX_LOCK_OP unknown = { GMAX_LOCK_REG_UNKNOWN, 0, 0 };
+	uint64_t period = (uint64_t)(issuer->PeriodUs * 1000.0 / sim->Scale);
+	uint64_t next = sim->StartNs + SimRandom(&thread->Random) % period;
+
+	// Address byte, register address, data, and a repeated start for reads
+	uint32_t bytes = 3 + issuer->Length + (issuer->Direction == SIM_XFER ? 1 : 0);
+
+	for (;;) {
+		uint64_t waitStart, acquired, locked, unlocked;
+
+		SimSleepUntil(next);
+		if (next >= sim->EndNs) {
+			break;
+		}
+
+		waitStart = SimNow();
+		pthread_mutex_lock(&amp->SpbLock);
+		acquired = SimNow();
+		SimBook(sim, &amp->Profile.Wait[GmaxLockSpb], waitStart, acquired, op, amp->Owner);
+		amp->Owner = op;
+
+		pthread_mutex_lock(&sim->Controller);
+		locked = SimNow();
+		SimBook(sim, &amp->Profile.Wait[GmaxLockController], acquired, locked, op, unknown);
+
+		SimSleepUntil(locked + SIM_LOCK_NS + (uint64_t)bytes * SIM_BYTE_NS);
+
+		pthread_mutex_unlock(&sim->Controller);
+		unlocked = SimNow();
+		SimBook(sim, &amp->Profile.Hold[GmaxLockController], locked, unlocked, op, op);
+		SimBook(sim, &amp->Profile.Hold[GmaxLockSpb], acquired, SimNow(), op, op);
+		pthread_mutex_unlock(&amp->SpbLock);
+
+		//
+		// Periodic, but a late issuer does not burst to catch up
+		//
+		next += period;
+		if (next < unlocked) {
+			next = unlocked + period;
+		}
+	}
+
+	return NULL;
+}
+
+static void*
+SimTouchThread(
+	void* Context
+)
+{
+	SIM* sim = (SIM*)Context;
+	uint64_t next = sim->StartNs;
+
+	if (sim->TouchUs == 0 || sim->TouchMs == 0) {
+		return NULL;
+	}
+
+	for (;;) {
+		uint64_t locked;
+
+		next += (uint64_t)sim->TouchMs * 1000000ULL;
+		SimSleepUntil(next);
+		if (next >= sim->EndNs) {
+			break;
+		}
+
+		pthread_mutex_lock(&sim->Controller);
+		locked = SimNow();
+		SimSleepUntil(locked + (uint64_t)sim->TouchUs * 1000ULL);
+		pthread_mutex_unlock(&sim->Controller);
+		sim->TouchHolds++;
+	}
+
+	return NULL;
+}
+
+static const char*
+SimOpName(
+	GMAX_LOCK_OP Op,
+	char* Buffer,
+	size_t Length
+)
+{
+	if (Op.Reg == GMAX_LOCK_REG_UNKNOWN) {
+		snprintf(Buffer, Length, "other client");
+	}
+	else {
+		snprintf(Buffer, Length, "%s 0x%04X x%u",
+			Op.Direction == SIM_XFER ? "read" : "write", Op.Reg, Op.Length);
+	}
+	return Buffer;
+}
+
+static int
+SimCompareSample(
+	const void* A,
+	const void* B
+)
+{
+	const GMAX_LOCK_SAMPLE* a = (const GMAX_LOCK_SAMPLE*)A;
+	const GMAX_LOCK_SAMPLE* b = (const GMAX_LOCK_SAMPLE*)B;
+
+	return a->Us < b->Us ? 1 : a->Us > b->Us ? -1 : 0;
+}
+
+static void
+SimPrintSummary(
+	const char* Name,
+	const GMAX_LOCK_HISTOGRAM* Histogram
+)
+{
+	uint32_t max = 0;
+
+	for (unsigned i = 0; i < GMAX_LOCK_WORST; i++) {
+		if (Histogram->Worst[i].Us > max) {
+			max = Histogram->Worst[i].Us;
+		}
+	}
+
+	printf("  %-16s %8u  mean %7.1f  p50 <%6u  p99 <%6u  max %7u us\n",
+		Name,
+		Histogram->Count,
+		Histogram->Count ? (double)Histogram->TotalUs / Histogram->Count : 0.0,
+		GmaxLockPercentileUs(Histogram, 50),
+		GmaxLockPercentileUs(Histogram, 99),
+		max);
+}
+
+static void
+SimPrintWorst(
+	const char* Name,
+	const GMAX_LOCK_HISTOGRAM* Histogram,
+	int Wait
+)
+{
+	GMAX_LOCK_SAMPLE worst[GMAX_LOCK_WORST];
+	char op[32], holder[32];
+
+	memcpy(worst, Histogram->Worst, sizeof(worst));
+	qsort(worst, GMAX_LOCK_WORST, sizeof(worst[0]), SimCompareSample);
+
+	printf("  worst %s\n", Name);
+	for (unsigned i = 0; i < GMAX_LOCK_WORST && worst[i].Us != 0; i++) {
+		printf("    %7u us  at %6u ms  ", worst[i].Us, worst[i].TimestampMs);
+		if (Wait) {
+			printf("%-18s  behind %s\n",
+				SimOpName(worst[i].Op, op, sizeof(op)),
+				SimOpName(worst[i].Holder, holder, sizeof(holder)));
+		}
+		else {
+			printf("%s\n", SimOpName(worst[i].Op, op, sizeof(op)));
+		}
+	}
+}
+
+static void
+SimPrintAmp(
+	unsigned Index,
+	const GMAX_LOCK_PROFILE* Profile
+)
+{
+	const GMAX_LOCK_HISTOGRAM* series[] = {
+		&Profile->Wait[GmaxLockSpb],
+		&Profile->Hold[GmaxLockSpb],
+		&Profile->Wait[GmaxLockController],
+		&Profile->Hold[GmaxLockController],
+	};
+	const char* names[] = { "SpbLock wait", "SpbLock hold", "controller wait", "controller hold" };
+	unsigned last = 0;
+
+	printf("amp %u%27s\n", Index, "count");
+	for (unsigned s = 0; s < 4; s++) {
+		SimPrintSummary(names[s], series[s]);
+	}
+
+	for (unsigned s = 0; s < 4; s++) {
+		for (unsigned b = 0; b < GMAX_LOCK_BUCKETS; b++) {
+			if (series[s]->Bucket[b] != 0 && b > last) {
+				last = b;
+			}
+		}
+	}
+
+	printf("\n  %-16s %12s %12s %12s %12s\n", "us", "spb wait", "spb hold", "ctl wait", "ctl hold");
+	for (unsigned b = 0; b <= last; b++) {
+		char range[24];
+
+		if (b == 0) {
+			snprintf(range, sizeof(range), "< 1");
+		}
+		else if (b == 1) {
+			snprintf(range, sizeof(range), "1");
+		}
+		else if (b == GMAX_LOCK_BUCKETS - 1) {
+			snprintf(range, sizeof(range), ">= %u", 1u << (b - 1));
+		}
+		else {
+			snprintf(range, sizeof(range), "%u - %u", 1u << (b - 1), (1u << b) - 1);
+		}
+
+		printf("  %-16s", range);
+		for (unsigned s = 0; s < 4; s++) {
+			printf(" %12u", series[s]->Bucket[b]);
+		}
+		printf("\n");
+	}
+
+	printf("\n");
+	SimPrintWorst("SpbLock waits", series[0], 1);
+	SimPrintWorst("controller waits", series[2], 1);
+	SimPrintWorst("SpbLock holds", series[1], 0);
+	printf("\n");
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	SIM sim;
+	pthread_t threads[SIM_MAX_AMPS * SIM_ISSUER_COUNT];
+	SIM_THREAD contexts[SIM_MAX_AMPS * SIM_ISSUER_COUNT];
+	pthread_t touch;
+	uint32_t durationMs = 2000;
+	unsigned count = 0;
+
+	memset(&sim, 0, sizeof(sim));
+	sim.Amps = 2;
+	sim.TouchUs = 400;
+	sim.TouchMs = 8;
+	sim.Scale = 1.0;
+	sim.Seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-amps") && i + 1 < argc) {
+			sim.Amps = (uint32_t)atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-ms") && i + 1 < argc) {
+			durationMs = (uint32_t)atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-touch-us") && i + 1 < argc) {
+			sim.TouchUs = (uint32_t)atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-touch-ms") && i + 1 < argc) {
+			sim.TouchMs = (uint32_t)atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-scale") && i + 1 < argc) {
+			sim.Scale = atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-seed") && i + 1 < argc) {
+			sim.Seed = strtoull(argv[++i], NULL, 0);
+		}
+		else {
+			fprintf(stderr, "usage: %s [-amps n] [-ms duration] [-touch-us us] [-touch-ms period] [-scale x] [-seed n]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (sim.Amps == 0 || sim.Amps > SIM_MAX_AMPS || sim.Scale <= 0.0) {
+		fprintf(stderr, "amps must be 1-%u and scale positive\n", SIM_MAX_AMPS);
+		return 1;
+	}
+
+	pthread_mutex_init(&sim.Controller, NULL);
+	for (unsigned a = 0; a < sim.Amps; a++) {
+		pthread_mutex_init(&sim.Amp[a].SpbLock, NULL);
+		sim.Amp[a].Owner.Reg = GMAX_LOCK_REG_UNKNOWN;
+	}
+
+	sim.StartNs = SimNow() + 10000000ULL;
+	sim.EndNs = sim.StartNs + (uint64_t)durationMs * 1000000ULL;
+
+	for (unsigned a = 0; a < sim.Amps; a++) {
+		for (unsigned i = 0; i < SIM_ISSUER_COUNT; i++) {
+			SIM_THREAD* context = &contexts[count];
+
+			context->Sim = &sim;
+			context->Amp = &sim.Amp[a];
+			context->Issuer = &SimIssuers[i];
+			context->Random = (sim.Seed + count + 1) * 0x9E3779B97F4A7C15ULL;
+			pthread_create(&threads[count], NULL, SimIssuerThread, context);
+			count++;
+		}
+	}
+	pthread_create(&touch, NULL, SimTouchThread, &sim);
+
+	for (unsigned t = 0; t < count; t++) {
+		pthread_join(threads[t], NULL);
+	}
+	pthread_join(touch, NULL);
+
+	printf("%u amps x %u issuers for %u ms at %.2fx rate, other client holds the controller %u us every %u ms (%llu holds)\n\n",
+		sim.Amps, (unsigned)SIM_ISSUER_COUNT, durationMs, sim.Scale,
+		sim.TouchUs, sim.TouchMs, (unsigned long long)sim.TouchHolds);
+
+	for (unsigned a = 0; a < sim.Amps; a++) {
+		SimPrintAmp(a, &sim.Amp[a].Profile);
+	}
+
+	return 0;
+}
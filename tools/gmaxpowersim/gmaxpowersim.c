@@ -0,0 +1,376 @@
+/*++
+
+Module Name:
+
+gmaxpowersim.c
+
+Abstract:
+
+Runs the power sequencing state machine (opengmaxcodec/powerseq.h) on
+virtual time, the way power.c drives it: due steps are written
+straight away, short settles are spun out, longer ones go to a
+high-resolution timer and a work item. The same sequence is also run
+the old way, sleeping in KeDelayExecutionThread for every settle,
+which wakes on the next system timer tick.
+
+For both it reports how long the sequence takes to settle and how
+long the calling thread is held. For the state machine it also
+checks that no step is written before its settle time has passed.
+With -cancel it checks that no step of a superseded sequence is
+written after the power-down that replaced it.
+
+Usage: gmaxpowersim [-n runs] [-settle-us us] [-steps n]
+	[-tick-us us] [-cancel p] [-seed n]
+
+Environment:
+
+Host, portable C
+
+--*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../opengmaxcodec/powerseq.h"
+
+#define GMAX_POWER_STALL_MAX_US 10	// opengmaxcodec/power.h
+#define SIM_TRANSFER_US 150		// one register write at 400 kHz, as gmaxbussim
+#define SIM_TIMER_JITTER_US 60		// high-resolution timer expiry
+#define SIM_WORKITEM_US 40		// work item dispatch at PASSIVE_LEVEL
+#define SIM_MAX_STEPS 8
+
+#define SIM_GLOBAL_SHDN 0x0400		// MAX98512
+#define SIM_AMP_EN 0x0038
+#define SIM_SOFT_RESET 0x0401
+
+typedef struct _SIM_CONFIG {
+	uint32_t Runs;
+	uint32_t SettleUs;		// after each step but the last
+	uint32_t Steps;
+	uint32_t TickUs;
+	double Cancel;
+	uint64_t Seed;
+} SIM_CONFIG;
+
+typedef struct _SIM_RESULT {
+	uint64_t* SettledUs;
+	uint64_t* BlockedUs;
+	uint64_t StallUs;
+	uint32_t Deferred;
+	uint32_t Early;			// writes before the step's settle time passed
+	uint32_t Stale;			// writes of a superseded sequence
+	uint32_t Cancelled;
+} SIM_RESULT;
+
+static uint64_t
+SimRandom(
+	uint64_t* State
+)
+{
+	// xorshift64*
+	*State ^= *State >> 12;
+	*State ^= *State << 25;
+	*State ^= *State >> 27;
+	return *State * 2685821657736338717ULL;
+}
+
+static double
+SimUniform(
+	uint64_t* State
+)
+{
+	return (SimRandom(State) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//
+// The MAX98512 power-up, GLOBAL_EN then AMP_EN, with -steps - 2 extra
+// settle steps in between for a chip that needs a staged bring-up
+//
+static uint32_t
+SimBuildSequence(
+	const SIM_CONFIG* Config,
+	GMAX_POWER_STEP* Steps
+)
+{
+	uint32_t count = Config->Steps;
+
+	memset(Steps, 0, sizeof(GMAX_POWER_STEP) * count);
+	for (uint32_t i = 0; i < count; i++) {
+		Steps[i].Writes[0].Reg = i == 0 ? SIM_GLOBAL_SHDN : SIM_AMP_EN;
+		Steps[i].Writes[0].Value = 1;
+		Steps[i].Count = 1;
+		Steps[i].SettleUs = i + 1 < count ? GMAX_POWER_SETTLE_QUIRK : 0;
+	}
+	return count;
+}
+
+//
+// KeDelayExecutionThread returns on the first tick after the due time
+//
+static uint64_t
+SimSleepUs(
+	const SIM_CONFIG* Config,
+	uint64_t Now,
+	uint32_t Us,
+	uint64_t Phase
+)
+{
+	uint64_t due = Now + Us;
+	uint64_t tick = Config->TickUs;
+	uint64_t wake = ((due + Phase + tick - 1) / tick) * tick - Phase;
+
+	return (wake > due ? wake : due) - Now;
+}
+
+static void
+SimLegacy(
+	const SIM_CONFIG* Config,
+	const GMAX_POWER_STEP* Steps,
+	uint32_t Count,
+	uint64_t* Random,
+	uint32_t Run,
+	SIM_RESULT* Result
+)
+{
+	uint64_t phase = (uint64_t)(SimUniform(Random) * Config->TickUs);
+	uint64_t now = 0;
+
+	for (uint32_t i = 0; i < Count; i++) {
+		now += (uint64_t)Steps[i].Count * SIM_TRANSFER_US;
+		if (i + 1 < Count) {
+			now += SimSleepUs(Config, now, Config->SettleUs, phase);
+		}
+	}
+
+	Result->SettledUs[Run] = now;
+	Result->BlockedUs[Run] = now;
+}
+
+//
+// GmaxPowerRun on virtual time. Returns the time the pass ends; sets
+// *Pending when the timer was armed for *WakeUs.
+//
+static uint64_t
+SimRun(
+	GMAX_POWER_SEQ* Seq,
+	uint64_t Now,
+	uint64_t* WriteDue,
+	int* Pending,
+	uint64_t* WakeUs,
+	SIM_RESULT* Result
+)
+{
+	const GMAX_POWER_STEP* step;
+
+	*Pending = 0;
+	for (;;) {
+		GMAX_POWER_SEQ_ACTION action = GmaxPowerSeqNext(Seq, Now * 10, &step);
+		uint64_t remaining;
+
+		if (action == GmaxPowerSeqStop) {
+			return Now;
+		}
+
+		if (action == GmaxPowerSeqWrite) {
+			if (Now < *WriteDue) {
+				Result->Early++;
+			}
+			Now += (uint64_t)step->Count * SIM_TRANSFER_US;
+			GmaxPowerSeqWritten(Seq, 1, Now * 10);
+			*WriteDue = Seq->DueAt / 10;
+			continue;
+		}
+
+		remaining = Seq->DueAt / 10 - Now;
+		if (remaining <= GMAX_POWER_STALL_MAX_US) {
+			Result->StallUs += remaining;
+			Now += remaining;
+			continue;
+		}
+
+		Result->Deferred++;
+		*Pending = 1;
+		*WakeUs = Now + remaining;
+		return Now;
+	}
+}
+
+static void
+SimStateMachine(
+	const SIM_CONFIG* Config,
+	const GMAX_POWER_STEP* Steps,
+	uint32_t Count,
+	uint64_t* Random,
+	uint32_t Run,
+	SIM_RESULT* Result
+)
+{
+	static const GMAX_POWER_STEP down[] = {
+		{{{SIM_SOFT_RESET, 1}}, 1, 0}
+	};
+	GMAX_POWER_SEQ seq;
+	uint64_t writeDue = 0;
+	uint64_t wake = 0;
+	uint64_t cancelAt = UINT64_MAX;
+	uint64_t now;
+	int pending;
+
+	GmaxPowerSeqStart(&seq, Steps, Count, Config->SettleUs, 0);
+	now = SimRun(&seq, 0, &writeDue, &pending, &wake, Result);
+	Result->BlockedUs[Run] = now;
+
+	//
+	// A StopCodec somewhere in the settle time supersedes the sequence
+	//
+	if (pending && SimUniform(Random) < Config->Cancel) {
+		cancelAt = now + (uint64_t)(SimUniform(Random) * (wake - now));
+	}
+
+	while (pending) {
+		uint64_t fire = wake + (uint64_t)(SimUniform(Random) * SIM_TIMER_JITTER_US) + SIM_WORKITEM_US;
+		if (cancelAt <= fire) {
+			uint32_t written;
+
+			writeDue = cancelAt;
+			GmaxPowerSeqStart(&seq, down, 1, 0, cancelAt * 10);
+			SimRun(&seq, cancelAt, &writeDue, &pending, &wake, Result);
+			Result->Cancelled++;
+
+			//
+			// The stale timer still fires and must find nothing to do
+			//
+			written = seq.Next;
+			SimRun(&seq, fire, &writeDue, &pending, &wake, Result);
+			if (seq.Next != written) {
+				Result->Stale++;
+			}
+			now = cancelAt;
+			break;
+		}
+
+		now = SimRun(&seq, fire, &writeDue, &pending, &wake, Result);
+	}
+
+	Result->SettledUs[Run] = seq.State == GmaxPowerSeqDone ? now : 0;
+}
+
+static int
+CompareUint64(
+	const void* A,
+	const void* B
+)
+{
+	uint64_t a = *(const uint64_t*)A;
+	uint64_t b = *(const uint64_t*)B;
+
+	return a < b ? -1 : a > b;
+}
+
+static void
+SimReportRow(
+	const char* Name,
+	uint64_t* Values,
+	uint32_t Count
+)
+{
+	qsort(Values, Count, sizeof(uint64_t), CompareUint64);
+	printf("%-18s %10.3f %10.3f %10.3f %10.3f\n",
+		Name,
+		Values[Count / 2] / 1000.0,
+		Values[(uint64_t)(Count - 1) * 99 / 100] / 1000.0,
+		Values[(uint64_t)(Count - 1) * 999 / 1000] / 1000.0,
+		Values[Count - 1] / 1000.0);
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	SIM_CONFIG config = { 100000, 2, 2, 15625, 0, 1 };
+	GMAX_POWER_STEP steps[SIM_MAX_STEPS];
+	SIM_RESULT legacy = { 0 };
+	SIM_RESULT timer = { 0 };
+	uint64_t random;
+	uint32_t count;
+	uint32_t settled = 0;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "-n")) {
+			config.Runs = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-settle-us")) {
+			config.SettleUs = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-steps")) {
+			config.Steps = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-tick-us")) {
+			config.TickUs = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-cancel")) {
+			config.Cancel = atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-seed")) {
+			config.Seed = strtoull(argv[i + 1], NULL, 0);
+		}
+		else {
+			break;
+		}
+	}
+
+	if (config.Runs == 0 || config.TickUs == 0 || config.Steps < 2 || config.Steps > SIM_MAX_STEPS ||
+		(argc % 2) == 0) {
+		fprintf(stderr, "usage: %s [-n runs] [-settle-us us] [-steps 2..%u] [-tick-us us] "
+			"[-cancel p] [-seed n]\n", argv[0], SIM_MAX_STEPS);
+		return 2;
+	}
+
+	legacy.SettledUs = (uint64_t*)malloc(config.Runs * sizeof(uint64_t));
+	legacy.BlockedUs = (uint64_t*)malloc(config.Runs * sizeof(uint64_t));
+	timer.SettledUs = (uint64_t*)malloc(config.Runs * sizeof(uint64_t));
+	timer.BlockedUs = (uint64_t*)malloc(config.Runs * sizeof(uint64_t));
+	if (!legacy.SettledUs || !legacy.BlockedUs || !timer.SettledUs || !timer.BlockedUs) {
+		return 1;
+	}
+
+	count = SimBuildSequence(&config, steps);
+	random = config.Seed * 0x94D049BB133111EBULL | 1;
+
+	for (uint32_t r = 0; r < config.Runs; r++) {
+		SimLegacy(&config, steps, count, &random, r, &legacy);
+		SimStateMachine(&config, steps, count, &random, r, &timer);
+	}
+
+	//
+	// Cancelled runs never settle, leave them out of the settle row
+	//
+	for (uint32_t r = 0; r < config.Runs; r++) {
+		if (timer.SettledUs[r]) {
+			timer.SettledUs[settled++] = timer.SettledUs[r];
+		}
+	}
+
+	printf("%u power-ups of %u steps, %u us settle, tick %u us, cancel %g\n\n",
+		config.Runs, count, config.SettleUs, config.TickUs, config.Cancel);
+	printf("%-18s %10s %10s %10s %10s\n", "", "p50 ms", "p99 ms", "p99.9 ms", "max ms");
+	SimReportRow("legacy settled", legacy.SettledUs, config.Runs);
+	SimReportRow("legacy blocked", legacy.BlockedUs, config.Runs);
+	if (settled) {
+		SimReportRow("timer settled", timer.SettledUs, settled);
+	}
+	SimReportRow("timer blocked", timer.BlockedUs, config.Runs);
+
+	printf("\ntimer: %u waits deferred, %.2f us stalled per run, %u cancelled\n",
+		timer.Deferred, (double)timer.StallUs / config.Runs, timer.Cancelled);
+	printf("early writes %u, stale writes %u\n", timer.Early, timer.Stale);
+
+	free(legacy.SettledUs);
+	free(legacy.BlockedUs);
+	free(timer.SettledUs);
+	free(timer.BlockedUs);
+	return timer.Early || timer.Stale ? 1 : 0;
+}
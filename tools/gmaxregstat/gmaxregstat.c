@@ -0,0 +1,453 @@
+/*++
+
+Module Name:
+
+gmaxregstat.c
+
+Abstract:
+
+Prints the most accessed amp registers from IOCTL_GMAX_GET_REG_STATS,
+with the share of reads a register cache would have served and of
+writes that rewrote the value already there.
+
+With -l prints the SpbLock and controller lock profile from
+IOCTL_GMAX_GET_LOCK_PROFILE instead, with -i the driver's register
+image from IOCTL_GMAX_GET_REG_IMAGE (last value seen on the bus, read
+without touching it), with -b the SPB transfer counters from
+IOCTL_GMAX_GET_SPB_STATS (bytes sent and how many were copied on the
+way), with -t the start and power transition timeline from
+IOCTL_GMAX_GET_TIMELINE as Chrome trace JSON for Perfetto or
+chrome://tracing, bus transfers nested in the stages that made them.
+
+Usage: gmaxregstat [-n count] [-s accesses|time|redundant] [-l] [-i] [-b] [-t] [-r]
+
+-r clears the counters (register, lock profile or SPB) after printing,
+so successive runs cover the time in between.
+
+Environment:
+
+User mode
+
+--*/
+
+#include <windows.h>
+#include <winioctl.h>
+#include <initguid.h>
+#include <setupapi.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../opengmaxcodec/gmaxioctl.h"
+#include "../../opengmaxcodec/lockprof.h"
+
+#pragma comment(lib, "setupapi.lib")
+
+#define GMAX_REGSTAT_MAX 512
+#define GMAX_TIMELINE_MAX 256
+
+static const char* StageNames[GmaxStageMax] = {
+	"DriverEntry",
+	"EvtDeviceAdd",
+	"PrepareHardware",
+	"SPB open",
+	"boot cache",
+	"ACPI _UID",
+	"ACPI _HID",
+	"ACPI _DSD",
+	"tuning load",
+	"SelfManagedIoInit",
+	"CsAudio callback",
+	"D0Entry",
+	"StartCodec",
+	"D0Exit",
+	"write",
+	"read"
+};
+
+typedef enum {
+	SortAccesses,
+	SortTime,
+	SortRedundant
+} SORT_KEY;
+
+static SORT_KEY SortKey = SortAccesses;
+
+static HANDLE
+OpenGmaxDevice(void)
+{
+	HDEVINFO devInfo;
+	SP_DEVICE_INTERFACE_DATA ifData;
+	PSP_DEVICE_INTERFACE_DETAIL_DATA_A detail;
+	DWORD size = 0;
+	HANDLE handle = INVALID_HANDLE_VALUE;
+
+	devInfo = SetupDiGetClassDevsA(&GUID_DEVINTERFACE_GMAX, NULL, NULL,
+		DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+	if (devInfo == INVALID_HANDLE_VALUE) {
+		return INVALID_HANDLE_VALUE;
+	}
+
+	ifData.cbSize = sizeof(ifData);
+	if (!SetupDiEnumDeviceInterfaces(devInfo, NULL, &GUID_DEVINTERFACE_GMAX, 0, &ifData)) {
+		goto exit;
+	}
+
+	SetupDiGetDeviceInterfaceDetailA(devInfo, &ifData, NULL, 0, &size, NULL);
+	detail = (PSP_DEVICE_INTERFACE_DETAIL_DATA_A)malloc(size);
+	if (!detail) {
+		goto exit;
+	}
+
+	detail->cbSize = sizeof(*detail);
+	if (SetupDiGetDeviceInterfaceDetailA(devInfo, &ifData, detail, size, NULL, NULL)) {
+		handle = CreateFileA(detail->DevicePath, GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+	}
+	free(detail);
+
+exit:
+	SetupDiDestroyDeviceInfoList(devInfo);
+	return handle;
+}
+
+static double
+Ratio(
+	UINT32 Part,
+	UINT32 Whole
+)
+{
+	return Whole ? 100.0 * Part / Whole : 0.0;
+}
+
+static int
+CompareStats(
+	const void* A,
+	const void* B
+)
+{
+	const GMAX_REG_STATS* a = (const GMAX_REG_STATS*)A;
+	const GMAX_REG_STATS* b = (const GMAX_REG_STATS*)B;
+	UINT64 ka, kb;
+
+	switch (SortKey) {
+	case SortTime:
+		ka = a->BusTime;
+		kb = b->BusTime;
+		break;
+	case SortRedundant:
+		ka = (UINT64)a->RedundantWrites + a->NoopUpdates + a->CacheHits;
+		kb = (UINT64)b->RedundantWrites + b->NoopUpdates + b->CacheHits;
+		break;
+	default:
+		ka = (UINT64)a->Reads + a->Writes;
+		kb = (UINT64)b->Reads + b->Writes;
+		break;
+	}
+
+	return ka < kb ? 1 : ka > kb ? -1 : (int)a->Reg - (int)b->Reg;
+}
+
+static void
+PrintLockOp(
+	GMAX_LOCK_OP Op
+)
+{
+	if (Op.Reg == GMAX_LOCK_REG_UNKNOWN) {
+		printf("%-18s", "other client");
+	}
+	else {
+		printf("%-5s 0x%04X x%-5u", Op.Direction == GmaxSpbXfer ? "read" : "write", Op.Reg, Op.Length);
+	}
+}
+
+static int
+PrintLockProfile(
+	HANDLE Device,
+	BOOL Reset
+)
+{
+	static const char* names[GmaxLockMax] = { "SpbLock", "controller" };
+	GMAX_LOCK_PROFILE profile;
+	DWORD returned;
+
+	if (!DeviceIoControl(Device, IOCTL_GMAX_GET_LOCK_PROFILE, NULL, 0,
+		&profile, sizeof(profile), &returned, NULL)) {
+		fprintf(stderr, "IOCTL_GMAX_GET_LOCK_PROFILE failed: %lu\n", GetLastError());
+		return 1;
+	}
+
+	printf("lock        kind     count     mean-us  p50-us  p99-us\n");
+	for (unsigned l = 0; l < GmaxLockMax; l++) {
+		for (unsigned k = 0; k < 2; k++) {
+			const GMAX_LOCK_HISTOGRAM* h = k ? &profile.Hold[l] : &profile.Wait[l];
+
+			printf("%-11s %-5s %9u %11.1f %7u %7u\n",
+				names[l],
+				k ? "hold" : "wait",
+				h->Count,
+				h->Count ? (double)h->TotalUs / h->Count : 0.0,
+				GmaxLockPercentileUs(h, 50),
+				GmaxLockPercentileUs(h, 99));
+		}
+	}
+
+	for (unsigned l = 0; l < GmaxLockMax; l++) {
+		printf("\nworst %s waits (unordered)\n", names[l]);
+		for (unsigned i = 0; i < GMAX_LOCK_WORST; i++) {
+			const GMAX_LOCK_SAMPLE* w = &profile.Wait[l].Worst[i];
+
+			if (w->Us == 0) {
+				continue;
+			}
+			printf("%9u us  at %10u ms  ", w->Us, w->TimestampMs);
+			PrintLockOp(w->Op);
+			printf("  behind ");
+			PrintLockOp(w->Holder);
+			printf("\n");
+		}
+	}
+
+	if (Reset &&
+		!DeviceIoControl(Device, IOCTL_GMAX_RESET_LOCK_PROFILE, NULL, 0, NULL, 0, &returned, NULL)) {
+		fprintf(stderr, "IOCTL_GMAX_RESET_LOCK_PROFILE failed: %lu\n", GetLastError());
+	}
+
+	return 0;
+}
+
+static int
+PrintRegImage(
+	HANDLE Device
+)
+{
+	GMAX_REG_IMAGE image;
+	DWORD returned;
+	unsigned printed = 0;
+
+	if (!DeviceIoControl(Device, IOCTL_GMAX_GET_REG_IMAGE, NULL, 0,
+		&image, sizeof(image), &returned, NULL)) {
+		fprintf(stderr, "IOCTL_GMAX_GET_REG_IMAGE failed: %lu\n", GetLastError());
+		return 1;
+	}
+
+	printf("sequence %u, updated %u ms ago\n", image.Sequence, image.AgeMs);
+	for (unsigned r = 0, i = 0; r < image.RangeCount && r < GMAX_REG_IMAGE_RANGES; r++) {
+		for (unsigned n = 0; n < image.Ranges[r].Count && i < GMAX_REG_IMAGE_COUNT; n++, i++) {
+			if (!(image.Valid[i / 8] & (1 << (i % 8)))) {
+				continue;
+			}
+			printf("%s0x%04X=%02X", printed % 8 ? "  " : "\n",
+				image.Ranges[r].Base + n, image.Value[i]);
+			printed++;
+		}
+	}
+	printf("\n");
+
+	return 0;
+}
+
+static int
+PrintSpbStats(
+	HANDLE Device,
+	BOOL Reset
+)
+{
+	GMAX_SPB_STATS stats;
+	DWORD returned;
+
+	if (!DeviceIoControl(Device, IOCTL_GMAX_GET_SPB_STATS, NULL, 0,
+		&stats, sizeof(stats), &returned, NULL)) {
+		fprintf(stderr, "IOCTL_GMAX_GET_SPB_STATS failed: %lu\n", GetLastError());
+		return 1;
+	}
+
+	printf("transfers      %llu\n", stats.Transfers);
+	printf("bytes sent     %llu\n", stats.BytesSent);
+	printf("bytes read     %llu\n", stats.BytesRead);
+	printf("bytes copied   %llu (%.2f per transfer)\n", stats.BytesCopied,
+		stats.Transfers ? (double)stats.BytesCopied / stats.Transfers : 0.0);
+	printf("allocations    %u\n", stats.Allocations);
+	printf("retries        %u\n", stats.Retries);
+	printf("fast fails     %u\n", stats.FastFails);
+
+	if (Reset &&
+		!DeviceIoControl(Device, IOCTL_GMAX_RESET_SPB_STATS, NULL, 0, NULL, 0, &returned, NULL)) {
+		fprintf(stderr, "IOCTL_GMAX_RESET_SPB_STATS failed: %lu\n", GetLastError());
+	}
+
+	return 0;
+}
+
+static int
+PrintTimeline(
+	HANDLE Device
+)
+{
+	static struct {
+		GMAX_TIMELINE_HEADER Header;
+		GMAX_TIMELINE_RECORD Records[GMAX_TIMELINE_MAX];
+	} timeline;
+	DWORD returned;
+
+	if (!DeviceIoControl(Device, IOCTL_GMAX_GET_TIMELINE, NULL, 0,
+		&timeline, sizeof(timeline), &returned, NULL)) {
+		fprintf(stderr, "IOCTL_GMAX_GET_TIMELINE failed: %lu\n", GetLastError());
+		return 1;
+	}
+
+	printf("{\"displayTimeUnit\": \"ms\", \"otherData\": {\"bootRecords\": %u, \"dropped\": %u},\n",
+		timeline.Header.BootRecords, timeline.Header.Dropped);
+	printf("\"traceEvents\": [\n");
+	for (UINT32 i = 0; i < timeline.Header.Records; i++) {
+		const GMAX_TIMELINE_RECORD* record = &timeline.Records[i];
+		int bus = record->Stage == GmaxStageBusWrite || record->Stage == GmaxStageBusXfer;
+
+		printf("%s{\"name\": \"%s", i ? ",\n" : "",
+			record->Stage < GmaxStageMax ? StageNames[record->Stage] : "?");
+		if (bus) {
+			printf(" 0x%04X", record->Data);
+		}
+		printf("\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, "
+			"\"ts\": %.1f, \"dur\": %u, \"args\": {\"status\": \"0x%08X\", \"boot\": %d}}",
+			bus ? "bus" : "stage",
+			(record->Start - timeline.Header.StartTime) / 10.0,
+			record->Duration,
+			(UINT32)record->Status,
+			i < timeline.Header.BootRecords);
+	}
+	printf("\n]}\n");
+
+	return 0;
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	static GMAX_REG_STATS stats[GMAX_REGSTAT_MAX];
+	UINT64 totalTime = 0;
+	UINT64 totalAccesses = 0;
+	BOOL reset = FALSE;
+	BOOL locks = FALSE;
+	BOOL image = FALSE;
+	BOOL spb = FALSE;
+	BOOL trace = FALSE;
+	DWORD returned;
+	DWORD count;
+	HANDLE device;
+	int top = 20;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			top = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			i++;
+			SortKey = !strcmp(argv[i], "time") ? SortTime :
+				!strcmp(argv[i], "redundant") ? SortRedundant : SortAccesses;
+		}
+		else if (!strcmp(argv[i], "-l")) {
+			locks = TRUE;
+		}
+		else if (!strcmp(argv[i], "-i")) {
+			image = TRUE;
+		}
+		else if (!strcmp(argv[i], "-b")) {
+			spb = TRUE;
+		}
+		else if (!strcmp(argv[i], "-t")) {
+			trace = TRUE;
+		}
+		else if (!strcmp(argv[i], "-r")) {
+			reset = TRUE;
+		}
+		else {
+			fprintf(stderr, "usage: %s [-n count] [-s accesses|time|redundant] [-l] [-i] [-b] [-t] [-r]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	device = OpenGmaxDevice();
+	if (device == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "no gmax device found\n");
+		return 1;
+	}
+
+	if (image) {
+		int result = PrintRegImage(device);
+
+		CloseHandle(device);
+		return result;
+	}
+
+	if (trace) {
+		int result = PrintTimeline(device);
+
+		CloseHandle(device);
+		return result;
+	}
+
+	if (spb) {
+		int result = PrintSpbStats(device, reset);
+
+		CloseHandle(device);
+		return result;
+	}
+
+	if (locks) {
+		int result = PrintLockProfile(device, reset);
+
+		CloseHandle(device);
+		return result;
+	}
+
+	if (!DeviceIoControl(device, IOCTL_GMAX_GET_REG_STATS, NULL, 0,
+		stats, sizeof(stats), &returned, NULL)) {
+		fprintf(stderr, "IOCTL_GMAX_GET_REG_STATS failed: %lu\n", GetLastError());
+		CloseHandle(device);
+		return 1;
+	}
+	count = returned / sizeof(GMAX_REG_STATS);
+
+	for (DWORD i = 0; i < count; i++) {
+		totalTime += stats[i].BusTime;
+		totalAccesses += (UINT64)stats[i].Reads + stats[i].Writes;
+	}
+
+	qsort(stats, count, sizeof(GMAX_REG_STATS), CompareStats);
+
+	printf("%u registers, %llu accesses, %.3f ms on the bus\n\n",
+		(unsigned)count, totalAccesses, totalTime / 1e4);
+	printf("reg     reads  writes  noop-upd  cache-hit%%  redundant-wr%%  bus-ms  bus%%\n");
+
+	for (DWORD i = 0; i < count && (int)i < top; i++) {
+		const GMAX_REG_STATS* s = &stats[i];
+
+		if (s->Reg == GMAX_REG_STATS_OTHER) {
+			printf("other ");
+		}
+		else {
+			printf("0x%04X", s->Reg);
+		}
+		printf(" %7u %7u %9u %10.1f %14.1f %7.3f %5.1f\n",
+			s->Reads,
+			s->Writes,
+			s->NoopUpdates,
+			Ratio(s->CacheHits, s->Reads),
+			Ratio(s->RedundantWrites, s->Writes),
+			s->BusTime / 1e4,
+			totalTime ? 100.0 * s->BusTime / totalTime : 0.0);
+	}
+
+	if (reset &&
+		!DeviceIoControl(device, IOCTL_GMAX_RESET_REG_STATS, NULL, 0, NULL, 0, &returned, NULL)) {
+		fprintf(stderr, "IOCTL_GMAX_RESET_REG_STATS failed: %lu\n", GetLastError());
+	}
+
+	CloseHandle(device);
+	return 0;
+}
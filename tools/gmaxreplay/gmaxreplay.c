@@ -0,0 +1,588 @@
+/*++
+
+Module Name:
+
+gmaxreplay.c
+
+Abstract:
+
+Records SPB traffic from the driver's capture ring and replays it
+through the driver's transfer policy against the simulated amp the
+host simulators share (tools/simamp), so two driver builds can be
+compared on the same workload.
+
+Usage:
+	gmaxreplay start
+	gmaxreplay stop
+	gmaxreplay dump <file> [seconds]
+	gmaxreplay replay <file>
+	gmaxreplay diff <before> <after>
+
+dump keeps draining the ring for the given time (default: once), so
+captures longer than the ring are not lost as long as the tool keeps
+up. replay sends the transfers in order to the simulated amp, with
+spb.c's retry and breaker policy in front of it (spbretry.h), keeping
+the gaps between them. Writes change the amp's registers as the chip
+would (addresses auto-increment over a burst, SOFT_RESET resets it)
+and reads are checked against it. A read that disagrees with what
+the amp was last known to hold marks a register the hardware changes
+on its own; everything else could be served from a cache. Writes of
+the value already held are counted as redundant. The simulated bus
+time depends only on the transfers, not on the machine the capture
+came from, so it is the number to compare between builds.
+
+The simulated amp is a MAX98512. Transfers to registers it does not
+decode are timed and counted, but not modelled.
+
+Environment:
+
+User mode
+
+--*/
+
+#include <windows.h>
+#include <winioctl.h>
+#include <initguid.h>
+#include <setupapi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../opengmaxcodec/gmaxioctl.h"
+#include "../simamp/simamp.h"
+
+#pragma comment(lib, "setupapi.lib")
+
+#define GMAX_REG_SPACE 0x10000
+#define GMAX_DRAIN_BUFFER (64 * 1024)
+#define GMAX_DRAIN_PERIOD_MS 100
+#define GMAX_TOP_REGISTERS 16
+
+typedef struct _CAPTURE {
+	GMAX_SPB_CAPTURE_HEADER Header;
+	UINT8* Records;
+} CAPTURE;
+
+typedef struct _REPLAY {
+	UINT32 Transfers[2];		// by GMAX_SPB_DIRECTION
+	UINT32 Failed;
+	UINT64 Bytes;
+	UINT64 BusTime;			// us
+	UINT32 Span;			// us, first to last transfer
+	UINT32 RedundantWrites;
+	UINT32 VolatileReads;
+	UINT32 Unmapped;		// transfers outside the simulated amp
+	UINT64 SimBusTime;		// us, on the simulated amp
+	UINT32 SimFailed;
+	UINT32* Latency;
+	UINT32 LatencyCount;
+	UINT32 Accesses[GMAX_REG_SPACE];	// transfers starting at each register
+	UINT32 Changed[GMAX_REG_SPACE];		// reads that did not match the amp
+	UINT8 Known[SIM_AMP_REG_COUNT];		// amp register holds what the driver saw
+	SIM_AMP Amp;
+	uint64_t Now;			// 100ns, from the first transfer
+	uint64_t Random;
+} REPLAY;
+
+static HANDLE
+OpenGmaxDevice(void)
+{
+	HDEVINFO devInfo;
+	SP_DEVICE_INTERFACE_DATA ifData;
+	PSP_DEVICE_INTERFACE_DETAIL_DATA_A detail;
+	DWORD size = 0;
+	HANDLE handle = INVALID_HANDLE_VALUE;
+
+	devInfo = SetupDiGetClassDevsA(&GUID_DEVINTERFACE_GMAX, NULL, NULL,
+		DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+	if (devInfo == INVALID_HANDLE_VALUE) {
+		return INVALID_HANDLE_VALUE;
+	}
+
+	ifData.cbSize = sizeof(ifData);
+	if (!SetupDiEnumDeviceInterfaces(devInfo, NULL, &GUID_DEVINTERFACE_GMAX, 0, &ifData)) {
+		goto exit;
+	}
+
+	SetupDiGetDeviceInterfaceDetailA(devInfo, &ifData, NULL, 0, &size, NULL);
+	detail = (PSP_DEVICE_INTERFACE_DETAIL_DATA_A)malloc(size);
+	if (!detail) {
+		goto exit;
+	}
+
+	detail->cbSize = sizeof(*detail);
+	if (SetupDiGetDeviceInterfaceDetailA(devInfo, &ifData, detail, size, NULL, NULL)) {
+		handle = CreateFileA(detail->DevicePath, GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+	}
+	free(detail);
+
+exit:
+	SetupDiDestroyDeviceInfoList(devInfo);
+	return handle;
+}
+
+static UINT32
+RecordSize(
+	const GMAX_SPB_RECORD* Record
+)
+{
+	UINT32 payload = min(Record->WriteLength, GMAX_SPB_CAPTURE_MAX_PAYLOAD) +
+		min(Record->ReadLength, GMAX_SPB_CAPTURE_MAX_PAYLOAD);
+
+	return sizeof(GMAX_SPB_RECORD) + ((payload + 3) & ~3u);
+}
+
+static int
+SetCapture(
+	UINT32 Enable
+)
+{
+	HANDLE device = OpenGmaxDevice();
+	DWORD returned;
+	BOOL ok;
+
+	if (device == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "no gmax device found\n");
+		return 1;
+	}
+
+	ok = DeviceIoControl(device, IOCTL_GMAX_SET_SPB_CAPTURE, &Enable, sizeof(Enable),
+		NULL, 0, &returned, NULL);
+	if (!ok) {
+		fprintf(stderr, "IOCTL_GMAX_SET_SPB_CAPTURE failed: %lu\n", GetLastError());
+	}
+
+	CloseHandle(device);
+	return ok ? 0 : 1;
+}
+
+static int
+Dump(
+	const char* Path,
+	DWORD Seconds
+)
+{
+	GMAX_SPB_CAPTURE_HEADER total = { 0 };
+	ULONGLONG end = GetTickCount64() + Seconds * 1000ULL;
+	UINT8* buffer;
+	HANDLE device;
+	FILE* file;
+	int result = 1;
+
+	device = OpenGmaxDevice();
+	if (device == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "no gmax device found\n");
+		return 1;
+	}
+
+	buffer = (UINT8*)malloc(GMAX_DRAIN_BUFFER);
+	file = fopen(Path, "wb");
+	if (!buffer || !file) {
+		fprintf(stderr, "cannot write %s\n", Path);
+		goto exit;
+	}
+
+	// Header is rewritten with the totals once the drain ends
+	fwrite(&total, sizeof(total), 1, file);
+
+	for (;;) {
+		const GMAX_SPB_CAPTURE_HEADER* header = (const GMAX_SPB_CAPTURE_HEADER*)buffer;
+		DWORD returned;
+
+		if (!DeviceIoControl(device, IOCTL_GMAX_GET_SPB_CAPTURE, NULL, 0,
+			buffer, GMAX_DRAIN_BUFFER, &returned, NULL)) {
+			fprintf(stderr, "IOCTL_GMAX_GET_SPB_CAPTURE failed: %lu\n", GetLastError());
+			goto exit;
+		}
+
+		if (total.Version == 0) {
+			total.Version = header->Version;
+			total.StartTime = header->StartTime;
+		}
+		total.Records += header->Records;
+		total.Bytes += header->Bytes;
+		total.Dropped = header->Dropped;
+		fwrite(header + 1, 1, header->Bytes, file);
+
+		// A full buffer means more is waiting, otherwise wait for traffic
+		if (returned + sizeof(GMAX_SPB_RECORD) + 2 * GMAX_SPB_CAPTURE_MAX_PAYLOAD <= GMAX_DRAIN_BUFFER) {
+			if (GetTickCount64() >= end) {
+				break;
+			}
+			Sleep(GMAX_DRAIN_PERIOD_MS);
+		}
+	}
+
+	fseek(file, 0, SEEK_SET);
+	fwrite(&total, sizeof(total), 1, file);
+	printf("%u transfers, %u dropped\n", total.Records, total.Dropped);
+	result = 0;
+
+exit:
+	if (file) {
+		fclose(file);
+	}
+	free(buffer);
+	CloseHandle(device);
+	return result;
+}
+
+static int
+LoadCapture(
+	const char* Path,
+	CAPTURE* Capture
+)
+{
+	FILE* file = fopen(Path, "rb");
+
+	memset(Capture, 0, sizeof(*Capture));
+	if (!file) {
+		fprintf(stderr, "cannot read %s\n", Path);
+		return -1;
+	}
+
+	if (fread(&Capture->Header, sizeof(Capture->Header), 1, file) != 1 ||
+		Capture->Header.Version != GMAX_SPB_CAPTURE_VERSION) {
+		fprintf(stderr, "%s is not a version %u capture\n", Path, GMAX_SPB_CAPTURE_VERSION);
+		fclose(file);
+		return -1;
+	}
+
+	Capture->Records = (UINT8*)malloc(Capture->Header.Bytes + 1);
+	if (!Capture->Records ||
+		fread(Capture->Records, 1, Capture->Header.Bytes, file) != Capture->Header.Bytes) {
+		fprintf(stderr, "%s is truncated\n", Path);
+		fclose(file);
+		return -1;
+	}
+
+	fclose(file);
+	return 0;
+}
+
+static int
+CompareUint32(
+	const void* A,
+	const void* B
+)
+{
+	UINT32 a = *(const UINT32*)A;
+	UINT32 b = *(const UINT32*)B;
+
+	return a < b ? -1 : a > b;
+}
+
+static UINT32
+Percentile(
+	const REPLAY* Replay,
+	UINT32 Percent
+)
+{
+	if (Replay->LatencyCount == 0) {
+		return 0;
+	}
+	return Replay->Latency[(UINT64)(Replay->LatencyCount - 1) * Percent / 100];
+}
+
+static void
+ReplayWrite(
+	REPLAY* Replay,
+	UINT16 Reg,
+	const UINT8* Data,
+	UINT32 Length
+)
+/*++
+
+Routine Description:
+
+Counts the writes that would not change the amp before sending them,
+then marks what the amp holds as known. A soft reset forgets all of it,
+the chip's reset values are not modelled.
+
+--*/
+{
+	BOOLEAN reset = FALSE;
+
+	for (UINT32 i = 0; i < Length; i++) {
+		UINT32 r = Reg + i;
+
+		if (r >= SIM_AMP_REG_COUNT) {
+			continue;
+		}
+		if (r == MAX98512_R0401_SOFT_RESET && (Data[i] & MAX98512_SOFT_RESET)) {
+			reset = TRUE;
+		}
+		else if (Replay->Known[r] && SimAmpRead(&Replay->Amp, (UINT16)r) == Data[i]) {
+			Replay->RedundantWrites++;
+		}
+	}
+
+	for (UINT32 i = 0; i < Length; i++) {
+		if (Reg + i < SIM_AMP_REG_COUNT) {
+			Replay->Known[Reg + i] = 1;
+		}
+	}
+	if (reset) {
+		memset(Replay->Known, 0, sizeof(Replay->Known));
+	}
+}
+
+static void
+ReplayRead(
+	REPLAY* Replay,
+	UINT16 Reg,
+	const UINT8* Simulated,
+	const UINT8* Captured,
+	UINT32 Length
+)
+/*++
+
+Routine Description:
+
+Compares what the simulated amp answered with what the device did and
+brings the amp in line with the device, so one volatile register is
+counted once per change rather than on every later read.
+
+--*/
+{
+	for (UINT32 i = 0; i < Length; i++) {
+		UINT32 r = Reg + i;
+
+		if (r >= SIM_AMP_REG_COUNT) {
+			continue;
+		}
+		if (Replay->Known[r] && Simulated[i] != Captured[i]) {
+			Replay->Changed[r]++;
+			Replay->VolatileReads++;
+		}
+		Replay->Amp.Regs[r] = Captured[i];
+		Replay->Known[r] = 1;
+	}
+}
+
+static int
+Replay(
+	const CAPTURE* Capture,
+	REPLAY* Replay
+)
+{
+	const SIM_AMP_FAULTS faults = { 0 };
+	const UINT8* p = Capture->Records;
+	const UINT8* end = p + Capture->Header.Bytes;
+	UINT8 answer[GMAX_SPB_CAPTURE_MAX_PAYLOAD];
+	UINT32 first = 0;
+
+	memset(Replay, 0, sizeof(*Replay));
+	Replay->Latency = (UINT32*)malloc((Capture->Header.Records + 1) * sizeof(UINT32));
+	if (!Replay->Latency) {
+		return -1;
+	}
+	Replay->Random = 1;
+	SimAmpInitialize(&Replay->Amp, &faults, &Replay->Now, &Replay->Random);
+
+	while (p + sizeof(GMAX_SPB_RECORD) <= end) {
+		const GMAX_SPB_RECORD* record = (const GMAX_SPB_RECORD*)p;
+		const UINT8* sent = p + sizeof(GMAX_SPB_RECORD);
+		UINT32 sentStored = min(record->WriteLength, GMAX_SPB_CAPTURE_MAX_PAYLOAD);
+		const UINT8* read = sent + sentStored;
+		UINT32 readStored = min(record->ReadLength, GMAX_SPB_CAPTURE_MAX_PAYLOAD);
+		UINT32 size = RecordSize(record);
+		SIM_AMP_RESULT result;
+		SIM_AMP_STATUS status;
+		UINT64 start;
+		UINT16 reg;
+
+		if (p + size > end || record->Direction > GmaxSpbXfer) {
+			fprintf(stderr, "corrupt record at offset %u\n", (unsigned)(p - Capture->Records));
+			return -1;
+		}
+		p += size;
+
+		if (Replay->LatencyCount == 0) {
+			first = record->Timestamp;
+		}
+		Replay->Span = record->Timestamp + record->Latency - first;
+		Replay->Transfers[record->Direction]++;
+		Replay->Bytes += record->WriteLength + record->ReadLength;
+		Replay->BusTime += record->Latency;
+		Replay->Latency[Replay->LatencyCount++] = record->Latency;
+
+		//
+		// A transfer that failed on the device did not reach the amp
+		//
+		if (record->Status < 0) {
+			Replay->Failed++;
+			continue;
+		}
+		if (sentStored < 2) {
+			continue;
+		}
+
+		reg = (UINT16)((sent[0] << 8) | sent[1]);
+		Replay->Accesses[reg]++;
+		if (reg >= SIM_AMP_REG_COUNT) {
+			Replay->Unmapped++;
+		}
+
+		//
+		// Same idle time between transfers as on the device
+		//
+		start = (UINT64)(record->Timestamp - first) * 10;
+		if (Replay->Now < start) {
+			Replay->Now = start;
+		}
+		start = Replay->Now;
+
+		// Register writes carry data after the address, reads do not
+		if (record->Direction == GmaxSpbWrite) {
+			ReplayWrite(Replay, reg, sent + 2, sentStored - 2);
+			status = SimAmpTransfer(&Replay->Amp, 0, 1, reg, (UINT8*)sent + 2, sentStored - 2, &result);
+		}
+		else {
+			status = SimAmpTransfer(&Replay->Amp, 0, 0, reg, answer, readStored, &result);
+			if (status == SimAmpSuccess) {
+				ReplayRead(Replay, reg, answer, read, readStored);
+			}
+		}
+
+		//
+		// Payload past what the capture kept still takes bus time
+		//
+		Replay->Now += SIM_US(SIM_AMP_BYTE_US) *
+			(record->WriteLength - sentStored + record->ReadLength - readStored);
+		Replay->SimBusTime += (Replay->Now - start) / 10;
+		if (status != SimAmpSuccess) {
+			Replay->SimFailed++;
+		}
+	}
+
+	qsort(Replay->Latency, Replay->LatencyCount, sizeof(UINT32), CompareUint32);
+	return 0;
+}
+
+static void
+PrintLine(
+	const char* Name,
+	double Before,
+	double After,
+	int HaveAfter
+)
+{
+	if (!HaveAfter) {
+		printf("%-20s %12.0f\n", Name, Before);
+		return;
+	}
+
+	printf("%-20s %12.0f %12.0f %+9.1f%%\n", Name, Before, After,
+		Before ? 100.0 * (After - Before) / Before : 0.0);
+}
+
+static void
+PrintReport(
+	const CAPTURE* Capture,
+	const REPLAY* A,
+	const CAPTURE* CaptureB,
+	const REPLAY* B
+)
+{
+	int diff = B != NULL;
+	const REPLAY* b = diff ? B : A;
+
+	if (diff) {
+		printf("%-20s %12s %12s %10s\n", "", "before", "after", "change");
+	}
+	PrintLine("transfers", Capture->Header.Records, diff ? CaptureB->Header.Records : 0, diff);
+	PrintLine("  writes", A->Transfers[GmaxSpbWrite], b->Transfers[GmaxSpbWrite], diff);
+	PrintLine("  reads", A->Transfers[GmaxSpbXfer], b->Transfers[GmaxSpbXfer], diff);
+	PrintLine("failed", A->Failed, b->Failed, diff);
+	PrintLine("dropped", Capture->Header.Dropped, diff ? CaptureB->Header.Dropped : 0, diff);
+	PrintLine("bytes", (double)A->Bytes, (double)b->Bytes, diff);
+	PrintLine("bus time us", (double)A->BusTime, (double)b->BusTime, diff);
+	PrintLine("sim bus time us", (double)A->SimBusTime, (double)b->SimBusTime, diff);
+	PrintLine("sim failed", A->SimFailed, b->SimFailed, diff);
+	PrintLine("unmapped", A->Unmapped, b->Unmapped, diff);
+	PrintLine("span us", A->Span, b->Span, diff);
+	PrintLine("latency p50 us", Percentile(A, 50), Percentile(b, 50), diff);
+	PrintLine("latency p99 us", Percentile(A, 99), Percentile(b, 99), diff);
+	PrintLine("latency max us", Percentile(A, 100), Percentile(b, 100), diff);
+	PrintLine("redundant writes", A->RedundantWrites, b->RedundantWrites, diff);
+	PrintLine("volatile reads", A->VolatileReads, b->VolatileReads, diff);
+
+	printf("\n");
+
+	//
+	// Registers whose transfer count moved the most, or the busiest
+	// ones for a single capture
+	//
+	static UINT8 shown[GMAX_REG_SPACE];
+
+	memset(shown, 0, sizeof(shown));
+	for (int n = 0; n < GMAX_TOP_REGISTERS; n++) {
+		INT64 best = 0;
+		int reg = -1;
+
+		for (int r = 0; r < GMAX_REG_SPACE; r++) {
+			INT64 score = diff ?
+				_abs64((INT64)b->Accesses[r] - A->Accesses[r]) :
+				A->Accesses[r];
+
+			if (score > best && !shown[r]) {
+				best = score;
+				reg = r;
+			}
+		}
+
+		if (reg < 0) {
+			break;
+		}
+		shown[reg] = 1;
+
+		printf("reg 0x%04X %10u", reg, A->Accesses[reg]);
+		if (diff) {
+			printf(" -> %-10u", b->Accesses[reg]);
+		}
+		printf("%s\n", A->Changed[reg] || b->Changed[reg] ? "  volatile" : "");
+	}
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	static REPLAY replay[2];
+	CAPTURE capture[2];
+
+	if (argc >= 2 && !strcmp(argv[1], "start")) {
+		return SetCapture(1);
+	}
+	if (argc >= 2 && !strcmp(argv[1], "stop")) {
+		return SetCapture(0);
+	}
+	if (argc >= 3 && !strcmp(argv[1], "dump")) {
+		return Dump(argv[2], argc >= 4 ? (DWORD)atoi(argv[3]) : 0);
+	}
+	if (argc == 3 && !strcmp(argv[1], "replay")) {
+		if (LoadCapture(argv[2], &capture[0]) || Replay(&capture[0], &replay[0])) {
+			return 1;
+		}
+		PrintReport(&capture[0], &replay[0], NULL, NULL);
+		return 0;
+	}
+	if (argc == 4 && !strcmp(argv[1], "diff")) {
+		for (int i = 0; i < 2; i++) {
+			if (LoadCapture(argv[2 + i], &capture[i]) || Replay(&capture[i], &replay[i])) {
+				return 1;
+			}
+		}
+		PrintReport(&capture[0], &replay[0], &capture[1], &replay[1]);
+		return 0;
+	}
+
+	fprintf(stderr,
+		"usage: %s start | stop | dump <file> [seconds] | replay <file> | diff <before> <after>\n",
+		argv[0]);
+	return 2;
+}
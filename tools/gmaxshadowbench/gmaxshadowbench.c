@@ -0,0 +1,438 @@
+/*++
+
+Module Name:
+
+gmaxshadowbench.c
+
+Abstract:
+
+Diagnostic reads against an in-flight StartCodec, through the bus and
+through the register shadow. One thread replays StartCodec over and
+over: a few dozen register writes, each taking the amp's bus lock for
+its transfer time on a 400 kHz bus. Reader threads meanwhile read
+cached state the way telemetry and IOCTL readers do.
+
+In bus mode every read takes the bus lock and a transfer, as every
+gmax_reg_read did. In shadow mode readers copy from a register image
+published with the same sequence lock protocol as opengmaxcodec/
+shadow.c: writers bump the sequence before and after an update,
+readers retry if it was odd or moved.
+
+Reported per mode are reader latency, reads that saw a torn image
+(the start sequence writes whole blocks of equal bytes, a consistent
+read never mixes two generations) and how long StartCodec took, which
+is what readers on the bus cost the writer.
+
+Usage: gmaxshadowbench [-readers n] [-ms duration] [-read-us period]
+	[-mode bus|shadow|both]
+
+Environment:
+
+Host, portable C11 with POSIX threads
+
+--*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_MAX_READERS 64
+#define BENCH_REGS 0x111		// GMAX_REG_IMAGE_COUNT
+#define BENCH_BLOCK 8			// registers per start sequence write
+#define BENCH_START_WRITES 32
+#define BENCH_START_GAP_US 2000		// between start sequences
+#define BENCH_BYTE_NS 22500		// 9 bit times at 400 kHz
+#define BENCH_LOCK_NS 30000		// IOCTL_SPB_LOCK_CONTROLLER round trip
+#define BENCH_BUCKETS 32		// log2 ns
+
+typedef enum {
+	BenchBus,
+	BenchShadow
+} BENCH_MODE;
+
+typedef struct _BENCH_HISTOGRAM {
+	uint64_t Count;
+	uint64_t TotalNs;
+	uint64_t MaxNs;
+	uint64_t Bucket[BENCH_BUCKETS];
+} BENCH_HISTOGRAM;
+
+typedef struct _BENCH {
+	BENCH_MODE Mode;
+	uint64_t EndNs;
+	uint32_t ReadUs;
+
+	pthread_mutex_t BusLock;	// SpbLock and the controller lock
+	uint8_t Chip[BENCH_REGS];	// what the amp holds, under BusLock
+
+	atomic_uint Sequence;		// odd while an update is in progress
+	_Atomic uint8_t Value[BENCH_REGS];
+
+	atomic_int Stop;
+	BENCH_HISTOGRAM Start;		// StartCodec duration
+} BENCH;
+
+typedef struct _BENCH_READER {
+	BENCH* Bench;
+	uint64_t Random;
+	BENCH_HISTOGRAM Latency;
+	uint64_t Torn;
+	uint64_t Retries;
+} BENCH_READER;
+
+static uint64_t
+BenchNow(
+	void
+)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void
+BenchSleepUntil(
+	uint64_t Ns
+)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t)(Ns / 1000000000ULL);
+	ts.tv_nsec = (long)(Ns % 1000000000ULL);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+	}
+}
+
+static uint64_t
+BenchRandom(
+	uint64_t* State
+)
+{
+	// xorshift64*
+	*State ^= *State >> 12;
+	*State ^= *State << 25;
+	*State ^= *State >> 27;
+	return *State * 2685821657736338717ULL;
+}
+
+static void
+BenchRecord(
+	BENCH_HISTOGRAM* Histogram,
+	uint64_t Ns
+)
+{
+	unsigned bucket = 0;
+
+	while ((Ns >> bucket) > 1 && bucket < BENCH_BUCKETS - 1) {
+		bucket++;
+	}
+
+	Histogram->Count++;
+	Histogram->TotalNs += Ns;
+	Histogram->Bucket[bucket]++;
+	if (Ns > Histogram->MaxNs) {
+		Histogram->MaxNs = Ns;
+	}
+}
+
+static void
+BenchMerge(
+	BENCH_HISTOGRAM* Into,
+	const BENCH_HISTOGRAM* From
+)
+{
+	Into->Count += From->Count;
+	Into->TotalNs += From->TotalNs;
+	if (From->MaxNs > Into->MaxNs) {
+		Into->MaxNs = From->MaxNs;
+	}
+	for (unsigned b = 0; b < BENCH_BUCKETS; b++) {
+		Into->Bucket[b] += From->Bucket[b];
+	}
+}
+
+static uint64_t
+BenchPercentile(
+	const BENCH_HISTOGRAM* Histogram,
+	unsigned Percent
+)
+{
+	uint64_t target = (Histogram->Count * Percent + 99) / 100;
+	uint64_t seen = 0;
+
+	for (unsigned b = 0; b < BENCH_BUCKETS; b++) {
+		seen += Histogram->Bucket[b];
+		if (seen >= target && seen != 0) {
+			return 2ULL << b;
+		}
+	}
+	return 0;
+}
+
+//
+// One transfer on the bus: lock, wire time, unlock
+//
+static void
+BenchTransfer(
+	BENCH* Bench,
+	uint16_t Reg,
+	uint8_t* Data,
+	uint32_t Length,
+	int Write
+)
+{
+	uint32_t bytes = 3 + Length + (Write ? 0 : 1);
+
+	pthread_mutex_lock(&Bench->BusLock);
+	BenchSleepUntil(BenchNow() + BENCH_LOCK_NS + (uint64_t)bytes * BENCH_BYTE_NS);
+	if (Write) {
+		memcpy(&Bench->Chip[Reg], Data, Length);
+	}
+	else {
+		memcpy(Data, &Bench->Chip[Reg], Length);
+	}
+	pthread_mutex_unlock(&Bench->BusLock);
+}
+
+//
+// GmaxShadowStore
+//
+static void
+BenchShadowStore(
+	BENCH* Bench,
+	uint16_t Reg,
+	const uint8_t* Data,
+	uint32_t Length
+)
+{
+	unsigned sequence = atomic_load_explicit(&Bench->Sequence, memory_order_relaxed);
+
+	atomic_store_explicit(&Bench->Sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	for (uint32_t i = 0; i < Length; i++) {
+		atomic_store_explicit(&Bench->Value[Reg + i], Data[i], memory_order_relaxed);
+	}
+
+	atomic_store_explicit(&Bench->Sequence, sequence + 2, memory_order_release);
+}
+
+//
+// GmaxShadowRead, for a block of registers
+//
+static void
+BenchShadowRead(
+	BENCH* Bench,
+	uint16_t Reg,
+	uint8_t* Data,
+	uint32_t Length,
+	uint64_t* Retries
+)
+{
+	for (;;) {
+		unsigned sequence = atomic_load_explicit(&Bench->Sequence, memory_order_acquire);
+
+		if (sequence & 1) {
+			(*Retries)++;
+			continue;
+		}
+
+		for (uint32_t i = 0; i < Length; i++) {
+			Data[i] = atomic_load_explicit(&Bench->Value[Reg + i], memory_order_relaxed);
+		}
+
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&Bench->Sequence, memory_order_relaxed) == sequence) {
+			return;
+		}
+		(*Retries)++;
+	}
+}
+
+static void*
+BenchStartCodecThread(
+	void* Context
+)
+{
+	BENCH* bench = (BENCH*)Context;
+	uint8_t generation = 0;
+
+	while (BenchNow() < bench->EndNs) {
+		uint64_t start = BenchNow();
+		uint8_t block[BENCH_BLOCK];
+
+		generation++;
+		memset(block, generation, sizeof(block));
+
+		for (unsigned w = 0; w < BENCH_START_WRITES; w++) {
+			uint16_t reg = (uint16_t)((w * BENCH_BLOCK) % (BENCH_REGS - BENCH_BLOCK));
+
+			BenchTransfer(bench, reg, block, BENCH_BLOCK, 1);
+			BenchShadowStore(bench, reg, block, BENCH_BLOCK);
+		}
+
+		BenchRecord(&bench->Start, BenchNow() - start);
+		BenchSleepUntil(BenchNow() + BENCH_START_GAP_US * 1000ULL);
+	}
+
+	atomic_store(&bench->Stop, 1);
+	return NULL;
+}
+
+static void*
+BenchReaderThread(
+	void* Context
+)
+{
+	BENCH_READER* reader = (BENCH_READER*)Context;
+	BENCH* bench = reader->Bench;
+	uint64_t next = BenchNow();
+
+	while (!atomic_load(&bench->Stop)) {
+		uint16_t reg = (uint16_t)(BenchRandom(&reader->Random) % (BENCH_START_WRITES) * BENCH_BLOCK);
+		uint8_t data[BENCH_BLOCK];
+		uint64_t start = BenchNow();
+
+		if (bench->Mode == BenchBus) {
+			BenchTransfer(bench, reg, data, BENCH_BLOCK, 0);
+		}
+		else {
+			BenchShadowRead(bench, reg, data, BENCH_BLOCK, &reader->Retries);
+		}
+		BenchRecord(&reader->Latency, BenchNow() - start);
+
+		for (unsigned i = 1; i < BENCH_BLOCK; i++) {
+			if (data[i] != data[0]) {
+				reader->Torn++;
+				break;
+			}
+		}
+
+		next += (uint64_t)bench->ReadUs * 1000ULL;
+		if (next > BenchNow()) {
+			BenchSleepUntil(next);
+		}
+		else {
+			next = BenchNow();
+		}
+	}
+
+	return NULL;
+}
+
+static void
+BenchRun(
+	BENCH_MODE Mode,
+	uint32_t Readers,
+	uint32_t DurationMs,
+	uint32_t ReadUs
+)
+{
+	static BENCH bench;
+	static BENCH_READER readers[BENCH_MAX_READERS];
+	pthread_t threads[BENCH_MAX_READERS];
+	pthread_t writer;
+	BENCH_HISTOGRAM latency;
+	uint64_t torn = 0, retries = 0;
+
+	memset(&bench, 0, sizeof(bench));
+	memset(readers, 0, sizeof(readers));
+	memset(&latency, 0, sizeof(latency));
+
+	bench.Mode = Mode;
+	bench.ReadUs = ReadUs;
+	bench.EndNs = BenchNow() + (uint64_t)DurationMs * 1000000ULL;
+	pthread_mutex_init(&bench.BusLock, NULL);
+	atomic_init(&bench.Sequence, 0);
+	atomic_init(&bench.Stop, 0);
+	for (unsigned r = 0; r < BENCH_REGS; r++) {
+		atomic_init(&bench.Value[r], 0);
+	}
+
+	pthread_create(&writer, NULL, BenchStartCodecThread, &bench);
+	for (uint32_t i = 0; i < Readers; i++) {
+		readers[i].Bench = &bench;
+		readers[i].Random = (i + 1) * 0x9E3779B97F4A7C15ULL;
+		pthread_create(&threads[i], NULL, BenchReaderThread, &readers[i]);
+	}
+
+	pthread_join(writer, NULL);
+	for (uint32_t i = 0; i < Readers; i++) {
+		pthread_join(threads[i], NULL);
+		BenchMerge(&latency, &readers[i].Latency);
+		torn += readers[i].Torn;
+		retries += readers[i].Retries;
+	}
+	pthread_mutex_destroy(&bench.BusLock);
+
+	printf("%-6s  reads %9llu  mean %10.0f ns  p50 <%9llu  p99 <%9llu  max %9llu ns  torn %llu  retries %llu\n",
+		Mode == BenchBus ? "bus" : "shadow",
+		(unsigned long long)latency.Count,
+		latency.Count ? (double)latency.TotalNs / latency.Count : 0.0,
+		(unsigned long long)BenchPercentile(&latency, 50),
+		(unsigned long long)BenchPercentile(&latency, 99),
+		(unsigned long long)latency.MaxNs,
+		(unsigned long long)torn,
+		(unsigned long long)retries);
+	printf("        StartCodec %5llu runs  mean %8.2f ms  max %8.2f ms\n",
+		(unsigned long long)bench.Start.Count,
+		bench.Start.Count ? bench.Start.TotalNs / 1e6 / bench.Start.Count : 0.0,
+		bench.Start.MaxNs / 1e6);
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	uint32_t readers = 4;
+	uint32_t durationMs = 2000;
+	uint32_t readUs = 500;
+	int bus = 1, shadow = 1;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-readers") && i + 1 < argc) {
+			readers = (uint32_t)atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-ms") && i + 1 < argc) {
+			durationMs = (uint32_t)atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-read-us") && i + 1 < argc) {
+			readUs = (uint32_t)atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-mode") && i + 1 < argc) {
+			i++;
+			bus = strcmp(argv[i], "shadow") != 0;
+			shadow = strcmp(argv[i], "bus") != 0;
+		}
+		else {
+			fprintf(stderr, "usage: %s [-readers n] [-ms duration] [-read-us period] [-mode bus|shadow|both]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (readers == 0 || readers > BENCH_MAX_READERS) {
+		fprintf(stderr, "readers must be 1-%u\n", BENCH_MAX_READERS);
+		return 1;
+	}
+
+	printf("StartCodec: %u writes of %u registers every %u us, %u readers every %u us, %u ms per mode\n\n",
+		BENCH_START_WRITES, BENCH_BLOCK, BENCH_START_GAP_US, readers, readUs, durationMs);
+
+	if (bus) {
+		BenchRun(BenchBus, readers, durationMs, readUs);
+	}
+	if (shadow) {
+		BenchRun(BenchShadow, readers, durationMs, readUs);
+	}
+
+	return 0;
+}
@@ -0,0 +1,1196 @@
+/*++
+
+Module Name:
+
+gmaxsoak.c
+
+Abstract:
+
+Soak and fault-injection harness for the codec's power paths. Runs a
+long stretch of virtual time against the simulated amp the host tools
+share (tools/simamp/simamp.h): system sleep and wake cycles
+(OnD0Exit/OnD0Entry), storms of short CsAudio Start/Stop pairs such as
+notification sounds, which idle the device in and out of D0, and
+BCLK/LRCLK stops while a stream plays.
+
+The driver side runs the decisions the driver itself compiles: the
+codec state StartCodec, StopCodec, OnD0Entry/OnD0Exit, the recovery
+pass and the clock-loss handlers share (codecstate.h), SPB retries and
+the circuit breaker (spbretry.h), power sequencing (powerseq.h), the
+interrupt sources (intflags.h), the tuning bursts (tuningfile.h) and
+the clock recovery plan (clkmon.h).
+What is left here is the bus I/O each step does and the timers:
+recovery, S0 idle and the sentinel poll. Faults are injected per
+transfer attempt (NACK, latency spike, a hung transfer that runs into
+its timeout) and per clock stop (the amp resets before the clock comes
+back, losing its interrupts, so only the sentinel poll notices).
+
+After every operation the model is checked against the amp:
+
+	image		a started codec has the image the driver wrote
+	on-stopped	the amp does not play while the driver has it stopped,
+			unless a failed power-down has a recovery pass coming
+	silent		a started codec with a running clock is not muted
+	stuck-muted	the driver does not think the clock is still gone
+			once a sentinel poll has had time to run after it
+			came back
+	leak		no buffer outlives the operation that took it
+
+The report gives, per epoch of -epoch cycles and for the whole run,
+operation counts and p50/p99/p99.9/max latency, injected faults,
+retries, breaker trips, recovery passes, allocations and check
+failures, with the first few failures of each check as they happen.
+It depends only on the options, so reports from two builds of the
+model or the shared headers diff line by line.
+
+Usage: gmaxsoak [-cycles n] [-epoch n] [-storm n] [-nack p] [-spike p]
+	[-spike-us us] [-hang p] [-clock p] [-reset p] [-seed n]
+
+Environment:
+
+Host, portable C
+
+--*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../opengmaxcodec/spbretry.h"
+#include "../../opengmaxcodec/powerseq.h"
+#include "../../opengmaxcodec/tuningfile.h"
+#include "../../opengmaxcodec/codecstate.h"
+#include "../../opengmaxcodec/intflags.h"
+#include "../simamp/simamp.h"
+
+#define GMAX_POWER_STALL_MAX_US 10	// opengmaxcodec/power.h
+#define GMAX_IDLE_TIMEOUT_MS 1000	// S0 idle settings, opengmaxcodec.c
+#define DEFAULT_SPB_BUFFER_SIZE 64	// opengmaxcodec/spb.h
+
+#define SIM_ENABLE 0x01
+
+#define SIM_TIMER_US 100		// high-resolution timer and work item
+#define SIM_IRQ_LATENCY_US 200		// as gmaxclocksim
+#define SIM_AMP_TURN_ON_US 1000
+#define SIM_POWER_SETTLE_US 2		// default platform quirk
+#define SIM_SOUND_GAP_MS 1500		// mean time between notification sounds
+#define SIM_AWAKE_TAIL_MS 3000		// after the last sound, before suspend
+#define SIM_ASLEEP_S 60
+#define SIM_CHECK_REPORT 5		// failures printed per check
+
+//
+// Latency histogram, 32 linear buckets per power of two
+//
+#define SIM_HIST_SUB_BITS 5
+#define SIM_HIST_SUB (1u << SIM_HIST_SUB_BITS)
+#define SIM_HIST_BUCKETS (SIM_HIST_SUB * 40)
+
+typedef struct _SIM_HIST {
+	uint64_t Count;
+	uint64_t TotalUs;
+	uint64_t MaxUs;
+	uint32_t Bucket[SIM_HIST_BUCKETS];
+} SIM_HIST;
+
+typedef enum {
+	SimOpD0Entry,
+	SimOpD0Exit,
+	SimOpStreamStart,
+	SimOpStreamStop,
+	SimOpClockRecovery,	// clock back to output, amp turn-on included
+	SimOpClockPoll,		// sentinel poll while the clock is lost
+	SimOpRecovery,		// recovery timer pass
+	SimOpTransfer,		// retries and backoff included
+	SimOpMax
+} SIM_OP;
+
+static const char* SimOpNames[SimOpMax] = {
+	"D0Entry",
+	"D0Exit",
+	"stream-start",
+	"stream-stop",
+	"clock-recovery",
+	"clock-poll",
+	"recovery-pass",
+	"transfer"
+};
+
+typedef enum {
+	SimCheckImage,
+	SimCheckOnStopped,
+	SimCheckSilent,
+	SimCheckStuckMuted,
+	SimCheckLeak,
+	SimCheckMax
+} SIM_CHECK;
+
+static const char* SimCheckNames[SimCheckMax] = {
+	"image",
+	"on-stopped",
+	"silent",
+	"stuck-muted",
+	"leak"
+};
+
+typedef enum {
+	SimSuccess,
+	SimBusFailure,		// timeout, NACK or fast fail, GmaxIsBusFailure
+	SimPlanFailure		// clock recovery found the amp reset
+} SIM_STATUS;
+
+typedef struct _SIM_CONFIG {
+	uint64_t Cycles;
+	uint64_t Epoch;
+	uint32_t Storm;			// mean sounds per wake
+	double Nack;
+	double Spike;
+	uint32_t SpikeUs;
+	double Hang;
+	double Clock;			// clock stop per stream
+	double Reset;			// amp reset per clock stop
+	uint64_t Seed;
+} SIM_CONFIG;
+
+typedef struct _SIM_COUNTERS {
+	SIM_HIST Op[SimOpMax];
+	uint64_t Nacks;
+	uint64_t Spikes;
+	uint64_t Hangs;
+	uint64_t Retries;
+	uint64_t FastFails;
+	uint64_t Trips;
+	uint64_t BusFailures;		// D0Entry, clock and recovery sequences
+	uint64_t ClockStops;
+	uint64_t AmpResets;
+	uint64_t Allocations;
+	uint64_t Checks[SimCheckMax];
+} SIM_COUNTERS;
+
+typedef struct _SIM {
+	SIM_CONFIG Config;
+	uint64_t Random;
+	uint64_t Now;			// 100ns, like interrupt time
+	uint64_t Cycle;
+
+	//
+	// The amp
+	//
+	SIM_AMP Amp;
+
+	//
+	// The driver
+	//
+	uint64_t Deadline;
+	GMAX_TUNING_IMAGE Image;
+	uint8_t* Wire;
+	int D0;
+	int Streaming;
+	GMAX_CODEC_STATE Codec;
+	uint64_t RecoveryDue;		// 0 when the timer is not queued
+	uint64_t IdleDue;
+	uint64_t ClockPollDue;
+
+	uint64_t ClockBackAt;		// the amp's clock last came back
+
+	uint64_t LiveAllocations;
+	uint64_t LiveBytes;
+	uint64_t PeakBytes;
+	uint64_t BaseAllocations;	// held for the life of the device
+
+	SIM_COUNTERS Epoch;
+	SIM_COUNTERS Total;
+} SIM;
+
+//
+// A MAX98512-like init image and its power sequences
+//
+static const uint16_t SimImageRegs[] = { 0x0011, 0x0014, 0x0015, 0x0016, 0x0018, 0x0020, 0x0022, 0x0023, 0x0024, 0x0025, 0x0026, 0x0041 };
+static const uint8_t SimImageValues[] = { 0x03, 0x10, 0x8C, 0x08, 0x03, 0x58, 0x26, 0x08, 0x88, 0x40, 0x01, 0x07 };
+
+static const GMAX_POWER_STEP SimPowerUpSteps[] = {
+	{{{MAX98512_R0400_GLOBAL_SHDN, SIM_ENABLE}}, 1, GMAX_POWER_SETTLE_QUIRK},
+	{{{MAX98512_R0038_AMP_EN, SIM_ENABLE}}, 1, 0}
+};
+
+static const GMAX_POWER_STEP SimPowerDownSteps[] = {
+	{{{MAX98512_R0401_SOFT_RESET, SIM_ENABLE}}, 1, 0}
+};
+
+//
+// The BDE runs, as GmaxBdeApply writes them after GmaxBdeInvalidate
+//
+static const struct {
+	uint16_t Reg;
+	uint8_t Length;
+} SimBdeRuns[] = {
+	{ MAX98512_R0050_BROWNOUT_EN, 4 },
+	{ MAX98512_R0058_BROWNOUT_LVL1_THRESH, 8 },
+	{ MAX98512_R0070_BROWNOUT_LVL1_CUR_LIMIT, 16 }
+};
+
+#define SIM_COUNT(Sim, Field, N) ((Sim)->Epoch.Field += (N), (Sim)->Total.Field += (N))
+
+//
+// Exponential with the given mean, without libm
+//
+static uint64_t
+SimExponentialMs(
+	uint64_t* State,
+	uint32_t MeanMs
+)
+{
+	double u = SimUniform(State);
+	double x = 0;
+
+	//
+	// -ln(1 - u) by summing the series of ln(1 - u) for u < 0.5 and
+	// reflecting for the rest, good to well under a millisecond
+	//
+	if (u > 0.999) {
+		u = 0.999;
+	}
+	for (unsigned k = 1; k < 400; k++) {
+		double term = 1.0;
+
+		for (unsigned i = 0; i < k; i++) {
+			term *= u;
+		}
+		x += term / k;
+		if (term / k < 1e-9) {
+			break;
+		}
+	}
+	return (uint64_t)(x * MeanMs);
+}
+
+static unsigned
+SimHistBucket(
+	uint64_t Us
+)
+{
+	unsigned shift = 0;
+	unsigned index;
+
+	if (Us < SIM_HIST_SUB) {
+		return (unsigned)Us;
+	}
+	while ((Us >> shift) >= 2 * SIM_HIST_SUB) {
+		shift++;
+	}
+	index = (shift + 1) * SIM_HIST_SUB + (unsigned)((Us >> shift) - SIM_HIST_SUB);
+	return index < SIM_HIST_BUCKETS ? index : SIM_HIST_BUCKETS - 1;
+}
+
+//
+// Upper bound of the bucket holding the given per-mille
+//
+static uint64_t
+SimHistPercentile(
+	const SIM_HIST* Hist,
+	unsigned PerMille
+)
+{
+	uint64_t target = (Hist->Count * PerMille + 999) / 1000;
+	uint64_t seen = 0;
+
+	for (unsigned b = 0; b < SIM_HIST_BUCKETS; b++) {
+		seen += Hist->Bucket[b];
+		if (seen >= target && seen != 0) {
+			unsigned shift;
+			uint64_t upper;
+
+			if (b < SIM_HIST_SUB) {
+				return b;
+			}
+			shift = b / SIM_HIST_SUB - 1;
+			upper = (((uint64_t)SIM_HIST_SUB + b % SIM_HIST_SUB + 1) << shift) - 1;
+			return upper < Hist->MaxUs ? upper : Hist->MaxUs;
+		}
+	}
+	return 0;
+}
+
+static void
+SimRecord(
+	SIM* Sim,
+	SIM_OP Op,
+	uint64_t Start
+)
+{
+	uint64_t us = (Sim->Now - Start) / 10;
+	SIM_HIST* hists[2] = { &Sim->Epoch.Op[Op], &Sim->Total.Op[Op] };
+
+	for (unsigned i = 0; i < 2; i++) {
+		hists[i]->Count++;
+		hists[i]->TotalUs += us;
+		hists[i]->Bucket[SimHistBucket(us)]++;
+		if (us > hists[i]->MaxUs) {
+			hists[i]->MaxUs = us;
+		}
+	}
+}
+
+//
+// Every buffer the modelled driver takes goes through here
+//
+static void*
+SimAlloc(
+	SIM* Sim,
+	uint32_t Size
+)
+{
+	void* p = malloc(Size);
+
+	if (p) {
+		Sim->LiveAllocations++;
+		Sim->LiveBytes += Size;
+		if (Sim->LiveBytes > Sim->PeakBytes) {
+			Sim->PeakBytes = Sim->LiveBytes;
+		}
+		SIM_COUNT(Sim, Allocations, 1);
+	}
+	return p;
+}
+
+static void
+SimFree(
+	SIM* Sim,
+	void* P,
+	uint32_t Size
+)
+{
+	if (P) {
+		free(P);
+		Sim->LiveAllocations--;
+		Sim->LiveBytes -= Size;
+	}
+}
+
+static void
+SimRecoverySchedule(
+	SIM* Sim,
+	uint32_t DelayMs
+)
+{
+	Sim->RecoveryDue = Sim->Now + SIM_MS(DelayMs ? DelayMs : 1);
+}
+
+//
+// GmaxRecoveryRetry
+//
+static void
+SimRecoveryRetry(
+	SIM* Sim
+)
+{
+	uint32_t delayMs = SPB_BREAKER_COOLDOWN_MS;
+
+	if (Sim->Amp.Breaker.State == SpbBreakerOpen) {
+		delayMs = Sim->Amp.Breaker.OpenUntil > Sim->Now ?
+			(uint32_t)((Sim->Amp.Breaker.OpenUntil - Sim->Now) / 10000) + 1 :
+			1;
+	}
+	SimRecoverySchedule(Sim, delayMs);
+}
+
+//
+// GmaxRecoveryNext
+//
+static void
+SimRecoveryNext(
+	SIM* Sim,
+	GMAX_CODEC_NEXT Next
+)
+{
+	if (Next == GmaxCodecRetry) {
+		SimRecoveryRetry(Sim);
+	}
+	else if (Next == GmaxCodecRestart) {
+		SimRecoverySchedule(Sim, 1);
+	}
+}
+
+//
+// SpbTransfer: one write, or an address write and a read, with the
+// retry and breaker policy of spb.c. Messages that do not fit a
+// preallocated buffer take their own.
+//
+static SIM_STATUS
+SimTransfer(
+	SIM* Sim,
+	int Write,
+	uint16_t Reg,
+	uint8_t* Data,
+	uint32_t Length
+)
+{
+	uint64_t start = Sim->Now;
+	uint32_t bufferSize = Write ? 2 + Length : Length;
+	void* buffer = NULL;
+	SIM_AMP_RESULT result;
+	SIM_STATUS status;
+
+	if (bufferSize > DEFAULT_SPB_BUFFER_SIZE) {
+		buffer = SimAlloc(Sim, bufferSize);
+	}
+
+	status = SimAmpTransfer(&Sim->Amp, Sim->Deadline, Write, Reg, Data, Length, &result) ==
+		SimAmpSuccess ? SimSuccess : SimBusFailure;
+	SIM_COUNT(Sim, Nacks, result.Nacks);
+	SIM_COUNT(Sim, Spikes, result.Spikes);
+	SIM_COUNT(Sim, Hangs, result.Hangs);
+	SIM_COUNT(Sim, Retries, result.Retries);
+	SIM_COUNT(Sim, FastFails, result.FastFails);
+
+	SimFree(Sim, buffer, bufferSize);
+	SimRecord(Sim, SimOpTransfer, start);
+
+	//
+	// GmaxSpbBreakerOpened
+	//
+	if (result.Tripped) {
+		SIM_COUNT(Sim, Trips, 1);
+		SimRecoverySchedule(Sim, Sim->Amp.Breaker.CooldownMs);
+	}
+	return status;
+}
+
+static SIM_STATUS
+SimWrite(
+	SIM* Sim,
+	uint16_t Reg,
+	uint8_t Value
+)
+{
+	return SimTransfer(Sim, 1, Reg, &Value, 1);
+}
+
+//
+// GmaxPowerUp/GmaxPowerDown. A settle longer than the stall limit is
+// a timer and a work item later; single-threaded, the model waits it
+// out in line.
+//
+static SIM_STATUS
+SimPowerSequence(
+	SIM* Sim,
+	const GMAX_POWER_STEP* Steps,
+	uint32_t Count
+)
+{
+	GMAX_POWER_SEQ seq;
+	const GMAX_POWER_STEP* step;
+	SIM_STATUS status = SimSuccess;
+
+	GmaxPowerSeqStart(&seq, Steps, Count, SIM_POWER_SETTLE_US, Sim->Now);
+	for (;;) {
+		GMAX_POWER_SEQ_ACTION action = GmaxPowerSeqNext(&seq, Sim->Now, &step);
+
+		if (action == GmaxPowerSeqStop) {
+			break;
+		}
+
+		if (action == GmaxPowerSeqWrite) {
+			for (uint32_t i = 0; i < step->Count && status == SimSuccess; i++) {
+				status = SimWrite(Sim, step->Writes[i].Reg, step->Writes[i].Value);
+			}
+			GmaxPowerSeqWritten(&seq, status == SimSuccess, Sim->Now);
+			continue;
+		}
+
+		if (seq.DueAt - Sim->Now > SIM_US(GMAX_POWER_STALL_MAX_US)) {
+			Sim->Now = seq.DueAt + SIM_US(SIM_TIMER_US);
+		}
+		else {
+			Sim->Now = seq.DueAt;
+		}
+	}
+
+	return seq.State == GmaxPowerSeqDone ? SimSuccess : status;
+}
+
+//
+// GmaxClockSentinel: PCM_MODE_CFG as the image writes it
+//
+static uint8_t
+SimClockSentinel(
+	const SIM* Sim
+)
+{
+	uint8_t expected = 0;
+
+	for (uint32_t i = 0; i < Sim->Image.Count; i++) {
+		if (Sim->Image.Reg[i] == MAX98512_R0020_PCM_MODE_CFG) {
+			expected = Sim->Image.Value[i];
+		}
+	}
+	return expected;
+}
+
+//
+// StartCodecStep: the bus I/O of one step
+//
+static SIM_STATUS
+SimStartCodecStep(
+	SIM* Sim,
+	GMAX_CODEC_STEP Step
+)
+{
+	static const uint8_t bde[16] = { 0 };
+	uint8_t clear[3] = { 0xFF, 0xFF, 0xFF };
+	uint8_t buffer[16];
+	uint8_t revId = 0;
+	SIM_STATUS status = SimSuccess;
+
+	switch (Step) {
+	case GmaxCodecStepReset:
+		return SimPowerSequence(Sim, SimPowerDownSteps, 1);
+
+	case GmaxCodecStepRevId:
+		return SimTransfer(Sim, 0, MAX98512_R0402_REV_ID, &revId, 1);
+
+	case GmaxCodecStepTuning:
+		for (uint32_t b = 0; b < Sim->Image.Bursts && status == SimSuccess; b++) {
+			uint32_t start = Sim->Image.BurstStart[b];
+
+			status = SimTransfer(Sim, 1, Sim->Image.Reg[start], Sim->Wire + start + 2 * b + 2,
+				Sim->Image.BurstLength[b]);
+		}
+		return status;
+
+	case GmaxCodecStepVolume:
+		status = SimWrite(Sim, MAX98512_R0035_AMP_VOL_CTRL, 0x40);
+		if (status == SimSuccess) {
+			status = SimWrite(Sim, MAX98512_R003A_SPK_GAIN, 0x05);
+		}
+		return status;
+
+	case GmaxCodecStepBde:
+		for (uint32_t i = 0; i < sizeof(SimBdeRuns) / sizeof(SimBdeRuns[0]) && status == SimSuccess; i++) {
+			memcpy(buffer, bde, SimBdeRuns[i].Length);
+			status = SimTransfer(Sim, 1, SimBdeRuns[i].Reg, buffer, SimBdeRuns[i].Length);
+		}
+		return status;
+
+	case GmaxCodecStepInterrupts:
+		memcpy(buffer, GmaxIntEnableMask, sizeof(GmaxIntEnableMask));
+		status = SimTransfer(Sim, 1, MAX98512_R000D_INT_FLAG_CLR1, clear, sizeof(clear));
+		if (status == SimSuccess) {
+			status = SimTransfer(Sim, 1, MAX98512_R000A_INT_EN1, buffer, sizeof(GmaxIntEnableMask));
+		}
+		if (status == SimSuccess) {
+			status = SimWrite(Sim, MAX98512_R0010_IRQ_CTRL, MAX98512_IRQ_CTRL_EN);
+		}
+		return status;
+
+	case GmaxCodecStepPowerUp:
+		return SimPowerSequence(Sim, SimPowerUpSteps, 2);
+
+	default:
+		return SimSuccess;
+	}
+}
+
+static SIM_STATUS
+SimStartCodec(
+	SIM* Sim
+)
+{
+	GMAX_CODEC_STEP step = GmaxCodecStartFirst(&Sim->Codec);
+	SIM_STATUS status = SimSuccess;
+
+	while (step != GmaxCodecStepDone) {
+		status = SimStartCodecStep(Sim, step);
+		step = GmaxCodecStartStep(&Sim->Codec, step, status == SimSuccess);
+	}
+	return status;
+}
+
+//
+// StopCodec, under its own resume deadline. GmaxClockStop first.
+//
+static SIM_STATUS
+SimStopCodec(
+	SIM* Sim
+)
+{
+	SIM_STATUS status;
+
+	Sim->ClockPollDue = 0;
+
+	Sim->Deadline = Sim->Now + SIM_MS(GMAX_RESUME_DEADLINE_MS);
+	status = SimPowerSequence(Sim, SimPowerDownSteps, 1);
+	Sim->Deadline = 0;
+
+	SimRecoveryNext(Sim, GmaxCodecStopped(&Sim->Codec, status == SimSuccess));
+	return status;
+}
+
+static void
+SimD0Entry(
+	SIM* Sim
+)
+{
+	uint64_t start = Sim->Now;
+	SIM_STATUS status;
+
+	Sim->D0 = 1;
+	Sim->RecoveryDue = 0;
+	GmaxCodecD0Entry(&Sim->Codec);
+
+	Sim->Deadline = Sim->Now + SIM_MS(GMAX_RESUME_DEADLINE_MS);
+	status = SimStartCodec(Sim);
+	Sim->Deadline = 0;
+
+	if (status != SimSuccess) {
+		SIM_COUNT(Sim, BusFailures, 1);
+	}
+	SimRecoveryNext(Sim, GmaxCodecD0EntryDone(status == SimBusFailure));
+	SimRecord(Sim, SimOpD0Entry, start);
+}
+
+static void
+SimD0Exit(
+	SIM* Sim
+)
+{
+	uint64_t start = Sim->Now;
+
+	GmaxCodecD0Exit(&Sim->Codec);
+	Sim->RecoveryDue = 0;
+	SimStopCodec(Sim);
+	Sim->D0 = 0;
+	SimRecord(Sim, SimOpD0Exit, start);
+}
+
+//
+// GmaxEvtRecoveryTimer
+//
+static void
+SimRecoveryPass(
+	SIM* Sim
+)
+{
+	uint64_t start = Sim->Now;
+	SIM_STATUS status;
+	GMAX_CODEC_NEXT next;
+
+	Sim->RecoveryDue = 0;
+	if (!GmaxCodecRecoveryBegin(&Sim->Codec)) {
+		return;
+	}
+
+	Sim->Deadline = Sim->Now + SIM_MS(GMAX_RECOVERY_DEADLINE_MS);
+	status = SimPowerSequence(Sim, SimPowerDownSteps, 1);
+	if (GmaxCodecRecoveryReset(&Sim->Codec, status == SimSuccess)) {
+		status = SimStartCodec(Sim);
+	}
+	Sim->Deadline = 0;
+	SimRecord(Sim, SimOpRecovery, start);
+
+	if (status == SimSuccess) {
+		return;
+	}
+
+	SIM_COUNT(Sim, BusFailures, 1);
+	next = GmaxCodecRecoveryDone(&Sim->Codec, 0);
+	SimRecoveryNext(Sim, next);
+}
+
+//
+// GmaxClockHandleLoss, from the CLK_ERR interrupt
+//
+static void
+SimClockLoss(
+	SIM* Sim
+)
+{
+	Sim->Amp.Clock = 0;
+	SIM_COUNT(Sim, ClockStops, 1);
+
+	if (!(Sim->Amp.Regs[MAX98512_R0010_IRQ_CTRL] & MAX98512_IRQ_CTRL_EN)) {
+		return;
+	}
+
+	Sim->Now += SIM_US(SIM_IRQ_LATENCY_US);
+	if (!GmaxCodecClockLoss(&Sim->Codec)) {
+		return;
+	}
+
+	SimWrite(Sim, MAX98512_R0038_AMP_EN, 0);
+	Sim->ClockPollDue = Sim->Now + SIM_MS(GMAX_CLOCK_POLL_MS);
+}
+
+//
+// GmaxEvtClockPollTimer: an amp that reset while the clock was gone
+// reads back a different PCM_MODE_CFG
+//
+static void
+SimClockPoll(
+	SIM* Sim
+)
+{
+	uint64_t start = Sim->Now;
+	uint8_t sentinel = 0;
+	SIM_STATUS status;
+	GMAX_CODEC_NEXT next;
+
+	Sim->ClockPollDue = 0;
+	if (!GmaxCodecClockLost(&Sim->Codec)) {
+		return;
+	}
+
+	status = SimTransfer(Sim, 0, MAX98512_R0020_PCM_MODE_CFG, &sentinel, 1);
+	next = GmaxCodecClockPolled(&Sim->Codec, status == SimSuccess, sentinel, SimClockSentinel(Sim));
+	SimRecord(Sim, SimOpClockPoll, start);
+
+	if (next == GmaxCodecPoll) {
+		Sim->ClockPollDue = Sim->Now + SIM_MS(GMAX_CLOCK_POLL_MS);
+		return;
+	}
+
+	if (status != SimSuccess) {
+		SIM_COUNT(Sim, BusFailures, 1);
+	}
+	SimRecoveryNext(Sim, next);
+}
+
+//
+// GmaxClockHandleRecovery, from the CLK_RECOVER interrupt. An amp that
+// reset while the clock was gone has its interrupts off and raises
+// nothing.
+//
+static void
+SimClockReturn(
+	SIM* Sim,
+	int Reset
+)
+{
+	uint64_t start = Sim->Now;
+	GMAX_CLOCK_PLAN plan = GmaxClockRestart;
+	uint8_t sentinel = 0;
+	uint8_t global = 0;
+	SIM_STATUS status;
+	GMAX_CODEC_NEXT next;
+
+	if (Reset) {
+		SimAmpReset(&Sim->Amp);
+		SIM_COUNT(Sim, AmpResets, 1);
+	}
+	Sim->Amp.Clock = 1;
+	Sim->ClockBackAt = Sim->Now;
+
+	if (!(Sim->Amp.Regs[MAX98512_R0010_IRQ_CTRL] & MAX98512_IRQ_CTRL_EN)) {
+		return;
+	}
+
+	Sim->Now += SIM_US(SIM_IRQ_LATENCY_US);
+	if (!GmaxCodecClockLost(&Sim->Codec)) {
+		return;
+	}
+
+	status = SimTransfer(Sim, 0, MAX98512_R0020_PCM_MODE_CFG, &sentinel, 1);
+	if (status == SimSuccess) {
+		status = SimTransfer(Sim, 0, MAX98512_R0400_GLOBAL_SHDN, &global, 1);
+	}
+	if (status == SimSuccess) {
+		plan = GmaxClockRecoveryPlan(sentinel, SimClockSentinel(Sim), global, SIM_ENABLE);
+	}
+
+	switch (plan) {
+	case GmaxClockAmpEnable:
+		status = SimWrite(Sim, MAX98512_R0038_AMP_EN, SIM_ENABLE);
+		break;
+	case GmaxClockPowerUp:
+		status = SimPowerSequence(Sim, SimPowerUpSteps, 2);
+		break;
+	default:
+		status = SimPlanFailure;
+		break;
+	}
+
+	next = GmaxCodecClockRecovered(&Sim->Codec, status == SimSuccess);
+	if (next != GmaxCodecNone) {
+		if (status == SimBusFailure) {
+			SIM_COUNT(Sim, BusFailures, 1);
+		}
+		SimRecoveryNext(Sim, next);
+		return;
+	}
+
+	Sim->Now += SIM_US(SIM_AMP_TURN_ON_US);
+	SimRecord(Sim, SimOpClockRecovery, start);
+}
+
+static void
+SimCheck(
+	SIM* Sim,
+	const char* After
+)
+{
+	const GMAX_CODEC_STATE* codec = &Sim->Codec;
+	int failed[SimCheckMax] = { 0 };
+	int quiet = Sim->RecoveryDue == 0 && codec->Clock == GmaxClockRunning;
+
+	//
+	// Longest a poll can take to see a changed sentinel once the clock
+	// is back: the poll period, then a read that runs out its retries
+	//
+	uint64_t pollUs = 1000ULL * (GMAX_CLOCK_POLL_MS + SPB_MAX_ATTEMPTS * SPB_TRANSFER_TIMEOUT_MS) +
+		SPB_MAX_ATTEMPTS * (SPB_BACKOFF_MAX_US + Sim->Config.SpikeUs);
+
+	//
+	// An amp a failed power-down left on is fine while a recovery pass
+	// is still coming for it
+	//
+	if (!codec->PoweredOn && SimAmpPlaying(&Sim->Amp) &&
+		!(codec->NeedsReset && Sim->RecoveryDue)) {
+		failed[SimCheckOnStopped] = 1;
+	}
+
+	if (codec->PoweredOn && quiet) {
+		for (uint32_t i = 0; i < Sim->Image.Count; i++) {
+			if (Sim->Amp.Regs[Sim->Image.Reg[i]] != Sim->Image.Value[i]) {
+				failed[SimCheckImage] = 1;
+				break;
+			}
+		}
+		if (Sim->Amp.Clock && !SimAmpPlaying(&Sim->Amp)) {
+			failed[SimCheckSilent] = 1;
+		}
+	}
+
+	if (GmaxCodecClockLost(codec) && Sim->Amp.Clock &&
+		Sim->Now - Sim->ClockBackAt > SIM_US(pollUs)) {
+		failed[SimCheckStuckMuted] = 1;
+	}
+
+	if (Sim->LiveAllocations != Sim->BaseAllocations) {
+		failed[SimCheckLeak] = 1;
+	}
+
+	for (unsigned c = 0; c < SimCheckMax; c++) {
+		if (!failed[c]) {
+			continue;
+		}
+		if (Sim->Total.Checks[c] < SIM_CHECK_REPORT) {
+			printf("check %s failed after %s, cycle %llu at %llu ms\n",
+				SimCheckNames[c], After,
+				(unsigned long long)Sim->Cycle,
+				(unsigned long long)(Sim->Now / 10000));
+		}
+		SIM_COUNT(Sim, Checks[c], 1);
+	}
+}
+
+//
+// Runs the recovery, clock poll and idle timers due before Until, then
+// moves to it
+//
+static void
+SimRunUntil(
+	SIM* Sim,
+	uint64_t Until
+)
+{
+	for (;;) {
+		uint64_t next = UINT64_MAX;
+
+		if (Sim->RecoveryDue && Sim->RecoveryDue < next) {
+			next = Sim->RecoveryDue;
+		}
+		if (Sim->IdleDue && Sim->IdleDue < next) {
+			next = Sim->IdleDue;
+		}
+		if (Sim->ClockPollDue && Sim->ClockPollDue < next) {
+			next = Sim->ClockPollDue;
+		}
+		if (next > Until) {
+			break;
+		}
+
+		if (Sim->Now < next) {
+			Sim->Now = next;
+		}
+
+		if (next == Sim->RecoveryDue) {
+			SimRecoveryPass(Sim);
+			SimCheck(Sim, "recovery-pass");
+		}
+		else if (next == Sim->ClockPollDue) {
+			SimClockPoll(Sim);
+			SimCheck(Sim, "clock-poll");
+		}
+		else {
+			Sim->IdleDue = 0;
+			if (Sim->D0 && !Sim->Streaming) {
+				SimD0Exit(Sim);
+				SimCheck(Sim, "idle D0Exit");
+			}
+		}
+	}
+
+	if (Sim->Now < Until) {
+		Sim->Now = Until;
+	}
+}
+
+//
+// CsAudioCallbackFunction: Start stops idle, which brings the device
+// to D0 first; Stop lets it idle out after the timeout
+//
+static void
+SimStreamStart(
+	SIM* Sim
+)
+{
+	uint64_t start = Sim->Now;
+
+	if (!Sim->Streaming) {
+		Sim->Streaming = 1;
+		Sim->IdleDue = 0;
+		if (!Sim->D0) {
+			SimD0Entry(Sim);
+		}
+	}
+	SimRecord(Sim, SimOpStreamStart, start);
+}
+
+static void
+SimStreamStop(
+	SIM* Sim
+)
+{
+	uint64_t start = Sim->Now;
+
+	if (Sim->Streaming) {
+		Sim->Streaming = 0;
+		Sim->IdleDue = Sim->Now + SIM_MS(GMAX_IDLE_TIMEOUT_MS);
+	}
+	SimRecord(Sim, SimOpStreamStop, start);
+}
+
+static void
+SimSound(
+	SIM* Sim
+)
+{
+	uint64_t end;
+
+	SimRunUntil(Sim, Sim->Now + SIM_MS(SimExponentialMs(&Sim->Random, SIM_SOUND_GAP_MS)));
+
+	SimStreamStart(Sim);
+	SimCheck(Sim, "stream-start");
+	end = Sim->Now + SIM_MS(100 + SimRandom(&Sim->Random) % 700);
+
+	if (SimUniform(&Sim->Random) < Sim->Config.Clock) {
+		uint64_t stop = Sim->Now + (uint64_t)(SimUniform(&Sim->Random) * (end - Sim->Now));
+		uint64_t gap = SIM_MS(1 + SimRandom(&Sim->Random) % 50);
+		int reset = SimUniform(&Sim->Random) < Sim->Config.Reset;
+
+		SimRunUntil(Sim, stop);
+		SimClockLoss(Sim);
+		SimCheck(Sim, "clock stop");
+		SimRunUntil(Sim, stop + gap);
+		SimClockReturn(Sim, reset);
+		SimCheck(Sim, "clock return");
+	}
+
+	SimRunUntil(Sim, end);
+	SimStreamStop(Sim);
+	SimCheck(Sim, "stream-stop");
+}
+
+static void
+SimCycle(
+	SIM* Sim
+)
+{
+	uint32_t sounds = Sim->Config.Storm ?
+		(uint32_t)(SimRandom(&Sim->Random) % (2 * Sim->Config.Storm + 1)) : 0;
+
+	//
+	// Resume: D0 first, then idle unless a stream starts
+	//
+	SimD0Entry(Sim);
+	SimCheck(Sim, "D0Entry");
+	Sim->IdleDue = Sim->Now + SIM_MS(GMAX_IDLE_TIMEOUT_MS);
+
+	for (uint32_t s = 0; s < sounds; s++) {
+		SimSound(Sim);
+	}
+
+	SimRunUntil(Sim, Sim->Now + SIM_MS(SIM_AWAKE_TAIL_MS));
+
+	//
+	// Suspend
+	//
+	Sim->IdleDue = 0;
+	if (Sim->D0) {
+		SimD0Exit(Sim);
+		SimCheck(Sim, "D0Exit");
+	}
+	SimRunUntil(Sim, Sim->Now + SIM_MS(SIM_ASLEEP_S * 1000ULL));
+}
+
+static void
+SimReport(
+	const SIM* Sim,
+	const SIM_COUNTERS* Counters,
+	const char* Title
+)
+{
+	printf("\n%s\n", Title);
+	printf("  %-16s %10s %10s %10s %10s %10s\n", "op", "count", "p50-us", "p99-us", "p99.9-us", "max-us");
+	for (unsigned op = 0; op < SimOpMax; op++) {
+		const SIM_HIST* h = &Counters->Op[op];
+
+		printf("  %-16s %10llu %10llu %10llu %10llu %10llu\n",
+			SimOpNames[op],
+			(unsigned long long)h->Count,
+			(unsigned long long)SimHistPercentile(h, 500),
+			(unsigned long long)SimHistPercentile(h, 990),
+			(unsigned long long)SimHistPercentile(h, 999),
+			(unsigned long long)h->MaxUs);
+	}
+
+	printf("  faults: nack %llu, spike %llu, hang %llu, clock stop %llu, amp reset %llu\n",
+		(unsigned long long)Counters->Nacks,
+		(unsigned long long)Counters->Spikes,
+		(unsigned long long)Counters->Hangs,
+		(unsigned long long)Counters->ClockStops,
+		(unsigned long long)Counters->AmpResets);
+	printf("  bus: retries %llu, fast fails %llu, breaker trips %llu, failed sequences %llu\n",
+		(unsigned long long)Counters->Retries,
+		(unsigned long long)Counters->FastFails,
+		(unsigned long long)Counters->Trips,
+		(unsigned long long)Counters->BusFailures);
+	printf("  memory: allocations %llu, live %llu (%llu bytes), peak %llu bytes\n",
+		(unsigned long long)Counters->Allocations,
+		(unsigned long long)Sim->LiveAllocations,
+		(unsigned long long)Sim->LiveBytes,
+		(unsigned long long)Sim->PeakBytes);
+	printf("  checks:");
+	for (unsigned c = 0; c < SimCheckMax; c++) {
+		printf("%s %s %llu", c ? "," : "", SimCheckNames[c], (unsigned long long)Counters->Checks[c]);
+	}
+	printf("\n");
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	SIM_CONFIG config = { 100000, 10000, 4, 0.0005, 0.001, 5000, 0.00005, 0.02, 0.05, 1 };
+	static SIM sim;
+	SIM_AMP_FAULTS faults;
+	uint64_t epochStart = 0;
+	uint64_t failures = 0;
+	uint32_t wireSize;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "-cycles")) {
+			config.Cycles = strtoull(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-epoch")) {
+			config.Epoch = strtoull(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-storm")) {
+			config.Storm = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-nack")) {
+			config.Nack = atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-spike")) {
+			config.Spike = atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-spike-us")) {
+			config.SpikeUs = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+		}
+		else if (!strcmp(argv[i], "-hang")) {
+			config.Hang = atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-clock")) {
+			config.Clock = atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-reset")) {
+			config.Reset = atof(argv[i + 1]);
+		}
+		else if (!strcmp(argv[i], "-seed")) {
+			config.Seed = strtoull(argv[i + 1], NULL, 0);
+		}
+		else {
+			break;
+		}
+	}
+
+	if (config.Cycles == 0 || config.Epoch == 0 || (argc % 2) == 0) {
+		fprintf(stderr, "usage: %s [-cycles n] [-epoch n] [-storm n] [-nack p] [-spike p] "
+			"[-spike-us us] [-hang p] [-clock p] [-reset p] [-seed n]\n", argv[0]);
+		return 2;
+	}
+
+	sim.Config = config;
+	sim.Random = config.Seed * 0x94D049BB133111EBULL | 1;
+	faults.Nack = config.Nack;
+	faults.Spike = config.Spike;
+	faults.SpikeUs = config.SpikeUs;
+	faults.Hang = config.Hang;
+	SimAmpInitialize(&sim.Amp, &faults, &sim.Now, &sim.Random);
+
+	//
+	// OnPrepareHardware: the image and its wire layout, kept for the
+	// life of the device
+	//
+	for (uint32_t i = 0; i < sizeof(SimImageRegs) / sizeof(SimImageRegs[0]); i++) {
+		sim.Image.Reg[i] = SimImageRegs[i];
+		sim.Image.Value[i] = SimImageValues[i];
+		sim.Image.Count++;
+	}
+	GmaxTuningCompile(&sim.Image);
+
+	wireSize = sim.Image.Count + 2u * sim.Image.Bursts;
+	sim.Wire = (uint8_t*)SimAlloc(&sim, wireSize);
+	if (!sim.Wire) {
+		return 1;
+	}
+	for (uint32_t b = 0; b < sim.Image.Bursts; b++) {
+		uint32_t start = sim.Image.BurstStart[b];
+		uint8_t* p = sim.Wire + start + 2 * b;
+
+		p[0] = (uint8_t)(sim.Image.Reg[start] >> 8);
+		p[1] = (uint8_t)sim.Image.Reg[start];
+		memcpy(p + 2, &sim.Image.Value[start], sim.Image.BurstLength[b]);
+	}
+	sim.BaseAllocations = sim.LiveAllocations;
+
+	printf("gmaxsoak: %llu cycles, storm %u, nack %g, spike %g x %u us, hang %g, clock %g, reset %g, seed %llu\n",
+		(unsigned long long)config.Cycles, config.Storm, config.Nack, config.Spike, config.SpikeUs,
+		config.Hang, config.Clock, config.Reset, (unsigned long long)config.Seed);
+	printf("image: %u registers in %u bursts\n\n", sim.Image.Count, sim.Image.Bursts);
+
+	for (sim.Cycle = 0; sim.Cycle < config.Cycles; sim.Cycle++) {
+		SimCycle(&sim);
+
+		if ((sim.Cycle + 1) % config.Epoch == 0 || sim.Cycle + 1 == config.Cycles) {
+			char title[96];
+
+			snprintf(title, sizeof(title), "epoch cycles %llu-%llu",
+				(unsigned long long)epochStart, (unsigned long long)sim.Cycle);
+			SimReport(&sim, &sim.Epoch, title);
+			memset(&sim.Epoch, 0, sizeof(sim.Epoch));
+			epochStart = sim.Cycle + 1;
+		}
+	}
+
+	SimReport(&sim, &sim.Total, "total");
+
+	for (unsigned c = 0; c < SimCheckMax; c++) {
+		failures += sim.Total.Checks[c];
+	}
+
+	SimFree(&sim, sim.Wire, wireSize);
+	return failures ? 1 : 0;
+}
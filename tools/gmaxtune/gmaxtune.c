@@ -0,0 +1,693 @@
+/*++
+
+Module Name:
+
+gmaxtune.c
+
+Abstract:
+
+Compiles a readable tuning source into the binary tuning file the
+driver loads (opengmaxcodec/tuningfile.h), and prints binary files
+back.
+
+Source format, one statement per line, # starts a comment:
+
+    profile <name>                  starts a profile
+    [uid <n>:] <reg> = <v> [<v>...] values for <reg>, <reg>+1, ...
+    [uid <n>:] <reg> = <v>... & <m>...
+                                    only the bits in each mask; the
+                                    register must be in the init image
+
+Numbers are decimal or 0x hex. Runs longer than one SPB transfer are
+split. A uid prefix limits the run to the amp with that _UID.
+
+selftest compiles a sample, applies it over a sample init image and
+checks that every single bit flip and truncation of the file is
+rejected, and that runs outside the MAX98512 register map or on the
+registers the driver sequences itself are refused. apply checks a
+profile against the same MAX98512 limits.
+
+Usage: gmaxtune compile <source> <output>
+       gmaxtune dump <file>
+       gmaxtune apply <file> <profile> <uid>
+       gmaxtune selftest
+
+Environment:
+
+Host, portable C
+
+--*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../opengmaxcodec/tuningfile.h"
+#include "../../opengmaxcodec/max98512.h"
+
+#define MAX_PROFILES 64
+
+static const char* ResultNames[] = {
+	"ok",
+	"truncated",
+	"bad magic",
+	"bad version",
+	"bad checksum",
+	"bad run",
+	"bad profile name",
+	"no such profile",
+	"masked register not in the init image",
+	"too many registers",
+	"register outside the chip's register map",
+	"register the driver sequences itself"
+};
+
+typedef struct {
+	char Name[GMAX_TUNING_MAX_NAME + 1];
+	uint32_t Runs;
+	uint32_t Length;
+	uint8_t Body[GMAX_TUNING_MAX_SIZE];
+} PROFILE;
+
+static PROFILE Profiles[MAX_PROFILES];
+static uint32_t ProfileCount;
+
+//
+// A small init image to apply profiles over, shaped like the driver's
+//
+static const uint16_t SampleRegs[] = { 0x0014, 0x0015, 0x0016, 0x0018, 0x0020, 0x0022, 0x0023, 0x0024, 0x0025, 0x0026, 0x0041 };
+static const uint8_t SampleValues[] = { 0x10, 0x8C, 0x08, 0x03, 0x58, 0x26, 0x08, 0x88, 0x40, 0x01, 0x07 };
+
+static const char SampleSource[] =
+	"# sample tuning\n"
+	"profile default\n"
+	"0x0020 = 0x18 & 0xC0         # 32 bit slots\n"
+	"0x003A = 0x05 0x06 0x07\n"
+	"uid 1: 0x0025 = 0x00\n"
+	"profile quiet\n"
+	"0x0035 = 0x40\n";
+
+//
+// Well formed profiles the MAX98512 limits refuse, applied for _UID 0
+//
+static const struct {
+	const char* What;
+	const char* Source;
+	GMAX_TUNING_RESULT Result;
+} Refused[] = {
+	{ "run past the register map", "profile p\n0x0200 = 1\n", GmaxTuningOutsideMap },
+	{ "run across a gap in the map", "profile p\n0x008C = 1 2 3\n", GmaxTuningOutsideMap },
+	{ "run across the end of the 16 bit space", "profile p\n0xFFFF = 1\n", GmaxTuningOutsideMap },
+	{ "SOFT_RESET", "profile p\n0x0401 = 1\n", GmaxTuningReserved },
+	{ "GLOBAL_EN", "profile p\n0x0400 = 1\n", GmaxTuningReserved },
+	{ "AMP_EN", "profile p\n0x0038 = 1\n", GmaxTuningReserved },
+	{ "INT_EN2", "profile p\n0x000B = 0xFF\n", GmaxTuningReserved },
+	{ "IRQ_CTRL", "profile p\n0x0010 = 0\n", GmaxTuningReserved },
+	{ "run ending on AMP_EN", "profile p\n0x0036 = 1 2 3\n", GmaxTuningReserved },
+	{ "run starting on INT_EN3", "profile p\n0x000C = 1 2\n", GmaxTuningReserved },
+	{ "masked run on IRQ_CTRL", "profile p\n0x0010 = 1 & 1\n", GmaxTuningReserved },
+	{ "run for another amp", "profile p\n0x0020 = 0x18\nuid 5: 0x0038 = 1\n", GmaxTuningReserved }
+};
+
+static void
+Put16(
+	uint8_t* Data,
+	uint32_t Value
+)
+{
+	Data[0] = (uint8_t)Value;
+	Data[1] = (uint8_t)(Value >> 8);
+}
+
+static void
+Put32(
+	uint8_t* Data,
+	uint32_t Value
+)
+{
+	Put16(Data, Value & 0xFFFF);
+	Put16(Data + 2, Value >> 16);
+}
+
+static int
+ParseNumber(
+	char** Cursor,
+	uint32_t Max,
+	uint32_t* Value
+)
+{
+	char* end;
+	unsigned long value;
+
+	while (isspace((unsigned char)**Cursor)) {
+		(*Cursor)++;
+	}
+	if (!isdigit((unsigned char)**Cursor)) {
+		return 0;
+	}
+
+	errno = 0;
+	value = strtoul(*Cursor, &end, 0);
+	if (errno || value > Max) {
+		return 0;
+	}
+	*Cursor = end;
+	*Value = (uint32_t)value;
+	return 1;
+}
+
+static int
+ParseList(
+	char** Cursor,
+	uint8_t* Values,
+	uint32_t* Count
+)
+{
+	uint32_t value;
+
+	*Count = 0;
+	while (ParseNumber(Cursor, 0xFF, &value)) {
+		if (*Count >= 256) {
+			return 0;
+		}
+		Values[(*Count)++] = (uint8_t)value;
+	}
+	return *Count > 0;
+}
+
+static int
+AddRun(
+	PROFILE* Profile,
+	uint32_t Reg,
+	uint8_t Uid,
+	const uint8_t* Values,
+	const uint8_t* Masks,
+	uint32_t Count
+)
+{
+	for (uint32_t done = 0; done < Count; ) {
+		uint32_t length = Count - done > GMAX_TUNING_MAX_RUN ? GMAX_TUNING_MAX_RUN : Count - done;
+		uint32_t bytes = 5 + length * (Masks ? 2 : 1);
+		uint8_t* out = Profile->Body + Profile->Length;
+
+		if (Reg + done + length > 0x10000 || Profile->Length + bytes > sizeof(Profile->Body) ||
+			Profile->Runs >= 0xFFFF) {
+			return 0;
+		}
+
+		Put16(out, Reg + done);
+		out[2] = (uint8_t)length;
+		out[3] = Uid;
+		out[4] = Masks ? GMAX_TUNING_RUN_MASKED : 0;
+		memcpy(out + 5, Values + done, length);
+		if (Masks) {
+			memcpy(out + 5 + length, Masks + done, length);
+		}
+
+		Profile->Length += bytes;
+		Profile->Runs++;
+		done += length;
+	}
+	return 1;
+}
+
+static int
+ParseLine(
+	char* Line,
+	const char* Source,
+	int Number
+)
+{
+	uint8_t values[256], masks[256];
+	uint32_t reg, uid = GMAX_TUNING_UID_ANY, count, maskCount;
+	char* cursor = Line;
+	char* comment = strchr(Line, '#');
+
+	if (comment) {
+		*comment = '\0';
+	}
+	while (isspace((unsigned char)*cursor)) {
+		cursor++;
+	}
+	if (*cursor == '\0') {
+		return 1;
+	}
+
+	if (!strncmp(cursor, "profile", 7) && isspace((unsigned char)cursor[7])) {
+		char name[64];
+		PROFILE* profile;
+
+		if (sscanf(cursor + 7, " %63s", name) != 1 || strlen(name) > GMAX_TUNING_MAX_NAME) {
+			fprintf(stderr, "%s:%d: profile names are 1 to %d characters\n", Source, Number, GMAX_TUNING_MAX_NAME);
+			return 0;
+		}
+		for (uint32_t i = 0; i < ProfileCount; i++) {
+			if (!strcmp(Profiles[i].Name, name)) {
+				fprintf(stderr, "%s:%d: profile %s defined twice\n", Source, Number, name);
+				return 0;
+			}
+		}
+		if (ProfileCount >= MAX_PROFILES) {
+			fprintf(stderr, "%s:%d: more than %d profiles\n", Source, Number, MAX_PROFILES);
+			return 0;
+		}
+		profile = &Profiles[ProfileCount++];
+		memset(profile, 0, sizeof(*profile));
+		strcpy(profile->Name, name);
+		return 1;
+	}
+
+	if (ProfileCount == 0) {
+		fprintf(stderr, "%s:%d: register before the first profile\n", Source, Number);
+		return 0;
+	}
+
+	if (!strncmp(cursor, "uid", 3) && isspace((unsigned char)cursor[3])) {
+		cursor += 3;
+		if (!ParseNumber(&cursor, GMAX_TUNING_UID_ANY - 1, &uid) || *cursor++ != ':') {
+			fprintf(stderr, "%s:%d: expected uid <0-254>:\n", Source, Number);
+			return 0;
+		}
+	}
+
+	if (!ParseNumber(&cursor, 0xFFFF, &reg)) {
+		fprintf(stderr, "%s:%d: expected a register\n", Source, Number);
+		return 0;
+	}
+	while (isspace((unsigned char)*cursor)) {
+		cursor++;
+	}
+	if (*cursor++ != '=' || !ParseList(&cursor, values, &count)) {
+		fprintf(stderr, "%s:%d: expected = and byte values\n", Source, Number);
+		return 0;
+	}
+
+	while (isspace((unsigned char)*cursor)) {
+		cursor++;
+	}
+	if (*cursor == '&') {
+		cursor++;
+		if (!ParseList(&cursor, masks, &maskCount) || maskCount != count) {
+			fprintf(stderr, "%s:%d: expected one mask per value\n", Source, Number);
+			return 0;
+		}
+		while (isspace((unsigned char)*cursor)) {
+			cursor++;
+		}
+	}
+	else {
+		maskCount = 0;
+	}
+
+	if (*cursor != '\0') {
+		fprintf(stderr, "%s:%d: unexpected '%s'\n", Source, Number, cursor);
+		return 0;
+	}
+
+	if (!AddRun(&Profiles[ProfileCount - 1], reg, (uint8_t)uid, values, maskCount ? masks : NULL, count)) {
+		fprintf(stderr, "%s:%d: run past 0xFFFF or profile too large\n", Source, Number);
+		return 0;
+	}
+	return 1;
+}
+
+//
+// Returns the file size, 0 if it would not fit
+//
+static uint32_t
+Serialize(
+	uint8_t* Buffer,
+	uint32_t Capacity
+)
+{
+	uint32_t size = GMAX_TUNING_HEADER;
+
+	for (uint32_t i = 0; i < ProfileCount; i++) {
+		uint32_t nameLength = (uint32_t)strlen(Profiles[i].Name);
+
+		if (size + 1 + nameLength + 2 + Profiles[i].Length > Capacity) {
+			fprintf(stderr, "tuning file over %u bytes\n", Capacity);
+			return 0;
+		}
+		Buffer[size] = (uint8_t)nameLength;
+		memcpy(Buffer + size + 1, Profiles[i].Name, nameLength);
+		Put16(Buffer + size + 1 + nameLength, Profiles[i].Runs);
+		size += 1 + nameLength + 2;
+		memcpy(Buffer + size, Profiles[i].Body, Profiles[i].Length);
+		size += Profiles[i].Length;
+	}
+
+	Put32(Buffer, GMAX_TUNING_MAGIC);
+	Put16(Buffer + 4, GMAX_TUNING_VERSION);
+	Put16(Buffer + 6, ProfileCount);
+	Put32(Buffer + 8, size);
+	Put32(Buffer + 12, GmaxTuningCrc32(Buffer + GMAX_TUNING_HEADER, size - GMAX_TUNING_HEADER));
+	return size;
+}
+
+static uint32_t
+CompileText(
+	const char* Text,
+	const char* Source,
+	uint8_t* Buffer,
+	uint32_t Capacity
+)
+{
+	char line[1024];
+	int number = 0;
+
+	ProfileCount = 0;
+	while (*Text) {
+		size_t length = strcspn(Text, "\n");
+
+		if (length >= sizeof(line)) {
+			fprintf(stderr, "%s:%d: line too long\n", Source, number + 1);
+			return 0;
+		}
+		memcpy(line, Text, length);
+		line[length] = '\0';
+		Text += length + (Text[length] == '\n');
+
+		if (!ParseLine(line, Source, ++number)) {
+			return 0;
+		}
+	}
+
+	if (ProfileCount == 0) {
+		fprintf(stderr, "%s: no profiles\n", Source);
+		return 0;
+	}
+	return Serialize(Buffer, Capacity);
+}
+
+//
+// What GmaxTuningGetLimits (opengmaxcodec/tuning.c) allows on the
+// MAX98512: Max98512RegMap less SOFT_RESET, GLOBAL_EN, AMP_EN, INT_EN1..3
+// and IRQ_CTRL
+//
+static void
+SampleLimits(
+	GMAX_TUNING_LIMITS* Limits
+)
+{
+	memset(Limits, 0, sizeof(*Limits));
+	Limits->Ranges[0].Base = 0x0000;
+	Limits->Ranges[0].Count = MAX98512_R008D_IVADC_BYPASS + 1;
+	Limits->Ranges[1].Base = MAX98512_R0400_GLOBAL_SHDN;
+	Limits->Ranges[1].Count = MAX98512_R0402_REV_ID - MAX98512_R0400_GLOBAL_SHDN + 1;
+	Limits->RangeCount = 2;
+
+	GmaxTuningReserve(Limits, MAX98512_R0401_SOFT_RESET, 1);
+	GmaxTuningReserve(Limits, MAX98512_R0400_GLOBAL_SHDN, 1);
+	GmaxTuningReserve(Limits, MAX98512_R0038_AMP_EN, 1);
+	GmaxTuningReserve(Limits, MAX98512_R000A_INT_EN1, 3);
+	GmaxTuningReserve(Limits, MAX98512_R0010_IRQ_CTRL, 1);
+}
+
+static void
+SeedImage(
+	GMAX_TUNING_IMAGE* Image
+)
+{
+	memset(Image, 0, sizeof(*Image));
+	for (uint32_t i = 0; i < sizeof(SampleRegs) / sizeof(SampleRegs[0]); i++) {
+		Image->Reg[i] = SampleRegs[i];
+		Image->Value[i] = SampleValues[i];
+	}
+	Image->Count = sizeof(SampleRegs) / sizeof(SampleRegs[0]);
+}
+
+static int
+Dump(
+	const uint8_t* Data,
+	uint32_t Length
+)
+{
+	GMAX_TUNING_RESULT result = GmaxTuningValidate(Data, Length);
+	uint32_t offset = GMAX_TUNING_HEADER;
+
+	if (result != GmaxTuningOk) {
+		printf("rejected: %s, the driver would write the init image only\n", ResultNames[result]);
+		return 1;
+	}
+
+	printf("version %u, %u bytes, %u profiles\n", GMAX_TUNING_VERSION, Length, GmaxTuningGet16(Data + 6));
+	for (uint32_t p = 0; p < GmaxTuningGet16(Data + 6); p++) {
+		uint32_t nameLength = Data[offset];
+		uint32_t runs = GmaxTuningGet16(Data + offset + 1 + nameLength);
+
+		printf("profile %.*s\n", (int)nameLength, (const char*)Data + offset + 1);
+		offset += 1 + nameLength + 2;
+
+		for (uint32_t r = 0; r < runs; r++) {
+			uint32_t length = Data[offset + 2];
+			int masked = (Data[offset + 4] & GMAX_TUNING_RUN_MASKED) != 0;
+
+			printf("  ");
+			if (Data[offset + 3] != GMAX_TUNING_UID_ANY) {
+				printf("uid %u: ", Data[offset + 3]);
+			}
+			printf("0x%04X =", GmaxTuningGet16(Data + offset));
+			for (uint32_t i = 0; i < length; i++) {
+				printf(" 0x%02X", Data[offset + 5 + i]);
+			}
+			if (masked) {
+				printf(" &");
+				for (uint32_t i = 0; i < length; i++) {
+					printf(" 0x%02X", Data[offset + 5 + length + i]);
+				}
+			}
+			printf("\n");
+			offset += 5 + length * (masked ? 2 : 1);
+		}
+	}
+	return 0;
+}
+
+static int
+Apply(
+	const uint8_t* Data,
+	uint32_t Length,
+	const char* Name,
+	uint8_t Uid
+)
+{
+	static GMAX_TUNING_IMAGE image;
+	GMAX_TUNING_LIMITS limits;
+	GMAX_TUNING_RESULT result = GmaxTuningValidate(Data, Length);
+	uint32_t profile = 0;
+
+	if (result == GmaxTuningOk) {
+		profile = GmaxTuningFindProfile(Data, Name);
+		result = profile ? GmaxTuningOk : GmaxTuningNoProfile;
+	}
+	if (result == GmaxTuningOk) {
+		SampleLimits(&limits);
+		SeedImage(&image);
+		result = GmaxTuningApplyProfile(Data, profile, Uid, &limits, &image);
+	}
+	if (result != GmaxTuningOk) {
+		printf("rejected: %s\n", ResultNames[result]);
+		return 1;
+	}
+
+	GmaxTuningCompile(&image);
+	printf("%u registers in %u bursts over the sample init image\n", image.Count, image.Bursts);
+	for (uint32_t b = 0; b < image.Bursts; b++) {
+		printf("  0x%04X:", image.Reg[image.BurstStart[b]]);
+		for (uint32_t i = 0; i < image.BurstLength[b]; i++) {
+			printf(" %02X", image.Value[image.BurstStart[b] + i]);
+		}
+		printf("\n");
+	}
+	return 0;
+}
+
+static int
+SelfTest(
+	void
+)
+{
+	static uint8_t encoded[GMAX_TUNING_MAX_SIZE];
+	static uint8_t damaged[GMAX_TUNING_MAX_SIZE];
+	static GMAX_TUNING_IMAGE image;
+	GMAX_TUNING_LIMITS limits;
+	uint32_t size, flips = 0, truncations = 0;
+	uint32_t profile, index;
+	int failures = 0;
+
+	SampleLimits(&limits);
+
+	size = CompileText(SampleSource, "sample", encoded, sizeof(encoded));
+	if (size == 0 || GmaxTuningValidate(encoded, size) != GmaxTuningOk) {
+		printf("FAIL sample does not compile\n");
+		return 1;
+	}
+
+	//
+	// Masked write keeps the other bits, uid runs only hit their amp
+	//
+	for (uint8_t uid = 0; uid < 2; uid++) {
+		profile = GmaxTuningFindProfile(encoded, "default");
+		SeedImage(&image);
+		if (!profile || GmaxTuningApplyProfile(encoded, profile, uid, &limits, &image) != GmaxTuningOk) {
+			printf("FAIL apply, uid %u\n", uid);
+			failures++;
+			continue;
+		}
+		GmaxTuningCompile(&image);
+		if (!GmaxTuningFind(&image, 0x0020, &index) || image.Value[index] != 0x18) {
+			printf("FAIL masked write, uid %u\n", uid);
+			failures++;
+		}
+		if (!GmaxTuningFind(&image, 0x0025, &index) || image.Value[index] != (uid == 1 ? 0x00 : 0x40)) {
+			printf("FAIL uid run, uid %u\n", uid);
+			failures++;
+		}
+		if (image.Count != 14 || image.Bursts != 6) {
+			printf("FAIL %u registers in %u bursts, uid %u\n", image.Count, image.Bursts, uid);
+			failures++;
+		}
+	}
+
+	if (GmaxTuningFindProfile(encoded, "quie") || !GmaxTuningFindProfile(encoded, "quiet")) {
+		printf("FAIL profile lookup\n");
+		failures++;
+	}
+
+	for (uint32_t bit = 0; bit < size * 8; bit++) {
+		memcpy(damaged, encoded, size);
+		damaged[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+		if (GmaxTuningValidate(damaged, size) == GmaxTuningOk) {
+			printf("FAIL bit %u flipped and accepted\n", bit);
+			failures++;
+		}
+		flips++;
+	}
+
+	for (uint32_t length = 0; length < size; length++) {
+		if (GmaxTuningValidate(encoded, length) == GmaxTuningOk) {
+			printf("FAIL truncated to %u bytes and accepted\n", length);
+			failures++;
+		}
+		truncations++;
+	}
+
+	//
+	// Well formed files the driver must still refuse
+	//
+	if (CompileText("profile p\n0x0050 = 1 & 1\n", "unknown", encoded, sizeof(encoded)) == 0 ||
+		(SeedImage(&image), GmaxTuningApplyProfile(encoded, GMAX_TUNING_HEADER, 0, &limits, &image)) != GmaxTuningUnknownBase) {
+		printf("FAIL masked write outside the init image accepted\n");
+		failures++;
+	}
+
+	for (uint32_t i = 0; i < sizeof(Refused) / sizeof(Refused[0]); i++) {
+		GMAX_TUNING_RESULT result = GmaxTuningTooManyRegs;
+
+		if (CompileText(Refused[i].Source, "refused", encoded, sizeof(encoded)) != 0) {
+			SeedImage(&image);
+			result = GmaxTuningApplyProfile(encoded, GMAX_TUNING_HEADER, 0, &limits, &image);
+		}
+		if (result != Refused[i].Result) {
+			printf("FAIL %s: %s, expected %s\n", Refused[i].What, ResultNames[result], ResultNames[Refused[i].Result]);
+			failures++;
+		}
+	}
+
+	size = CompileText("profile long\n0x0040 = 0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 "
+		"20 21 22 23 24 25 26 27 28 29 30 31 32 33 34 35 36 37 38 39 40 41 42 43 44 45 46 47 48 49 "
+		"50 51 52 53 54 55 56 57 58 59 60 61 62 63 64 65 66 67 68 69\n", "long", encoded, sizeof(encoded));
+	SeedImage(&image);
+	if (size == 0 || GmaxTuningApplyProfile(encoded, GMAX_TUNING_HEADER, 0, &limits, &image) != GmaxTuningOk) {
+		printf("FAIL long run\n");
+		failures++;
+	}
+	else {
+		GmaxTuningCompile(&image);
+		for (uint32_t b = 0; b < image.Bursts; b++) {
+			if (image.BurstLength[b] > GMAX_TUNING_MAX_RUN) {
+				printf("FAIL burst of %u bytes\n", image.BurstLength[b]);
+				failures++;
+			}
+		}
+	}
+
+	printf("apply, %u bit flips, %u truncations, mask, register map and burst checks: %s\n",
+		flips, truncations, failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
+
+static uint32_t
+ReadFile(
+	const char* Path,
+	void* Buffer,
+	uint32_t Capacity
+)
+{
+	FILE* file = fopen(Path, "rb");
+	size_t length;
+
+	if (!file) {
+		perror(Path);
+		return 0;
+	}
+	length = fread(Buffer, 1, Capacity, file);
+	fclose(file);
+	return (uint32_t)length;
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	static uint8_t buffer[GMAX_TUNING_MAX_SIZE + 1];
+	static char text[256 * 1024];
+	uint32_t length;
+
+	if (argc == 2 && !strcmp(argv[1], "selftest")) {
+		return SelfTest();
+	}
+
+	if (argc == 4 && !strcmp(argv[1], "compile")) {
+		FILE* file;
+
+		length = ReadFile(argv[2], text, sizeof(text) - 1);
+		if (length == 0) {
+			return 1;
+		}
+		text[length] = '\0';
+
+		length = CompileText(text, argv[2], buffer, GMAX_TUNING_MAX_SIZE);
+		if (length == 0) {
+			return 1;
+		}
+
+		file = fopen(argv[3], "wb");
+		if (!file || fwrite(buffer, 1, length, file) != length) {
+			perror(argv[3]);
+			return 1;
+		}
+		fclose(file);
+		printf("%s: %u profiles, %u bytes\n", argv[3], ProfileCount, length);
+		return 0;
+	}
+
+	if (argc == 3 && !strcmp(argv[1], "dump")) {
+		length = ReadFile(argv[2], buffer, sizeof(buffer));
+		return length ? Dump(buffer, length) : 1;
+	}
+
+	if (argc == 5 && !strcmp(argv[1], "apply")) {
+		length = ReadFile(argv[2], buffer, sizeof(buffer));
+		return length ? Apply(buffer, length, argv[3], (uint8_t)atoi(argv[4])) : 1;
+	}
+
+	fprintf(stderr, "usage: %s compile <source> <output> | dump <file> | apply <file> <profile> <uid> | selftest\n", argv[0]);
+	return 2;
+}
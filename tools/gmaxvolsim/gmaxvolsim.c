@@ -0,0 +1,538 @@
+/*++
+
+Module Name:
+
+gmaxvolsim.c
+
+Abstract:
+
+Runs the volume ramp policy the driver's volume timer runs
+(opengmaxcodec/volramp.h) against a busy simulated bus
+(tools/simamp/simamp.h). Other register commands, burst reads of up to
+-burst bytes, hold the bus for a share -load of the time. As under the
+driver's command scheduler, a volume step waits for the command on the
+bus to finish but goes ahead of commands queued behind it. The timer
+fires on the first system clock tick at or after its due time
+(-tick-us, 0 for exact). Transfers do not fail here; gmaxsoak covers
+bus faults.
+
+Each case ramps between two levels, some across the SPK_GAIN floor, and
+one case per load supersedes a ramp half way. Every case checks:
+
+	the amp ends on the split target level
+	the last write lands within one clock tick, the longest other
+	command and one volume write of the ramp's end
+	every write moves towards the target and never past it, and no
+	register of a write raises the output above both ends of it
+	the steps written and the steps coalesced add up to the ramp
+
+Per load it reports the steps written, steps coalesced, step lateness,
+how late the last write landed, and the bus time of the volume writes
+and of the other traffic.
+
+Usage: gmaxvolsim [-load x] [-burst bytes] [-tick-us us] [-seed n] [-v]
+
+Environment:
+
+Host, portable C
+
+--*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../simamp/simamp.h"
+#include "../../opengmaxcodec/volramp.h"
+
+#define SIM_STEP_LENGTH SIM_MS(GMAX_VOLUME_STEP_MS)
+
+typedef struct _SIM_CONFIG {
+	double Load;		// < 0 runs the default sweep
+	uint32_t Burst;
+	uint32_t TickUs;
+	uint64_t Seed;
+} SIM_CONFIG;
+
+typedef struct _SIM_TOTALS {
+	uint32_t Ramps;
+	uint32_t Ticks;
+	uint32_t Writes;
+	uint32_t Coalesced;
+	uint64_t Lateness;
+	uint64_t MaxLateness;
+	uint64_t MaxLand;
+	uint64_t VolumeBus;
+	uint64_t OtherBus;
+} SIM_TOTALS;
+
+typedef struct _SIM {
+	SIM_AMP Amp;
+	uint64_t Now;
+	uint64_t Random;
+	const SIM_CONFIG* Config;
+	double Load;
+
+	uint64_t BusFree;	// end of the command on the bus
+	uint64_t OtherNext;	// arrival of the next other command
+	uint64_t OtherMean;	// mean gap between their arrivals
+
+	//
+	// GMAX_VOLUME
+	//
+	uint8_t Current;
+	uint8_t SpeakerGain;
+	uint8_t RequestedGain;
+	GMAX_VOLUME_RAMP Ramp;
+
+	uint32_t Advanced;	// ticks that moved the ramp on a step
+	uint32_t Coalesced;
+	uint64_t LastWrite;	// end of the last volume write
+	int Peaked;
+	int Overshot;
+
+	SIM_TOTALS* Totals;
+} SIM;
+
+static int SimVerbose;
+static int SimFailures;
+static int SimCases;
+
+static void
+SimCheck(
+	int Ok,
+	const char* Case,
+	const char* What
+)
+{
+	if (!Ok) {
+		printf("FAIL %s: %s\n", Case, What);
+		SimFailures++;
+	}
+	else if (SimVerbose) {
+		printf("  ok %s: %s\n", Case, What);
+	}
+}
+
+static uint64_t
+SimTimerFire(
+	const SIM* Sim,
+	uint64_t Due
+)
+{
+	uint64_t tick = SIM_US(Sim->Config->TickUs);
+
+	return tick ? (Due + tick - 1) / tick * tick : Due;
+}
+
+static uint64_t
+SimOtherGap(
+	SIM* Sim
+)
+{
+	return (uint64_t)(SimUniform(&Sim->Random) * 2.0 * (double)Sim->OtherMean);
+}
+
+//
+// One command of other traffic, started once the bus is free
+//
+static void
+SimOther(
+	SIM* Sim
+)
+{
+	uint8_t data[1024];
+	uint32_t length = 1 + (uint32_t)(SimRandom(&Sim->Random) % Sim->Config->Burst);
+	SIM_AMP_RESULT result;
+	uint64_t start = Sim->OtherNext > Sim->BusFree ? Sim->OtherNext : Sim->BusFree;
+
+	Sim->Now = start;
+	SimAmpTransfer(&Sim->Amp, 0, 0, MAX98512_R004A_MEAS_ADC_CH0_READ, data, length, &result);
+	Sim->Totals->OtherBus += Sim->Now - start;
+	Sim->BusFree = Sim->Now;
+	Sim->OtherNext = start + SimOtherGap(Sim);
+}
+
+static int32_t
+SimAmpLevel(
+	const SIM* Sim
+)
+{
+	return GmaxVolumeRegLevel(Sim->Amp.Regs[MAX98512_R0035_AMP_VOL_CTRL] & MAX98512_AMP_VOL_MASK,
+		Sim->Amp.Regs[MAX98512_R003A_SPK_GAIN] & MAX98512_SPK_PCM_GAIN_MASK);
+}
+
+static void
+SimRegWrite(
+	SIM* Sim,
+	uint16_t Reg,
+	uint8_t Value,
+	int32_t Ceiling
+)
+{
+	SIM_AMP_RESULT result;
+
+	SimAmpTransfer(&Sim->Amp, 0, 1, Reg, &Value, 1, &result);
+	if (SimAmpLevel(Sim) > Ceiling) {
+		Sim->Peaked = 1;
+	}
+}
+
+//
+// GmaxVolumeWrite: the register going down first
+//
+static void
+SimVolumeWrite(
+	SIM* Sim,
+	uint8_t Amp,
+	uint8_t Gain
+)
+{
+	int32_t before = GmaxVolumeRegLevel(Sim->Current, Sim->SpeakerGain);
+	int32_t after = GmaxVolumeRegLevel(Amp, Gain);
+	int32_t ceiling = before > after ? before : after;
+
+	if (Gain < Sim->SpeakerGain) {
+		SimRegWrite(Sim, MAX98512_R003A_SPK_GAIN, Gain & MAX98512_SPK_PCM_GAIN_MASK, ceiling);
+		Sim->SpeakerGain = Gain;
+	}
+	if (Amp != Sim->Current) {
+		SimRegWrite(Sim, MAX98512_R0035_AMP_VOL_CTRL, Amp & MAX98512_AMP_VOL_MASK, ceiling);
+		Sim->Current = Amp;
+	}
+	if (Gain != Sim->SpeakerGain) {
+		SimRegWrite(Sim, MAX98512_R003A_SPK_GAIN, Gain & MAX98512_SPK_PCM_GAIN_MASK, ceiling);
+		Sim->SpeakerGain = Gain;
+	}
+}
+
+//
+// GmaxEvtVolumeTimer, once the volume command has the bus. Returns the
+// next due time, 0 once the ramp has ended.
+//
+static uint64_t
+SimVolumeTimer(
+	SIM* Sim
+)
+{
+	GMAX_VOLUME_TICK tick;
+	uint32_t lastStep = Sim->Ramp.LastStep;
+	uint8_t desired;
+	uint8_t gain;
+
+	GmaxVolumeRampTick(&Sim->Ramp, Sim->Now, &tick);
+
+	Sim->Totals->Ticks++;
+	Sim->Totals->Coalesced += tick.Coalesced;
+	Sim->Totals->Lateness += tick.Lateness;
+	if (tick.Lateness > Sim->Totals->MaxLateness) {
+		Sim->Totals->MaxLateness = tick.Lateness;
+	}
+	Sim->Coalesced += tick.Coalesced;
+	if (Sim->Ramp.LastStep > lastStep) {
+		Sim->Advanced++;
+	}
+
+	desired = GmaxVolumeSplit(tick.Level, Sim->RequestedGain, &gain);
+
+	if (desired != Sim->Current || gain != Sim->SpeakerGain) {
+		int32_t before = GmaxVolumeRegLevel(Sim->Current, Sim->SpeakerGain);
+		int32_t after = GmaxVolumeRegLevel(desired, gain);
+		int32_t target = Sim->Ramp.Target;
+		uint64_t start = Sim->Now;
+
+		//
+		// Towards the target from where the amp was, never past it
+		//
+		if ((before <= target && (after < before || after > target)) ||
+			(before >= target && (after > before || after < target))) {
+			Sim->Overshot = 1;
+		}
+
+		SimVolumeWrite(Sim, desired, gain);
+		Sim->Totals->Writes++;
+		Sim->Totals->VolumeBus += Sim->Now - start;
+		Sim->LastWrite = Sim->Now;
+	}
+
+	Sim->BusFree = Sim->Now;
+	return tick.NextDeadline;
+}
+
+//
+// GmaxVolumeRetarget and GmaxVolumeKick at Sim->Now. Returns when the
+// timer fires.
+//
+static uint64_t
+SimRetarget(
+	SIM* Sim,
+	int32_t Volume,
+	uint8_t Gain,
+	uint32_t RampMs
+)
+{
+	Sim->RequestedGain = Gain;
+	GmaxVolumeRampStart(&Sim->Ramp, GmaxVolumeRegLevel(Sim->Current, Sim->SpeakerGain),
+		GmaxVolumeLevel(Volume, Gain), Sim->Now, RampMs);
+	Sim->Advanced = 0;
+	Sim->Coalesced = 0;
+	return SimTimerFire(Sim, Sim->Now + SIM_US(1));
+}
+
+//
+// Runs the bus until the ramp has ended, or until Until if that comes
+// first. Returns when the timer fires next, 0 if it is not armed.
+//
+static uint64_t
+SimRun(
+	SIM* Sim,
+	uint64_t Fire,
+	uint64_t Until
+)
+{
+	while (Fire) {
+		uint64_t other = Sim->OtherNext > Sim->BusFree ? Sim->OtherNext : Sim->BusFree;
+		uint64_t volume = Fire > Sim->BusFree ? Fire : Sim->BusFree;
+		uint64_t next;
+
+		if (other < volume) {
+			if (other >= Until) {
+				break;
+			}
+			SimOther(Sim);
+			continue;
+		}
+		if (volume >= Until) {
+			break;
+		}
+
+		Sim->Now = volume;
+		next = SimVolumeTimer(Sim);
+		if (!next) {
+			return 0;
+		}
+		Fire = SimTimerFire(Sim, next > Sim->Now ? next : Sim->Now + SIM_US(1));
+	}
+
+	return Fire;
+}
+
+static void
+SimSetup(
+	SIM* Sim,
+	int32_t Volume,
+	uint8_t Gain
+)
+{
+	uint8_t code;
+
+	Sim->RequestedGain = Gain;
+	code = GmaxVolumeSplit(GmaxVolumeLevel(Volume, Gain), Gain, &Sim->SpeakerGain);
+	Sim->Current = code;
+	SimAmpWrite(&Sim->Amp, MAX98512_R0035_AMP_VOL_CTRL, code);
+	SimAmpWrite(&Sim->Amp, MAX98512_R003A_SPK_GAIN, Sim->SpeakerGain);
+	Sim->Ramp.Ramping = 0;
+	Sim->Peaked = 0;
+	Sim->Overshot = 0;
+
+	//
+	// Let the other traffic settle in before the ramp starts
+	//
+	Sim->Now += SIM_MS(50);
+	if (Sim->OtherNext != UINT64_MAX) {
+		while (Sim->OtherNext < Sim->Now) {
+			SimOther(Sim);
+		}
+		if (Sim->BusFree > Sim->Now) {
+			Sim->Now = Sim->BusFree;
+		}
+	}
+	Sim->Now += SimRandom(&Sim->Random) % SIM_STEP_LENGTH;
+}
+
+static void
+SimFinish(
+	SIM* Sim,
+	const char* Case,
+	uint32_t RampMs
+)
+{
+	uint64_t end = Sim->Ramp.StartTime + (uint64_t)Sim->Ramp.Steps * SIM_STEP_LENGTH;
+	uint64_t bound = SIM_US(Sim->Config->TickUs) + SimAmpBusTime(Sim->Config->Burst) + 3 * SimAmpBusTime(1);
+	uint64_t land = Sim->LastWrite > end ? Sim->LastWrite - end : 0;
+	uint8_t gain;
+	uint8_t code = GmaxVolumeSplit(Sim->Ramp.Target, Sim->RequestedGain, &gain);
+
+	SimCases++;
+	Sim->Totals->Ramps++;
+	if (land > Sim->Totals->MaxLand) {
+		Sim->Totals->MaxLand = land;
+	}
+
+	SimCheck((Sim->Amp.Regs[MAX98512_R0035_AMP_VOL_CTRL] & MAX98512_AMP_VOL_MASK) == code &&
+		(Sim->Amp.Regs[MAX98512_R003A_SPK_GAIN] & MAX98512_SPK_PCM_GAIN_MASK) == gain,
+		Case, "amp ends on the target");
+	SimCheck(!Sim->Ramp.Ramping, Case, "ramp has ended");
+	SimCheck(land <= bound, Case, "last write lands on time");
+	SimCheck(!Sim->Overshot, Case, "writes move towards the target");
+	SimCheck(!Sim->Peaked, Case, "no register write peaks the output");
+	SimCheck(!RampMs || Sim->Ramp.Start == Sim->Ramp.Target ||
+		Sim->Advanced + Sim->Coalesced == Sim->Ramp.Steps,
+		Case, "steps written and coalesced add up");
+
+	if (SimVerbose) {
+		printf("  %s: %u steps, %u coalesced, landed %.1f us late\n",
+			Case, Sim->Ramp.Steps, Sim->Coalesced, land / 10.0);
+	}
+}
+
+//
+// AMP_VOL_CTRL in 1/100 dB and SPK_GAIN code of the ramp ends
+//
+typedef struct _SIM_RAMP_CASE {
+	const char* Name;
+	int32_t FromVolume;
+	uint8_t FromGain;
+	int32_t ToVolume;
+	uint8_t ToGain;
+} SIM_RAMP_CASE;
+
+static const SIM_RAMP_CASE SimRampCases[] = {
+	{"up", -1600, 1, 600, 3},
+	{"down-past-floor", 0, 3, -3000, 3},
+	{"small", -600, 2, -300, 2},
+	{"mute", 0, 1, -1600, 1}
+};
+
+static const uint32_t SimRampMs[] = { 0, 16, 100, 250, 1000, 3000 };
+
+static void
+SimLoad(
+	const SIM_CONFIG* Config,
+	double Load
+)
+{
+	SIM_TOTALS totals;
+	SIM sim;
+	SIM_AMP_FAULTS faults;
+	char name[96];
+
+	memset(&totals, 0, sizeof(totals));
+	memset(&faults, 0, sizeof(faults));
+	memset(&sim, 0, sizeof(sim));
+
+	sim.Random = Config->Seed ? Config->Seed : 1;
+	sim.Config = Config;
+	sim.Load = Load;
+	sim.Totals = &totals;
+	SimAmpInitialize(&sim.Amp, &faults, &sim.Now, &sim.Random);
+
+	if (Load > 0) {
+		uint64_t hold = SimAmpBusTime((1 + Config->Burst) / 2);
+
+		sim.OtherMean = (uint64_t)((double)hold / Load);
+		sim.OtherNext = SimOtherGap(&sim);
+	}
+	else {
+		sim.OtherNext = UINT64_MAX;
+	}
+
+	for (size_t c = 0; c < sizeof(SimRampCases) / sizeof(SimRampCases[0]); c++) {
+		const SIM_RAMP_CASE* ramp = &SimRampCases[c];
+
+		for (size_t m = 0; m < sizeof(SimRampMs) / sizeof(SimRampMs[0]); m++) {
+			snprintf(name, sizeof(name), "load %.2f %s %u ms", Load, ramp->Name, SimRampMs[m]);
+			SimSetup(&sim, ramp->FromVolume, ramp->FromGain);
+			SimRun(&sim, SimRetarget(&sim, ramp->ToVolume, ramp->ToGain, SimRampMs[m]), UINT64_MAX);
+			SimFinish(&sim, name, SimRampMs[m]);
+		}
+	}
+
+	//
+	// A new request half way through a ramp starts from the value last
+	// written. The first write after it must not jump back.
+	//
+	snprintf(name, sizeof(name), "load %.2f superseded", Load);
+	SimSetup(&sim, 0, 3);
+	{
+		uint64_t fire = SimRetarget(&sim, -3000, 3, 1000);
+		uint64_t start = sim.Now;
+
+		SimRun(&sim, fire, start + SIM_MS(500));
+		if (sim.BusFree > start + SIM_MS(500)) {
+			sim.Now = sim.BusFree;
+		}
+		else {
+			sim.Now = start + SIM_MS(500);
+		}
+		SimCheck(sim.Ramp.Ramping, name, "first ramp still running");
+		SimRun(&sim, SimRetarget(&sim, -600, 3, 1000), UINT64_MAX);
+		SimFinish(&sim, name, 1000);
+	}
+
+	printf("%-6.2f %6u %7u %7u %10u %9.1f %9.1f %9.1f %10.1f %10.1f\n",
+		Load, totals.Ramps, totals.Ticks, totals.Writes, totals.Coalesced,
+		totals.Ticks ? totals.Lateness / 10.0 / totals.Ticks : 0.0,
+		totals.MaxLateness / 10.0, totals.MaxLand / 10.0,
+		totals.VolumeBus / 10000.0, totals.OtherBus / 10000.0);
+}
+
+int
+main(
+	int argc,
+	char** argv
+)
+{
+	static const double sweep[] = { 0.0, 0.25, 0.5, 0.8, 0.95 };
+	SIM_CONFIG config;
+
+	config.Load = -1;
+	config.Burst = 256;
+	config.TickUs = 1000;
+	config.Seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-v")) {
+			SimVerbose = 1;
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-load")) {
+			config.Load = atof(argv[++i]);
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-burst")) {
+			config.Burst = (uint32_t)strtoul(argv[++i], NULL, 0);
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-tick-us")) {
+			config.TickUs = (uint32_t)strtoul(argv[++i], NULL, 0);
+		}
+		else if (i + 1 < argc && !strcmp(argv[i], "-seed")) {
+			config.Seed = strtoull(argv[++i], NULL, 0);
+		}
+		else {
+			fprintf(stderr, "usage: %s [-load x] [-burst bytes] [-tick-us us] [-seed n] [-v]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (config.Burst < 1 || config.Burst > 1024 || config.Load >= 1.0) {
+		fprintf(stderr, "%s: -burst is 1 to 1024, -load below 1\n", argv[0]);
+		return 2;
+	}
+
+	printf("tick %u us, other commands up to %u bytes (%.1f us)\n",
+		config.TickUs, config.Burst, SimAmpBusTime(config.Burst) / 10.0);
+	printf("%-6s %6s %7s %7s %10s %9s %9s %9s %10s %10s\n",
+		"load", "ramps", "ticks", "writes", "coalesced",
+		"late-us", "late-max", "land-max", "vol-ms", "other-ms");
+
+	if (config.Load >= 0) {
+		SimLoad(&config, config.Load);
+	}
+	else {
+		for (size_t i = 0; i < sizeof(sweep) / sizeof(sweep[0]); i++) {
+			SimLoad(&config, sweep[i]);
+		}
+	}
+
+	printf("gmaxvolsim: %d cases, %d failures\n", SimCases, SimFailures);
+	return SimFailures ? 1 : 0;
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+//
+// Simulated MAX98512 for the host tools: the amp's register file behind
+// a 400 kHz bus, with spb.c's deadline, retry and circuit breaker
+// policy (spbretry.h) in front of it. Faults are injected per transfer
+// attempt: a NACK, a latency spike, or a hung transfer that runs into
+// its send timeout.
+//
+// gmaxsoak runs the codec against it, gmaxreplay feeds captured driver
+// traffic through it. The caller owns the clock (100ns, like interrupt
+// time) and the random stream, so a run depends only on its options.
+//
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../../opengmaxcodec/max98512.h"
+#include "../../opengmaxcodec/spbretry.h"
+
+#define SIM_AMP_REG_COUNT (MAX98512_R0402_REV_ID + 1)
+#define SIM_AMP_REV_ID 0x43
+
+#define SIM_AMP_TRANSFER_US 150		// three-byte transfer at 400 kHz, as gmaxbussim
+#define SIM_AMP_BYTE_US 23		// each byte after that
+#define SIM_AMP_NACK_US 60
+
+#define SIM_US(x) ((uint64_t)(x) * 10)
+#define SIM_MS(x) ((uint64_t)(x) * 10000)
+
+typedef enum {
+	SimAmpSuccess,
+	SimAmpBusFailure	// timeout, NACK or fast fail, GmaxIsBusFailure
+} SIM_AMP_STATUS;
+
+typedef struct _SIM_AMP_FAULTS {
+	double Nack;
+	double Spike;
+	uint32_t SpikeUs;
+	double Hang;
+} SIM_AMP_FAULTS;
+
+//
+// What one transfer ran into, retries included
+//
+typedef struct _SIM_AMP_RESULT {
+	uint32_t Nacks;
+	uint32_t Spikes;
+	uint32_t Hangs;
+	uint32_t Retries;
+	uint32_t FastFails;
+	int Tripped;		// this failure opened the breaker
+} SIM_AMP_RESULT;
+
+typedef struct _SIM_AMP {
+	uint8_t Regs[SIM_AMP_REG_COUNT];
+	int Clock;		// BCLK/LRCLK running
+	SPB_BREAKER Breaker;
+	SIM_AMP_FAULTS Faults;
+	uint64_t* Now;
+	uint64_t* Random;
+} SIM_AMP;
+
+static __inline uint64_t
+SimRandom(
+	uint64_t* State
+)
+{
+	// xorshift64*
+	*State ^= *State >> 12;
+	*State ^= *State << 25;
+	*State ^= *State >> 27;
+	return *State * 2685821657736338717ULL;
+}
+
+static __inline double
+SimUniform(
+	uint64_t* State
+)
+{
+	return (SimRandom(State) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//
+// Power-on state: everything zero but the revision
+//
+static __inline void
+SimAmpReset(
+	SIM_AMP* Amp
+)
+{
+	memset(Amp->Regs, 0, sizeof(Amp->Regs));
+	Amp->Regs[MAX98512_R0402_REV_ID] = SIM_AMP_REV_ID;
+}
+
+static __inline void
+SimAmpInitialize(
+	SIM_AMP* Amp,
+	const SIM_AMP_FAULTS* Faults,
+	uint64_t* Now,
+	uint64_t* Random
+)
+{
+	memset(Amp, 0, sizeof(*Amp));
+	Amp->Faults = *Faults;
+	Amp->Now = Now;
+	Amp->Random = Random;
+	Amp->Clock = 1;
+	SimAmpReset(Amp);
+}
+
+//
+// A register write as the chip takes it. SOFT_RESET resets the amp and
+// reads back 0, REV_ID is read-only, and a write to INT_FLAG_CLRn clears
+// those bits in INT_FLAGn.
+//
+static __inline void
+SimAmpWrite(
+	SIM_AMP* Amp,
+	uint16_t Reg,
+	uint8_t Value
+)
+{
+	if (Reg >= SIM_AMP_REG_COUNT || Reg == MAX98512_R0402_REV_ID) {
+		return;
+	}
+	if (Reg == MAX98512_R0401_SOFT_RESET) {
+		if (Value & MAX98512_SOFT_RESET) {
+			SimAmpReset(Amp);
+		}
+		return;
+	}
+	if (Reg >= MAX98512_R000D_INT_FLAG_CLR1 && Reg <= MAX98512_R000F_INT_FLAG_CLR3) {
+		Amp->Regs[Reg - MAX98512_R000D_INT_FLAG_CLR1 + MAX98512_R0007_INT_FLAG1] &= (uint8_t)~Value;
+		return;
+	}
+	Amp->Regs[Reg] = Value;
+}
+
+static __inline uint8_t
+SimAmpRead(
+	const SIM_AMP* Amp,
+	uint16_t Reg
+)
+{
+	return Reg < SIM_AMP_REG_COUNT ? Amp->Regs[Reg] : 0;
+}
+
+static __inline int
+SimAmpPlaying(
+	const SIM_AMP* Amp
+)
+{
+	return Amp->Clock &&
+		(Amp->Regs[MAX98512_R0400_GLOBAL_SHDN] & MAX98512_GLOBAL_EN_MASK) &&
+		(Amp->Regs[MAX98512_R0038_AMP_EN] & MAX98512_AMP_EN_MASK);
+}
+
+//
+// Bus time of one attempt that the amp acknowledges: the address and
+// the payload, either direction
+//
+static __inline uint64_t
+SimAmpBusTime(
+	uint32_t Length
+)
+{
+	uint32_t bytes = 2 + Length;
+
+	return SIM_US(SIM_AMP_TRANSFER_US + SIM_AMP_BYTE_US * (bytes > 3 ? bytes - 3 : 0));
+}
+
+//
+// One SpbTransfer: a register write, or an address write and a read,
+// addresses incrementing over the burst. Retries and backoff follow
+// spb.c; Deadline is the one SpbSetDeadline set, 0 for none. Moves the
+// caller's clock by the time the transfer took.
+//
+static __inline SIM_AMP_STATUS
+SimAmpTransfer(
+	SIM_AMP* Amp,
+	uint64_t Deadline,
+	int Write,
+	uint16_t Reg,
+	uint8_t* Data,
+	uint32_t Length,
+	SIM_AMP_RESULT* Result
+)
+{
+	const SIM_AMP_FAULTS* faults = &Amp->Faults;
+	uint64_t start = *Amp->Now;
+	SIM_AMP_STATUS status = SimAmpBusFailure;
+
+	memset(Result, 0, sizeof(*Result));
+
+	for (uint32_t attempt = 0;; attempt++) {
+		uint64_t timeout;
+		uint32_t backoff;
+		double u;
+
+		if (!SpbBreakerAllow(&Amp->Breaker, *Amp->Now)) {
+			Result->FastFails++;
+			break;
+		}
+
+		timeout = SpbSendTimeout(*Amp->Now, Deadline);
+		u = SimUniform(Amp->Random);
+		if (timeout == 0) {
+			status = SimAmpBusFailure;
+		}
+		else if (u < faults->Hang) {
+			Result->Hangs++;
+			*Amp->Now += timeout;
+			status = SimAmpBusFailure;
+		}
+		else if (u < faults->Hang + faults->Nack) {
+			Result->Nacks++;
+			*Amp->Now += SIM_US(SIM_AMP_NACK_US);
+			status = SimAmpBusFailure;
+		}
+		else {
+			*Amp->Now += SimAmpBusTime(Length);
+			if (u < faults->Hang + faults->Nack + faults->Spike) {
+				Result->Spikes++;
+				*Amp->Now += SIM_US(faults->SpikeUs);
+			}
+			for (uint32_t i = 0; i < Length; i++) {
+				if (Write) {
+					SimAmpWrite(Amp, (uint16_t)(Reg + i), Data[i]);
+				}
+				else {
+					Data[i] = SimAmpRead(Amp, (uint16_t)(Reg + i));
+				}
+			}
+			status = SimAmpSuccess;
+		}
+
+		if (status == SimAmpSuccess) {
+			SpbBreakerRecord(&Amp->Breaker, 1, start);
+			break;
+		}
+
+		backoff = SpbBackoffUs(attempt, (uint32_t)SimRandom(Amp->Random));
+		if (attempt + 1 >= SPB_MAX_ATTEMPTS ||
+			SpbSendTimeout(*Amp->Now + SIM_US(backoff), Deadline) == 0) {
+			Result->Tripped = SpbBreakerRecord(&Amp->Breaker, 0, *Amp->Now);
+			break;
+		}
+
+		Result->Retries++;
+		*Amp->Now += SIM_US(backoff);
+	}
+
+	return status;
+}